@@ -50,6 +50,11 @@
 #include "proland/math/noise.h"
 
 #include <algorithm>
+#include <vector>
+#include <assert.h>
+#include <pthread.h>
+
+#include "proland/util/parallel.h"
 
 namespace proland
 {
@@ -58,7 +63,7 @@ namespace proland
 // CLASSIC PERLIN NOISE
 // ----------------------------------------------------------------------------
 
-static bool initialized = false;
+static pthread_once_t initialized = PTHREAD_ONCE_INIT;
 
 static int p[2 * 256 + 2];
 static float g1[2 * 256 + 2];
@@ -103,6 +108,19 @@ static void init()
     }
 }
 
+// the tables are initialized only once, even if several threads call the
+// noise functions concurrently for the first time
+static inline void checkInit()
+{
+    pthread_once(&initialized, init);
+}
+
+// number of points processed together by the batch functions. Each step of
+// the noise computation is done for all these points before the next one,
+// so that the arithmetic steps can be compiled into SIMD instructions (the
+// gradient table lookups remain scalar gathers).
+#define NOISE_LANES 8
+
 #define S_CURVE(t) ( t * t * (3.0f - 2.0f * t) )
 
 #define LERP(t, a, b) ( a + t * (b - a) )
@@ -114,124 +132,145 @@ static void init()
     r0 = t - (int)floor(t);\
     r1 = r0 - 1.0f;
 
-float cnoise(float x, float y, int period)
-{
-    int bx0, bx1, by0, by1, b00, b10, b01, b11;
-    float rx0, rx1, ry0, ry1, *q, sx, sy, a, b, t, u, v;
-    register int i, j;
+#define AT2(rx,ry) ( rx * q[0] + ry * q[1] )
 
-    if (!initialized) {
-        initialized = true;
-        init();
-    }
+#define AT3(rx,ry,rz) ( rx * q[0] + ry * q[1] + rz * q[2] )
 
-    SETUP(x, bx0,bx1, rx0,rx1);
-    SETUP(y, by0,by1, ry0,ry1);
+// computes the classic 2D noise at n <= NOISE_LANES points. The scalar
+// function uses this code too, so that both give exactly the same results.
+static void cnoiseLanes(int n, const float *x, const float *y, float *result, int period)
+{
+    int bx0[NOISE_LANES], bx1[NOISE_LANES], by0[NOISE_LANES], by1[NOISE_LANES];
+    float rx0[NOISE_LANES], rx1[NOISE_LANES], ry0[NOISE_LANES], ry1[NOISE_LANES];
+    float sx[NOISE_LANES], sy[NOISE_LANES];
+    float u00[NOISE_LANES], u10[NOISE_LANES], u01[NOISE_LANES], u11[NOISE_LANES];
+    float *q, t, a, b;
+    int i, j, k;
 
-    if (period != 0) {
-        i = p[bx0 % period];
-        j = p[bx1 % period];
-        b00 = p[i + by0 % period];
-        b10 = p[j + by0 % period];
-        b01 = p[i + by1 % period];
-        b11 = p[j + by1 % period];
-    } else {
-        i = p[bx0];
-        j = p[bx1];
-        b00 = p[i + by0];
-        b10 = p[j + by0];
-        b01 = p[i + by1];
-        b11 = p[j + by1];
+    for (k = 0; k < n; ++k) {
+        SETUP(x[k], bx0[k],bx1[k], rx0[k],rx1[k]);
+        SETUP(y[k], by0[k],by1[k], ry0[k],ry1[k]);
+        sx[k] = S_CURVE(rx0[k]);
+        sy[k] = S_CURVE(ry0[k]);
     }
 
-    sx = S_CURVE(rx0);
-    sy = S_CURVE(ry0);
-
-    #define AT2(rx,ry) ( rx * q[0] + ry * q[1] )
-
-    q = g2[b00];
-    u = AT2(rx0,ry0);
-    q = g2[b10];
-    v = AT2(rx1,ry0);
-    a = LERP(sx, u, v);
-
-    q = g2[b01];
-    u = AT2(rx0,ry1);
-    q = g2[b11];
-    v = AT2(rx1,ry1);
-    b = LERP(sx, u, v);
+    for (k = 0; k < n; ++k) {
+        int b00, b10, b01, b11;
+        if (period != 0) {
+            i = p[bx0[k] % period];
+            j = p[bx1[k] % period];
+            b00 = p[i + by0[k] % period];
+            b10 = p[j + by0[k] % period];
+            b01 = p[i + by1[k] % period];
+            b11 = p[j + by1[k] % period];
+        } else {
+            i = p[bx0[k]];
+            j = p[bx1[k]];
+            b00 = p[i + by0[k]];
+            b10 = p[j + by0[k]];
+            b01 = p[i + by1[k]];
+            b11 = p[j + by1[k]];
+        }
+        q = g2[b00];
+        u00[k] = AT2(rx0[k],ry0[k]);
+        q = g2[b10];
+        u10[k] = AT2(rx1[k],ry0[k]);
+        q = g2[b01];
+        u01[k] = AT2(rx0[k],ry1[k]);
+        q = g2[b11];
+        u11[k] = AT2(rx1[k],ry1[k]);
+    }
 
-    return LERP(sy, a, b);
+    for (k = 0; k < n; ++k) {
+        a = LERP(sx[k], u00[k], u10[k]);
+        b = LERP(sx[k], u01[k], u11[k]);
+        result[k] = LERP(sy[k], a, b);
+    }
 }
 
-float cnoise(float x, float y, float z, int period)
+// computes the classic 3D noise at n <= NOISE_LANES points (see cnoiseLanes)
+static void cnoiseLanes(int n, const float *x, const float *y, const float *z, float *result, int period)
 {
-    int bx0, bx1, by0, by1, bz0, bz1, b00, b10, b01, b11;
-    float rx0, rx1, ry0, ry1, rz0, rz1, *q, sy, sz, a, b, c, d, t, u, v;
-    register int i, j;
+    int bx0[NOISE_LANES], bx1[NOISE_LANES], by0[NOISE_LANES], by1[NOISE_LANES], bz0[NOISE_LANES], bz1[NOISE_LANES];
+    float rx0[NOISE_LANES], rx1[NOISE_LANES], ry0[NOISE_LANES], ry1[NOISE_LANES], rz0[NOISE_LANES], rz1[NOISE_LANES];
+    float sx[NOISE_LANES], sy[NOISE_LANES], sz[NOISE_LANES];
+    float u[8][NOISE_LANES];
+    float *q, t, a, b, c, d;
+    int i, j, k;
 
-    if (!initialized) {
-        initialized = true;
-        init();
+    for (k = 0; k < n; ++k) {
+        SETUP(x[k], bx0[k],bx1[k], rx0[k],rx1[k]);
+        SETUP(y[k], by0[k],by1[k], ry0[k],ry1[k]);
+        SETUP(z[k], bz0[k],bz1[k], rz0[k],rz1[k]);
+        sx[k] = S_CURVE(rx0[k]);
+        sy[k] = S_CURVE(ry0[k]);
+        sz[k] = S_CURVE(rz0[k]);
     }
 
-    SETUP(x, bx0,bx1, rx0,rx1);
-    SETUP(y, by0,by1, ry0,ry1);
-    SETUP(z, bz0,bz1, rz0,rz1);
-
-    if (period != 0) {
-        i = p[bx0 % period];
-        j = p[bx1 % period];
-        b00 = p[i + by0 % period];
-        b10 = p[j + by0 % period];
-        b01 = p[i + by1 % period];
-        b11 = p[j + by1 % period];
-        bz0 = bz0 % period;
-        bz1 = bz1 % period;
-    } else {
-        i = p[bx0];
-        j = p[bx1];
-        b00 = p[i + by0];
-        b10 = p[j + by0];
-        b01 = p[i + by1];
-        b11 = p[j + by1];
+    for (k = 0; k < n; ++k) {
+        int b00, b10, b01, b11, z0, z1;
+        if (period != 0) {
+            i = p[bx0[k] % period];
+            j = p[bx1[k] % period];
+            b00 = p[i + by0[k] % period];
+            b10 = p[j + by0[k] % period];
+            b01 = p[i + by1[k] % period];
+            b11 = p[j + by1[k] % period];
+            z0 = bz0[k] % period;
+            z1 = bz1[k] % period;
+        } else {
+            i = p[bx0[k]];
+            j = p[bx1[k]];
+            b00 = p[i + by0[k]];
+            b10 = p[j + by0[k]];
+            b01 = p[i + by1[k]];
+            b11 = p[j + by1[k]];
+            z0 = bz0[k];
+            z1 = bz1[k];
+        }
+        q = g3[b00 + z0];
+        u[0][k] = AT3(rx0[k],ry0[k],rz0[k]);
+        q = g3[b10 + z0];
+        u[1][k] = AT3(rx1[k],ry0[k],rz0[k]);
+        q = g3[b01 + z0];
+        u[2][k] = AT3(rx0[k],ry1[k],rz0[k]);
+        q = g3[b11 + z0];
+        u[3][k] = AT3(rx1[k],ry1[k],rz0[k]);
+        q = g3[b00 + z1];
+        u[4][k] = AT3(rx0[k],ry0[k],rz1[k]);
+        q = g3[b10 + z1];
+        u[5][k] = AT3(rx1[k],ry0[k],rz1[k]);
+        q = g3[b01 + z1];
+        u[6][k] = AT3(rx0[k],ry1[k],rz1[k]);
+        q = g3[b11 + z1];
+        u[7][k] = AT3(rx1[k],ry1[k],rz1[k]);
     }
 
-    t  = S_CURVE(rx0);
-    sy = S_CURVE(ry0);
-    sz = S_CURVE(rz0);
-
-    #define AT3(rx,ry,rz) ( rx * q[0] + ry * q[1] + rz * q[2] )
-
-    q = g3[b00 + bz0];
-    u = AT3(rx0,ry0,rz0);
-    q = g3[b10 + bz0];
-    v = AT3(rx1,ry0,rz0);
-    a = LERP(t, u, v);
-
-    q = g3[b01 + bz0];
-    u = AT3(rx0,ry1,rz0);
-    q = g3[b11 + bz0];
-    v = AT3(rx1,ry1,rz0);
-    b = LERP(t, u, v);
-
-    c = LERP(sy, a, b);
-
-    q = g3[b00 + bz1];
-    u = AT3(rx0,ry0,rz1);
-    q = g3[b10 + bz1];
-    v = AT3(rx1,ry0,rz1);
-    a = LERP(t, u, v);
-
-    q = g3[b01 + bz1];
-    u = AT3(rx0,ry1,rz1);
-    q = g3[b11 + bz1];
-    v = AT3(rx1,ry1,rz1);
-    b = LERP(t, u, v);
+    for (k = 0; k < n; ++k) {
+        a = LERP(sx[k], u[0][k], u[1][k]);
+        b = LERP(sx[k], u[2][k], u[3][k]);
+        c = LERP(sy[k], a, b);
+        a = LERP(sx[k], u[4][k], u[5][k]);
+        b = LERP(sx[k], u[6][k], u[7][k]);
+        d = LERP(sy[k], a, b);
+        result[k] = LERP(sz[k], c, d);
+    }
+}
 
-    d = LERP(sy, a, b);
+float cnoise(float x, float y, int period)
+{
+    float result;
+    checkInit();
+    cnoiseLanes(1, &x, &y, &result, period);
+    return result;
+}
 
-    return LERP(sz, c, d);
+float cnoise(float x, float y, float z, int period)
+{
+    float result;
+    checkInit();
+    cnoiseLanes(1, &x, &y, &z, &result, period);
+    return result;
 }
 
 // ----------------------------------------------------------------------------
@@ -308,7 +347,7 @@ static float dot(int g[], float x, float y, float z, float w)
     return g[0]*x + g[1]*y + g[2]*z + g[3]*w;
 }
 
-float snoise(float xin, float yin, int P)
+static inline float snoiseKernel(float xin, float yin, int P)
 {
     float n0, n1, n2; // Noise contributions from the three corners
     // Skew the input space to determine which simplex cell we're in
@@ -373,7 +412,7 @@ float snoise(float xin, float yin, int P)
     return 70.0f * (n0 + n1 + n2);
 }
 
-float snoise(float xin, float yin, float zin, int P)
+static inline float snoiseKernel(float xin, float yin, float zin, int P)
 {
     float n0, n1, n2, n3; // Noise contributions from the four corners
     // Skew the input space to determine which simplex cell we're in
@@ -467,7 +506,7 @@ float snoise(float xin, float yin, float zin, int P)
     return 32.0f*(n0 + n1 + n2 + n3);
 }
 
-float snoise(float x, float y, float z, float w, int P)
+static inline float snoiseKernel(float x, float y, float z, float w, int P)
 {
     // The skewing and unskewing factors are hairy again for the 4D case
     float F4 = (sqrt(5.0f)-1.0f)/4.0f;
@@ -600,105 +639,450 @@ float snoise(float x, float y, float z, float w, int P)
     return 27.0f * (n0 + n1 + n2 + n3 + n4);
 }
 
+float snoise(float x, float y, int P)
+{
+    return snoiseKernel(x, y, P);
+}
+
+float snoise(float x, float y, float z, int P)
+{
+    return snoiseKernel(x, y, z, P);
+}
+
+float snoise(float x, float y, float z, float w, int P)
+{
+    return snoiseKernel(x, y, z, w, P);
+}
+
 // ----------------------------------------------------------------------------
-// NOISE TEXTURES
+// BATCH NOISE
 // ----------------------------------------------------------------------------
 
-float *buildFbm4NoiseTexture2D(int size, int freq, int octaves, int lacunarity, float gain)
+static void snoiseLanes(int n, const float *x, const float *y, float *result, int P)
 {
-    int i, j, k, l;
-    float *base = new float[4 * size * size];
-    float *data = new float[4 * size * size];
-    float c = ((float) freq) / size;
+    for (int k = 0; k < n; ++k) {
+        result[k] = snoiseKernel(x[k], y[k], P);
+    }
+}
 
-    for (j = 0; j < size; ++j) {
-        for (i = 0; i < size; ++i) {
-            base[4*(i + j*size)] = cnoise(i*c + 0.33f, j*c + 0.33f, freq);
-            base[4*(i + j*size)+1] = cnoise(-i*c + 0.33f, j*c + 0.33f, freq);
-            base[4*(i + j*size)+2] = cnoise(i*c + 0.33f, -j*c + 0.33f, freq);
-            base[4*(i + j*size)+3] = cnoise(-i*c + 0.33f, -j*c + 0.33f, freq);
-        }
+static void snoiseLanes(int n, const float *x, const float *y, const float *z, float *result, int P)
+{
+    for (int k = 0; k < n; ++k) {
+        result[k] = snoiseKernel(x[k], y[k], z[k], P);
     }
+}
 
-    float max = 0;
-    for (j = 0; j < size; ++j) {
-        for (i = 0; i < size; ++i) {
-            for (k = 0; k < 4; ++k) {
-                int ip = i;
-                int jp = j;
-                float amp = 1;
-                float f = 0;
-                for (l = 0; l < octaves; ++l) {
-                    f += base[4*(ip + jp * size) + k] * amp;
-                    ip = (ip * lacunarity) % size;
-                    jp = (jp * lacunarity) % size;
-                    amp *= gain;
+static void snoiseLanes(int n, const float *x, const float *y, const float *z, const float *w, float *result, int P)
+{
+    for (int k = 0; k < n; ++k) {
+        result[k] = snoiseKernel(x[k], y[k], z[k], w[k], P);
+    }
+}
+
+/**
+ * Evaluates a noise function for at most NOISE_LANES points.
+ * The unused coordinates are NULL.
+ */
+typedef void (*NoiseLanes)(int n, const float **coords, float *result, int P);
+
+static void cnoiseLanes2(int n, const float **c, float *result, int P)
+{
+    cnoiseLanes(n, c[0], c[1], result, P);
+}
+
+static void cnoiseLanes3(int n, const float **c, float *result, int P)
+{
+    cnoiseLanes(n, c[0], c[1], c[2], result, P);
+}
+
+static void snoiseLanes2(int n, const float **c, float *result, int P)
+{
+    snoiseLanes(n, c[0], c[1], result, P);
+}
+
+static void snoiseLanes3(int n, const float **c, float *result, int P)
+{
+    snoiseLanes(n, c[0], c[1], c[2], result, P);
+}
+
+static void snoiseLanes4(int n, const float **c, float *result, int P)
+{
+    snoiseLanes(n, c[0], c[1], c[2], c[3], result, P);
+}
+
+static NoiseLanes getNoiseLanes(NoiseFunction f, int dimension)
+{
+    if (f == CLASSIC_NOISE) {
+        assert(dimension == 2 || dimension == 3);
+        return dimension == 2 ? cnoiseLanes2 : cnoiseLanes3;
+    }
+    assert(dimension >= 2 && dimension <= 4);
+    return dimension == 2 ? snoiseLanes2 : (dimension == 3 ? snoiseLanes3 : snoiseLanes4);
+}
+
+// computes the sum of 'octaves' noise functions at n points, NOISE_LANES
+// points at a time. The octaves are accumulated in the same order, and with
+// the same operations, as a scalar loop 'f += amp * noise(x * freq, ...)'.
+static void fbmNoise(NoiseLanes noise, int dimension, int n, const float **coords, float *result,
+    int P, int octaves, float lacunarity, float gain)
+{
+    float scaled[4][NOISE_LANES];
+    float value[NOISE_LANES];
+    const float *c[4];
+
+    for (int i = 0; i < n; i += NOISE_LANES) {
+        int m = std::min(NOISE_LANES, n - i);
+        if (octaves == 1) {
+            for (int d = 0; d < dimension; ++d) {
+                c[d] = coords[d] + i;
+            }
+            noise(m, c, result + i, P);
+            continue;
+        }
+        for (int k = 0; k < m; ++k) {
+            result[i + k] = 0.0f;
+        }
+        float freq = 1.0f;
+        float amp = 1.0f;
+        for (int o = 0; o < octaves; ++o) {
+            for (int d = 0; d < dimension; ++d) {
+                for (int k = 0; k < m; ++k) {
+                    scaled[d][k] = coords[d][i + k] * freq;
                 }
-                data[4*(i + j * size) + k] = f;
-                max = std::max<float>(fabs(f), max);
+                c[d] = scaled[d];
             }
+            noise(m, c, value, P == 0 ? 0 : int(P * freq + 0.5f));
+            for (int k = 0; k < m; ++k) {
+                result[i + k] += amp * value[k];
+            }
+            freq *= lacunarity;
+            amp *= gain;
         }
     }
+}
+
+void cnoise(int n, const float *x, const float *y, float *result, int P, int octaves, float lacunarity, float gain)
+{
+    const float *c[2] = { x, y };
+    checkInit();
+    fbmNoise(cnoiseLanes2, 2, n, c, result, P, octaves, lacunarity, gain);
+}
+
+void cnoise(int n, const float *x, const float *y, const float *z, float *result, int P, int octaves, float lacunarity, float gain)
+{
+    const float *c[3] = { x, y, z };
+    checkInit();
+    fbmNoise(cnoiseLanes3, 3, n, c, result, P, octaves, lacunarity, gain);
+}
+
+void snoise(int n, const float *x, const float *y, float *result, int P, int octaves, float lacunarity, float gain)
+{
+    const float *c[2] = { x, y };
+    fbmNoise(snoiseLanes2, 2, n, c, result, P, octaves, lacunarity, gain);
+}
+
+void snoise(int n, const float *x, const float *y, const float *z, float *result, int P, int octaves, float lacunarity, float gain)
+{
+    const float *c[3] = { x, y, z };
+    fbmNoise(snoiseLanes3, 3, n, c, result, P, octaves, lacunarity, gain);
+}
+
+void snoise(int n, const float *x, const float *y, const float *z, const float *w, float *result, int P, int octaves, float lacunarity, float gain)
+{
+    const float *c[4] = { x, y, z, w };
+    fbmNoise(snoiseLanes4, 4, n, c, result, P, octaves, lacunarity, gain);
+}
+
+/**
+ * The parameters of a noiseGrid computation, shared by all the threads.
+ */
+struct NoiseGrid
+{
+    NoiseLanes noise;
+
+    int dimension;
+
+    const int *size;
 
-    for (j = 0; j < size; ++j) {
-        for (i = 0; i < size; ++i) {
-            for (k = 0; k < 4; ++k) {
-                data[4*(i+j*size)+k] = 0.5f + data[4*(i+j*size)+k] / max * 0.5f;
+    const float *origin;
+
+    const float *step;
+
+    float *result;
+
+    int P;
+
+    int octaves;
+
+    float lacunarity;
+
+    float gain;
+};
+
+// computes the grid rows [begin,end[ of a NoiseGrid. A row is a line of
+// grid points along the first dimension.
+static void noiseGridRows(void *context, int begin, int end)
+{
+    NoiseGrid *g = (NoiseGrid*) context;
+    int width = g->size[0];
+    std::vector<float> coords(g->dimension * width);
+    const float *c[4];
+
+    for (int d = 0; d < g->dimension; ++d) {
+        c[d] = &coords[d * width];
+    }
+    for (int i = 0; i < width; ++i) {
+        coords[i] = g->origin[0] + i * g->step[0];
+    }
+    for (int row = begin; row < end; ++row) {
+        int r = row;
+        for (int d = 1; d < g->dimension; ++d) {
+            float v = g->origin[d] + (r % g->size[d]) * g->step[d];
+            r /= g->size[d];
+            for (int i = 0; i < width; ++i) {
+                coords[d * width + i] = v;
             }
         }
+        fbmNoise(g->noise, g->dimension, width, c, g->result + row * width, g->P, g->octaves, g->lacunarity, g->gain);
     }
+}
+
+void noiseGrid(NoiseFunction f, int dimension, const int size[], const float origin[], const float step[],
+    float *result, int P, int octaves, float lacunarity, float gain, int threadCount)
+{
+    NoiseGrid g;
+    g.noise = getNoiseLanes(f, dimension);
+    g.dimension = dimension;
+    g.size = size;
+    g.origin = origin;
+    g.step = step;
+    g.result = result;
+    g.P = P;
+    g.octaves = octaves;
+    g.lacunarity = lacunarity;
+    g.gain = gain;
 
-    delete[] base;
-    return data;
+    int rows = 1;
+    for (int d = 1; d < dimension; ++d) {
+        rows *= size[d];
+    }
+    checkInit();
+    parallelFor(0, rows, noiseGridRows, &g, 1, threadCount);
 }
 
-float *buildFbm1NoiseTexture3D(int size, int freq, int octaves, int lacunarity, float gain)
+// ----------------------------------------------------------------------------
+// NOISE TEXTURES
+// ----------------------------------------------------------------------------
+
+/**
+ * The parameters of a buildFbm4NoiseTexture2D or buildFbm1NoiseTexture3D
+ * computation, shared by all the threads.
+ */
+struct FbmTexture
+{
+    int size;
+
+    int freq;
+
+    int octaves;
+
+    int lacunarity;
+
+    float gain;
+
+    float *base;
+
+    float *data;
+
+    float *rowMax;
+
+    float max;
+};
+
+static void fbm4Base(void *context, int begin, int end)
 {
-    int i, j, k, l;
-    float *base = new float[size * size * size];
-    float *data = new float[size * size * size];
-    float c = ((float) freq) / size;
+    FbmTexture *t = (FbmTexture*) context;
+    int size = t->size;
+    float c = ((float) t->freq) / size;
+    std::vector<float> xs(4 * size);
+    float *x = &xs[0];
+    float *mx = &xs[size];
+    float *y = &xs[2 * size];
+    float *my = &xs[3 * size];
+    float *v = new float[4 * size];
 
-    for (k = 0; k < size; ++k) {
-        for (j = 0; j < size; ++j) {
-            for (i = 0; i < size; ++i) {
-                base[(i + j*size + k*size*size)] = cnoise(i*c + 0.33f, j*c + 0.33f, k*c + 0.33f, freq);
+    for (int i = 0; i < size; ++i) {
+        x[i] = i*c + 0.33f;
+        mx[i] = -i*c + 0.33f;
+    }
+    for (int j = begin; j < end; ++j) {
+        for (int i = 0; i < size; ++i) {
+            y[i] = j*c + 0.33f;
+            my[i] = -j*c + 0.33f;
+        }
+        cnoise(size, x, y, v, t->freq);
+        cnoise(size, mx, y, v + size, t->freq);
+        cnoise(size, x, my, v + 2 * size, t->freq);
+        cnoise(size, mx, my, v + 3 * size, t->freq);
+        for (int i = 0; i < size; ++i) {
+            for (int k = 0; k < 4; ++k) {
+                t->base[4*(i + j*size)+k] = v[i + k * size];
             }
         }
     }
+    delete[] v;
+}
 
-    float max = 0;
-    for (k = 0; k < size; ++k) {
-       for (j = 0; j < size; ++j) {
-           for (i = 0; i < size; ++i) {
+static void fbm4Octaves(void *context, int begin, int end)
+{
+    FbmTexture *t = (FbmTexture*) context;
+    int size = t->size;
+    for (int j = begin; j < end; ++j) {
+        float max = 0;
+        for (int i = 0; i < size; ++i) {
+            for (int k = 0; k < 4; ++k) {
                 int ip = i;
                 int jp = j;
-                int kp = k;
                 float amp = 1;
                 float f = 0;
-                for (l = 0; l < octaves; ++l) {
-                    f += base[ip + jp * size + kp * size * size] * amp;
-                    ip = (ip * lacunarity) % size;
-                    jp = (jp * lacunarity) % size;
-                    kp = (kp * lacunarity) % size;
-                    amp *= gain;
+                for (int l = 0; l < t->octaves; ++l) {
+                    f += t->base[4*(ip + jp * size) + k] * amp;
+                    ip = (ip * t->lacunarity) % size;
+                    jp = (jp * t->lacunarity) % size;
+                    amp *= t->gain;
                 }
-                data[i + j * size + k * size * size] = f;
+                t->data[4*(i + j * size) + k] = f;
                 max = std::max<float>(fabs(f), max);
             }
         }
+        t->rowMax[j] = max;
     }
+}
 
-    for (k = 0; k < size; ++k) {
-        for (j = 0; j < size; ++j) {
-            for (i = 0; i < size; ++i) {
-                data[i+j*size+k*size*size] = 0.5f + data[i+j*size+k*size*size] / max * 0.5f;
+static void fbm4Normalize(void *context, int begin, int end)
+{
+    FbmTexture *t = (FbmTexture*) context;
+    int size = t->size;
+    for (int j = begin; j < end; ++j) {
+        for (int i = 0; i < size; ++i) {
+            for (int k = 0; k < 4; ++k) {
+                t->data[4*(i+j*size)+k] = 0.5f + t->data[4*(i+j*size)+k] / t->max * 0.5f;
             }
         }
     }
+}
+
+float *buildFbm4NoiseTexture2D(int size, int freq, int octaves, int lacunarity, float gain, int threadCount)
+{
+    FbmTexture t;
+    t.size = size;
+    t.freq = freq;
+    t.octaves = octaves;
+    t.lacunarity = lacunarity;
+    t.gain = gain;
+    t.base = new float[4 * size * size];
+    t.data = new float[4 * size * size];
+    t.rowMax = new float[size];
+
+    parallelFor(0, size, fbm4Base, &t, 1, threadCount);
+    parallelFor(0, size, fbm4Octaves, &t, 1, threadCount);
+    t.max = 0;
+    for (int j = 0; j < size; ++j) {
+        t.max = std::max<float>(t.rowMax[j], t.max);
+    }
+    parallelFor(0, size, fbm4Normalize, &t, 1, threadCount);
+
+    delete[] t.rowMax;
+    delete[] t.base;
+    return t.data;
+}
+
+static void fbm1Base(void *context, int begin, int end)
+{
+    FbmTexture *t = (FbmTexture*) context;
+    int size = t->size;
+    float c = ((float) t->freq) / size;
+    std::vector<float> xs(3 * size);
+    float *x = &xs[0];
+    float *y = &xs[size];
+    float *z = &xs[2 * size];
+
+    for (int i = 0; i < size; ++i) {
+        x[i] = i*c + 0.33f;
+    }
+    for (int jk = begin; jk < end; ++jk) {
+        int j = jk % size;
+        int k = jk / size;
+        for (int i = 0; i < size; ++i) {
+            y[i] = j*c + 0.33f;
+            z[i] = k*c + 0.33f;
+        }
+        cnoise(size, x, y, z, t->base + jk * size, t->freq);
+    }
+}
+
+static void fbm1Octaves(void *context, int begin, int end)
+{
+    FbmTexture *t = (FbmTexture*) context;
+    int size = t->size;
+    for (int jk = begin; jk < end; ++jk) {
+        int j = jk % size;
+        int k = jk / size;
+        float max = 0;
+        for (int i = 0; i < size; ++i) {
+            int ip = i;
+            int jp = j;
+            int kp = k;
+            float amp = 1;
+            float f = 0;
+            for (int l = 0; l < t->octaves; ++l) {
+                f += t->base[ip + jp * size + kp * size * size] * amp;
+                ip = (ip * t->lacunarity) % size;
+                jp = (jp * t->lacunarity) % size;
+                kp = (kp * t->lacunarity) % size;
+                amp *= t->gain;
+            }
+            t->data[i + j * size + k * size * size] = f;
+            max = std::max<float>(fabs(f), max);
+        }
+        t->rowMax[jk] = max;
+    }
+}
+
+static void fbm1Normalize(void *context, int begin, int end)
+{
+    FbmTexture *t = (FbmTexture*) context;
+    int size = t->size;
+    for (int i = begin * size; i < end * size; ++i) {
+        t->data[i] = 0.5f + t->data[i] / t->max * 0.5f;
+    }
+}
+
+float *buildFbm1NoiseTexture3D(int size, int freq, int octaves, int lacunarity, float gain, int threadCount)
+{
+    FbmTexture t;
+    t.size = size;
+    t.freq = freq;
+    t.octaves = octaves;
+    t.lacunarity = lacunarity;
+    t.gain = gain;
+    t.base = new float[size * size * size];
+    t.data = new float[size * size * size];
+    t.rowMax = new float[size * size];
+
+    int rows = size * size;
+    int grain = std::max(1, size / 16);
+    parallelFor(0, rows, fbm1Base, &t, grain, threadCount);
+    parallelFor(0, rows, fbm1Octaves, &t, grain, threadCount);
+    t.max = 0;
+    for (int jk = 0; jk < rows; ++jk) {
+        t.max = std::max<float>(t.rowMax[jk], t.max);
+    }
+    parallelFor(0, rows, fbm1Normalize, &t, grain, threadCount);
 
-    delete[] base;
-    return data;
+    delete[] t.rowMax;
+    delete[] t.base;
+    return t.data;
 }
 
 }
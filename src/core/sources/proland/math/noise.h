@@ -170,6 +170,141 @@ PROLAND_API float snoise(float x, float y, float z, int P = 0);
  */
 PROLAND_API float snoise(float x, float y, float z, float w, int P = 0);
 
+/**
+ * Computes a sum of classic 2D Perlin noise functions at several points.
+ * The result at point i is the sum, for o in [0,octaves[, of
+ * gain^o * cnoise(x[i] * lacunarity^o, y[i] * lacunarity^o, P * lacunarity^o),
+ * with the same floating point operations as the scalar function. In
+ * particular, with octaves = 1, the result is bit-identical to cnoise(x[i],y[i],P).
+ * This function is thread safe.
+ * @ingroup proland_math
+ *
+ * @param n the number of points where the function must be evaluated.
+ * @param x the x coordinates of these points.
+ * @param y the y coordinates of these points.
+ * @param result where the n computed values must be stored.
+ * @param P an optional period to get a periodic noise function. The default
+ *      value 0 means a non periodic function.
+ * @param octaves the number of Perlin noise functions to add.
+ * @param lacunarity the frequency factor between each noise function.
+ * @param gain the amplitude factor between each noise function.
+ */
+PROLAND_API void cnoise(int n, const float *x, const float *y, float *result, int P = 0,
+    int octaves = 1, float lacunarity = 2.0f, float gain = 0.5f);
+
+/**
+ * Computes a sum of classic 3D Perlin noise functions at several points.
+ * See the 2D version of this function for more details.
+ * @ingroup proland_math
+ *
+ * @param n the number of points where the function must be evaluated.
+ * @param x the x coordinates of these points.
+ * @param y the y coordinates of these points.
+ * @param z the z coordinates of these points.
+ * @param result where the n computed values must be stored.
+ * @param P an optional period to get a periodic noise function. The default
+ *      value 0 means a non periodic function.
+ * @param octaves the number of Perlin noise functions to add.
+ * @param lacunarity the frequency factor between each noise function.
+ * @param gain the amplitude factor between each noise function.
+ */
+PROLAND_API void cnoise(int n, const float *x, const float *y, const float *z, float *result, int P = 0,
+    int octaves = 1, float lacunarity = 2.0f, float gain = 0.5f);
+
+/**
+ * Computes a sum of 2D Perlin simplex noise functions at several points.
+ * See the cnoise batch functions for more details.
+ * @ingroup proland_math
+ *
+ * @param n the number of points where the function must be evaluated.
+ * @param x the x coordinates of these points.
+ * @param y the y coordinates of these points.
+ * @param result where the n computed values must be stored.
+ * @param P an optional period to get a periodic noise function. The default
+ *      value 0 means a non periodic function.
+ * @param octaves the number of Perlin noise functions to add.
+ * @param lacunarity the frequency factor between each noise function.
+ * @param gain the amplitude factor between each noise function.
+ */
+PROLAND_API void snoise(int n, const float *x, const float *y, float *result, int P = 0,
+    int octaves = 1, float lacunarity = 2.0f, float gain = 0.5f);
+
+/**
+ * Computes a sum of 3D Perlin simplex noise functions at several points.
+ * See the cnoise batch functions for more details.
+ * @ingroup proland_math
+ *
+ * @param n the number of points where the function must be evaluated.
+ * @param x the x coordinates of these points.
+ * @param y the y coordinates of these points.
+ * @param z the z coordinates of these points.
+ * @param result where the n computed values must be stored.
+ * @param P an optional period to get a periodic noise function. The default
+ *      value 0 means a non periodic function.
+ * @param octaves the number of Perlin noise functions to add.
+ * @param lacunarity the frequency factor between each noise function.
+ * @param gain the amplitude factor between each noise function.
+ */
+PROLAND_API void snoise(int n, const float *x, const float *y, const float *z, float *result, int P = 0,
+    int octaves = 1, float lacunarity = 2.0f, float gain = 0.5f);
+
+/**
+ * Computes a sum of 4D Perlin simplex noise functions at several points.
+ * See the cnoise batch functions for more details.
+ * @ingroup proland_math
+ *
+ * @param n the number of points where the function must be evaluated.
+ * @param x the x coordinates of these points.
+ * @param y the y coordinates of these points.
+ * @param z the z coordinates of these points.
+ * @param w the w coordinates of these points.
+ * @param result where the n computed values must be stored.
+ * @param P an optional period to get a periodic noise function. The default
+ *      value 0 means a non periodic function.
+ * @param octaves the number of Perlin noise functions to add.
+ * @param lacunarity the frequency factor between each noise function.
+ * @param gain the amplitude factor between each noise function.
+ */
+PROLAND_API void snoise(int n, const float *x, const float *y, const float *z, const float *w, float *result, int P = 0,
+    int octaves = 1, float lacunarity = 2.0f, float gain = 0.5f);
+
+/**
+ * The noise functions that can be evaluated with #noiseGrid.
+ * @ingroup proland_math
+ */
+enum NoiseFunction {
+    CLASSIC_NOISE, ///< classic Perlin noise (2D or 3D), see cnoise
+    SIMPLEX_NOISE ///< Perlin simplex noise (2D, 3D or 4D), see snoise
+};
+
+/**
+ * Computes a sum of Perlin noise functions on a regular grid of points. The
+ * value at grid point (i0,i1,...) is the value of the corresponding batch
+ * function (see cnoise and snoise) at point origin + (i0*step[0],i1*step[1],...),
+ * and is stored in result at index i0 + size[0] * (i1 + size[1] * (...)).
+ * The grid is split in rows that are computed in parallel, with up to
+ * 'threadCount' threads. This function is thread safe.
+ * @ingroup proland_math
+ *
+ * @param f the noise function to evaluate.
+ * @param dimension the grid dimension (2 or 3 for CLASSIC_NOISE, 2, 3 or 4
+ *      for SIMPLEX_NOISE).
+ * @param size the number of grid points along each dimension.
+ * @param origin the coordinates of the first grid point.
+ * @param step the distance between grid points along each dimension.
+ * @param result where the computed values must be stored. Its size must be
+ *      the product of the values in 'size'.
+ * @param P an optional period to get a periodic noise function. The default
+ *      value 0 means a non periodic function.
+ * @param octaves the number of Perlin noise functions to add.
+ * @param lacunarity the frequency factor between each noise function.
+ * @param gain the amplitude factor between each noise function.
+ * @param threadCount the maximum number of threads to use, or 0 to use one
+ *      thread per processor.
+ */
+PROLAND_API void noiseGrid(NoiseFunction f, int dimension, const int size[], const float origin[], const float step[],
+    float *result, int P = 0, int octaves = 1, float lacunarity = 2.0f, float gain = 0.5f, int threadCount = 0);
+
 /**
  * Computes a 2D Fbm noise function in a 2D float array. This function is a sum
  * of several Perlin noise function with different frequencies and amplitudes.
@@ -181,10 +316,12 @@ PROLAND_API float snoise(float x, float y, float z, float w, int P = 0);
  * @param octaves the number of Perlin noise functions to add.
  * @param lacunarity the frequency factor between each noise function.
  * @param gain the amplitude factor between each noise function.
+ * @param threadCount the maximum number of threads to use, or 0 to use one
+ *      thread per processor. The result does not depend on this value.
  * @return the computed size*size array of values. These values are normalized
  *      to stay in the range 0-1.
  */
-PROLAND_API float *buildFbm4NoiseTexture2D(int size, int freq, int octaves, int lacunarity, float gain);
+PROLAND_API float *buildFbm4NoiseTexture2D(int size, int freq, int octaves, int lacunarity, float gain, int threadCount = 0);
 
 /**
  * Computes a 3D Fbm noise function in a 3D float array. This function is a sum
@@ -197,10 +334,12 @@ PROLAND_API float *buildFbm4NoiseTexture2D(int size, int freq, int octaves, int
  * @param octaves the number of Perlin noise functions to add.
  * @param lacunarity the frequency factor between each noise function.
  * @param gain the amplitude factor between each noise function.
+ * @param threadCount the maximum number of threads to use, or 0 to use one
+ *      thread per processor. The result does not depend on this value.
  * @return the computed size*size*size array of values. These values are
  *      normalized to stay in the range 0-1.
  */
-PROLAND_API float *buildFbm1NoiseTexture3D(int size, int freq, int octaves, int lacunarity, float gain);
+PROLAND_API float *buildFbm1NoiseTexture3D(int size, int freq, int octaves, int lacunarity, float gain, int threadCount = 0);
 
 }
 
@@ -71,17 +71,40 @@ public:
         {
             this->data = new T[size];
             this->size = size;
+            this->ownsData = true;
         }
 
         /**
-         * Deletes this CPUSlot. This deletes the #data array.
+         * Creates a new CPUSlot using the given array to store the tile
+         * data. This array is not deleted by this slot.
+         *
+         * @param owner the TileStorage that manages this slot.
+         * @param size the number of elements in the data array.
+         * @param data the array to store the tile data.
+         */
+        CPUSlot(TileStorage *owner, int size, T *data) : Slot(owner)
+        {
+            this->data = data;
+            this->size = size;
+            this->ownsData = false;
+        }
+
+        /**
+         * Deletes this CPUSlot. This deletes the #data array, if it was
+         * created by this slot.
          */
         virtual ~CPUSlot()
         {
-            if (data != NULL) {
+            if (data != NULL && ownsData) {
                 delete[] data;
             }
         }
+
+    private:
+        /**
+         * True if the #data array was created by this slot.
+         */
+        bool ownsData;
     };
 
     /**
@@ -92,7 +115,7 @@ public:
      *      component is of type T.
      * @param capacity the number of slots managed by this tile storage.
      */
-    CPUTileStorage(int tileSize, int channels, int capacity) : TileStorage()
+    CPUTileStorage(int tileSize, int channels, int capacity) : TileStorage(), slab(NULL)
     {
         init(tileSize, channels, capacity);
     }
@@ -102,6 +125,11 @@ public:
      */
     virtual ~CPUTileStorage()
     {
+        // the slots themselves are deleted in ~TileStorage, but they do not
+        // own their data, which is deleted here
+        if (slab != NULL) {
+            delete[] slab;
+        }
     }
 
     /**
@@ -113,11 +141,19 @@ public:
         return channels;
     }
 
+    virtual int getSlotData(Slot *s, void **data)
+    {
+        CPUSlot *cs = dynamic_cast<CPUSlot*>(s);
+        assert(cs != NULL);
+        *data = cs->data;
+        return cs->size * sizeof(T);
+    }
+
 protected:
     /**
      * Creates an uninitialized CPUTileStorage.
      */
-    CPUTileStorage() : TileStorage()
+    CPUTileStorage() : TileStorage(), slab(NULL)
     {
     }
 
@@ -134,8 +170,14 @@ protected:
         TileStorage::init(tileSize, capacity);
         this->channels = channels;
         int size = tileSize * tileSize * channels;
+        // the data of all the slots is allocated in a single block, with
+        // each slot data aligned on a cache line. This avoids as many
+        // allocations as slots, and the associated memory fragmentation.
+        size_t stride = ((size * sizeof(T) + 63) / 64) * 64;
+        slab = new unsigned char[stride * capacity + 63];
+        unsigned char *p = slab + (64 - ((size_t) slab) % 64) % 64;
         for (int i = 0; i < capacity; ++i) {
-            freeSlots.push_back(new CPUSlot(this, size));
+            freeSlots.push_back(new CPUSlot(this, size, (T*) (p + i * stride)));
         }
     }
 
@@ -148,6 +190,11 @@ private:
      * The number of components per pixel of each tile.
      */
     int channels;
+
+    /**
+     * The memory block containing the data of all the slots.
+     */
+    unsigned char *slab;
 };
 
 }
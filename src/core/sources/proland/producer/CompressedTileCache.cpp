@@ -0,0 +1,522 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "proland/producer/CompressedTileCache.h"
+
+#include <climits>
+#include <cstring>
+
+#include "ork/resource/ResourceTemplate.h"
+
+#include <pthread.h>
+
+using namespace std;
+using namespace ork;
+
+namespace proland
+{
+
+// The compressed data is a sequence of (literals, match) pairs, where the
+// match is a copy of previously uncompressed bytes. Each pair starts with a
+// token byte containing the number of literals (4 high bits) and the match
+// length minus MIN_MATCH (4 low bits). A value of 15 means that the length
+// continues in the following bytes, each byte being added to the length,
+// until a byte different from 255. Then come the literals, followed by the
+// match offset (2 bytes, little endian) and the match length continuation,
+// if any. The last pair has no match.
+
+#define HASH_BITS 14
+
+#define HASH_SIZE (1 << HASH_BITS)
+
+#define WINDOW_SIZE (1 << 16)
+
+#define MIN_MATCH 4
+
+const int CompressedTileCache::WORK_SIZE = HASH_SIZE + WINDOW_SIZE;
+
+static inline unsigned int read32(const unsigned char *p)
+{
+    unsigned int v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline unsigned int hash32(unsigned int v)
+{
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static inline void writeLength(unsigned char *&op, int length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char) length;
+}
+
+static void writeSequence(unsigned char *&op, const unsigned char *literals, int literalLength, int offset, int matchLength)
+{
+    unsigned char *token = op++;
+    int t = (literalLength >= 15 ? 15 : literalLength) << 4;
+    if (literalLength >= 15) {
+        writeLength(op, literalLength - 15);
+    }
+    memcpy(op, literals, literalLength);
+    op += literalLength;
+    if (matchLength > 0) {
+        *op++ = (unsigned char) (offset & 255);
+        *op++ = (unsigned char) (offset >> 8);
+        int m = matchLength - MIN_MATCH;
+        t |= m >= 15 ? 15 : m;
+        if (m >= 15) {
+            writeLength(op, m - 15);
+        }
+    }
+    *token = (unsigned char) t;
+}
+
+int CompressedTileCache::getMaxCompressedSize(int size)
+{
+    return size + size / 255 + 16;
+}
+
+int CompressedTileCache::compress(const unsigned char *src, int size, unsigned char *dst, int level, int *work)
+{
+    // head[h] is the last position whose 4 next bytes have hash h, and
+    // chain[p % WINDOW_SIZE] is the previous position with the same hash
+    // as position p (hash chains limited to the match window)
+    int *head = work;
+    int *chain = work + HASH_SIZE;
+    for (int i = 0; i < HASH_SIZE; ++i) {
+        head[i] = -1;
+    }
+
+    unsigned char *op = dst;
+    int last = size - MIN_MATCH;
+    int anchor = 0;
+    int misses = 0;
+    int i = 0;
+    while (i <= last) {
+        unsigned int v = read32(src + i);
+        unsigned int h = hash32(v);
+        int bestLength = 0;
+        int bestPosition = 0;
+        int candidate = head[h];
+        for (int depth = 0; depth < level && candidate >= 0 && i - candidate < WINDOW_SIZE; ++depth) {
+            if (read32(src + candidate) == v) {
+                int length = MIN_MATCH;
+                while (i + length < size && src[candidate + length] == src[i + length]) {
+                    ++length;
+                }
+                if (length > bestLength) {
+                    bestLength = length;
+                    bestPosition = candidate;
+                    if (i + length == size) {
+                        break;
+                    }
+                }
+            }
+            candidate = chain[candidate & (WINDOW_SIZE - 1)];
+        }
+        chain[i & (WINDOW_SIZE - 1)] = head[h];
+        head[h] = i;
+
+        if (bestLength >= MIN_MATCH) {
+            writeSequence(op, src + anchor, i - anchor, i - bestPosition, bestLength);
+            int end = i + bestLength;
+            // adds the positions inside the match to the hash chains; with
+            // level 1 only the last ones are added, for speed
+            int j = level > 1 ? i + 1 : end - 2;
+            for (; j < end && j <= last; ++j) {
+                unsigned int hj = hash32(read32(src + j));
+                chain[j & (WINDOW_SIZE - 1)] = head[hj];
+                head[hj] = j;
+            }
+            i = end;
+            anchor = i;
+            misses = 0;
+        } else {
+            // skips faster and faster in incompressible data
+            ++misses;
+            i += 1 + (misses >> 6);
+        }
+    }
+    if (anchor < size) {
+        writeSequence(op, src + anchor, size - anchor, 0, 0);
+    }
+    return int(op - dst);
+}
+
+int CompressedTileCache::uncompress(const unsigned char *src, int size, unsigned char *dst, int maxSize)
+{
+    const unsigned char *ip = src;
+    const unsigned char *ipEnd = src + size;
+    unsigned char *op = dst;
+    unsigned char *opEnd = dst + maxSize;
+    while (ip < ipEnd) {
+        int token = *ip++;
+        int length = token >> 4;
+        if (length == 15) {
+            int b;
+            do {
+                if (ip >= ipEnd) {
+                    return -1;
+                }
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        if (length > ipEnd - ip || length > opEnd - op) {
+            return -1;
+        }
+        memcpy(op, ip, length);
+        ip += length;
+        op += length;
+        if (ip == ipEnd) {
+            break;
+        }
+
+        if (ipEnd - ip < 2) {
+            return -1;
+        }
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - dst) {
+            return -1;
+        }
+        length = token & 15;
+        if (length == 15) {
+            int b;
+            do {
+                if (ip >= ipEnd) {
+                    return -1;
+                }
+                b = *ip++;
+                length += b;
+            } while (b == 255);
+        }
+        length += MIN_MATCH;
+        if (length > opEnd - op) {
+            return -1;
+        }
+        const unsigned char *match = op - offset;
+        if (offset >= length) {
+            memcpy(op, match, length);
+            op += length;
+        } else {
+            // overlapping copy, must be done byte per byte
+            for (int i = 0; i < length; ++i) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return int(op - dst);
+}
+
+/**
+ * Groups the first bytes of all the elements of an array, then the second
+ * bytes, etc.
+ */
+static void shuffle(const unsigned char *src, int size, int elementSize, unsigned char *dst)
+{
+    int n = size / elementSize;
+    for (int b = 0; b < elementSize; ++b) {
+        const unsigned char *s = src + b;
+        unsigned char *d = dst + b * n;
+        for (int i = 0; i < n; ++i) {
+            d[i] = s[i * elementSize];
+        }
+    }
+    memcpy(dst + n * elementSize, src + n * elementSize, size - n * elementSize);
+}
+
+/**
+ * Inverse of #shuffle.
+ */
+static void unshuffle(const unsigned char *src, int size, int elementSize, unsigned char *dst)
+{
+    int n = size / elementSize;
+    for (int b = 0; b < elementSize; ++b) {
+        const unsigned char *s = src + b * n;
+        unsigned char *d = dst + b;
+        for (int i = 0; i < n; ++i) {
+            d[i * elementSize] = s[i];
+        }
+    }
+    memcpy(dst + n * elementSize, src + n * elementSize, size - n * elementSize);
+}
+
+CompressedTileCache::CompressedTileCache(int capacity, int elementSize, int level) :
+    Object("CompressedTileCache")
+{
+    init(capacity, elementSize, level);
+}
+
+CompressedTileCache::CompressedTileCache() : Object("CompressedTileCache")
+{
+}
+
+void CompressedTileCache::init(int capacity, int elementSize, int level)
+{
+    assert(elementSize >= 1 && level >= 1);
+    this->capacity = capacity;
+    this->elementSize = elementSize;
+    this->level = level;
+    this->size = 0;
+    this->uncompressedSize = 0;
+    this->shuffleBuffer = NULL;
+    this->compressBuffer = NULL;
+    this->bufferSize = 0;
+    this->work = new int[WORK_SIZE];
+    this->queries = 0;
+    this->hits = 0;
+    mutex = new pthread_mutex_t;
+    pthread_mutex_init((pthread_mutex_t*) mutex, NULL);
+}
+
+CompressedTileCache::~CompressedTileCache()
+{
+    list<Record>::iterator i = tilesOrder.begin();
+    while (i != tilesOrder.end()) {
+        delete[] i->data;
+        ++i;
+    }
+    if (shuffleBuffer != NULL) {
+        delete[] shuffleBuffer;
+        delete[] compressBuffer;
+    }
+    delete[] work;
+    pthread_mutex_destroy((pthread_mutex_t*) mutex);
+    delete (pthread_mutex_t*) mutex;
+}
+
+int CompressedTileCache::getCapacity()
+{
+    return capacity;
+}
+
+int CompressedTileCache::getSize()
+{
+    return size;
+}
+
+int CompressedTileCache::getUncompressedSize()
+{
+    return uncompressedSize;
+}
+
+int CompressedTileCache::getTileCount()
+{
+    return (int) tiles.size();
+}
+
+int CompressedTileCache::getQueries()
+{
+    return queries;
+}
+
+int CompressedTileCache::getHits()
+{
+    return hits;
+}
+
+bool CompressedTileCache::readTile(int cacheId, int producerId, int level, int tx, int ty, void *data, int size)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    ++queries;
+    bool found = false;
+    map<TId, list<Record>::iterator>::iterator i = tiles.find(make_pair(make_pair(cacheId, producerId), make_pair(level, make_pair(tx, ty))));
+    if (i != tiles.end() && size == i->second->rawSize) {
+        list<Record>::iterator li = i->second;
+        unsigned char *dst = (unsigned char*) data;
+        int n;
+        if (li->size == li->rawSize) {
+            // the tile is not compressed
+            memcpy(dst, li->data, size);
+            n = size;
+        } else if (elementSize > 1) {
+            reserve(size);
+            n = uncompress(li->data, li->size, shuffleBuffer, size);
+            if (n == size) {
+                unshuffle(shuffleBuffer, size, elementSize, dst);
+            }
+        } else {
+            n = uncompress(li->data, li->size, dst, size);
+        }
+        if (n == size) {
+            // marks the tile as most recently used
+            tilesOrder.splice(tilesOrder.end(), tilesOrder, li);
+            found = true;
+            ++hits;
+        } else {
+            removeTile(i);
+        }
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    return found;
+}
+
+void CompressedTileCache::writeTile(int cacheId, int producerId, int level, int tx, int ty, const void *data, int size)
+{
+    if (capacity <= 0) {
+        return;
+    }
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    TId id = make_pair(make_pair(cacheId, producerId), make_pair(level, make_pair(tx, ty)));
+    map<TId, list<Record>::iterator>::iterator i = tiles.find(id);
+    if (i != tiles.end()) {
+        // the tile is already stored, it just becomes the most recently used
+        tilesOrder.splice(tilesOrder.end(), tilesOrder, i->second);
+    } else {
+        reserve(size);
+        const unsigned char *src = (const unsigned char*) data;
+        if (elementSize > 1) {
+            shuffle(src, size, elementSize, shuffleBuffer);
+            src = shuffleBuffer;
+        }
+        Record r;
+        r.id = id;
+        r.rawSize = size;
+        r.size = compress(src, size, compressBuffer, this->level, work);
+        if (r.size < size) {
+            r.data = new unsigned char[r.size];
+            memcpy(r.data, compressBuffer, r.size);
+        } else {
+            // incompressible tile, stored as is
+            r.size = size;
+            r.data = new unsigned char[size];
+            memcpy(r.data, data, size);
+        }
+        if (r.size <= capacity) {
+            while (this->size + r.size > capacity) {
+                // evicts the least recently used tiles to make room
+                removeTile(tiles.find(tilesOrder.front().id));
+            }
+            tiles[id] = tilesOrder.insert(tilesOrder.end(), r);
+            this->size += r.size;
+            uncompressedSize += r.rawSize;
+        } else {
+            delete[] r.data;
+        }
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void CompressedTileCache::invalidateTiles(int cacheId, int producerId)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    pair<int, int> pid = make_pair(cacheId, producerId);
+    map<TId, list<Record>::iterator>::iterator i = tiles.lower_bound(make_pair(pid, make_pair(INT_MIN, make_pair(INT_MIN, INT_MIN))));
+    while (i != tiles.end() && i->first.first == pid) {
+        removeTile(i++);
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void CompressedTileCache::invalidateTile(int cacheId, int producerId, int level, int tx, int ty)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    map<TId, list<Record>::iterator>::iterator i = tiles.find(make_pair(make_pair(cacheId, producerId), make_pair(level, make_pair(tx, ty))));
+    if (i != tiles.end()) {
+        removeTile(i);
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void CompressedTileCache::swap(ptr<CompressedTileCache> c)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    pthread_mutex_lock((pthread_mutex_t*) c->mutex);
+    std::swap(capacity, c->capacity);
+    std::swap(elementSize, c->elementSize);
+    std::swap(level, c->level);
+    std::swap(size, c->size);
+    std::swap(uncompressedSize, c->uncompressedSize);
+    std::swap(tilesOrder, c->tilesOrder);
+    std::swap(tiles, c->tiles);
+    std::swap(shuffleBuffer, c->shuffleBuffer);
+    std::swap(compressBuffer, c->compressBuffer);
+    std::swap(bufferSize, c->bufferSize);
+    std::swap(work, c->work);
+    std::swap(queries, c->queries);
+    std::swap(hits, c->hits);
+    pthread_mutex_unlock((pthread_mutex_t*) c->mutex);
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void CompressedTileCache::reserve(int size)
+{
+    if (size > bufferSize) {
+        if (shuffleBuffer != NULL) {
+            delete[] shuffleBuffer;
+            delete[] compressBuffer;
+        }
+        shuffleBuffer = new unsigned char[size];
+        compressBuffer = new unsigned char[getMaxCompressedSize(size)];
+        bufferSize = size;
+    }
+}
+
+void CompressedTileCache::removeTile(map<TId, list<Record>::iterator>::iterator i)
+{
+    list<Record>::iterator li = i->second;
+    size -= li->size;
+    uncompressedSize -= li->rawSize;
+    delete[] li->data;
+    tilesOrder.erase(li);
+    tiles.erase(i);
+}
+
+class CompressedTileCacheResource : public ResourceTemplate<1, CompressedTileCache>
+{
+public:
+    CompressedTileCacheResource(ptr<ResourceManager> manager, const string &name, ptr<ResourceDescriptor> desc, const TiXmlElement *e = NULL) :
+        ResourceTemplate<1, CompressedTileCache>(manager, name, desc)
+    {
+        e = e == NULL ? desc->descriptor : e;
+        int capacity;
+        int elementSize = 1;
+        int level = 1;
+        checkParameters(desc, e, "name,capacity,elementSize,level,");
+        getIntParameter(desc, e, "capacity", &capacity);
+        if (e->Attribute("elementSize") != NULL) {
+            getIntParameter(desc, e, "elementSize", &elementSize);
+        }
+        if (e->Attribute("level") != NULL) {
+            getIntParameter(desc, e, "level", &level);
+        }
+        init(capacity, elementSize, level);
+    }
+};
+
+extern const char compressedTileCache[] = "compressedTileCache";
+
+static ResourceFactory::Type<compressedTileCache, CompressedTileCacheResource> CompressedTileCacheType;
+
+}
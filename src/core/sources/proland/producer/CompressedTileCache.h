@@ -0,0 +1,346 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _PROLAND_COMPRESSED_TILE_CACHE_H_
+#define _PROLAND_COMPRESSED_TILE_CACHE_H_
+
+#include <list>
+#include <map>
+
+#include "ork/core/Object.h"
+
+using namespace ork;
+
+namespace proland
+{
+
+/**
+ * A second level cache of tiles, in memory, storing compressed tiles. A
+ * TileCache using a CompressedTileCache compresses the tiles it evicts from
+ * its TileStorage into this cache, and uncompresses them from this cache
+ * when they are needed again, instead of producing them again. Like a
+ * DiskTileCache, this is only possible with storages giving a raw access to
+ * their tiles data (see TileStorage#getSlotData). If a TileCache has both
+ * a CompressedTileCache and a DiskTileCache, the compressed cache is looked
+ * up first.
+ * The tiles are compressed with a fast LZ77 codec, after an optional
+ * shuffle of the bytes of each tile element (e.g., all the first bytes of
+ * the float values of an elevation tile are stored first, then all the
+ * second bytes, etc), which improves the compression ratio of multi bytes
+ * values. The memory used by the compressed tiles is bounded, and the least
+ * recently used tiles are evicted when this cache is full. The tiles are
+ * identified by the id of their TileCache, by the local id of their
+ * %producer in this TileCache (see TileProducer#getId), and by their
+ * coordinates, so that a CompressedTileCache can be shared between several
+ * TileCache (in order to share a memory budget between them).
+ * @ingroup producer
+ * @authors Eric Bruneton, Antoine Begault, Guillaume Piolat
+ */
+PROLAND_API class CompressedTileCache : public Object
+{
+public:
+    /**
+     * Creates a new CompressedTileCache.
+     *
+     * @param capacity the maximum memory used by the compressed tiles, in
+     *      bytes.
+     * @param elementSize the size in bytes of each tile element, for the
+     *      byte shuffle (e.g. 4 for float tiles). 1 disables the shuffle.
+     * @param level the number of candidate matches tested at each position
+     *      by the compressor. Higher values give better compression ratios,
+     *      but slower compression. Decompression speed does not depend on
+     *      this level.
+     */
+    CompressedTileCache(int capacity, int elementSize = 1, int level = 1);
+
+    /**
+     * Deletes this CompressedTileCache.
+     */
+    virtual ~CompressedTileCache();
+
+    /**
+     * Returns the maximum memory used by the compressed tiles, in bytes.
+     */
+    int getCapacity();
+
+    /**
+     * Returns the memory currently used by the compressed tiles, in bytes.
+     */
+    int getSize();
+
+    /**
+     * Returns the uncompressed size of the tiles currently stored in this
+     * cache, in bytes. Divided by #getSize, this gives the current
+     * compression ratio.
+     */
+    int getUncompressedSize();
+
+    /**
+     * Returns the number of tiles currently stored in this cache.
+     */
+    int getTileCount();
+
+    /**
+     * Returns the number of #readTile queries to this cache. Only used for
+     * statistics.
+     */
+    int getQueries();
+
+    /**
+     * Returns the number of #readTile queries that found the requested
+     * tile. Only used for statistics.
+     */
+    int getHits();
+
+    /**
+     * Reads a tile from this cache.
+     *
+     * @param cacheId the id of the TileCache of the tile's %producer.
+     * @param producerId the id of the tile's %producer.
+     * @param level the tile's quadtree level.
+     * @param tx the tile's quadtree x coordinate.
+     * @param ty the tile's quadtree y coordinate.
+     * @param[out] data where the uncompressed tile data must be written.
+     * @param size the size in bytes of the tile data.
+     * @return true if the tile was found in this cache, with the given
+     *      size, and copied in data.
+     */
+    bool readTile(int cacheId, int producerId, int level, int tx, int ty, void *data, int size);
+
+    /**
+     * Writes a tile in this cache. If this tile is already in this cache,
+     * its data is supposed unchanged (this cache must be notified of tile
+     * changes with #invalidateTile or #invalidateTiles). Otherwise the tile
+     * is compressed, and the least recently used tiles are evicted if
+     * necessary to make room for it.
+     *
+     * @param cacheId the id of the TileCache of the tile's %producer.
+     * @param producerId the id of the tile's %producer.
+     * @param level the tile's quadtree level.
+     * @param tx the tile's quadtree x coordinate.
+     * @param ty the tile's quadtree y coordinate.
+     * @param data the tile data.
+     * @param size the size in bytes of the tile data.
+     */
+    void writeTile(int cacheId, int producerId, int level, int tx, int ty, const void *data, int size);
+
+    /**
+     * Removes the tiles of the given %producer from this cache.
+     *
+     * @param cacheId the id of the TileCache of the %producer.
+     * @param producerId the id of a %producer. See TileProducer#getId.
+     */
+    void invalidateTiles(int cacheId, int producerId);
+
+    /**
+     * Removes a tile from this cache.
+     *
+     * @param cacheId the id of the TileCache of the tile's %producer.
+     * @param producerId the id of the tile's %producer.
+     * @param level the tile's quadtree level.
+     * @param tx the tile's quadtree x coordinate.
+     * @param ty the tile's quadtree y coordinate.
+     */
+    void invalidateTile(int cacheId, int producerId, int level, int tx, int ty);
+
+    /**
+     * Compresses the given data with the codec used by this cache (without
+     * byte shuffle).
+     *
+     * @param src the data to compress.
+     * @param size the size of the data to compress, in bytes.
+     * @param[out] dst where the compressed data must be written. Its size
+     *      must be at least #getMaxCompressedSize(size).
+     * @param level the number of candidate matches tested at each position.
+     * @param work a work buffer of #WORK_SIZE ints.
+     * @return the size of the compressed data, in bytes.
+     */
+    static int compress(const unsigned char *src, int size, unsigned char *dst, int level, int *work);
+
+    /**
+     * Uncompresses data compressed with #compress.
+     *
+     * @param src the compressed data.
+     * @param size the size of the compressed data, in bytes.
+     * @param[out] dst where the uncompressed data must be written.
+     * @param maxSize the size of dst, in bytes.
+     * @return the size of the uncompressed data, in bytes, or -1 if the
+     *      compressed data is corrupted.
+     */
+    static int uncompress(const unsigned char *src, int size, unsigned char *dst, int maxSize);
+
+    /**
+     * Returns the maximum size of the compressed data produced by #compress.
+     *
+     * @param size the size of the data to compress, in bytes.
+     */
+    static int getMaxCompressedSize(int size);
+
+    /**
+     * The size of the work buffer used by #compress, in ints.
+     */
+    static const int WORK_SIZE;
+
+protected:
+    /**
+     * Creates an uninitialized CompressedTileCache.
+     */
+    CompressedTileCache();
+
+    /**
+     * Initializes this CompressedTileCache. See #CompressedTileCache.
+     */
+    void init(int capacity, int elementSize = 1, int level = 1);
+
+    void swap(ptr<CompressedTileCache> c);
+
+private:
+    /**
+     * A tile identifier. Contains a TileCache id and a %producer id (first
+     * pair element) and tile coordinates level,tx,ty (second pair element).
+     */
+    typedef std::pair<std::pair<int, int>, std::pair<int, std::pair<int, int> > > TId;
+
+    /**
+     * A tile stored in this cache.
+     */
+    struct Record
+    {
+        /**
+         * The id of the tile stored in this record.
+         */
+        TId id;
+
+        /**
+         * The compressed tile data, or the uncompressed data if the tile
+         * could not be compressed.
+         */
+        unsigned char *data;
+
+        /**
+         * The size of #data, in bytes.
+         */
+        int size;
+
+        /**
+         * The size of the uncompressed tile data, in bytes.
+         */
+        int rawSize;
+    };
+
+    /**
+     * The maximum memory used by the compressed tiles, in bytes.
+     */
+    int capacity;
+
+    /**
+     * The size in bytes of each tile element, for the byte shuffle.
+     */
+    int elementSize;
+
+    /**
+     * The number of candidate matches tested at each position by the
+     * compressor.
+     */
+    int level;
+
+    /**
+     * The memory currently used by the compressed tiles, in bytes.
+     */
+    int size;
+
+    /**
+     * The uncompressed size of the tiles currently stored in this cache.
+     */
+    int uncompressedSize;
+
+    /**
+     * The tiles stored in this cache, ordered by date of last use (to
+     * implement a LRU cache).
+     */
+    std::list<Record> tilesOrder;
+
+    /**
+     * The tiles stored in this cache. Maps tile identifiers to positions in
+     * the ordered list of tiles #tilesOrder.
+     */
+    std::map<TId, std::list<Record>::iterator> tiles;
+
+    /**
+     * A buffer for the shuffled tile data.
+     */
+    unsigned char *shuffleBuffer;
+
+    /**
+     * A buffer for the compressed tile data.
+     */
+    unsigned char *compressBuffer;
+
+    /**
+     * The size of #shuffleBuffer and #compressBuffer, in bytes.
+     */
+    int bufferSize;
+
+    /**
+     * The work buffer used by #compress.
+     */
+    int *work;
+
+    /**
+     * The number of #readTile queries. Only used for statistics.
+     */
+    int queries;
+
+    /**
+     * The number of #readTile queries that found the requested tile.
+     * Only used for statistics.
+     */
+    int hits;
+
+    /**
+     * A mutex to serialize parallel accesses to this cache.
+     */
+    void *mutex;
+
+    /**
+     * Resizes #shuffleBuffer and #compressBuffer if necessary.
+     *
+     * @param size the size in bytes of the uncompressed tiles.
+     */
+    void reserve(int size);
+
+    /**
+     * Removes a tile from this cache.
+     *
+     * @param i the position of this tile in #tiles.
+     */
+    void removeTile(std::map<TId, std::list<Record>::iterator>::iterator i);
+};
+
+}
+
+#endif
@@ -0,0 +1,229 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "proland/producer/DiskTileCache.h"
+
+#include <climits>
+
+#include "ork/core/Logger.h"
+#include "ork/resource/ResourceTemplate.h"
+
+#include <pthread.h>
+
+using namespace std;
+using namespace ork;
+
+namespace proland
+{
+
+DiskTileCache::DiskTileCache(const string &fileName, int capacity) : Object("DiskTileCache")
+{
+    init(fileName, capacity);
+}
+
+DiskTileCache::DiskTileCache() : Object("DiskTileCache")
+{
+}
+
+void DiskTileCache::init(const string &fileName, int capacity)
+{
+    this->fileName = fileName;
+    this->capacity = capacity;
+    this->recordSize = -1;
+    this->records = 0;
+    this->queries = 0;
+    this->hits = 0;
+    fopen(&file, fileName.c_str(), "w+b");
+    if (file == NULL && Logger::ERROR_LOGGER != NULL) {
+        Logger::ERROR_LOGGER->log("CACHE", "Cannot create disk tile cache '" + fileName + "'");
+    }
+    mutex = new pthread_mutex_t;
+    pthread_mutex_init((pthread_mutex_t*) mutex, NULL);
+}
+
+DiskTileCache::~DiskTileCache()
+{
+    if (file != NULL) {
+        fclose(file);
+        remove(fileName.c_str());
+    }
+    pthread_mutex_destroy((pthread_mutex_t*) mutex);
+    delete (pthread_mutex_t*) mutex;
+}
+
+int DiskTileCache::getCapacity()
+{
+    return capacity;
+}
+
+int DiskTileCache::getTileCount()
+{
+    return (int) tiles.size();
+}
+
+int DiskTileCache::getQueries()
+{
+    return queries;
+}
+
+int DiskTileCache::getHits()
+{
+    return hits;
+}
+
+bool DiskTileCache::readTile(int cacheId, int producerId, int level, int tx, int ty, void *data, int size)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    ++queries;
+    bool found = false;
+    map<TId, list<Record>::iterator>::iterator i = tiles.find(make_pair(make_pair(cacheId, producerId), make_pair(level, make_pair(tx, ty))));
+    if (i != tiles.end() && size == recordSize) {
+        list<Record>::iterator li = i->second;
+        fseek64(file, (long long) li->index * recordSize, SEEK_SET);
+        if (fread(data, recordSize, 1, file) == 1) {
+            // marks the tile as most recently used
+            tilesOrder.splice(tilesOrder.end(), tilesOrder, li);
+            found = true;
+            ++hits;
+        } else {
+            removeTile(i);
+        }
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    return found;
+}
+
+void DiskTileCache::writeTile(int cacheId, int producerId, int level, int tx, int ty, const void *data, int size)
+{
+    if (file == NULL || capacity <= 0) {
+        return;
+    }
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    if (recordSize != -1 && size != recordSize) {
+        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+        return;
+    }
+    recordSize = size;
+    TId id = make_pair(make_pair(cacheId, producerId), make_pair(level, make_pair(tx, ty)));
+    map<TId, list<Record>::iterator>::iterator i = tiles.find(id);
+    if (i != tiles.end()) {
+        // the tile is already stored, it just becomes the most recently used
+        tilesOrder.splice(tilesOrder.end(), tilesOrder, i->second);
+    } else {
+        if ((int) tiles.size() == capacity) {
+            // evicts the least recently used tile to reuse its record
+            removeTile(tiles.find(tilesOrder.front().id));
+        }
+        int index;
+        if (freeRecords.empty()) {
+            index = records++;
+        } else {
+            index = freeRecords.back();
+            freeRecords.pop_back();
+        }
+        fseek64(file, (long long) index * recordSize, SEEK_SET);
+        if (fwrite(data, recordSize, 1, file) == 1) {
+            Record r;
+            r.id = id;
+            r.index = index;
+            tiles[id] = tilesOrder.insert(tilesOrder.end(), r);
+        } else {
+            freeRecords.push_back(index);
+            if (Logger::WARNING_LOGGER != NULL) {
+                Logger::WARNING_LOGGER->log("CACHE", "Cannot write tile in disk tile cache '" + fileName + "'");
+            }
+        }
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void DiskTileCache::invalidateTiles(int cacheId, int producerId)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    pair<int, int> pid = make_pair(cacheId, producerId);
+    map<TId, list<Record>::iterator>::iterator i = tiles.lower_bound(make_pair(pid, make_pair(INT_MIN, make_pair(INT_MIN, INT_MIN))));
+    while (i != tiles.end() && i->first.first == pid) {
+        removeTile(i++);
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void DiskTileCache::invalidateTile(int cacheId, int producerId, int level, int tx, int ty)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    map<TId, list<Record>::iterator>::iterator i = tiles.find(make_pair(make_pair(cacheId, producerId), make_pair(level, make_pair(tx, ty))));
+    if (i != tiles.end()) {
+        removeTile(i);
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void DiskTileCache::swap(ptr<DiskTileCache> c)
+{
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    pthread_mutex_lock((pthread_mutex_t*) c->mutex);
+    std::swap(fileName, c->fileName);
+    std::swap(file, c->file);
+    std::swap(capacity, c->capacity);
+    std::swap(recordSize, c->recordSize);
+    std::swap(records, c->records);
+    std::swap(freeRecords, c->freeRecords);
+    std::swap(tilesOrder, c->tilesOrder);
+    std::swap(tiles, c->tiles);
+    std::swap(queries, c->queries);
+    std::swap(hits, c->hits);
+    pthread_mutex_unlock((pthread_mutex_t*) c->mutex);
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+}
+
+void DiskTileCache::removeTile(map<TId, list<Record>::iterator>::iterator i)
+{
+    freeRecords.push_back(i->second->index);
+    tilesOrder.erase(i->second);
+    tiles.erase(i);
+}
+
+class DiskTileCacheResource : public ResourceTemplate<1, DiskTileCache>
+{
+public:
+    DiskTileCacheResource(ptr<ResourceManager> manager, const string &name, ptr<ResourceDescriptor> desc, const TiXmlElement *e = NULL) :
+        ResourceTemplate<1, DiskTileCache>(manager, name, desc)
+    {
+        e = e == NULL ? desc->descriptor : e;
+        int capacity;
+        checkParameters(desc, e, "name,file,capacity,");
+        string file = getParameter(desc, e, "file");
+        getIntParameter(desc, e, "capacity", &capacity);
+        init(file, capacity);
+    }
+};
+
+extern const char diskTileCache[] = "diskTileCache";
+
+static ResourceFactory::Type<diskTileCache, DiskTileCacheResource> DiskTileCacheType;
+
+}
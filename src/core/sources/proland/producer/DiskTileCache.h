@@ -0,0 +1,259 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _PROLAND_DISK_TILE_CACHE_H_
+#define _PROLAND_DISK_TILE_CACHE_H_
+
+#include <cstdio>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ork/core/Object.h"
+
+using namespace ork;
+
+namespace proland
+{
+
+/**
+ * A second level cache of tiles, on disk. A TileCache using a DiskTileCache
+ * copies the tiles it evicts from its TileStorage into this cache, and
+ * reads them back from it when they are needed again, instead of producing
+ * them again. This is only possible with storages giving a raw access to
+ * their tiles data (see TileStorage#getSlotData), such as CPUTileStorage.
+ * The tiles are stored in a single file, as fixed size records. The number
+ * of records is bounded, and the least recently used tiles are evicted
+ * when this cache is full. The tiles are identified by the id of their
+ * TileCache, by the local id of their %producer in this TileCache (see
+ * TileProducer#getId), and by their coordinates. These ids are only valid
+ * during a session, so the file is cleared when this cache is created. A
+ * DiskTileCache can be shared between several TileCache, provided their
+ * tiles have the same size (tiles with a different size are not stored).
+ * @ingroup producer
+ * @authors Eric Bruneton, Antoine Begault, Guillaume Piolat
+ */
+PROLAND_API class DiskTileCache : public Object
+{
+public:
+    /**
+     * Creates a new DiskTileCache.
+     *
+     * @param fileName the file where the tiles must be stored. This file is
+     *      created if it does not exist, and cleared otherwise.
+     * @param capacity the maximum number of tiles that can be stored in
+     *      this cache.
+     */
+    DiskTileCache(const std::string &fileName, int capacity);
+
+    /**
+     * Deletes this DiskTileCache. This deletes the file used to store the
+     * tiles.
+     */
+    virtual ~DiskTileCache();
+
+    /**
+     * Returns the maximum number of tiles that can be stored in this cache.
+     */
+    int getCapacity();
+
+    /**
+     * Returns the number of tiles currently stored in this cache.
+     */
+    int getTileCount();
+
+    /**
+     * Returns the number of #readTile queries to this cache. Only used for
+     * statistics.
+     */
+    int getQueries();
+
+    /**
+     * Returns the number of #readTile queries that found the requested
+     * tile. Only used for statistics.
+     */
+    int getHits();
+
+    /**
+     * Reads a tile from this cache.
+     *
+     * @param cacheId the id of the TileCache of the tile's %producer.
+     * @param producerId the id of the tile's %producer.
+     * @param level the tile's quadtree level.
+     * @param tx the tile's quadtree x coordinate.
+     * @param ty the tile's quadtree y coordinate.
+     * @param[out] data where the tile data must be copied.
+     * @param size the size in bytes of the tile data.
+     * @return true if the tile was found in this cache, with the given
+     *      size, and copied in data.
+     */
+    bool readTile(int cacheId, int producerId, int level, int tx, int ty, void *data, int size);
+
+    /**
+     * Writes a tile in this cache. If this tile is already in this cache,
+     * its data is supposed unchanged (this cache must be notified of tile
+     * changes with #invalidateTile or #invalidateTiles). Otherwise, if this
+     * cache is full, the least recently used tile is evicted to make room
+     * for the new tile.
+     *
+     * @param cacheId the id of the TileCache of the tile's %producer.
+     * @param producerId the id of the tile's %producer.
+     * @param level the tile's quadtree level.
+     * @param tx the tile's quadtree x coordinate.
+     * @param ty the tile's quadtree y coordinate.
+     * @param data the tile data.
+     * @param size the size in bytes of the tile data. All the tiles of a
+     *      DiskTileCache must have the same size. The tiles whose size is
+     *      different from the size of the first stored tile are ignored.
+     */
+    void writeTile(int cacheId, int producerId, int level, int tx, int ty, const void *data, int size);
+
+    /**
+     * Removes the tiles of the given %producer from this cache.
+     *
+     * @param cacheId the id of the TileCache of the %producer.
+     * @param producerId the id of a %producer. See TileProducer#getId.
+     */
+    void invalidateTiles(int cacheId, int producerId);
+
+    /**
+     * Removes a tile from this cache.
+     *
+     * @param cacheId the id of the TileCache of the tile's %producer.
+     * @param producerId the id of the tile's %producer.
+     * @param level the tile's quadtree level.
+     * @param tx the tile's quadtree x coordinate.
+     * @param ty the tile's quadtree y coordinate.
+     */
+    void invalidateTile(int cacheId, int producerId, int level, int tx, int ty);
+
+protected:
+    /**
+     * Creates an uninitialized DiskTileCache.
+     */
+    DiskTileCache();
+
+    /**
+     * Initializes this DiskTileCache. See #DiskTileCache.
+     */
+    void init(const std::string &fileName, int capacity);
+
+    void swap(ptr<DiskTileCache> c);
+
+private:
+    /**
+     * A tile identifier. Contains a TileCache id and a %producer id (first
+     * pair element) and tile coordinates level,tx,ty (second pair element).
+     */
+    typedef std::pair<std::pair<int, int>, std::pair<int, std::pair<int, int> > > TId;
+
+    /**
+     * A tile stored in this cache.
+     */
+    struct Record
+    {
+        /**
+         * The id of the tile stored in this record.
+         */
+        TId id;
+
+        /**
+         * The index of this record in the file.
+         */
+        int index;
+    };
+
+    /**
+     * The file where the tiles are stored.
+     */
+    std::string fileName;
+
+    /**
+     * The file where the tiles are stored, opened for reading and writing.
+     */
+    FILE *file;
+
+    /**
+     * The maximum number of tiles that can be stored in this cache.
+     */
+    int capacity;
+
+    /**
+     * The size in bytes of each tile, or -1 if no tile has been written yet.
+     */
+    int recordSize;
+
+    /**
+     * The number of records in the file, used or not.
+     */
+    int records;
+
+    /**
+     * The indices of the records of the file that are not used.
+     */
+    std::vector<int> freeRecords;
+
+    /**
+     * The tiles stored in this cache, ordered by date of last use (to
+     * implement a LRU cache).
+     */
+    std::list<Record> tilesOrder;
+
+    /**
+     * The tiles stored in this cache. Maps tile identifiers to positions in
+     * the ordered list of tiles #tilesOrder.
+     */
+    std::map<TId, std::list<Record>::iterator> tiles;
+
+    /**
+     * The number of #readTile queries. Only used for statistics.
+     */
+    int queries;
+
+    /**
+     * The number of #readTile queries that found the requested tile.
+     * Only used for statistics.
+     */
+    int hits;
+
+    /**
+     * A mutex to serialize parallel accesses to this cache.
+     */
+    void *mutex;
+
+    /**
+     * Removes a tile from this cache.
+     *
+     * @param i the position of this tile in #tiles.
+     */
+    void removeTile(std::map<TId, std::list<Record>::iterator>::iterator i);
+};
+
+}
+
+#endif
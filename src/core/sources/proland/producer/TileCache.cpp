@@ -27,6 +27,8 @@
 
 #include "proland/producer/TileCache.h"
 
+#include <new>
+#include <set>
 #include <sstream>
 
 #include "ork/core/Logger.h"
@@ -41,8 +43,48 @@ using namespace ork;
 namespace proland
 {
 
+/**
+ * The id of the next TileCache to be created.
+ */
+static int nextCacheId = 0;
+
+/**
+ * The TileCache that have second level caches. See
+ * TileCache#invalidateDependentCopies.
+ */
+static set<TileCache*> cachesWithCopies;
+
+/**
+ * A mutex to serialize accesses to nextCacheId and cachesWithCopies.
+ */
+static pthread_mutex_t cachesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Returns true if the producer q uses the producer p, directly or
+ * indirectly, either itself or via its layers.
+ *
+ * @param visited the producers already visited by this search.
+ */
+static bool dependsOn(TileProducer *q, TileProducer *p, set<TileProducer*> &visited)
+{
+    if (!visited.insert(q).second) {
+        return false;
+    }
+    vector< ptr<TileProducer> > producers;
+    q->getReferencedProducers(producers);
+    for (int i = 0; i < q->getLayerCount(); ++i) {
+        q->getLayer(i)->getReferencedProducers(producers);
+    }
+    for (unsigned int i = 0; i < producers.size(); ++i) {
+        if (producers[i].get() == p || dependsOn(producers[i].get(), p, visited)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 TileCache::Tile::Tile(int producerId, int level, int tx, int ty, ptr<Task> task, TileStorage::Slot *data) :
-    producerId(producerId), level(level), tx(tx), ty(ty), task(task), data(data), users(0)
+    producerId(producerId), level(level), tx(tx), ty(ty), task(task), data(data), users(0), prev(NULL), next(NULL)
 {
     assert(data != NULL);
 }
@@ -91,12 +133,24 @@ TileCache::TileCache() : Object("TileCache")
 
 void TileCache::init(ptr<TileStorage> storage, std::string name, ptr<Scheduler> scheduler)
 {
+    pthread_mutex_lock(&cachesMutex);
+    this->id = nextCacheId++;
+    pthread_mutex_unlock(&cachesMutex);
     this->nextProducerId = 0;
     this->storage = storage;
     this->scheduler = scheduler;
     this->queries = 0;
     this->misses = 0;
     this->name = name;
+    this->firstUnusedTile = NULL;
+    this->lastUnusedTile = NULL;
+    this->unusedTileCount = 0;
+    int capacity = storage->getCapacity();
+    tilePool = new unsigned char[capacity * sizeof(Tile)];
+    freeTiles.reserve(capacity);
+    for (int i = capacity - 1; i >= 0; --i) {
+        freeTiles.push_back(tilePool + i * sizeof(Tile));
+    }
     mutex = new pthread_mutex_t;
     pthread_mutexattr_t attrs;
     pthread_mutexattr_init(&attrs);
@@ -107,24 +161,31 @@ void TileCache::init(ptr<TileStorage> storage, std::string name, ptr<Scheduler>
 
 TileCache::~TileCache()
 {
+    pthread_mutex_lock(&cachesMutex);
+    cachesWithCopies.erase(this);
+    pthread_mutex_unlock(&cachesMutex);
     pthread_mutex_destroy((pthread_mutex_t*) mutex);
     delete (pthread_mutex_t*) mutex;
     mutex = NULL;
     // The users of a TileCache must release all their tiles with putTile
     // before they erase their reference to the TileCache. Hence a TileCache
-    // cannot be deleted before all tiles are unused. So usedTiles should be
-    // empty at this point
-    assert(usedTiles.size() == 0);
-    unusedTiles.clear();
+    // cannot be deleted before all tiles are unused. So all tiles should be
+    // unused at this point
+    assert((int) tiles.size() == unusedTileCount);
+    tiles.clear();
     // releases the storage used by the unused tiles
-    list<Tile*>::iterator i = unusedTilesOrder.begin();
-    while (i != unusedTilesOrder.end()) {
-        storage->deleteSlot((*i)->data);
-        delete *i;
-        ++i;
+    Tile *t = firstUnusedTile;
+    while (t != NULL) {
+        Tile *next = t->next;
+        storage->deleteSlot(t->data);
+        deleteTile(t);
+        t = next;
     }
-    unusedTilesOrder.clear();
+    firstUnusedTile = NULL;
+    lastUnusedTile = NULL;
+    unusedTileCount = 0;
     deletedTiles.clear();
+    delete[] tilePool;
 }
 
 ptr<TileStorage> TileCache::getStorage()
@@ -137,14 +198,36 @@ ptr<Scheduler> TileCache::getScheduler()
     return scheduler;
 }
 
+ptr<DiskTileCache> TileCache::getDiskCache()
+{
+    return diskCache;
+}
+
+void TileCache::setDiskCache(ptr<DiskTileCache> diskCache)
+{
+    this->diskCache = diskCache;
+    updateCopiesRegistration();
+}
+
+ptr<CompressedTileCache> TileCache::getCompressedCache()
+{
+    return compressedCache;
+}
+
+void TileCache::setCompressedCache(ptr<CompressedTileCache> compressedCache)
+{
+    this->compressedCache = compressedCache;
+    updateCopiesRegistration();
+}
+
 int TileCache::getUsedTiles()
 {
-    return usedTiles.size();
+    return (int) tiles.size() - unusedTileCount;
 }
 
 int TileCache::getUnusedTiles()
 {
-    return unusedTiles.size();
+    return unusedTileCount;
 }
 
 TileCache::Tile* TileCache::findTile(int producerId, int level, int tx, int ty, bool includeCache)
@@ -152,21 +235,14 @@ TileCache::Tile* TileCache::findTile(int producerId, int level, int tx, int ty,
     assert(producers.find(producerId) != producers.end());
     pthread_mutex_lock((pthread_mutex_t*) mutex);
     Tile::TId id = Tile::getTId(producerId, level, tx, ty);
-    map<Tile::TId, Tile*>::iterator i = usedTiles.find(id);
+    map<Tile::TId, Tile*>::iterator i = tiles.find(id);
     Tile *t = NULL;
-    // looks for the requested tile in the used tiles list
-    if (i != usedTiles.end()) {
+    // looks for the requested tile in the used tiles, or in the unused
+    // tiles if includeCache is true
+    if (i != tiles.end() && (i->second->users > 0 || includeCache)) {
         t = i->second;
         assert(t->producerId == producerId && t->level == level && t->tx == tx && t->ty == ty);
     }
-    // looks for the requested tile in the unused tiles list (if includeCache is true)
-    if (t == NULL && includeCache) {
-        Cache::iterator i = unusedTiles.find(id);
-        if (i != unusedTiles.end()) {
-            t = *(i->second);
-            assert(t->producerId == producerId && t->level == level && t->tx == tx && t->ty == ty);
-        }
-    }
     pthread_mutex_unlock((pthread_mutex_t*) mutex);
     return t;
 }
@@ -176,24 +252,17 @@ TileCache::Tile* TileCache::getTile(int producerId, int level, int tx, int ty, u
     assert(producers.find(producerId) != producers.end());
     pthread_mutex_lock((pthread_mutex_t*) mutex);
     Tile::TId id = Tile::getTId(producerId, level, tx, ty);
-    map<Tile::TId, Tile*>::iterator i = usedTiles.find(id);
+    map<Tile::TId, Tile*>::iterator i = tiles.find(id);
     Tile *t;
-    if (i == usedTiles.end()) {
+    if (i == tiles.end() || i->second->users == 0) {
         bool deletedTile = false;
         ++queries;
-        Cache::iterator i = unusedTiles.find(id);
-        if (i == unusedTiles.end()) {
+        if (i == tiles.end()) {
             // the requested tile is not in storage, it must be created
             TileStorage::Slot *data = storage->newSlot();
-            if (data == NULL && unusedTiles.size() > 0) {
+            if (data == NULL && unusedTileCount > 0) {
                 // evict least recently used tile to reuse its data storage
-                list<Tile*>::iterator li = unusedTilesOrder.begin();
-                t = *li;
-                data = t->data;
-                unusedTiles.erase(t->getTId());
-                unusedTilesOrder.erase(li);
-                deletedTiles.insert(make_pair(t->getTId(), t->task.get()));
-                delete t;
+                data = evictTile();
             }
             if (data == NULL) { // cache is full
                 t = NULL;
@@ -209,18 +278,15 @@ TileCache::Tile* TileCache::getTile(int producerId, int level, int tx, int ty, u
                 }
                 task = producers[producerId]->createTile(level, tx, ty, data, deadline, task);
                 // creates the requested tile
-                t = new Tile(producerId, level, tx, ty, task, data);
+                t = newTile(producerId, level, tx, ty, task, data);
+                tiles.insert(make_pair(id, t));
             }
         } else {
-            // requested tile found in unused tile list
-            list<Tile*>::iterator li = i->second;
-            t = *li;
-            unusedTiles.erase(i);
-            unusedTilesOrder.erase(li);
+            // requested tile found in unused tile list, marks it as used
+            t = i->second;
+            removeUnusedTile(t);
         }
         if (t != NULL) {
-            // marks requested tile as used
-            usedTiles.insert(make_pair(id, t));
             if (deletedTile) {
                 // if the tile data was not in storage and if the task to create it
                 // was reused from a deleted tile, we need to reexecute the task
@@ -233,11 +299,17 @@ TileCache::Tile* TileCache::getTile(int producerId, int level, int tx, int ty, u
             }
         }
         if (Logger::DEBUG_LOGGER != NULL) {
-            Logger::DEBUG_LOGGER->logf("CACHE", "%s: tiles: %d used, %d reusable, total %d", name.c_str(), usedTiles.size(), unusedTiles.size(), storage->getCapacity());
+            Logger::DEBUG_LOGGER->logf("CACHE", "%s: tiles: %d used, %d reusable, total %d", name.c_str(), getUsedTiles(), unusedTileCount, storage->getCapacity());
+            if (compressedCache != NULL) {
+                Logger::DEBUG_LOGGER->logf("CACHE", "%s: compressed: %d tiles, %d/%d bytes, %d hits for %d queries", name.c_str(), compressedCache->getTileCount(), compressedCache->getSize(), compressedCache->getUncompressedSize(), compressedCache->getHits(), compressedCache->getQueries());
+            }
+            if (diskCache != NULL) {
+                Logger::DEBUG_LOGGER->logf("CACHE", "%s: disk: %d tiles, %d hits for %d queries", name.c_str(), diskCache->getTileCount(), diskCache->getHits(), diskCache->getQueries());
+            }
 //            Logger::DEBUG_LOGGER->logf("CACHE", "%s: queries: %d misses for %d queries", name.c_str(), misses, queries);
         }
     } else {
-        // requested tile found in used tiles list -> nothing to do
+        // requested tile found in used tiles -> nothing to do
         t = i->second;
         assert(t->producerId == producerId && t->level == level && t->tx == tx && t->ty == ty);
     }
@@ -257,52 +329,43 @@ ptr<Task> TileCache::prefetchTile(int producerId, int level, int tx, int ty)
     pthread_mutex_lock((pthread_mutex_t*) mutex);
     Tile::TId id = Tile::getTId(producerId, level, tx, ty);
     ptr<Task> task;
-    if (usedTiles.find(id) == usedTiles.end()) {
-        if (unusedTiles.find(id) == unusedTiles.end()) {
-            // the requested tile is not in storage, it must be created
-            TileStorage::Slot *data = storage->newSlot();
-            if (data == NULL && unusedTiles.size() > 0) {
-                // evict least recently used tile to reuse its data storage
-                list<Tile*>::iterator li = unusedTilesOrder.begin();
-                Tile *t = *li;
-                data = t->data;
-                assert(data != NULL);
-                unusedTiles.erase(t->getTId());
-                unusedTilesOrder.erase(li);
-                deletedTiles.insert(make_pair(t->getTId(), t->task.get()));
-                delete t;
+    if (tiles.find(id) == tiles.end()) {
+        // the requested tile is not in storage, it must be created
+        TileStorage::Slot *data = storage->newSlot();
+        if (data == NULL && unusedTileCount > 0) {
+            // evict least recently used tile to reuse its data storage
+            data = evictTile();
+        }
+        if (data != NULL) {
+            unsigned int deadline = 1u << 31u;
+            bool deletedTile = false;
+            map<Tile::TId, Task*>::iterator i = deletedTiles.find(id);
+            if (i != deletedTiles.end()) {
+                // if the task for creating this tile still exists, we reuse it
+                task = i->second;
+                deletedTile = true;
+                deletedTiles.erase(i);
             }
-            if (data != NULL) {
-                unsigned int deadline = 1u << 31u;
-                bool deletedTile = false;
-                map<Tile::TId, Task*>::iterator i = deletedTiles.find(id);
-                if (i != deletedTiles.end()) {
-                    // if the task for creating this tile still exists, we reuse it
-                    task = i->second;
-                    deletedTile = true;
-                    deletedTiles.erase(i);
-                }
-                task = producers[producerId]->createTile(level, tx, ty, data, deadline, task);
-                // creates the requested tile
-                Tile *t = new Tile(producerId, level, tx, ty, task, data);
-                list<Tile*>::iterator li = unusedTilesOrder.insert(unusedTilesOrder.end(), t);
-                unusedTiles[id] = li;
-                if (deletedTile) {
-                    // if the tile data was not in storage and if the task to create it
-                    // was reused from a deleted tile, we need to reexecute the task
-                    // to recreate the tile data
-                    if (scheduler == NULL) {
-                        task->setIsDone(false, 0, Task::DATA_NEEDED);
-                    } else {
-                        scheduler->reschedule(task, Task::DATA_NEEDED, deadline);
-                    }
+            task = producers[producerId]->createTile(level, tx, ty, data, deadline, task);
+            // creates the requested tile
+            Tile *t = newTile(producerId, level, tx, ty, task, data);
+            tiles.insert(make_pair(id, t));
+            addUnusedTile(t);
+            if (deletedTile) {
+                // if the tile data was not in storage and if the task to create it
+                // was reused from a deleted tile, we need to reexecute the task
+                // to recreate the tile data
+                if (scheduler == NULL) {
+                    task->setIsDone(false, 0, Task::DATA_NEEDED);
+                } else {
+                    scheduler->reschedule(task, Task::DATA_NEEDED, deadline);
                 }
-                /*if (Logger::DEBUG_LOGGER != NULL) {
-                    ostringstream oss;
-                    oss << "tiles: " << usedTiles.size() << " used, " << unusedTiles.size() << " reusable";
-                    Logger::DEBUG_LOGGER->log("CACHE", oss.str());
-                }*/
             }
+            /*if (Logger::DEBUG_LOGGER != NULL) {
+                ostringstream oss;
+                oss << "tiles: " << getUsedTiles() << " used, " << unusedTileCount << " reusable";
+                Logger::DEBUG_LOGGER->log("CACHE", oss.str());
+            }*/
         }
     }
     pthread_mutex_unlock((pthread_mutex_t*) mutex);
@@ -315,18 +378,12 @@ int TileCache::putTile(Tile *t)
     t->users -= 1;
     if (t->users == 0) {
         // the tile is now unused
-        Tile::TId id = t->getTId();
-        // removes it from the used tiles list
-        map<Tile::TId, Tile*>::iterator i = usedTiles.find(id);
-        assert(i != usedTiles.end() && i->second == t);
-        usedTiles.erase(i);
+        assert(tiles.find(t->getTId()) != tiles.end() && tiles.find(t->getTId())->second == t);
         // adds it to the unused tiles list
-        assert(unusedTiles.find(id) == unusedTiles.end());
-        list<Tile*>::iterator li = unusedTilesOrder.insert(unusedTilesOrder.end(), t);
-        unusedTiles[id] = li;
+        addUnusedTile(t);
         /*if (Logger::DEBUG_LOGGER != NULL) {
             ostringstream oss;
-            oss << "tiles: " << usedTiles.size() << " used, " << unusedTiles.size() << " reusable";
+            oss << "tiles: " << getUsedTiles() << " used, " << unusedTileCount << " reusable";
             Logger::DEBUG_LOGGER->log("CACHE", oss.str());
         }*/
     }
@@ -337,11 +394,16 @@ int TileCache::putTile(Tile *t)
 
 void TileCache::invalidateTiles(int producerId)
 {
+    // the copies of the tiles produced from these tiles, in the second
+    // level caches, are no longer valid
+    invalidateDependentCopies(producerId);
     // marks the tasks to produce the tiles of the given producer as not done
     // so that they will be reexecuted when their result will be needed
     pthread_mutex_lock((pthread_mutex_t*) mutex);
-    map<Tile::TId, Tile*>::iterator i = usedTiles.begin();
-    while (i != usedTiles.end()) {
+    // the copies of these tiles in the second level caches are no longer valid
+    invalidateCopies(producerId);
+    map<Tile::TId, Tile*>::iterator i = tiles.begin();
+    while (i != tiles.end()) {
         if (i->second->producerId == producerId) {
             if (scheduler == NULL) {
                 i->second->task->setIsDone(false, 0, Task::DATA_CHANGED);
@@ -351,17 +413,6 @@ void TileCache::invalidateTiles(int producerId)
         }
         i++;
     }
-    list<Tile*>::iterator j = unusedTilesOrder.begin();;
-    while (j != unusedTilesOrder.end()) {
-        if ((*j)->producerId == producerId) {
-            if (scheduler == NULL) {
-                (*j)->task->setIsDone(false, 0, Task::DATA_CHANGED);
-            } else {
-                scheduler->reschedule((*j)->task, Task::DATA_CHANGED, 1u << 31u);
-            }
-        }
-        j++;
-    }
     map<Tile::TId, Task*>::iterator k = deletedTiles.begin();
     while (k != deletedTiles.end()) {
         if (k->first.first == producerId) {
@@ -380,40 +431,27 @@ void TileCache::invalidateTile(int producerId, int level, int tx, int ty)
 {
     Tile::TId id = TileCache::Tile::getTId(producerId, level, tx, ty);
 
+    // the copies of the tiles produced from this tile, in the second level
+    // caches, are no longer valid (the tiles that depend on a given tile are
+    // not known, so all the tiles of the dependent producers are removed)
+    invalidateDependentCopies(producerId);
     pthread_mutex_lock((pthread_mutex_t*) mutex);
-    map<Tile::TId, Tile*>::iterator i = usedTiles.begin();
-    while (i != usedTiles.end()) {
-        if (i->first == id) {
-            if (scheduler == NULL) {
-                i->second->task->setIsDone(false, 0, Task::DATA_CHANGED);
-            } else {
-                scheduler->reschedule(i->second->task, Task::DATA_CHANGED, 1u << 31u);
-            }
-        }
-        i++;
-    }
-
-    list<Tile*>::iterator j = unusedTilesOrder.begin();;
-    while (j != unusedTilesOrder.end()) {
-        if ((*j)->getTId() == id) {
-            if (scheduler == NULL) {
-                (*j)->task->setIsDone(false, 0, Task::DATA_CHANGED);
-            } else {
-                scheduler->reschedule((*j)->task, Task::DATA_CHANGED, 1u << 31u);
-            }
+    invalidateCopy(producerId, level, tx, ty);
+    map<Tile::TId, Tile*>::iterator i = tiles.find(id);
+    if (i != tiles.end()) {
+        if (scheduler == NULL) {
+            i->second->task->setIsDone(false, 0, Task::DATA_CHANGED);
+        } else {
+            scheduler->reschedule(i->second->task, Task::DATA_CHANGED, 1u << 31u);
         }
-        j++;
     }
-    map<Tile::TId, Task*>::iterator k = deletedTiles.begin();
-    while (k != deletedTiles.end()) {
-        if (k->first == id) {
-            if (scheduler == NULL) {
-                k->second->setIsDone(false, 0, Task::DATA_CHANGED);
-            } else {
-                scheduler->reschedule(k->second, Task::DATA_CHANGED, 1u << 31u);
-            }
+    map<Tile::TId, Task*>::iterator k = deletedTiles.find(id);
+    if (k != deletedTiles.end()) {
+        if (scheduler == NULL) {
+            k->second->setIsDone(false, 0, Task::DATA_CHANGED);
+        } else {
+            scheduler->reschedule(k->second, Task::DATA_CHANGED, 1u << 31u);
         }
-        k++;
     }
     pthread_mutex_unlock((pthread_mutex_t*) mutex);
 }
@@ -422,6 +460,50 @@ void TileCache::swap(ptr<TileCache> t)
 {
 }
 
+TileCache::Tile *TileCache::newTile(int producerId, int level, int tx, int ty, ptr<Task> task, TileStorage::Slot *data)
+{
+    assert(!freeTiles.empty());
+    void *p = freeTiles.back();
+    freeTiles.pop_back();
+    return new (p) Tile(producerId, level, tx, ty, task, data);
+}
+
+void TileCache::deleteTile(Tile *t)
+{
+    t->~Tile();
+    freeTiles.push_back(t);
+}
+
+void TileCache::addUnusedTile(Tile *t)
+{
+    t->prev = lastUnusedTile;
+    t->next = NULL;
+    if (lastUnusedTile == NULL) {
+        firstUnusedTile = t;
+    } else {
+        lastUnusedTile->next = t;
+    }
+    lastUnusedTile = t;
+    ++unusedTileCount;
+}
+
+void TileCache::removeUnusedTile(Tile *t)
+{
+    if (t->prev == NULL) {
+        firstUnusedTile = t->next;
+    } else {
+        t->prev->next = t->next;
+    }
+    if (t->next == NULL) {
+        lastUnusedTile = t->prev;
+    } else {
+        t->next->prev = t->prev;
+    }
+    t->prev = NULL;
+    t->next = NULL;
+    --unusedTileCount;
+}
+
 void TileCache::createTileTaskDeleted(int producerId, int level, int tx, int ty)
 {
     Tile::TId id = Tile::getTId(producerId, level, tx, ty);
@@ -433,6 +515,113 @@ void TileCache::createTileTaskDeleted(int producerId, int level, int tx, int ty)
     pthread_mutex_unlock((pthread_mutex_t*) mutex);
 }
 
+TileStorage::Slot *TileCache::evictTile()
+{
+    Tile *t = firstUnusedTile;
+    assert(t != NULL);
+    TileStorage::Slot *data = t->data;
+    assert(data != NULL);
+    if ((compressedCache != NULL || diskCache != NULL) && t->task->isDone() && data->id == t->getTId()) {
+        // saves the tile data before reusing its storage, so that the tile
+        // can be read back instead of being produced again
+        void *buffer;
+        int size = storage->getSlotData(data, &buffer);
+        if (size > 0) {
+            if (compressedCache != NULL) {
+                compressedCache->writeTile(id, t->producerId, t->level, t->tx, t->ty, buffer, size);
+            }
+            if (diskCache != NULL) {
+                diskCache->writeTile(id, t->producerId, t->level, t->tx, t->ty, buffer, size);
+            }
+        }
+    }
+    removeUnusedTile(t);
+    tiles.erase(t->getTId());
+    deletedTiles.insert(make_pair(t->getTId(), t->task.get()));
+    deleteTile(t);
+    return data;
+}
+
+bool TileCache::readTile(int producerId, int level, int tx, int ty, TileStorage::Slot *data)
+{
+    if (compressedCache == NULL && diskCache == NULL) {
+        return false;
+    }
+    void *buffer;
+    int size = storage->getSlotData(data, &buffer);
+    if (size == 0) {
+        return false;
+    }
+    if (compressedCache != NULL && compressedCache->readTile(id, producerId, level, tx, ty, buffer, size)) {
+        return true;
+    }
+    return diskCache != NULL && diskCache->readTile(id, producerId, level, tx, ty, buffer, size);
+}
+
+void TileCache::invalidateCopies(int producerId)
+{
+    if (compressedCache != NULL) {
+        compressedCache->invalidateTiles(id, producerId);
+    }
+    if (diskCache != NULL) {
+        diskCache->invalidateTiles(id, producerId);
+    }
+}
+
+void TileCache::invalidateCopy(int producerId, int level, int tx, int ty)
+{
+    if (compressedCache != NULL) {
+        compressedCache->invalidateTile(id, producerId, level, tx, ty);
+    }
+    if (diskCache != NULL) {
+        diskCache->invalidateTile(id, producerId, level, tx, ty);
+    }
+}
+
+void TileCache::invalidateDependentCopies(int producerId)
+{
+    pthread_mutex_lock(&cachesMutex);
+    if (!cachesWithCopies.empty()) {
+        pthread_mutex_lock((pthread_mutex_t*) mutex);
+        map<int, TileProducer*>::iterator i = producers.find(producerId);
+        TileProducer *p = i == producers.end() ? NULL : i->second;
+        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+        if (p != NULL) {
+            set<TileCache*>::iterator c = cachesWithCopies.begin();
+            while (c != cachesWithCopies.end()) {
+                TileCache *cache = *c;
+                vector<int> dependents;
+                pthread_mutex_lock((pthread_mutex_t*) cache->mutex);
+                map<int, TileProducer*>::iterator j = cache->producers.begin();
+                while (j != cache->producers.end()) {
+                    set<TileProducer*> visited;
+                    if (j->second != p && dependsOn(j->second, p, visited)) {
+                        dependents.push_back(j->first);
+                    }
+                    j++;
+                }
+                pthread_mutex_unlock((pthread_mutex_t*) cache->mutex);
+                for (unsigned int k = 0; k < dependents.size(); ++k) {
+                    cache->invalidateCopies(dependents[k]);
+                }
+                c++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&cachesMutex);
+}
+
+void TileCache::updateCopiesRegistration()
+{
+    pthread_mutex_lock(&cachesMutex);
+    if (compressedCache != NULL || diskCache != NULL) {
+        cachesWithCopies.insert(this);
+    } else {
+        cachesWithCopies.erase(this);
+    }
+    pthread_mutex_unlock(&cachesMutex);
+}
+
 class TileCacheResource : public ResourceTemplate<1, TileCache>
 {
 public:
@@ -442,7 +631,9 @@ public:
         e = e == NULL ? desc->descriptor : e;
         ptr<TileStorage> storage;
         ptr<Scheduler> scheduler;
-        checkParameters(desc, e, "name,storage,scheduler,");
+        ptr<DiskTileCache> diskCache;
+        ptr<CompressedTileCache> compressedCache;
+        checkParameters(desc, e, "name,storage,scheduler,diskCache,compressedCache,");
         if (e->Attribute("storage") != NULL) {
             string id = getParameter(desc, e, "storage");
             storage = manager->loadResource(id).cast<TileStorage>();
@@ -459,7 +650,15 @@ public:
         }
         string id = getParameter(desc, e, "scheduler");
         scheduler = manager->loadResource(id).cast<Scheduler>();
+        if (e->Attribute("diskCache") != NULL) {
+            diskCache = manager->loadResource(getParameter(desc, e, "diskCache")).cast<DiskTileCache>();
+        }
+        if (e->Attribute("compressedCache") != NULL) {
+            compressedCache = manager->loadResource(getParameter(desc, e, "compressedCache")).cast<CompressedTileCache>();
+        }
         init(storage, name, scheduler);
+        setDiskCache(diskCache);
+        setCompressedCache(compressedCache);
     }
 };
 
@@ -33,6 +33,8 @@
 #include <string>
 
 #include "ork/taskgraph/Scheduler.h"
+#include "proland/producer/CompressedTileCache.h"
+#include "proland/producer/DiskTileCache.h"
 #include "proland/producer/TileStorage.h"
 
 using namespace ork;
@@ -184,6 +186,18 @@ public:
          */
         int users;
 
+        /**
+         * The previous tile in the list of unused tiles of the TileCache, if
+         * this tile is unused.
+         */
+        Tile *prev;
+
+        /**
+         * The next tile in the list of unused tiles of the TileCache, if
+         * this tile is unused.
+         */
+        Tile *next;
+
         friend class TileCache;
 
         friend class CreateTile;
@@ -215,6 +229,39 @@ public:
      */
     ptr<Scheduler> getScheduler();
 
+    /**
+     * Returns the second level cache used to store the tiles evicted from
+     * this cache. May be NULL.
+     */
+    ptr<DiskTileCache> getDiskCache();
+
+    /**
+     * Sets the second level cache used to store the tiles evicted from this
+     * cache. This is only possible if the storage of this cache gives a raw
+     * access to its tiles data (see TileStorage#getSlotData).
+     *
+     * @param diskCache a second level cache, or NULL to disable it.
+     */
+    void setDiskCache(ptr<DiskTileCache> diskCache);
+
+    /**
+     * Returns the second level cache used to store the tiles evicted from
+     * this cache in compressed form. May be NULL.
+     */
+    ptr<CompressedTileCache> getCompressedCache();
+
+    /**
+     * Sets the second level cache used to store the tiles evicted from this
+     * cache in compressed form. This is only possible if the storage of
+     * this cache gives a raw access to its tiles data (see
+     * TileStorage#getSlotData). If a disk cache is also used, the evicted
+     * tiles are stored in both caches, and the compressed cache is looked
+     * up first.
+     *
+     * @param compressedCache a second level cache, or NULL to disable it.
+     */
+    void setCompressedCache(ptr<CompressedTileCache> compressedCache);
+
     /**
      * Returns the number of tiles currently in use in this cache.
      */
@@ -333,7 +380,12 @@ protected:
     void swap(ptr<TileCache> c);
 
 private:
-    typedef std::map<Tile::TId, std::list<Tile*>::iterator> Cache;
+    /**
+     * A unique identifier of this cache. Used to identify the tiles of this
+     * cache in second level caches, which can be shared between several
+     * TileCache.
+     */
+    int id;
 
     /**
      * Next local identifier to be used for a TileProducer using this cache.
@@ -358,23 +410,43 @@ private:
     ptr<Scheduler> scheduler;
 
     /**
-     * The tiles currently in use. These tiles cannot be evicted from the cache
-     * and from the TileStorage, until they become unused. Maps tile identifiers
-     * to actual tiles.
+     * The second level cache to store the tiles evicted from this cache.
+     * May be NULL.
+     */
+    ptr<DiskTileCache> diskCache;
+
+    /**
+     * The second level cache to store the tiles evicted from this cache in
+     * compressed form. May be NULL.
+     */
+    ptr<CompressedTileCache> compressedCache;
+
+    /**
+     * The tiles currently in storage, used or unused. The tiles in use (i.e.,
+     * with at least one user) cannot be evicted from the cache and from the
+     * TileStorage, until they become unused. The unused tiles can be evicted
+     * from the cache at any moment. Maps tile identifiers to actual tiles.
+     * Used and unused tiles are stored in the same map so that a tile can
+     * become used or unused without any memory allocation.
+     */
+    std::map<Tile::TId, Tile*> tiles;
+
+    /**
+     * The least recently used unused tile. The unused tiles are ordered by
+     * date of last use (to implement a LRU cache) in a doubly linked list,
+     * using Tile#prev and Tile#next.
      */
-    std::map<Tile::TId, Tile*> usedTiles;
+    Tile *firstUnusedTile;
 
     /**
-     * The unused tiles. These tiles can be evicted from the cache at any
-     * moment. Maps tile identifiers to positions in the ordered list of tiles
-     * #unusedTilesOrder (used to implement a LRU cache).
+     * The most recently used unused tile. See #firstUnusedTile.
      */
-    Cache unusedTiles;
+    Tile *lastUnusedTile;
 
     /**
-     * The unused tiles, ordered by date of last use (to implement a LRU cache).
+     * The number of unused tiles.
      */
-    std::list<Tile*> unusedTilesOrder;
+    int unusedTileCount;
 
     /**
      * The tasks to produce the data of deleted tiles. When an unused tile is
@@ -410,11 +482,103 @@ private:
      */
     void* mutex;
 
+    /**
+     * The memory block used to store the Tile objects. Since each tile
+     * uses its own slot in #storage, the number of tiles is bounded by the
+     * storage capacity, and this block has room for this many tiles.
+     */
+    unsigned char *tilePool;
+
+    /**
+     * The free locations in #tilePool.
+     */
+    std::vector<void*> freeTiles;
+
+    /**
+     * Creates a new tile in #tilePool. See Tile#Tile.
+     */
+    Tile *newTile(int producerId, int level, int tx, int ty, ptr<Task> task, TileStorage::Slot *data);
+
+    /**
+     * Deletes a tile created with #newTile.
+     */
+    void deleteTile(Tile *t);
+
+    /**
+     * Adds a tile at the end of the list of unused tiles.
+     */
+    void addUnusedTile(Tile *t);
+
+    /**
+     * Removes a tile from the list of unused tiles.
+     */
+    void removeUnusedTile(Tile *t);
+
     /**
      * Notifies this TileCache that a tile creation task has been deleted.
      */
     void createTileTaskDeleted(int producerId, int level, int tx, int ty);
 
+    /**
+     * Evicts the least recently used unused tile, and copies it to the
+     * #compressedCache and #diskCache, if any.
+     *
+     * @return the storage used by the evicted tile.
+     */
+    TileStorage::Slot *evictTile();
+
+    /**
+     * Reads the data of a tile from the #compressedCache or from the
+     * #diskCache, if possible.
+     *
+     * @param producerId the id of the tile's %producer.
+     * @param level the tile's quadtree level.
+     * @param tx the tile's quadtree x coordinate.
+     * @param ty the tile's quadtree y coordinate.
+     * @param data where the tile data must be copied.
+     * @return true if the tile data was found in a second level cache.
+     */
+    bool readTile(int producerId, int level, int tx, int ty, TileStorage::Slot *data);
+
+    /**
+     * Removes the tiles of the given %producer from the #compressedCache
+     * and from the #diskCache, if any.
+     *
+     * @param producerId the id of a producer using this cache.
+     */
+    void invalidateCopies(int producerId);
+
+    /**
+     * Removes a tile from the #compressedCache and from the #diskCache, if
+     * any.
+     *
+     * @param producerId the id of the tile's %producer.
+     * @param level the tile's quadtree level.
+     * @param tx the tile's quadtree x coordinate.
+     * @param ty the tile's quadtree y coordinate.
+     */
+    void invalidateCopy(int producerId, int level, int tx, int ty);
+
+    /**
+     * Removes from the second level caches the tiles of the producers that
+     * depend, directly or indirectly, on the given %producer (see
+     * TileProducer#getReferencedProducers), in any TileCache. This must be
+     * called when some tiles of this %producer change, because the tiles
+     * produced from them become invalid. Only the tiles in second level
+     * caches need to be removed here: the tiles in TileStorage are
+     * invalidated via their task dependencies.
+     *
+     * @param producerId the id of a producer using this cache.
+     */
+    void invalidateDependentCopies(int producerId);
+
+    /**
+     * Registers or unregisters this cache in the list of caches that have
+     * second level caches, depending on whether it has a #compressedCache
+     * or a #diskCache or not. See #invalidateDependentCopies.
+     */
+    void updateCopiesRegistration();
+
     friend class TileProducer;
 
     friend class CreateTile;
@@ -209,7 +209,10 @@ public:
             // from the cache between the creation and the execution of the
             // task). In this case we do not execute the task, otherwise it
             // could override data already produced for the reaffected tile.
-            changes = owner->doCreateTile(level, tx, ty, data);
+            if (!owner->cache->readTile(owner->getId(), level, tx, ty, data)) {
+                // the tile is not in the second level caches, it must be produced
+                changes = owner->doCreateTile(level, tx, ty, data);
+            }
             data->id = TileCache::Tile::getTId(owner->getId(), level, tx, ty);
         }
         data->lock(false);
@@ -244,6 +247,13 @@ public:
         if (done) {
             // releases the tiles used to create this tile, if necessary
             stop();
+        } else if (r == DATA_CHANGED || r == DEPENDENCY_CHANGED) {
+            // the tile must be produced again, because it or one of the tiles
+            // it depends on changed, so its copy in the second level cache,
+            // if any, is no longer valid
+            if (owner != NULL && owner->cache != NULL) {
+                owner->cache->invalidateCopy(owner->getId(), level, tx, ty);
+            }
         } else if (r == DATA_NEEDED) {
             // the task will need to be reexecuted soon (this is not the case
             // if the reason is DATA_CHANGED - when invalidating tiles, see
@@ -382,6 +392,8 @@ TileProducer::~TileProducer()
     map<int, TileProducer*>::iterator i = cache->producers.find(id);
     assert(i != cache->producers.end());
     cache->producers.erase(i);
+    // the tiles of this producer in the second level caches can no longer be used
+    cache->invalidateCopies(id);
     for (int i = 0; i < (int) tasks.size(); i++) {
         CreateTile *t = dynamic_cast<CreateTile*>(tasks[i]);
         if (t != NULL) {
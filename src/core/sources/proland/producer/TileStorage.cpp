@@ -119,4 +119,9 @@ int TileStorage::getFreeSlots()
     return (int) freeSlots.size();
 }
 
+int TileStorage::getSlotData(Slot *s, void **data)
+{
+    return 0;
+}
+
 }
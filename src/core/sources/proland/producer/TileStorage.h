@@ -181,6 +181,18 @@ public:
      */
     int getFreeSlots();
 
+    /**
+     * Returns the raw data of the given slot, if this storage stores each
+     * tile in a contiguous array in CPU memory. This is used to copy tiles
+     * to and from a DiskTileCache. The default implementation returns 0.
+     *
+     * @param s a slot managed by this TileStorage.
+     * @param[out] data the address of the slot data.
+     * @return the size in bytes of the slot data, or 0 if this storage does
+     *      not give a raw access to its tiles data.
+     */
+    virtual int getSlotData(Slot *s, void **data);
+
 protected:
     /**
      * The size of each tile. For tiles made of raster data, this size is the
@@ -0,0 +1,121 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "proland/util/checksum.h"
+
+#include "ork/core/Object.h"
+
+using namespace ork;
+
+namespace proland
+{
+
+/**
+ * The magic number at the end of a checksum table ("CRCS").
+ */
+static const unsigned int CHECKSUMS_MAGIC = 0x53435243;
+
+/**
+ * The tables used to compute CRC-32 checksums sixteen bytes at a time
+ * ("slicing-by-16"). table[0] is the classical byte-wise table, and
+ * table[k][i] is the CRC of byte i followed by k zero bytes.
+ */
+static struct CrcTables
+{
+    unsigned int table[16][256];
+
+    CrcTables()
+    {
+        for (unsigned int i = 0; i < 256; ++i) {
+            unsigned int c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) != 0 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            table[0][i] = c;
+        }
+        for (unsigned int i = 0; i < 256; ++i) {
+            for (int k = 1; k < 16; ++k) {
+                unsigned int c = table[k - 1][i];
+                table[k][i] = table[0][c & 0xFF] ^ (c >> 8);
+            }
+        }
+    }
+} crcTables;
+
+unsigned int checksum(const void *data, int size, unsigned int crc)
+{
+    const unsigned int (*t)[256] = crcTables.table;
+    const unsigned char *p = (const unsigned char*) data;
+    crc = ~crc;
+    while (size >= 16) {
+        unsigned int a = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24));
+        unsigned int b = p[4] | (p[5] << 8) | (p[6] << 16) | ((unsigned int) p[7] << 24);
+        unsigned int c = p[8] | (p[9] << 8) | (p[10] << 16) | ((unsigned int) p[11] << 24);
+        unsigned int d = p[12] | (p[13] << 8) | (p[14] << 16) | ((unsigned int) p[15] << 24);
+        crc = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^ t[13][(a >> 16) & 0xFF] ^ t[12][a >> 24] ^
+            t[11][b & 0xFF] ^ t[10][(b >> 8) & 0xFF] ^ t[9][(b >> 16) & 0xFF] ^ t[8][b >> 24] ^
+            t[7][c & 0xFF] ^ t[6][(c >> 8) & 0xFF] ^ t[5][(c >> 16) & 0xFF] ^ t[4][c >> 24] ^
+            t[3][d & 0xFF] ^ t[2][(d >> 8) & 0xFF] ^ t[1][(d >> 16) & 0xFF] ^ t[0][d >> 24];
+        p += 16;
+        size -= 16;
+    }
+    while (size > 0) {
+        crc = t[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        --size;
+    }
+    return ~crc;
+}
+
+bool writeChecksums(FILE *f, const unsigned int *checksums, int ntiles)
+{
+    bool ok = fwrite(checksums, sizeof(unsigned int) * ntiles, 1, f) == 1;
+    ok = ok && fwrite(&ntiles, sizeof(int), 1, f) == 1;
+    ok = ok && fwrite(&CHECKSUMS_MAGIC, sizeof(unsigned int), 1, f) == 1;
+    return ok;
+}
+
+unsigned int *readChecksums(FILE *f, int ntiles)
+{
+    int n;
+    unsigned int magic;
+    fseek64(f, -(long long) (sizeof(int) + sizeof(unsigned int)), SEEK_END);
+    if (fread(&n, sizeof(int), 1, f) != 1 || fread(&magic, sizeof(unsigned int), 1, f) != 1) {
+        return NULL;
+    }
+    if (magic != CHECKSUMS_MAGIC || n != ntiles || ntiles <= 0) {
+        return NULL;
+    }
+    unsigned int *checksums = new unsigned int[ntiles];
+    fseek64(f, -(long long) (sizeof(unsigned int) * ntiles + sizeof(int) + sizeof(unsigned int)), SEEK_END);
+    if (fread(checksums, sizeof(unsigned int) * ntiles, 1, f) != 1) {
+        delete[] checksums;
+        return NULL;
+    }
+    return checksums;
+}
+
+}
@@ -0,0 +1,81 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _PROLAND_CHECKSUM_H_
+#define _PROLAND_CHECKSUM_H_
+
+#include <cstdio>
+
+namespace proland
+{
+
+/**
+ * Returns the CRC-32 checksum of the given data (with the polynomial used
+ * by zlib, PNG, etc). The checksum of data split in several parts can be
+ * computed incrementally, by passing the checksum of the previous parts
+ * in 'crc'.
+ * @ingroup proland_util
+ *
+ * @param data the data whose checksum must be computed.
+ * @param size the size of data, in bytes.
+ * @param crc the checksum of the previous parts of the data, or 0.
+ */
+PROLAND_API unsigned int checksum(const void *data, int size, unsigned int crc = 0);
+
+/**
+ * Writes a table of tile checksums at the current position of a tile file
+ * (such as the files produced by the terrain preprocessing tools). This
+ * table must be written at the end of the file, after the tile data, so
+ * that it is ignored by readers that do not check tiles. It contains the
+ * checksum of the stored (i.e., compressed) data of each tile, in tile id
+ * order, followed by the number of tiles and by a magic number.
+ * @ingroup proland_util
+ *
+ * @param f a tile file opened for writing.
+ * @param checksums the checksum of each tile. See #checksum.
+ * @param ntiles the number of tiles in the file.
+ * @return true if the table was successfully written.
+ */
+PROLAND_API bool writeChecksums(FILE *f, const unsigned int *checksums, int ntiles);
+
+/**
+ * Reads the table of tile checksums written at the end of a tile file
+ * with #writeChecksums.
+ * @ingroup proland_util
+ *
+ * @param f a tile file opened for reading. Its current position is
+ *      undefined after this call.
+ * @param ntiles the number of tiles in the file.
+ * @return the checksum of each tile, to be deleted by the caller with
+ *      delete[], or NULL if the file does not have a checksum table for
+ *      ntiles tiles.
+ */
+PROLAND_API unsigned int *readChecksums(FILE *f, int ntiles);
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "proland/util/parallel.h"
+
+#include <vector>
+#include <pthread.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace proland
+{
+
+/**
+ * The state shared by the threads executing a parallelFor loop.
+ */
+struct ParallelLoop
+{
+    ParallelLoopBody body;
+
+    void *context;
+
+    int next;
+
+    int end;
+
+    int grain;
+
+    pthread_mutex_t mutex;
+};
+
+static void *parallelLoopThread(void *arg)
+{
+    ParallelLoop *loop = (ParallelLoop*) arg;
+    while (true) {
+        pthread_mutex_lock(&loop->mutex);
+        int begin = loop->next;
+        loop->next = begin < loop->end - loop->grain ? begin + loop->grain : loop->end;
+        int end = loop->next;
+        pthread_mutex_unlock(&loop->mutex);
+        if (begin >= end) {
+            break;
+        }
+        loop->body(loop->context, begin, end);
+    }
+    return NULL;
+}
+
+static pthread_once_t processorCountInitialized = PTHREAD_ONCE_INIT;
+
+static int processorCount = 1;
+
+static void initProcessorCount()
+{
+#if defined(_WIN32) || defined(_WIN64)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    int n = (int) info.dwNumberOfProcessors;
+#else
+    int n = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    processorCount = n > 0 ? n : 1;
+}
+
+int getProcessorCount()
+{
+    // pthread_once since this can be called concurrently for the first time
+    pthread_once(&processorCountInitialized, initProcessorCount);
+    return processorCount;
+}
+
+void parallelFor(int begin, int end, ParallelLoopBody body, void *context, int grain, int threadCount)
+{
+    if (begin >= end) {
+        return;
+    }
+    if (grain < 1) {
+        grain = 1;
+    }
+    if (threadCount <= 0) {
+        threadCount = getProcessorCount();
+    }
+    int chunks = (end - begin + grain - 1) / grain;
+    if (threadCount > chunks) {
+        threadCount = chunks;
+    }
+    if (threadCount <= 1) {
+        body(context, begin, end);
+        return;
+    }
+
+    ParallelLoop loop;
+    loop.body = body;
+    loop.context = context;
+    loop.next = begin;
+    loop.end = end;
+    loop.grain = grain;
+    pthread_mutex_init(&loop.mutex, NULL);
+
+    vector<pthread_t> threads;
+    for (int i = 1; i < threadCount; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, parallelLoopThread, &loop) == 0) {
+            threads.push_back(thread);
+        }
+    }
+    // the calling thread also executes iterations; if no thread could be
+    // created the loop is simply executed sequentially
+    parallelLoopThread(&loop);
+    for (unsigned int i = 0; i < threads.size(); ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&loop.mutex);
+}
+
+}
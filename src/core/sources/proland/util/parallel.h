@@ -0,0 +1,81 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _PROLAND_PARALLEL_H_
+#define _PROLAND_PARALLEL_H_
+
+namespace proland
+{
+
+/**
+ * A loop body executed by #parallelFor. This function must process the
+ * iterations in the range [begin,end[. It can be called concurrently from
+ * several threads, with disjoint ranges.
+ * @ingroup proland_util
+ *
+ * @param context the user data passed to #parallelFor.
+ * @param begin the first iteration to process.
+ * @param end the iteration after the last one to process.
+ */
+typedef void (*ParallelLoopBody)(void *context, int begin, int end);
+
+/**
+ * Returns the number of processors available on this computer.
+ * @ingroup proland_util
+ */
+PROLAND_API int getProcessorCount();
+
+/**
+ * Executes the iterations [begin,end[ of a loop in parallel. The iterations
+ * are split in chunks of 'grain' iterations, which are dynamically dispatched
+ * to 'threadCount' threads (including the calling thread). This function
+ * returns when all the iterations have been executed. It is intended for
+ * CPU intensive precomputations (noise textures, patterns, etc) that are not
+ * executed through the ork::Scheduler.
+ *
+ * Each call creates and joins threadCount-1 new threads. This function must
+ * therefore not be called with threadCount different from 1 from tasks
+ * executed by the ork::Scheduler: these tasks already run in parallel on
+ * the scheduler threads, and each of them would start its own threads,
+ * leading to much more threads than processors.
+ * @ingroup proland_util
+ *
+ * @param begin the first iteration of the loop.
+ * @param end the iteration after the last one of the loop.
+ * @param body the loop body.
+ * @param context an arbitrary user data passed to each call of 'body'.
+ * @param grain the number of consecutive iterations executed in each call
+ *      to 'body'.
+ * @param threadCount the maximum number of threads to use, or 0 to use one
+ *      thread per processor. 1 means that the loop is executed sequentially
+ *      in the calling thread.
+ */
+PROLAND_API void parallelFor(int begin, int end, ParallelLoopBody body, void *context, int grain = 1, int threadCount = 0);
+
+}
+
+#endif
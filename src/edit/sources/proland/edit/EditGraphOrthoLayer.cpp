@@ -37,6 +37,8 @@
 
 #define INF 1e9
 
+#define MAX_PROXIMITY_INDEXES 8
+
 using namespace ork;
 
 namespace proland
@@ -112,15 +114,10 @@ EditGraphOrthoLayer::EditGraphHandler::~EditGraphHandler()
 {
 }
 
-//TODO : Choix appliquer a tous graphs ou juste graph edition
 bool EditGraphOrthoLayer::EditGraphHandler::undo()
 {
-    if (prevPos.z == 1.f) {
-        editor->movePoint(prevPos.x, prevPos.y);
-        update();
-        return true;
-    }
-    return false;
+    prevPos.z = 0.f;
+    return editor->undo();
 }
 
 void EditGraphOrthoLayer::EditGraphHandler::redisplay(double t, double dt)
@@ -228,6 +225,7 @@ bool EditGraphOrthoLayer::EditGraphHandler::mouseClick(button b, state s, modifi
                         }
                         prevPos = vec3d(v.x, v.y, 1.0f);
                     }
+                    editor->beginEditGroup();
                     if ((m & CTRL) == 0) {
                         mode = EDIT_MODE;
                     } else {
@@ -302,6 +300,7 @@ bool EditGraphOrthoLayer::EditGraphHandler::mouseClick(button b, state s, modifi
             if (res) {
                 update();
             }
+            editor->endEditGroup();
             edited = false;
             mode = DEFAULT_MODE;
             return res;
@@ -522,6 +521,9 @@ bool EditGraphOrthoLayer::EditGraphHandler::keyTyped(unsigned char c, modifier m
         return true;
     } else if (c == 'z') {
         return undo();
+    } else if (c == 'y') {
+        prevPos.z = 0.f;
+        return editor->redo();
     } else if (c == 'j') {
         vec3d v = getWorldCoordinates(x, y);
         if (Logger::INFO_LOGGER != NULL) {
@@ -613,6 +615,7 @@ void EditGraphOrthoLayer::EditGraphHandler::update()
     if (edited == false) {
         prevPos.z = 0.f;
     }
+    editor->recordChanges();
     editor->invalidateTiles();
     if (editor->editedGraph != -1) {
         editor->HANDLER->selectedCurveData.editor = editor;
@@ -636,7 +639,7 @@ void EditGraphOrthoLayer::getTypeNames(vector<string> &typeNames)
 static_ptr<EditGraphOrthoLayer::EditGraphHandlerList> EditGraphOrthoLayer::HANDLER(NULL);
 
 EditGraphOrthoLayer::EditGraphOrthoLayer() :
-    TileLayer("EditGraphOrthoLayer")
+    TileLayer("EditGraphOrthoLayer"), proximityIndexesTime(0)
 {
 }
 
@@ -654,6 +657,7 @@ ptr<EventHandler> EditGraphOrthoLayer::getEventHandler()
 void EditGraphOrthoLayer::init(const vector< ptr<GraphProducer> > &graphs, ptr<Program> layerProg, int displayLevel, float tolerance, bool softEdition, double softEditionDelay, bool deform, string terrain, ptr<ResourceManager> manager)
 {
     TileLayer::init(deform);
+    proximityIndexesTime = 0;
     defaultCurveType = 0;
     defaultCurveWidth = 7.0f;
     selectedCurve = NULL;
@@ -679,6 +683,9 @@ void EditGraphOrthoLayer::init(const vector< ptr<GraphProducer> > &graphs, ptr<P
     HANDLER->addHandler(this, new EditGraphHandler(this, manager, terrain));
     this->softEdition = softEdition;
     this->softEditionDelay = softEditionDelay;
+    this->undoLevels = 64;
+    this->editGroup = 0;
+    this->editGroupOpen = false;
 }
 
 EditGraphOrthoLayer::~EditGraphOrthoLayer()
@@ -975,6 +982,7 @@ void EditGraphOrthoLayer::setEditedGraph(int index)
 {
     if (index != editedGraph) {
         editedGraph = index;
+        clearHistory();
         if (editGraph != NULL) {
             set<TileCache::Tile::Id>::iterator i = usedTiles.begin();
             while (i != usedTiles.end()) {
@@ -1015,7 +1023,9 @@ bool EditGraphOrthoLayer::select(double x, double y, float tolerance)
     if (x == INF) {
         return false;
     }
-    return select(x, y, tolerance, selectedGraph, selectedArea, selectedCurve, selectedSegment, selectedPoint);
+    bool res = select(x, y, tolerance, selectedGraph, selectedArea, selectedCurve, selectedSegment, selectedPoint);
+    saveCurveStates();
+    return res;
 }
 
 bool EditGraphOrthoLayer::selection()
@@ -1035,6 +1045,7 @@ void EditGraphOrthoLayer::setSelection(CurvePtr curve, int point, int segment)
     selectedCurve = curve;
     selectedPoint = point;
     selectedSegment = segment;
+    saveCurveStates();
 }
 
 bool EditGraphOrthoLayer::select(double x, double y, float tolerance, GraphPtr &graph, list<AreaId> &areas, CurvePtr &curve, int &segment, int &point)
@@ -1052,82 +1063,53 @@ bool EditGraphOrthoLayer::select(double x, double y, float tolerance, GraphPtr &
 
 bool EditGraphOrthoLayer::findCurve(GraphPtr p, double x, double y, float tolerance, GraphPtr &graph, list<AreaId> &areas, CurvePtr &curve, int &segment, int &point)
 {
-    ptr<Graph::CurveIterator> ci = p->getCurves();
-    while (ci->hasNext()) {
-        CurvePtr cp = ci->next();
-        for (int i = 0; i < cp->getSize(); i++) {
-            vec2d pt = cp->getXY(i);
-            if (abs(x - pt.x) < tolerance && abs(y - pt.y) < tolerance) {
-                graph = p->getAncestor();
-                curve = cp->getAncestor();
-                point = curve->getVertex(pt);
-                if (point == -1) {
-                    return false;
-                }
-                assert(point != -1);
-
-                //if (Logger::INFO_LOGGER != NULL) {
-                //    ostringstream msg;
-                //    msg << "Selected curve : " << selectedCurve->getId().id << " - Node " << selectedPoint;
-                //    Logger::INFO_LOGGER->log("GRAPHEDITOR", msg.str());
-                //}
-                //printf("Selected Curve : %d - Node %d\n", selectedCurve->getId().id, selectedPoint);
-                return true;
+    return getProximityIndex(p, NULL)->find(x, y, tolerance, graph, areas, curve, segment, point);
+}
+
+ptr<GraphProximityIndex> EditGraphOrthoLayer::getProximityIndex(GraphPtr p, TileCache::Tile *t)
+{
+    // removes the indexes of the tile graphs that have been replaced
+    map<Graph*, ProximityIndex>::iterator i = proximityIndexes.begin();
+    while (i != proximityIndexes.end()) {
+        TileCache::Tile::Id id = i->second.tile;
+        if (i->first != p.get() && id.first >= 0) {
+            TileCache::Tile *u = editGraph == NULL ? NULL : editGraph->findTile(id.first, id.second.first, id.second.second, true);
+            if (u == NULL || getTileGraph(u).get() != i->first) {
+                proximityIndexes.erase(i++);
+                continue;
             }
         }
+        ++i;
     }
-    ci = p->getCurves();
-    while (ci->hasNext()) {
-        CurvePtr cp = ci->next();
-        vec2d cur;
-        vec2d next = cp->getXY(0);
-        for (int i = 0; i < cp->getSize(); i++) {
-            cur = next;
-            next = cp->getXY(i + 1);
-            seg2d ab = seg2d(cur, next);
-            if (ab.segmentDistSq(vec2d(x, y)) < tolerance*tolerance) {
-                graph = p->getAncestor();
-                curve = cp->getAncestor();
-                segment = curve->getVertex(cp->getXY(i));
-                int p1 = curve->getVertex(cur);
-                int p2 = curve->getVertex(next);
-                segment = min(p1, p2);
-                if (curve->getStart() == curve->getEnd()) {
-                    if (min(p1, p2) == 0 && max(p1, p2) != 1) {
-                        segment = max(p1, p2);
-                    }
-                }
-                if (segment == -1) {
-                    return false;
+
+    i = proximityIndexes.find(p.get());
+    if (i == proximityIndexes.end()) {
+        // the indexes keep their graph in memory, so only a few ones are kept
+        while (proximityIndexes.size() >= MAX_PROXIMITY_INDEXES) {
+            map<Graph*, ProximityIndex>::iterator lru = proximityIndexes.begin();
+            for (i = proximityIndexes.begin(); i != proximityIndexes.end(); ++i) {
+                if (i->second.lastUse < lru->second.lastUse) {
+                    lru = i;
                 }
-                assert(segment != -1);
-
-                //if (Logger::INFO_LOGGER != NULL) {
-                //    ostringstream msg;
-                //    msg << "Selected curve : " << selectedCurve->getId().id << " - Segment " << selectedSegment;
-                //    Logger::INFO_LOGGER->log("GRAPHEDITOR", msg.str());
-                //}
-                //printf("Selected Curve : %d - Segment %d\n", selectedCurve->getId().id, selectedSegment);
-                return true;
-            }
-        }
-    }
-    ptr<Graph::AreaIterator> ca = p->getAreas();
-    while (ca->hasNext()) {
-        AreaPtr a = ca->next();
-        GraphPtr g = a->getSubgraph();
-        if (g != NULL) {
-            if (findCurve(g, x, y, tolerance, graph, areas, curve, segment, point)) {
-                areas.push_front(a->getAncestor()->getId());
-                return true;
             }
+            proximityIndexes.erase(lru);
         }
+        i = proximityIndexes.insert(make_pair(p.get(), ProximityIndex())).first;
+        i->second.index = new GraphProximityIndex(p);
+    } else if (!i->second.index->update()) {
+        i->second.index = new GraphProximityIndex(p);
     }
+    i->second.tile = t == NULL ? make_pair(-1, make_pair(0, 0)) : t->getId();
+    i->second.lastUse = ++proximityIndexesTime;
+    return i->second.index;
+}
 
-    //if (Logger::INFO_LOGGER != NULL) {
-    //    Logger::INFO_LOGGER->log("GRAPHEDITOR", "No node selected !");
-    //}
-    return false;
+GraphPtr EditGraphOrthoLayer::getTileGraph(TileCache::Tile *t)
+{
+    if (t->task->isDone()) {
+        return dynamic_cast<ObjectTileStorage::ObjectSlot *>(t->getData())->data.cast<Graph>();
+    }
+    return NULL;
 }
 
 bool EditGraphOrthoLayer::select(TileCache::Tile *t, double x, double y, float tolerance, GraphPtr &graph, list<AreaId> &areas, CurvePtr &curve, int &segment, int &point)
@@ -1150,7 +1132,7 @@ bool EditGraphOrthoLayer::select(TileCache::Tile *t, double x, double y, float t
 
     float d = tolerance * q.z;
 
-    GraphPtr p = dynamic_cast<ObjectTileStorage::ObjectSlot *>(t->getData())->data.cast<Graph>();
+    GraphPtr p = getTileGraph(t);
 
     areas.clear();
     graph = NULL;
@@ -1159,7 +1141,7 @@ bool EditGraphOrthoLayer::select(TileCache::Tile *t, double x, double y, float t
     segment = -1;
     curveStart.z = 0.0f;
 
-    return findCurve(p, x, y, d, graph, areas, curve, segment, point);
+    return getProximityIndex(p, t)->find(x, y, d, graph, areas, curve, segment, point);
 }
 
 bool EditGraphOrthoLayer::updateSelectedCurve()
@@ -2064,6 +2046,7 @@ bool EditGraphOrthoLayer::removeCurve(GraphPtr g, CurvePtr &curve, Graph::Change
 
 void EditGraphOrthoLayer::update()
 {
+    recordChanges();
     invalidateTiles();
     if (editedGraph != -1) {
         editGraph->getRoot()->notifyListeners();
@@ -2074,6 +2057,277 @@ void EditGraphOrthoLayer::update()
     }
 }
 
+bool EditGraphOrthoLayer::undo()
+{
+    if (editedGraph == -1 || undoSteps.empty()) {
+        return false;
+    }
+    EditStep step = undoSteps.back();
+    undoSteps.pop_back();
+    restoreCurveStates(step, step.before);
+    redoSteps.push_back(step);
+    return true;
+}
+
+bool EditGraphOrthoLayer::redo()
+{
+    if (editedGraph == -1 || redoSteps.empty()) {
+        return false;
+    }
+    EditStep step = redoSteps.back();
+    redoSteps.pop_back();
+    restoreCurveStates(step, step.after);
+    undoSteps.push_back(step);
+    return true;
+}
+
+void EditGraphOrthoLayer::clearHistory()
+{
+    undoSteps.clear();
+    redoSteps.clear();
+    savedGraph = NULL;
+    savedStates.clear();
+    recordedStates.clear();
+}
+
+void EditGraphOrthoLayer::setUndoLevels(int undoLevels)
+{
+    this->undoLevels = undoLevels;
+    while ((int) undoSteps.size() > undoLevels) {
+        undoSteps.pop_front();
+    }
+}
+
+void EditGraphOrthoLayer::beginEditGroup()
+{
+    ++editGroup;
+    editGroupOpen = true;
+}
+
+void EditGraphOrthoLayer::endEditGroup()
+{
+    editGroupOpen = false;
+}
+
+void EditGraphOrthoLayer::CurveState::save(CurvePtr c)
+{
+    curve = c;
+    start = c->getStart();
+    end = c->getEnd();
+    vertices.clear();
+    for (int i = 0; i < c->getSize(); ++i) {
+        vertices.push_back(c->getVertex(i));
+    }
+    width = c->getWidth();
+    type = c->getType();
+}
+
+bool EditGraphOrthoLayer::CurveState::equals(const CurveState &s) const
+{
+    if (vertices.size() != s.vertices.size() || width != s.width || type != s.type) {
+        return false;
+    }
+    for (unsigned int i = 0; i < vertices.size(); ++i) {
+        const Vertex &u = vertices[i];
+        const Vertex &v = s.vertices[i];
+        if (u.x != v.x || u.y != v.y || u.isControl != v.isControl) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void EditGraphOrthoLayer::saveCurveStates()
+{
+    savedGraph = selectedGraph;
+    savedStates.clear();
+    if (editedGraph == -1 || selectedGraph == NULL || selectedCurve == NULL) {
+        return;
+    }
+    // an edit of the selected curve can also modify the curves sharing one
+    // of its nodes (moved nodes, opposite control points) or one of its
+    // areas (smoothed areas)
+    set<CurveId> curves;
+    curves.insert(selectedCurve->getId());
+    NodePtr nodes[2] = { selectedCurve->getStart(), selectedCurve->getEnd() };
+    for (int i = 0; i < 2; ++i) {
+        for (int j = 0; j < nodes[i]->getCurveCount(); ++j) {
+            curves.insert(nodes[i]->getCurve(j)->getId());
+        }
+    }
+    AreaPtr areas[2] = { selectedCurve->getArea1(), selectedCurve->getArea2() };
+    for (int i = 0; i < 2; ++i) {
+        if (areas[i] != NULL) {
+            for (int j = 0; j < areas[i]->getCurveCount(); ++j) {
+                curves.insert(areas[i]->getCurve(j)->getId());
+            }
+        }
+    }
+    for (set<CurveId>::iterator i = curves.begin(); i != curves.end(); ++i) {
+        CurveState state;
+        state.save(selectedGraph->getCurve(*i));
+        savedStates.push_back(state);
+    }
+}
+
+void EditGraphOrthoLayer::recordChanges()
+{
+    if (editedGraph == -1) {
+        return;
+    }
+    Graph::Changes &changes = editGraph->getRoot()->changes;
+    if (changes.addedCurves.empty() && changes.removedCurves.empty() && changes.addedAreas.empty() && changes.removedAreas.empty()) {
+        saveCurveStates();
+        return;
+    }
+
+    // only records the changes that modify existing curves without changing
+    // the graph topology, using the states saved before these changes. The
+    // changes of the last recorded edit, or of the last #undo or #redo, can
+    // still be present in the graph: their curves are in 'recordedStates'
+    bool valid = changes.addedCurves == changes.removedCurves && changes.addedAreas == changes.removedAreas;
+    EditStep step;
+    set<CurveId>::iterator i = changes.addedCurves.begin();
+    while (valid && i != changes.addedCurves.end()) {
+        const CurveState *before = NULL;
+        if (savedGraph != NULL && savedGraph == selectedGraph) {
+            for (unsigned int j = 0; j < savedStates.size() && before == NULL; ++j) {
+                if (savedStates[j].curve->getId() == *i) {
+                    before = &savedStates[j];
+                }
+            }
+        }
+        for (unsigned int j = 0; j < recordedStates.size() && before == NULL; ++j) {
+            if (recordedStates[j].curve->getId() == *i) {
+                before = &recordedStates[j];
+            }
+        }
+        valid = before != NULL;
+        if (valid) {
+            CurveState after;
+            after.save(before->curve);
+            valid = after.start == before->start && after.end == before->end;
+            if (valid && !before->equals(after)) {
+                step.before.push_back(*before);
+                step.after.push_back(after);
+            }
+        }
+        ++i;
+    }
+
+    if (!valid) {
+        if (!undoSteps.empty() || !redoSteps.empty()) {
+            if (Logger::INFO_LOGGER != NULL) {
+                Logger::INFO_LOGGER->log("GRAPHEDITOR", "Graph topology changed: clearing edit history");
+            }
+            undoSteps.clear();
+            redoSteps.clear();
+        }
+        recordedStates.clear();
+    } else if (!step.before.empty()) {
+        step.graph = selectedGraph;
+        step.areas = changes.changedArea;
+        step.group = editGroup;
+        redoSteps.clear();
+        if (editGroupOpen && !undoSteps.empty() && undoSteps.back().group == editGroup && undoSteps.back().graph == step.graph) {
+            // merges this edit with the previous one of the same group
+            EditStep &last = undoSteps.back();
+            for (unsigned int j = 0; j < step.after.size(); ++j) {
+                unsigned int k = 0;
+                while (k < last.after.size() && last.after[k].curve != step.after[j].curve) {
+                    ++k;
+                }
+                if (k < last.after.size()) {
+                    last.after[k] = step.after[j];
+                } else {
+                    last.before.push_back(step.before[j]);
+                    last.after.push_back(step.after[j]);
+                }
+            }
+            recordedStates = last.after;
+        } else {
+            recordedStates = step.after;
+            undoSteps.push_back(step);
+            while ((int) undoSteps.size() > undoLevels) {
+                undoSteps.pop_front();
+            }
+        }
+    }
+    saveCurveStates();
+}
+
+void EditGraphOrthoLayer::restoreCurveStates(const EditStep &step, const vector<CurveState> &states)
+{
+    GraphPtr root = editGraph->getRoot();
+    root->changes.clear();
+    root->changes.changedArea = step.areas;
+    box2d bounds;
+    float width = 0.0f;
+    for (unsigned int i = 0; i < states.size(); ++i) {
+        const CurveState &s = states[i];
+        CurvePtr c = s.curve;
+        bounds = bounds.enlarge(c->getBounds());
+        width = max(width, c->getWidth());
+
+        int n = (int) s.vertices.size();
+        while (c->getSize() > 2) {
+            c->removeVertex(1);
+        }
+        for (int j = 1; j < n - 1; ++j) {
+            c->addVertex(s.vertices[j]);
+        }
+        // moves the nodes last, which also resets the curve bounds
+        step.graph->movePoint(c, 0, s.vertices[0]);
+        step.graph->movePoint(c, c->getSize() - 1, s.vertices[n - 1]);
+        c->setWidth(s.width);
+        c->setType(s.type);
+        c->computeCurvilinearCoordinates();
+
+        bounds = bounds.enlarge(c->getBounds());
+        width = max(width, c->getWidth());
+        root->changes.addedCurves.insert(c->getId());
+        root->changes.removedCurves.insert(c->getId());
+    }
+    step.graph->getAreasFromCurves(root->changes.addedCurves, root->changes.addedAreas);
+    step.graph->getAreasFromCurves(root->changes.removedCurves, root->changes.removedAreas);
+
+    if (selectedCurve != NULL) {
+        if (selectedPoint >= selectedCurve->getSize()) {
+            selectedPoint = -1;
+        }
+        if (selectedSegment >= selectedCurve->getSize() - 1) {
+            selectedSegment = -1;
+        }
+    }
+
+    // the graph producers only re-clip the curves listed in the changes,
+    // and only the tiles of this layer touched by these curves are redrawn
+    invalidateTileRegion(bounds.enlarge(width));
+    root->notifyListeners();
+    recordedStates = states;
+    HANDLER->selectedCurveData.editor = this;
+    HANDLER->selectedCurveData.c = selectedCurve.get();
+    HANDLER->selectedCurveData.selectedSegment = selectedSegment;
+    HANDLER->selectedCurveData.selectedPoint = selectedPoint;
+    saveCurveStates();
+}
+
+void EditGraphOrthoLayer::invalidateTileRegion(const box2d &bounds)
+{
+    ptr<TileCache> cache = getCache();
+    int producerId = getProducerId();
+    float border = tileSize > 2 * tileBorder ? float(tileBorder) / (tileSize - 2 * tileBorder) : 0.0f;
+    set<TileCache::Tile::Id>::iterator i = usedTiles.begin();
+    while (i != usedTiles.end()) {
+        vec3d q = getTileCoords(i->first, i->second.first, i->second.second);
+        box2d b = box2d(q.x, q.x + q.z, q.y, q.y + q.z).enlarge(q.z * border);
+        if (b.intersects(bounds)) {
+            cache->invalidateTile(producerId, i->first, i->second.first, i->second.second);
+        }
+        ++i;
+    }
+}
+
 vec3d EditGraphOrthoLayer::getTileCoords(int level, int tx, int ty)
 {
     float rootQuadSize = getRootQuadSize();
@@ -2097,6 +2351,14 @@ void EditGraphOrthoLayer::swap(ptr<EditGraphOrthoLayer> p)
     std::swap(tileOffsetU, p->tileOffsetU);
     std::swap(layerProgram, p->layerProgram);
     std::swap(displayedPoints, p->displayedPoints);
+    std::swap(proximityIndexes, p->proximityIndexes);
+    std::swap(proximityIndexesTime, p->proximityIndexesTime);
+    std::swap(undoSteps, p->undoSteps);
+    std::swap(redoSteps, p->redoSteps);
+    std::swap(undoLevels, p->undoLevels);
+    std::swap(savedGraph, p->savedGraph);
+    std::swap(savedStates, p->savedStates);
+    std::swap(recordedStates, p->recordedStates);
 }
 
 class EditGraphOrthoLayerResource : public ResourceTemplate<40, EditGraphOrthoLayer>
@@ -2114,7 +2376,7 @@ public:
         mat4d transform;
         bool softEdition = true;
         double softEditionDelay = 100000.0;
-        checkParameters(desc, e, "name,graphs,renderProg,level,tolerance,terrain,deform,softEdition,softEditionDelay,");
+        checkParameters(desc, e, "name,graphs,renderProg,level,tolerance,terrain,deform,softEdition,softEditionDelay,undoLevels,");
 
         string names = getParameter(desc, e, "graphs") + ",";
         string::size_type start = 0;
@@ -2153,6 +2415,12 @@ public:
         terrain = getParameter(desc, e, "terrain");
 
         init(graphs, layerProgram, displayLevel, tolerance, softEdition, softEditionDelay, deform, terrain, manager);
+
+        if (e->Attribute("undoLevels") != NULL) {
+            int undoLevels;
+            getIntParameter(desc, e, "undoLevels", &undoLevels);
+            setUndoLevels(undoLevels);
+        }
     }
 
     //To avoid call to Resource::prepareUpdate, which won't find the resource editGraphOrthoLayer since
@@ -31,6 +31,8 @@
 #include "ork/render/Mesh.h"
 #include "ork/render/Program.h"
 #include "ork/ui/Window.h"
+#include "proland/graph/Curve.h"
+#include "proland/graph/GraphProximityIndex.h"
 #include "proland/graph/producer/GraphProducer.h"
 #include "proland/terrain/TerrainNode.h"
 
@@ -308,9 +310,8 @@ public:
          */
         virtual ~EditGraphHandler();
 
-    //TODO : Choix appliquer a tous graphs ou juste graph edition
         /**
-         * Cancels the last point move.
+         * Cancels the last edit. See EditGraphOrthoLayer#undo.
          */
         bool undo();
 
@@ -732,7 +733,9 @@ public:
     void setSelection(CurvePtr curve, int point, int segment);
 
     /**
-     * Iterative method for finding a Curve at given coordinates.
+     * Finds a Curve at given coordinates, using a GraphProximityIndex for 'p'.
+     * The index is created the first time 'p' is searched, and is updated
+     * with the changes of 'p' when it changes (see GraphProximityIndex#update).
      *
      * @param p the Graph to search into.
      * @param x x coordinate of the point to search.
@@ -992,6 +995,42 @@ public:
      */
     virtual void update();
 
+    /**
+     * Cancels the last edit recorded in the edit history. Only the graph
+     * tiles and the tiles of this layer touched by this edit are updated.
+     *
+     * @return true if an edit was canceled.
+     */
+    bool undo();
+
+    /**
+     * Restores the last edit canceled with #undo.
+     *
+     * @return true if an edit was restored.
+     */
+    bool redo();
+
+    /**
+     * Clears the edit history.
+     */
+    void clearHistory();
+
+    /**
+     * Sets the maximum number of edits that can be canceled with #undo.
+     */
+    void setUndoLevels(int undoLevels);
+
+    /**
+     * Starts a group of edits that must be canceled all at once, such as
+     * the successive moves of a point being dragged with the mouse.
+     */
+    void beginEditGroup();
+
+    /**
+     * Ends a group of edits started with #beginEditGroup.
+     */
+    void endEditGroup();
+
     /**
      * Returns #tolerance selection parameter.
      */
@@ -1198,6 +1237,205 @@ protected:
      */
     vec3d getTileCoords(int level, int tx, int ty);
 
+    /**
+     * The state of a curve, saved in the edit history.
+     */
+    struct CurveState
+    {
+        /**
+         * The curve whose state is saved.
+         */
+        CurvePtr curve;
+
+        /**
+         * The start node of #curve when its state was saved.
+         */
+        NodePtr start;
+
+        /**
+         * The end node of #curve when its state was saved.
+         */
+        NodePtr end;
+
+        /**
+         * The vertices of #curve, including its extremities.
+         */
+        vector<Vertex> vertices;
+
+        /**
+         * The width of #curve.
+         */
+        float width;
+
+        /**
+         * The type of #curve.
+         */
+        int type;
+
+        /**
+         * Saves the current state of the given curve.
+         */
+        void save(CurvePtr c);
+
+        /**
+         * Returns true if this state has the same vertices, width and type
+         * as the given one.
+         */
+        bool equals(const CurveState &s) const;
+    };
+
+    /**
+     * An edit in the edit history. An edit only contains the states of the
+     * curves that it modified, before and after the edit. Edits that add or
+     * remove curves, nodes or areas are not recorded, and clear the edit
+     * history.
+     */
+    struct EditStep
+    {
+        /**
+         * The graph containing the modified curves.
+         */
+        GraphPtr graph;
+
+        /**
+         * The areas containing #graph (see #selectedArea).
+         */
+        list<AreaId> areas;
+
+        /**
+         * The state of the modified curves before this edit.
+         */
+        vector<CurveState> before;
+
+        /**
+         * The state of the modified curves after this edit.
+         */
+        vector<CurveState> after;
+
+        /**
+         * The group of this edit (see #beginEditGroup).
+         */
+        int group;
+    };
+
+    /**
+     * The edits that can be canceled with #undo, from the oldest to the
+     * most recent one.
+     */
+    list<EditStep> undoSteps;
+
+    /**
+     * The edits that can be restored with #redo, from the oldest to the
+     * most recently canceled one.
+     */
+    list<EditStep> redoSteps;
+
+    /**
+     * The maximum number of edits in #undoSteps.
+     */
+    int undoLevels;
+
+    /**
+     * The current edit group (see #beginEditGroup).
+     */
+    int editGroup;
+
+    /**
+     * True if the edits must be merged in the current edit group.
+     */
+    bool editGroupOpen;
+
+    /**
+     * The graph containing the curves whose state is saved in #savedStates.
+     */
+    GraphPtr savedGraph;
+
+    /**
+     * The states of the selected curve, and of the curves that an edit of
+     * the selected curve can modify. Used to compute the states 'before' of
+     * the next edit.
+     */
+    vector<CurveState> savedStates;
+
+    /**
+     * The states of the curves modified by the last recorded, canceled or
+     * restored edit. Used to recognize the graph changes that have already
+     * been recorded.
+     */
+    vector<CurveState> recordedStates;
+
+    /**
+     * Saves the states of the selected curve and of its neighbors in
+     * #savedStates.
+     */
+    void saveCurveStates();
+
+    /**
+     * Records the current changes of the root graph in the edit history, if
+     * they only modify curves saved in #savedStates.
+     */
+    void recordChanges();
+
+    /**
+     * Restores the given curve states, and updates the graph tiles and the
+     * tiles of this layer touched by them.
+     */
+    void restoreCurveStates(const EditStep &step, const vector<CurveState> &states);
+
+    /**
+     * Invalidates the tiles of this layer that intersect the given bounds.
+     */
+    void invalidateTileRegion(const box2d &bounds);
+
+    /**
+     * A proximity index of a graph searched in #findCurve.
+     */
+    struct ProximityIndex
+    {
+        /**
+         * The proximity index.
+         */
+        ptr<GraphProximityIndex> index;
+
+        /**
+         * The id of the tile of #editGraph containing the indexed graph, with
+         * a negative level if this graph is not a tile of #editGraph.
+         */
+        TileCache::Tile::Id tile;
+
+        /**
+         * The value of #proximityIndexesTime when this index was last used.
+         */
+        unsigned int lastUse;
+    };
+
+    /**
+     * The proximity indexes of the last graphs searched in #findCurve.
+     */
+    map<Graph*, ProximityIndex> proximityIndexes;
+
+    /**
+     * The number of calls to #getProximityIndex, used to find the least
+     * recently used proximity index.
+     */
+    unsigned int proximityIndexesTime;
+
+    /**
+     * Returns an up to date proximity index for the given graph. Also
+     * removes the indexes of the graphs that are no longer the content of
+     * their tile, so that they do not keep these graphs in memory.
+     *
+     * @param p the graph to search into.
+     * @param t the tile of #editGraph containing 'p', or NULL.
+     */
+    ptr<GraphProximityIndex> getProximityIndex(GraphPtr p, TileCache::Tile *t);
+
+    /**
+     * Returns the graph stored in the given tile of #editGraph, or NULL if
+     * this tile is not ready.
+     */
+    GraphPtr getTileGraph(TileCache::Tile *t);
+
     /**
      * Uniform used to convert the coordinates of each points into texture coordinates inside the shader.
      */
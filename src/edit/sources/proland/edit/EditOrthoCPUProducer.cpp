@@ -25,11 +25,22 @@
  * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
  */
 
+#undef __STRICT_ANSI__
+
 #include "proland/edit/EditOrthoCPUProducer.h"
 
+#include "tiffio.h"
+
 #include "ork/core/Logger.h"
 #include "ork/resource/ResourceTemplate.h"
 #include "proland/producer/CPUTileStorage.h"
+#include "proland/util/checksum.h"
+#include "proland/util/mfs.h"
+#include "proland/util/parallel.h"
+
+#include <pthread.h>
+#include <cstring>
+#include <sstream>
 
 using namespace std;
 using namespace ork;
@@ -39,17 +50,208 @@ namespace proland
 
 int EMPTY_DELTA[4] = { 0, 0, 0, 0 };
 
-EditOrthoCPUProducer::EditOrthoCPUProducer(ptr<TileCache> cache, const char *name) :
-    OrthoCPUProducer()
+class EditOrthoCPUProducer::DeltaColors
+{
+public:
+    /**
+     * The color deltas of each edited tile and of its ancestors.
+     */
+    map<TileCache::Tile::Id, int*> tiles;
+
+    /**
+     * The number of pending tiles that must be updated with these deltas.
+     */
+    int users;
+
+    DeltaColors() : users(0)
+    {
+    }
+
+    ~DeltaColors()
+    {
+        map<TileCache::Tile::Id, int*>::iterator i = tiles.begin();
+        while (i != tiles.end()) {
+            delete[] i->second;
+            i++;
+        }
+    }
+};
+
+/**
+ * Looks up color deltas in a set of color delta tiles.
+ */
+class DeltaColorLookup
+{
+public:
+    DeltaColorLookup(const map<TileCache::Tile::Id, int*> *deltaColors, int tSize, int tChannels) :
+        deltaColors(deltaColors), tSize(tSize), tChannels(tChannels),
+        curId(make_pair(-1, make_pair(0, 0))), curDeltaColor(NULL)
+    {
+    }
+
+    /**
+     * Returns the color delta at the given location.
+     *
+     * @param level a quadtree level.
+     * @param n the numbers of tiles per row or column in the quadtree at
+     *      this level (1 << level).
+     * @param tx a logical tile x coordinate.
+     * @param ty a logical tile y coordinate.
+     * @param x a pixel coordinate relatively to the lower left corner of
+     *      the (level,tx,ty) tile (without borders). Can be outside the
+     *      tile itself (then the value will be looked up in an adjacent tile).
+     * @param y a pixel coordinate relatively to the lower left corner of
+     *      the (level,tx,ty) tile (without borders). Can be outside the
+     *      tile itself (then the value will be looked up in an adjacent tile).
+     */
+    int *get(int level, int n, int tx, int ty, int x, int y)
+    {
+        x += tx * tSize;
+        y += ty * tSize;
+        int nw = n * tSize;
+        x = clamp(x, 0, nw - 1);
+        y = clamp(y, 0, nw - 1);
+        tx = x / tSize;
+        ty = y / tSize;
+        x = x % tSize;
+        y = y % tSize;
+
+        int *deltaColor = NULL;
+        TileCache::Tile::Id id = TileCache::Tile::getId(level, tx, ty);
+        if (id == curId) {
+            deltaColor = curDeltaColor;
+        } else {
+            map<TileCache::Tile::Id, int*>::const_iterator i = deltaColors->find(id);
+            if (i != deltaColors->end()) {
+                deltaColor = i->second;
+            }
+            curId = id;
+            curDeltaColor = deltaColor;
+        }
+
+        return deltaColor == NULL ? EMPTY_DELTA : deltaColor + (x + y * tSize) * tChannels;
+    }
+
+private:
+    const map<TileCache::Tile::Id, int*> *deltaColors;
+
+    int tSize;
+
+    int tChannels;
+
+    /**
+     * The id of the last color delta tile that was used in #get.
+     * Optimization to avoid too many lookups in the #deltaColors map.
+     */
+    TileCache::Tile::Id curId;
+
+    /**
+     * The last color delta tile that was used in #get.
+     * Optimization to avoid too many lookups in the #deltaColors map.
+     */
+    int *curDeltaColor;
+};
+
+/**
+ * A Task to update the pending tiles of an EditOrthoCPUProducer.
+ */
+class UpdateOrthoTilesTask : public Task
+{
+public:
+    ptr<EditOrthoCPUProducer> producer;
+
+    UpdateOrthoTilesTask(ptr<EditOrthoCPUProducer> producer) :
+        Task("UpdateOrthoTilesTask", false, 0), producer(producer)
+    {
+    }
+
+    virtual bool run() {
+        producer->flushTiles();
+        return true;
+    }
+};
+
+/**
+ * The tiles to be updated in EditOrthoCPUProducer::flushTiles.
+ */
+struct OrthoTilesUpdate
+{
+    EditOrthoCPUProducer *producer;
+
+    vector<TileCache::Tile::Id> ids;
+};
+
+/**
+ * The size of the overlay file header (tile size, channels and border).
+ */
+#define OVERLAY_HEADER (3 * sizeof(int))
+
+/**
+ * The size of the header of each tile record in the overlay file
+ * (level, tx, ty and compressed data size).
+ */
+#define OVERLAY_RECORD (4 * sizeof(int))
+
+// compresses a tile in the same format as in OrthoCPUProducer files
+static void compressTile(unsigned char *tile, int width, int channels, mfs_file *fd)
 {
-    init(cache, name);
+    mfs_open(NULL, 0, (char*)"w", fd);
+    TIFF* tf = TIFFClientOpen("", (char*)"w", fd,
+        (TIFFReadWriteProc) mfs_read, (TIFFReadWriteProc) mfs_write, (TIFFSeekProc) mfs_lseek,
+        (TIFFCloseProc) mfs_close, (TIFFSizeProc) mfs_size, (TIFFMapFileProc) mfs_map,
+        (TIFFUnmapFileProc) mfs_unmap);
+    TIFFSetField(tf, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tf, TIFFTAG_IMAGELENGTH, width);
+    TIFFSetField(tf, TIFFTAG_COMPRESSION, COMPRESSION_DEFLATE);
+    TIFFSetField(tf, TIFFTAG_ORIENTATION, ORIENTATION_BOTLEFT);
+    TIFFSetField(tf, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    if (channels == 1) {
+        TIFFSetField(tf, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    } else {
+        TIFFSetField(tf, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    }
+    TIFFSetField(tf, TIFFTAG_SAMPLESPERPIXEL, channels);
+    TIFFSetField(tf, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFWriteEncodedStrip(tf, 0, tile, width * width * channels);
+    TIFFClose(tf);
 }
 
-EditOrthoCPUProducer::EditOrthoCPUProducer() : OrthoCPUProducer()
+// uncompresses a tile compressed with compressTile, of tileSize bytes
+// when uncompressed; returns false if the compressed data is corrupted
+static bool uncompressTile(unsigned char *data, int size, unsigned char *tile, int tileSize)
+{
+    mfs_file fd;
+    mfs_open(data, size, (char *)"r", &fd);
+    TIFF* tf = TIFFClientOpen("name", "r", &fd,
+        (TIFFReadWriteProc) mfs_read, (TIFFReadWriteProc) mfs_write, (TIFFSeekProc) mfs_lseek,
+        (TIFFCloseProc) mfs_close, (TIFFSizeProc) mfs_size, (TIFFMapFileProc) mfs_map,
+        (TIFFUnmapFileProc) mfs_unmap);
+    if (tf == NULL) {
+        return false;
+    }
+    // the strip size is bounded by the tile size, so that a corrupted
+    // TIFF header cannot overflow the tile data
+    bool ok = TIFFReadEncodedStrip(tf, 0, tile, tileSize) == tileSize;
+    TIFFClose(tf);
+    return ok;
+}
+
+EditOrthoCPUProducer::EditOrthoCPUProducer(ptr<TileCache> cache, const char *name, const char *overlay) :
+    OrthoCPUProducer(), overlay(NULL), mutex(NULL), updated(NULL)
+{
+    init(cache, name, overlay);
+}
+
+EditOrthoCPUProducer::EditOrthoCPUProducer() : OrthoCPUProducer(), overlay(NULL), mutex(NULL), updated(NULL)
 {
 }
 
 void EditOrthoCPUProducer::init(ptr<TileCache> cache, const char *name)
+{
+    init(cache, name, NULL);
+}
+
+void EditOrthoCPUProducer::init(ptr<TileCache> cache, const char *name, const char *overlay)
 {
     OrthoCPUProducer::init(cache, name);
     assert(getBorder() == 2);
@@ -57,14 +259,28 @@ void EditOrthoCPUProducer::init(ptr<TileCache> cache, const char *name)
     tWidth = cache->getStorage()->getTileSize();
     tSize = tWidth - 2 * getBorder();
     tChannels = dynamic_cast<CPUTileStorage<unsigned char>*>(cache->getStorage().get())->getChannels();
-    curId = make_pair(-1, make_pair(0, 0));
-    curDeltaColor = NULL;
+    mutex = new pthread_mutex_t;
+    pthread_mutex_init((pthread_mutex_t*) mutex, NULL);
+    updated = new pthread_cond_t;
+    pthread_cond_init((pthread_cond_t*) updated, NULL);
+    openOverlay(overlay);
 }
 
 EditOrthoCPUProducer::~EditOrthoCPUProducer()
 {
-    map<TileCache::Tile::Id, unsigned char*>::iterator i = modifiedTiles.begin();
-    while (i != modifiedTiles.end()) {
+    if (mutex != NULL) {
+        // stores the pending updates in the overlay file
+        flushTiles();
+        pthread_mutex_destroy((pthread_mutex_t*) mutex);
+        delete (pthread_mutex_t*) mutex;
+        pthread_cond_destroy((pthread_cond_t*) updated);
+        delete (pthread_cond_t*) updated;
+    }
+    if (overlay != NULL) {
+        fclose(overlay);
+    }
+    map<TileCache::Tile::Id, int*>::iterator i = deltaColors.begin();
+    while (i != deltaColors.end()) {
         delete[] i->second;
         i++;
     }
@@ -76,7 +292,10 @@ bool EditOrthoCPUProducer::hasTile(int level, int tx, int ty)
         return true;
     }
     TileCache::Tile::Id id = TileCache::Tile::getId(level, tx, ty);
-    return modifiedTiles.find(id) != modifiedTiles.end();
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    bool result = overlayTiles.find(id) != overlayTiles.end() || pendingTiles.find(id) != pendingTiles.end();
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+    return result;
 }
 
 void EditOrthoCPUProducer::editedTile(int level, int tx, int ty, int *deltaColor)
@@ -145,11 +364,17 @@ void EditOrthoCPUProducer::editedTile(int level, int tx, int ty, int *deltaColor
 
 void EditOrthoCPUProducer::updateTiles()
 {
+    if (deltaColors.empty()) {
+        return;
+    }
+    DeltaColors *deltas = new DeltaColors();
+    deltas->tiles.swap(deltaColors);
+
     // computes the set of modified residual tiles
     // (for each edited residual tile, the tile itself and its 8 neighbors are modified)
     set<TileCache::Tile::Id> changedTiles;
-    map<TileCache::Tile::Id, int*>::iterator i = deltaColors.begin();
-    while (i != deltaColors.end()) {
+    map<TileCache::Tile::Id, int*>::iterator i = deltas->tiles.begin();
+    while (i != deltas->tiles.end()) {
         TileCache::Tile::Id id = i->first;
         int level = id.first;
         int tx0 = id.second.first;
@@ -167,214 +392,487 @@ void EditOrthoCPUProducer::updateTiles()
         i++;
     }
 
-    int *tmp = new int[tWidth * (tWidth / 2 + 2) * tChannels];
-
-    // updates the modified residual tiles
+    // records the modified tiles; they will be updated when they are
+    // produced, or by an UpdateOrthoTilesTask
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
     set<TileCache::Tile::Id>::iterator j = changedTiles.begin();
     while (j != changedTiles.end()) {
-        TileCache::Tile::Id id = *j;
-        int level = id.first;
-        int tx = id.second.first;
-        int ty = id.second.second;
-        TileCache::Tile::Id key = TileCache::Tile::getId(level, tx, ty);
-
-        // finds the modified residual tile, creates it if necessary
-        unsigned char *modifiedTile = NULL;
-        map<TileCache::Tile::Id, unsigned char*>::iterator k = modifiedTiles.find(key);
-        if (k == modifiedTiles.end()) {
-            if (hasTile(level, tx, ty)) {
-                CPUTileStorage<unsigned char>::CPUSlot *slot = new CPUTileStorage<unsigned char>::CPUSlot(getCache()->getStorage().get(), tWidth * tWidth * tChannels);
-                doCreateTile(level, tx, ty, slot);
-                modifiedTiles.insert(make_pair(key, slot->data));
-                modifiedTile = slot->data;
-                slot->data = NULL;
-                delete slot;
-            } else {
-                modifiedTile = new unsigned char[tWidth * tWidth * tChannels];
-                for (int i = 0; i < tWidth * tWidth * tChannels; ++i) {
-                    modifiedTile[i] = 128;
-                }
-                modifiedTiles.insert(make_pair(key, modifiedTile));
+        pendingTiles[*j].push_back(deltas);
+        deltas->users += 1;
+        j++;
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+
+    ptr<Scheduler> scheduler = getCache()->getScheduler();
+    if (scheduler != NULL && scheduler->supportsPrefetch(false)) {
+        ptr<Task> t = new UpdateOrthoTilesTask(this);
+        scheduler->schedule(t);
+    } else {
+        flushTiles();
+    }
+}
+
+void EditOrthoCPUProducer::flushTiles()
+{
+    OrthoTilesUpdate update;
+    update.producer = this;
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    map<TileCache::Tile::Id, vector<DeltaColors*> >::iterator i = pendingTiles.begin();
+    while (i != pendingTiles.end()) {
+        update.ids.push_back(i->first);
+        i++;
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+
+    parallelFor(0, (int) update.ids.size(), flushPendingTiles, &update, 4);
+}
+
+void EditOrthoCPUProducer::flushPendingTiles(void *context, int begin, int end)
+{
+    OrthoTilesUpdate *update = (OrthoTilesUpdate*) context;
+    EditOrthoCPUProducer *p = update->producer;
+    CPUTileStorage<unsigned char>::CPUSlot *slot = new CPUTileStorage<unsigned char>::CPUSlot(p->getCache()->getStorage().get(), p->tWidth * p->tWidth * p->tChannels);
+    for (int i = begin; i < end; ++i) {
+        TileCache::Tile::Id id = update->ids[i];
+        p->produceTile(id.first, id.second.first, id.second.second, slot, true);
+    }
+    delete slot;
+}
+
+void EditOrthoCPUProducer::produceTile(int level, int tx, int ty, TileStorage::Slot *data, bool updateOnly)
+{
+    CPUTileStorage<unsigned char>::CPUSlot *cpuData = dynamic_cast<CPUTileStorage<unsigned char>::CPUSlot*>(data);
+    assert(cpuData != NULL);
+    unsigned char *tile = cpuData->data;
+    TileCache::Tile::Id id = TileCache::Tile::getId(level, tx, ty);
+
+    // finds the pending updates and the last modified version of this tile
+    // (waits if another thread is currently updating it)
+    vector<DeltaColors*> deltas;
+    unsigned char *compressedData = NULL;
+    int size = 0;
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    while (updatingTiles.find(id) != updatingTiles.end()) {
+        pthread_cond_wait((pthread_cond_t*) updated, (pthread_mutex_t*) mutex);
+    }
+    map<TileCache::Tile::Id, vector<DeltaColors*> >::iterator i = pendingTiles.find(id);
+    if (i != pendingTiles.end()) {
+        deltas.swap(i->second);
+        pendingTiles.erase(i);
+        updatingTiles.insert(id);
+    }
+    if (updateOnly && deltas.empty()) {
+        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+        return;
+    }
+    map<TileCache::Tile::Id, pair<long long, int> >::iterator j = overlayTiles.find(id);
+    if (j != overlayTiles.end()) {
+        size = j->second.second;
+        compressedData = new unsigned char[size];
+        fseek64(overlay, j->second.first, SEEK_SET);
+        if (fread(compressedData, size, 1, overlay) != 1) {
+            delete[] compressedData;
+            compressedData = NULL;
+        }
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+
+    // produces the current version of this tile
+    bool loaded = false;
+    if (compressedData != NULL) {
+        loaded = uncompressTile(compressedData, size, tile, tWidth * tWidth * tChannels);
+        delete[] compressedData;
+    }
+    if (!loaded) {
+        // size is not 0 if the overlay tile exists but cannot be read
+        if (size != 0 && Logger::WARNING_LOGGER != NULL) {
+            ostringstream oss;
+            oss << "Corrupted tile " << level << " " << tx << " " << ty << " in '" << overlayName << "', using original tile";
+            Logger::WARNING_LOGGER->log("EDIT", oss.str());
+        }
+        if (empty || !OrthoCPUProducer::hasTile(level, tx, ty)) {
+            int value = empty && level == 0 ? 0 : 128;
+            for (int k = 0; k < tWidth * tWidth * tChannels; ++k) {
+                tile[k] = value;
             }
         } else {
-            modifiedTile = k->second;
+            OrthoCPUProducer::doCreateTile(level, tx, ty, data);
         }
+    }
 
-        int n = 1 << level;
-        int w = tSize;
-        int b = getBorder();
-
-        int offset = (b * tWidth + b) * tChannels;
-        unsigned char *modifiedTile0 = modifiedTile + offset;
-
-        // updates the modified residual tile content
-        if (level == 0) {
-            for (int y = -b; y < w + b; ++y) {
-                for (int x = -b; x < w + b; ++x) {
-                    int *delta = getDeltaColor(level, n, tx, ty, x, y);
-                    unsigned char *dst = modifiedTile0 + (x + y * tWidth) * tChannels;
-                    for (int c = 0; c < tChannels; ++c) {
-                        dst[c] = clamp(int(dst[c]) + delta[c], 0, 255);
-                    }
+    if (deltas.empty()) {
+        return;
+    }
+
+    // applies the pending updates and stores the new version of this tile
+    int *tmp = new int[tWidth * (tWidth / 2 + 2) * tChannels];
+    for (unsigned int k = 0; k < deltas.size(); ++k) {
+        updateTile(level, tx, ty, deltas[k], tile, tmp);
+    }
+    delete[] tmp;
+
+    mfs_file fd;
+    compressTile(tile, tWidth, tChannels, &fd);
+
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    writeOverlayTile(id, (unsigned char*) fd.buf, fd.buf_size);
+    updatingTiles.erase(id);
+    for (unsigned int k = 0; k < deltas.size(); ++k) {
+        deltas[k]->users -= 1;
+        if (deltas[k]->users == 0) {
+            delete deltas[k];
+        }
+    }
+    pthread_cond_broadcast((pthread_cond_t*) updated);
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+
+    free(fd.buf);
+}
+
+void EditOrthoCPUProducer::updateTile(int level, int tx, int ty, DeltaColors *deltas, unsigned char *modifiedTile, int *tmp)
+{
+    DeltaColorLookup d(&(deltas->tiles), tSize, tChannels);
+
+    int n = 1 << level;
+    int w = tSize;
+    int b = getBorder();
+
+    int offset = (b * tWidth + b) * tChannels;
+    unsigned char *modifiedTile0 = modifiedTile + offset;
+
+    // updates the modified residual tile content
+    if (level == 0) {
+        for (int y = -b; y < w + b; ++y) {
+            for (int x = -b; x < w + b; ++x) {
+                int *delta = d.get(level, n, tx, ty, x, y);
+                unsigned char *dst = modifiedTile0 + (x + y * tWidth) * tChannels;
+                for (int c = 0; c < tChannels; ++c) {
+                    dst[c] = clamp(int(dst[c]) + delta[c], 0, 255);
                 }
             }
-        } else {
-            int rx = (tx % 2) * w / 2;
-            int ry = (ty % 2) * w / 2;
-            /*// unoptimized version
-            int masks[4][4] = {
-                { 1, 3, 3, 9 },
-                { 3, 1, 9, 3 },
-                { 3, 9, 1, 3 },
-                { 9, 3, 3, 1 }
-            };
-            for (int y = -b; y < w + b; ++y) {
-                int py = (y + 3) / 2 + ry - 2;
-                for (int x = -b; x < w + b; ++x) {
-                    int px = (x + 3) / 2 + rx - 2;
-                    int *m = masks[((x + 2) % 2) + 2 * ((y + 2) % 2)];
-                    int *p0 = getDeltaColor(level - 1, n / 2, tx / 2, ty / 2, px, py);
-                    int *p1 = getDeltaColor(level - 1, n / 2, tx / 2, ty / 2, px + 1, py);
-                    int *p2 = getDeltaColor(level - 1, n / 2, tx / 2, ty / 2, px, py + 1);
-                    int *p3 = getDeltaColor(level - 1, n / 2, tx / 2, ty / 2, px + 1, py + 1);
-                    int *delta = getDeltaColor(level, n, tx, ty, x, y);
-                    unsigned char *dst = modifiedTile0 + (x + y * tWidth) * tChannels;
-                    for (int c = 0; c < tChannels; ++c) {
-                        int r = delta[c] - (m[0] * p0[c] + m[1] * p1[c] + m[2] * p2[c] + m[3] * p3[c]) / 16;
-                        dst[c] = clamp(dst[c] + r / 2, 0, 255);
-                    }
-                }
-            }*/
-            // optimized version
-            for (int y = -2; y < w / 2 + 2; ++y) {
-                int px = rx - 2;
-                int py = ry + y;
-                int *p0 = getDeltaColor(level - 1, n / 2, tx / 2, ty / 2, px++, py);
-                int *p1 = getDeltaColor(level - 1, n / 2, tx / 2, ty / 2, px++, py);
-                int off = ((y + 2) * tWidth) * tChannels;
+        }
+    } else {
+        int rx = (tx % 2) * w / 2;
+        int ry = (ty % 2) * w / 2;
+        /*// unoptimized version
+        int masks[4][4] = {
+            { 1, 3, 3, 9 },
+            { 3, 1, 9, 3 },
+            { 3, 9, 1, 3 },
+            { 9, 3, 3, 1 }
+        };
+        for (int y = -b; y < w + b; ++y) {
+            int py = (y + 3) / 2 + ry - 2;
+            for (int x = -b; x < w + b; ++x) {
+                int px = (x + 3) / 2 + rx - 2;
+                int *m = masks[((x + 2) % 2) + 2 * ((y + 2) % 2)];
+                int *p0 = d.get(level - 1, n / 2, tx / 2, ty / 2, px, py);
+                int *p1 = d.get(level - 1, n / 2, tx / 2, ty / 2, px + 1, py);
+                int *p2 = d.get(level - 1, n / 2, tx / 2, ty / 2, px, py + 1);
+                int *p3 = d.get(level - 1, n / 2, tx / 2, ty / 2, px + 1, py + 1);
+                int *delta = d.get(level, n, tx, ty, x, y);
+                unsigned char *dst = modifiedTile0 + (x + y * tWidth) * tChannels;
                 for (int c = 0; c < tChannels; ++c) {
-                    tmp[off + c] = p0[c] + 3 * p1[c];
-                }
-                for (int x = -1; x < w + 1; x += 2) {
-                    p0 = p1;
-                    p1 = getDeltaColor(level - 1, n / 2, tx / 2, ty / 2, px++, py);
-                    off = (x + 2 + (y + 2) * tWidth) * tChannels;
-                    for (int c = 0; c < tChannels; ++c) {
-                        tmp[off + c] = 3 * p0[c] + p1[c];
-                        tmp[off + tChannels + c] = p0[c] + 3 * p1[c];
-                    }
+                    int r = delta[c] - (m[0] * p0[c] + m[1] * p1[c] + m[2] * p2[c] + m[3] * p3[c]) / 16;
+                    dst[c] = clamp(dst[c] + r / 2, 0, 255);
                 }
+            }
+        }*/
+        // optimized version
+        for (int y = -2; y < w / 2 + 2; ++y) {
+            int px = rx - 2;
+            int py = ry + y;
+            int *p0 = d.get(level - 1, n / 2, tx / 2, ty / 2, px++, py);
+            int *p1 = d.get(level - 1, n / 2, tx / 2, ty / 2, px++, py);
+            int off = ((y + 2) * tWidth) * tChannels;
+            for (int c = 0; c < tChannels; ++c) {
+                tmp[off + c] = p0[c] + 3 * p1[c];
+            }
+            for (int x = -1; x < w + 1; x += 2) {
                 p0 = p1;
-                p1 = getDeltaColor(level - 1, n / 2, tx / 2, ty / 2, px, py);
-                off = (w + 3 + (y + 2) * tWidth) * tChannels;
+                p1 = d.get(level - 1, n / 2, tx / 2, ty / 2, px++, py);
+                off = (x + 2 + (y + 2) * tWidth) * tChannels;
                 for (int c = 0; c < tChannels; ++c) {
                     tmp[off + c] = 3 * p0[c] + p1[c];
+                    tmp[off + tChannels + c] = p0[c] + 3 * p1[c];
                 }
             }
-            for (int y = -2; y < w + 2; ++y) {
-                int py = (y + 3) / 2;
-                int m0 = y % 2 == 0 ? 1 : 3;
-                int m1 = 4 - m0;
-                for (int x = -2; x < w + 2; ++x) {
-                    int *p0 = tmp + (x + 2 + py * tWidth) * tChannels;
-                    int *p1 = tmp + (x + 2 + (py + 1) * tWidth) * tChannels;
-                    int *delta = getDeltaColor(level, n, tx, ty, x, y);
-                    unsigned char *dst = modifiedTile0 + (x + y * tWidth) * tChannels;
-                    for (int c = 0; c < tChannels; ++c) {
-                        int r = delta[c] - (m0 * p0[c] + m1 * p1[c]) / 16;
-                        dst[c] = clamp(dst[c] + r / 2, 0, 255);
-                    }
+            p0 = p1;
+            p1 = d.get(level - 1, n / 2, tx / 2, ty / 2, px, py);
+            off = (w + 3 + (y + 2) * tWidth) * tChannels;
+            for (int c = 0; c < tChannels; ++c) {
+                tmp[off + c] = 3 * p0[c] + p1[c];
+            }
+        }
+        for (int y = -2; y < w + 2; ++y) {
+            int py = (y + 3) / 2;
+            int m0 = y % 2 == 0 ? 1 : 3;
+            int m1 = 4 - m0;
+            for (int x = -2; x < w + 2; ++x) {
+                int *p0 = tmp + (x + 2 + py * tWidth) * tChannels;
+                int *p1 = tmp + (x + 2 + (py + 1) * tWidth) * tChannels;
+                int *delta = d.get(level, n, tx, ty, x, y);
+                unsigned char *dst = modifiedTile0 + (x + y * tWidth) * tChannels;
+                for (int c = 0; c < tChannels; ++c) {
+                    int r = delta[c] - (m0 * p0[c] + m1 * p1[c]) / 16;
+                    dst[c] = clamp(dst[c] + r / 2, 0, 255);
                 }
             }
         }
-
-        j++;
     }
+}
 
-    delete[] tmp;
-
-    i = deltaColors.begin();
-    while (i != deltaColors.end()) {
-        delete[] i->second;
-        i++;
+void EditOrthoCPUProducer::openOverlay(const char *name)
+{
+    overlayName = name == NULL ? "" : name;
+    overlay = NULL;
+    overlaySize = OVERLAY_HEADER;
+    overlayTiles.clear();
+
+    bool valid = false;
+    if (overlayName.size() > 0) {
+        fopen(&overlay, name, "r+b");
+        int header[3];
+        if (overlay != NULL && fread(header, sizeof(int), 3, overlay) == 3) {
+            if (header[0] != tSize || header[1] != tChannels || header[2] != getBorder()) {
+                if (Logger::ERROR_LOGGER != NULL) {
+                    Logger::ERROR_LOGGER->log("EDIT", "Invalid overlay file '" + overlayName + "'");
+                }
+                // uses a temporary file instead, to not overwrite this file
+                fclose(overlay);
+                overlay = NULL;
+                overlayName = "";
+            } else {
+                // reads the tile records, until the end of the file or until
+                // an incomplete record (which is then overwritten by the next
+                // record)
+                int record[4];
+                while (fread(record, sizeof(int), 4, overlay) == 4) {
+                    if (record[0] < 0 || record[3] <= 0 || record[3] > 2 * tWidth * tWidth * tChannels) {
+                        break;
+                    }
+                    long long start = overlaySize + OVERLAY_RECORD;
+                    fseek64(overlay, start + record[3] - 1, SEEK_SET);
+                    if (fgetc(overlay) == EOF) {
+                        break;
+                    }
+                    overlayTiles[TileCache::Tile::getId(record[0], record[1], record[2])] = make_pair(start, record[3]);
+                    overlaySize = start + record[3];
+                }
+                valid = true;
+            }
+        } else {
+            if (overlay != NULL) {
+                fclose(overlay);
+            }
+            fopen(&overlay, name, "w+b");
+        }
+    }
+    if (overlay == NULL) {
+        if (overlayName.size() > 0 && Logger::ERROR_LOGGER != NULL) {
+            Logger::ERROR_LOGGER->log("EDIT", "Cannot open overlay file '" + overlayName + "'");
+        }
+        overlayName = "";
+        overlay = tmpfile();
     }
-    deltaColors.clear();
-    curId = make_pair(-1, make_pair(0, 0));
+    if (overlay != NULL && !valid) {
+        int header[3] = { tSize, tChannels, getBorder() };
+        fseek64(overlay, 0, SEEK_SET);
+        fwrite(header, sizeof(int), 3, overlay);
+        fflush(overlay);
+    }
+}
+
+void EditOrthoCPUProducer::writeOverlayTile(TileCache::Tile::Id id, unsigned char *data, int size)
+{
+    int record[4] = { id.first, id.second.first, id.second.second, size };
+    fseek64(overlay, overlaySize, SEEK_SET);
+    fwrite(record, sizeof(int), 4, overlay);
+    fwrite(data, size, 1, overlay);
+    fflush(overlay);
+    overlayTiles[id] = make_pair(overlaySize + OVERLAY_RECORD, size);
+    overlaySize += OVERLAY_RECORD + size;
 }
 
 void EditOrthoCPUProducer::reset()
 {
-    map<TileCache::Tile::Id, unsigned char*>::iterator i = modifiedTiles.begin();
-    while (i != modifiedTiles.end()) {
-        delete[] i->second;
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    // waits until no tile is being updated, and deletes the pending updates
+    while (!updatingTiles.empty()) {
+        pthread_cond_wait((pthread_cond_t*) updated, (pthread_mutex_t*) mutex);
+    }
+    set<DeltaColors*> deltas;
+    map<TileCache::Tile::Id, vector<DeltaColors*> >::iterator i = pendingTiles.begin();
+    while (i != pendingTiles.end()) {
+        deltas.insert(i->second.begin(), i->second.end());
         i++;
     }
-    modifiedTiles.clear();
+    set<DeltaColors*>::iterator j = deltas.begin();
+    while (j != deltas.end()) {
+        delete *j;
+        j++;
+    }
+    pendingTiles.clear();
+
+    // clears the overlay file
+    if (overlay != NULL) {
+        fclose(overlay);
+    }
+    string name = overlayName;
+    if (name.size() > 0) {
+        FILE *f;
+        fopen(&f, name.c_str(), "wb");
+        if (f != NULL) {
+            fclose(f);
+        }
+    }
+    openOverlay(name.size() > 0 ? name.c_str() : NULL);
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+
     invalidateTiles();
 }
 
-int *EditOrthoCPUProducer::getDeltaColor(int level, int n, int tx, int ty, int x, int y)
+bool EditOrthoCPUProducer::flatten(const char *file)
 {
-    x += tx * tSize;
-    y += ty * tSize;
-    int nw = n * tSize;
-    x = clamp(x, 0, nw - 1);
-    y = clamp(y, 0, nw - 1);
-    tx = x / tSize;
-    ty = y / tSize;
-    x = x % tSize;
-    y = y % tSize;
-
-    int *deltaColor = NULL;
-    TileCache::Tile::Id id = TileCache::Tile::getId(level, tx, ty);
-    if (id == curId) {
-        deltaColor = curDeltaColor;
-    } else {
-        map<TileCache::Tile::Id, int*>::iterator i = deltaColors.find(id);
-        if (i != deltaColors.end()) {
-            deltaColor = i->second;
+    if (isCompressed()) {
+        if (Logger::ERROR_LOGGER != NULL) {
+            Logger::ERROR_LOGGER->log("EDIT", "Cannot flatten DXT compressed tiles");
         }
-        curId = id;
-        curDeltaColor = deltaColor;
+        return false;
     }
+    flushTiles();
 
-    return deltaColor == NULL ? EMPTY_DELTA : deltaColor + (x + y * tSize) * tChannels;
+    FILE *f;
+    fopen(&f, file, "wb");
+    if (f == NULL) {
+        if (Logger::ERROR_LOGGER != NULL) {
+            Logger::ERROR_LOGGER->log("EDIT", "Cannot open file '" + string(file) + "'");
+        }
+        return false;
+    }
+
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+
+    // the maximum level of the original and of the modified tiles
+    int baseLevel = -1;
+    while (!empty && OrthoCPUProducer::hasTile(baseLevel + 1, 0, 0)) {
+        ++baseLevel;
+    }
+    int maxLevel = max(baseLevel, 0);
+    map<TileCache::Tile::Id, pair<long long, int> >::iterator i = overlayTiles.begin();
+    while (i != overlayTiles.end()) {
+        maxLevel = max(maxLevel, i->first.first);
+        i++;
+    }
+
+    int root = 0;
+    int flags = getBorder() == 0 ? 2 : 0;
+    fwrite(&maxLevel, sizeof(int), 1, f);
+    fwrite(&tSize, sizeof(int), 1, f);
+    fwrite(&tChannels, sizeof(int), 1, f);
+    fwrite(&root, sizeof(int), 1, f);
+    fwrite(&root, sizeof(int), 1, f);
+    fwrite(&root, sizeof(int), 1, f);
+    fwrite(&flags, sizeof(int), 1, f);
+    int ntiles = ((1 << (maxLevel * 2 + 2)) - 1) / 3;
+    long long *offsets = new long long[ntiles * 2];
+    unsigned int *checksums = new unsigned int[ntiles];
+    fwrite(offsets, sizeof(long long) * ntiles * 2, 1, f);
+
+    // the modified tiles and the original tiles are copied without being
+    // uncompressed; the tiles that exist in neither of them are stored once
+    unsigned char *compressedData = new unsigned char[2 * tWidth * tWidth * tChannels];
+    long long constantTiles[2][2] = { { -1, -1 }, { -1, -1 } };
+    unsigned int constantChecksums[2] = { 0, 0 };
+    long long offset = 0;
+    for (int level = 0; level <= maxLevel; ++level) {
+        int n = 1 << level;
+        for (int ty = 0; ty < n; ++ty) {
+            for (int tx = 0; tx < n; ++tx) {
+                int tileid = tx + ty * n + ((1 << (2 * level)) - 1) / 3;
+                int size = 0;
+                i = overlayTiles.find(TileCache::Tile::getId(level, tx, ty));
+                if (i != overlayTiles.end()) {
+                    size = i->second.second;
+                    fseek64(overlay, i->second.first, SEEK_SET);
+                    if (fread(compressedData, size, 1, overlay) != 1) {
+                        if (Logger::WARNING_LOGGER != NULL) {
+                            ostringstream oss;
+                            oss << "Corrupted tile " << level << " " << tx << " " << ty << " in '" << overlayName << "', using original tile";
+                            Logger::WARNING_LOGGER->log("EDIT", oss.str());
+                        }
+                        size = 0;
+                    }
+                }
+                if (size == 0 && level <= baseLevel) {
+                    // a corrupted original tile is copied as an empty tile,
+                    // which is replaced with its parent tile when loaded
+                    size = readCompressedTile(level, tx, ty, compressedData);
+                } else if (size == 0) {
+                    int k = empty && level == 0 ? 0 : 1;
+                    if (constantTiles[k][0] < 0) {
+                        unsigned char *tile = new unsigned char[tWidth * tWidth * tChannels];
+                        for (int p = 0; p < tWidth * tWidth * tChannels; ++p) {
+                            tile[p] = k == 0 ? 0 : 128;
+                        }
+                        mfs_file fd;
+                        compressTile(tile, tWidth, tChannels, &fd);
+                        fwrite(fd.buf, fd.buf_size, 1, f);
+                        constantChecksums[k] = checksum(fd.buf, fd.buf_size);
+                        free(fd.buf);
+                        delete[] tile;
+                        constantTiles[k][0] = offset;
+                        offset += fd.buf_size;
+                        constantTiles[k][1] = offset;
+                    }
+                    offsets[2 * tileid] = constantTiles[k][0];
+                    offsets[2 * tileid + 1] = constantTiles[k][1];
+                    checksums[tileid] = constantChecksums[k];
+                    continue;
+                }
+                fwrite(compressedData, size, 1, f);
+                checksums[tileid] = checksum(compressedData, size);
+                offsets[2 * tileid] = offset;
+                offset += size;
+                offsets[2 * tileid + 1] = offset;
+            }
+        }
+    }
+
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+
+    writeChecksums(f, checksums, ntiles);
+    fseek(f, sizeof(int) * 7, SEEK_SET);
+    fwrite(offsets, sizeof(long long) * ntiles * 2, 1, f);
+    fclose(f);
+    delete[] offsets;
+    delete[] checksums;
+    delete[] compressedData;
+    return true;
 }
 
 bool EditOrthoCPUProducer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *data)
 {
-    TileCache::Tile::Id id = TileCache::Tile::getId(level, tx, ty);
-    map<TileCache::Tile::Id, unsigned char*>::iterator it = modifiedTiles.find(id);
-    if (it != modifiedTiles.end()) {
-        unsigned char *src = it->second;
-        unsigned char *dst = dynamic_cast<CPUTileStorage<unsigned char>::CPUSlot*>(data)->data;
-        for (int i = 0; i < tWidth * tWidth * tChannels; ++i) {
-            dst[i] = src[i];
-        }
-        return true;
-    } else if (empty) {
-        CPUTileStorage<unsigned char>::CPUSlot *cpuData = dynamic_cast<CPUTileStorage<unsigned char>::CPUSlot*>(data);
-        assert(cpuData != NULL);
-        int value = level == 0 ? 0 : 128;
-        for (int i = 0; i < cpuData->size; i++) {
-            cpuData->data[i] = value;
-        }
-        return true;
-    } else {
-        return OrthoCPUProducer::doCreateTile(level, tx, ty, data);
-    }
+    produceTile(level, tx, ty, data, false);
+    return true;
 }
 
 void EditOrthoCPUProducer::swap(ptr<EditOrthoCPUProducer> p)
 {
     OrthoCPUProducer::swap(p);
+    std::swap(empty, p->empty);
     std::swap(tWidth, p->tWidth);
     std::swap(tSize, p->tSize);
     std::swap(tChannels, p->tChannels);
-    std::swap(curId, p->curId);
-    std::swap(curDeltaColor, p->curDeltaColor);
-    std::swap(modifiedTiles, p->modifiedTiles);
     std::swap(deltaColors, p->deltaColors);
+    std::swap(overlayName, p->overlayName);
+    std::swap(overlay, p->overlay);
+    std::swap(overlaySize, p->overlaySize);
+    std::swap(overlayTiles, p->overlayTiles);
+    std::swap(pendingTiles, p->pendingTiles);
+    std::swap(updatingTiles, p->updatingTiles);
+    std::swap(mutex, p->mutex);
+    std::swap(updated, p->updated);
 }
 
 class EditOrthoCPUProducerResource : public ResourceTemplate<2, EditOrthoCPUProducer>
@@ -386,13 +884,17 @@ public:
         e = e == NULL ? desc->descriptor : e;
         ptr<TileCache> cache;
         string file;
-        checkParameters(desc, e, "name,cache,file,");
+        string overlay;
+        checkParameters(desc, e, "name,cache,file,overlay,");
         cache = manager->loadResource(getParameter(desc, e, "cache")).cast<TileCache>();
         if (e->Attribute("file") != NULL) {
             file = getParameter(desc, e, "file");
             file = manager->getLoader()->findResource(file);
         }
-        init(cache, file.c_str());
+        if (e->Attribute("overlay") != NULL) {
+            overlay = getParameter(desc, e, "overlay");
+        }
+        init(cache, file.c_str(), overlay.c_str());
     }
 };
 
@@ -35,7 +35,19 @@ namespace proland
 
 /**
  * An OrthoCPUProducer whose tiles can be edited at runtime.
- * Intended to be used with an EditOrthoProducer.
+ * Intended to be used with an EditOrthoProducer. The modified tiles are
+ * not kept in memory. They are stored, compressed, in an overlay file, and
+ * are loaded like the other tiles when they are needed in the tile cache.
+ * A new version of a modified tile is appended to this file each time it
+ * is modified (copy-on-write), so that the overlay file is always valid
+ * and can be reopened later to restore the edits (e.g. after a restart of
+ * the application). The overlay can also be merged with the original tiles
+ * into a new tile file, with #flatten.
+ *
+ * When tiles are edited, the modifications of their ancestor and neighbor
+ * tiles are not computed immediately. Instead, the tiles to update are
+ * recorded and updated when they are produced, or in the background by a
+ * Task scheduled on the cache's scheduler (if it supports prefetching).
  * @ingroup edit
  * @authors Eric Bruneton, Antoine Begault
  */
@@ -45,8 +57,13 @@ public:
     /**
      * Creates a new EditOrthoCPUProducer.
      * See #OrthoCPUProducer.
+     *
+     * @param overlay the name of the file where the modified tiles must be
+     *      stored. If this file already exists, the modified tiles it
+     *      contains are used instead of the original ones. Maybe NULL to use
+     *      a temporary file, deleted when this producer is deleted.
      */
-    EditOrthoCPUProducer(ptr<TileCache> cache, const char *name);
+    EditOrthoCPUProducer(ptr<TileCache> cache, const char *name, const char *overlay = NULL);
 
     /**
      * Deletes this EditOrthoCPUProducer.
@@ -67,16 +84,37 @@ public:
     /**
      * Updates the residual tiles produced by this producer to take into
      * account all the edited tiles since the last call to this method.
+     * The tiles are not updated immediately, but when they are produced,
+     * or in the background (see #EditOrthoCPUProducer).
      */
     void updateTiles();
 
+    /**
+     * Updates all the tiles whose update was deferred by #updateTiles.
+     * The tiles are updated in parallel in the calling thread.
+     */
+    void flushTiles();
+
     virtual bool hasTile(int level, int tx, int ty);
 
     /**
-     * Cancels all editing operations performed on this producer.
+     * Cancels all editing operations performed on this producer. This also
+     * clears the overlay file.
      */
     void reset();
 
+    /**
+     * Writes a new tile file containing the original tiles of this producer,
+     * replaced with the modified tiles where they exist. The new file can be
+     * used in place of the original one, and the overlay file can then be
+     * deleted. The original tiles must not be compressed in DXT format.
+     *
+     * @param file the name of the file to write. Must be different from the
+     *      name of the file from which the original tiles are loaded.
+     * @return true if the file was successfully written.
+     */
+    bool flatten(const char *file);
+
 protected:
     /**
      * Creates an uninitialized EditOrthoCPUProducer.
@@ -89,11 +127,22 @@ protected:
      */
     virtual void init(ptr<TileCache> cache, const char *name);
 
+    /**
+     * Initializes this EditOrthoCPUProducer.
+     * See #EditOrthoCPUProducer.
+     */
+    void init(ptr<TileCache> cache, const char *name, const char *overlay);
+
     virtual bool doCreateTile(int level, int tx, int ty, TileStorage::Slot *data);
 
     virtual void swap(ptr<EditOrthoCPUProducer> p);
 
 private:
+    /**
+     * The color deltas of a call to #updateTiles.
+     */
+    class DeltaColors;
+
     /**
      * True if there is no file associated with this producer.
      */
@@ -115,44 +164,106 @@ private:
     int tChannels;
 
     /**
-     * The id of the last color delta tile that was used in
-     * #getDeltaColor. Optimization to avoid too many lookups in
-     * the #deltaColors map.
+     * The color deltas from which to recompute the color residual tiles.
      */
-    TileCache::Tile::Id curId;
+    std::map<TileCache::Tile::Id, int*> deltaColors;
 
     /**
-     * The last color delta tile that was used in #getDeltaColor.
-     * Optimization to avoid too many lookups in the #deltaColors map.
+     * The name of the file where the modified tiles are stored. Empty if
+     * a temporary file is used.
      */
-    int *curDeltaColor;
+    std::string overlayName;
 
     /**
-     * The color residual tiles that have been modified.
+     * The file where the modified tiles are stored. Each modified tile is
+     * stored as a level, tx, ty, size record followed by 'size' bytes of
+     * compressed data, in the same format as in the original tile file.
      */
-    std::map<TileCache::Tile::Id, unsigned char*> modifiedTiles;
+    FILE *overlay;
 
     /**
-     * The color deltas from which to recompute the color residual tiles.
+     * The offset of the end of the valid records in #overlay.
      */
-    std::map<TileCache::Tile::Id, int*> deltaColors;
+    long long overlaySize;
+
+    /**
+     * The offset and size of the last version of each modified tile in
+     * #overlay.
+     */
+    std::map<TileCache::Tile::Id, std::pair<long long, int> > overlayTiles;
+
+    /**
+     * The tiles that must be updated before being produced, with the color
+     * deltas to apply to them, in the order in which they must be applied.
+     */
+    std::map<TileCache::Tile::Id, std::vector<DeltaColors*> > pendingTiles;
+
+    /**
+     * The tiles that are currently being updated by a thread.
+     */
+    std::set<TileCache::Tile::Id> updatingTiles;
+
+    /**
+     * A mutex to serialize accesses to #overlay, #overlayTiles, #pendingTiles
+     * and #updatingTiles.
+     */
+    void *mutex;
+
+    /**
+     * A condition signaled when a tile is removed from #updatingTiles.
+     */
+    void *updated;
+
+    /**
+     * Opens the given overlay file, or creates it if it does not exist,
+     * and reads the location of the modified tiles it contains.
+     *
+     * @param name the name of the overlay file, or NULL to use a temporary
+     *      file.
+     */
+    void openOverlay(const char *name);
 
     /**
-     * Returns the color delta at the given location.
+     * Appends a new version of a modified tile to #overlay. Must be called
+     * with #mutex locked.
      *
-     * @param level a quadtree level.
-     * @param n the numbers of tiles per row or column in the quadtree at
-     *      this level (1 << level).
-     * @param tx a logical tile x coordinate.
-     * @param ty a logical tile y coordinate.
-     * @param x a pixel coordinate relatively to the lower left corner of
-     *      the (level,tx,ty) tile (without borders). Can be outside the
-     *      tile itself (then the value will be looked up in an adjacent tile).
-     * @param y a pixel coordinate relatively to the lower left corner of
-     *      the (level,tx,ty) tile (without borders). Can be outside the
-     *      tile itself (then the value will be looked up in an adjacent tile).
-     */
-    int *getDeltaColor(int level, int n, int tx, int ty, int x, int y);
+     * @param id the tile's coordinates.
+     * @param data the compressed tile data.
+     * @param size the size of the compressed tile data.
+     */
+    void writeOverlayTile(TileCache::Tile::Id id, unsigned char *data, int size);
+
+    /**
+     * Produces a tile from its original or modified version, and applies
+     * the pending updates of this tile, if any. If there were pending
+     * updates, the new tile content is stored in #overlay.
+     *
+     * @param level the level of the tile.
+     * @param tx the logical x coordinate of the tile.
+     * @param ty the logical y coordinate of the tile.
+     * @param data where the tile must be stored.
+     * @param updateOnly true to do nothing if the tile has no pending
+     *      updates.
+     */
+    void produceTile(int level, int tx, int ty, TileStorage::Slot *data, bool updateOnly);
+
+    /**
+     * Applies color deltas to a residual tile.
+     *
+     * @param level the level of the tile.
+     * @param tx the logical x coordinate of the tile.
+     * @param ty the logical y coordinate of the tile.
+     * @param deltas the color deltas to apply.
+     * @param modifiedTile the residual tile to update, borders included.
+     * @param tmp a temporary buffer of tWidth*(tWidth/2+2)*tChannels values.
+     */
+    void updateTile(int level, int tx, int ty, DeltaColors *deltas, unsigned char *modifiedTile, int *tmp);
+
+    /**
+     * Produces some pending tiles. This method is a ParallelLoopBody,
+     * called from #flushTiles.
+     */
+    static void flushPendingTiles(void *context, int begin, int end);
 };
 
 }
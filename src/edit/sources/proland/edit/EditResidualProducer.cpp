@@ -27,9 +27,12 @@
 
 #include "proland/edit/EditResidualProducer.h"
 
+#include <pthread.h>
+
 #include "ork/core/Logger.h"
 #include "ork/resource/ResourceTemplate.h"
 #include "proland/producer/CPUTileStorage.h"
+#include "proland/util/parallel.h"
 
 using namespace std;
 using namespace ork;
@@ -37,48 +40,176 @@ using namespace ork;
 namespace proland
 {
 
-EditResidualProducer::EditResidualProducer(ptr<TileCache> cache, const char *name, int deltaLevel, float zscale) :
-    ResidualProducer()
+/**
+ * The journal record marking a call to updateResiduals. The other records
+ * start with the level of an edited tile, which is always positive.
+ */
+#define JOURNAL_UPDATE -1
+
+/**
+ * The elevation deltas of a residual tile and of its 8 neighbor tiles.
+ * These tiles are looked up once per residual tile, instead of once per
+ * sample in the deltaElevations map.
+ */
+struct DeltaNeighborhood
 {
-    ResidualProducer::init(cache, name, deltaLevel, zscale);
-    init();
-}
+    /**
+     * The elevation deltas of the 3x3 tiles centered on the (level,tx,ty)
+     * tile, or NULL for tiles without deltas.
+     */
+    float *tiles[9];
+
+    int tSize;
+
+    int w;
+
+    int n;
+
+    int tx;
+
+    int ty;
+
+    /**
+     * Returns the elevation delta at the given location. See
+     * EditResidualProducer#updateResiduals for the meaning of the parameters.
+     *
+     * @param x a pixel coordinate relatively to the lower left corner of
+     *      the (level,tx,ty) tile (without borders). Must be at most 5
+     *      pixels outside this tile.
+     * @param y a pixel coordinate relatively to the lower left corner of
+     *      the (level,tx,ty) tile (without borders). Must be at most 5
+     *      pixels outside this tile.
+     */
+    float get(int x, int y) const
+    {
+        return getAbsolute(x + tx * w, y + ty * w);
+    }
 
-EditResidualProducer::EditResidualProducer() : ResidualProducer()
+    float getAbsolute(int x, int y) const
+    {
+        int nw = n * w;
+        if (x >= 0 && x <= nw && y >= 0 && y <= nw) {
+            int i = min(x, nw - 1) / w - tx + 1;
+            int j = min(y, nw - 1) / w - ty + 1;
+            assert(i >= 0 && i <= 2 && j >= 0 && j <= 2);
+            x = (x == nw ? w : x % w);
+            y = (y == nw ? w : y % w);
+            float *deltaElevation = tiles[i + 3 * j];
+            return deltaElevation == NULL ? 0.0f : deltaElevation[x + y * (tSize + 1)];
+        } else {
+            int x0 = clamp(x, 0, nw);
+            int y0 = clamp(y, 0, nw);
+            int x1 = 2 * x0 - x;
+            int y1 = 2 * y0 - y;
+            return 2.0f * getAbsolute(x0, y0) - getAbsolute(x1, y1);
+        }
+    }
+};
+
+/**
+ * The residual tiles to be updated in EditResidualProducer::updateResiduals.
+ */
+struct ResidualUpdate
 {
-    map<TileCache::Tile::Id, float*>::iterator i = modifiedTiles.begin();
-    while (i != modifiedTiles.end()) {
+    EditResidualProducer *producer;
+
+    /**
+     * The coordinates of the residual tiles to update.
+     */
+    vector<TileCache::Tile::Id> ids;
+
+    /**
+     * The current content of these tiles, or NULL for tiles that are not
+     * yet modified (which must first be loaded from the original residuals).
+     */
+    vector<float*> oldTiles;
+
+    /**
+     * The updated content of these tiles, computed in new arrays so that
+     * the current tiles can still be used by concurrent doCreateTile calls.
+     */
+    vector<float*> newTiles;
+};
+
+// deletes the tiles of the given map and clears it
+static void deleteTiles(map<TileCache::Tile::Id, float*> &tiles)
+{
+    map<TileCache::Tile::Id, float*>::iterator i = tiles.begin();
+    while (i != tiles.end()) {
         delete[] i->second;
         i++;
     }
+    tiles.clear();
 }
 
-void EditResidualProducer::init()
+EditResidualProducer::EditResidualProducer(ptr<TileCache> cache, const char *name, int deltaLevel, float zscale, const char *journal) :
+    ResidualProducer()
+{
+    ResidualProducer::init(cache, name, deltaLevel, zscale);
+    init(journal);
+}
+
+EditResidualProducer::EditResidualProducer() : ResidualProducer(), tilesMutex(NULL), journal(NULL)
+{
+}
+
+void EditResidualProducer::init(const char *journal)
 {
     tWidth = getCache()->getStorage()->getTileSize();
     tSize = tWidth - 5;
-    curId = make_pair(-1, make_pair(0, 0));
-    curDeltaElevation = NULL;
+    tilesMutex = new pthread_mutex_t;
+    pthread_mutex_init((pthread_mutex_t*) tilesMutex, NULL);
+    journalName = journal == NULL ? "" : journal;
+    this->journal = NULL;
+    if (journalName.size() > 0) {
+        openJournal();
+    }
 }
 
 EditResidualProducer::~EditResidualProducer()
 {
+    if (journal != NULL) {
+        fclose(journal);
+    }
+    deleteTiles(modifiedTiles);
+    deleteTiles(deltaElevations);
+    if (tilesMutex != NULL) {
+        pthread_mutex_destroy((pthread_mutex_t*) tilesMutex);
+        delete (pthread_mutex_t*) tilesMutex;
+    }
 }
 
 void EditResidualProducer::editedTile(int level, int tx, int ty, float *deltaElevation)
 {
-    bool empty = true;
-    for (int p = 0; p < (tSize + 1) * (tSize + 1); ++p) {
-        if (deltaElevation[p] != 0.0f) {
-            empty = false;
-            break;
+    // computes the bounding box of the non zero deltas
+    int x0 = tSize + 1;
+    int y0 = tSize + 1;
+    int x1 = -1;
+    int y1 = -1;
+    for (int y = 0; y <= tSize; ++y) {
+        for (int x = 0; x <= tSize; ++x) {
+            if (deltaElevation[x + y * (tSize + 1)] != 0.0f) {
+                x0 = min(x0, x);
+                y0 = min(y0, y);
+                x1 = max(x1, x);
+                y1 = max(y1, y);
+            }
         }
     }
-    if (empty) {
+    if (x1 < 0) {
         delete[] deltaElevation;
         return;
     }
 
+    if (journal != NULL) {
+        // records the non zero part of the deltas
+        int record[7] = { level, tx, ty, x0, y0, x1, y1 };
+        fwrite(record, sizeof(int), 7, journal);
+        for (int y = y0; y <= y1; ++y) {
+            fwrite(deltaElevation + x0 + y * (tSize + 1), sizeof(float), x1 - x0 + 1, journal);
+        }
+    }
+
     TileCache::Tile::Id id = make_pair(level, make_pair(tx, ty));
     deltaElevations.insert(make_pair(id, deltaElevation));
 
@@ -124,6 +255,15 @@ void EditResidualProducer::editedTile(int level, int tx, int ty, float *deltaEle
 
 void EditResidualProducer::updateResiduals()
 {
+    if (deltaElevations.empty()) {
+        return;
+    }
+    if (journal != NULL) {
+        int record = JOURNAL_UPDATE;
+        fwrite(&record, sizeof(int), 1, journal);
+        fflush(journal);
+    }
+
     // computes the set of modified residual tiles
     // (for each edited residual tile, the tile itself and its 8 neighbors are modified)
     set<TileCache::Tile::Id> modifiedResiduals;
@@ -147,44 +287,90 @@ void EditResidualProducer::updateResiduals()
         i++;
     }
 
-    float *tmp = new float[tWidth * (tWidth / 2 + 3)];
-
-    // updates the modified residual tiles
+    // finds the current content of the modified residual tiles; the map
+    // is only modified by this thread, so it can be read without locking
+    ResidualUpdate update;
+    update.producer = this;
     set<TileCache::Tile::Id>::iterator j = modifiedResiduals.begin();
     while (j != modifiedResiduals.end()) {
-        TileCache::Tile::Id id = *j;
+        TileCache::Tile::Id key = TileCache::Tile::getId(j->first, j->second.first, j->second.second);
+        map<TileCache::Tile::Id, float*>::iterator k = modifiedTiles.find(key);
+        update.ids.push_back(key);
+        update.oldTiles.push_back(k == modifiedTiles.end() ? NULL : k->second);
+        update.newTiles.push_back(NULL);
+        j++;
+    }
+
+    // computes the updated residual tiles
+    parallelFor(0, (int) update.ids.size(), updateResidualTiles, &update);
+
+    // replaces the modified residual tiles with their updated content
+    pthread_mutex_lock((pthread_mutex_t*) tilesMutex);
+    for (unsigned int t = 0; t < update.ids.size(); ++t) {
+        delete[] update.oldTiles[t];
+        modifiedTiles[update.ids[t]] = update.newTiles[t];
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) tilesMutex);
+
+    deleteTiles(deltaElevations);
+}
+
+void EditResidualProducer::updateResidualTiles(void *context, int begin, int end)
+{
+    ResidualUpdate *update = (ResidualUpdate*) context;
+    EditResidualProducer *p = update->producer;
+    int tWidth = p->tWidth;
+    int tSize = p->tSize;
+
+    float *tmp = new float[tWidth * (tWidth / 2 + 3)];
+
+    for (int t = begin; t < end; ++t) {
+        TileCache::Tile::Id id = update->ids[t];
         int level = id.first;
         int tx = id.second.first;
         int ty = id.second.second;
-        TileCache::Tile::Id key = TileCache::Tile::getId(level, tx, ty);
 
-        // finds the modified residual tile, creates it if necessary
-        float *modifiedTile = NULL;
-        map<TileCache::Tile::Id, float*>::iterator k = modifiedTiles.find(key);
-        if (k == modifiedTiles.end()) {
-            CPUTileStorage<float>::CPUSlot *slot = new CPUTileStorage<float>::CPUSlot(getCache()->getStorage().get(), tWidth * tWidth);
-            doCreateTile(level, tx, ty, slot);
-            modifiedTiles.insert(make_pair(key, slot->data));
-            modifiedTile = slot->data;
-            slot->data = NULL;
+        // copies the current residual tile, or loads it if necessary
+        float *modifiedTile = new float[tWidth * tWidth];
+        float *oldTile = update->oldTiles[t];
+        if (oldTile == NULL) {
+            CPUTileStorage<float>::CPUSlot *slot = new CPUTileStorage<float>::CPUSlot(p->getCache()->getStorage().get(), tWidth * tWidth, modifiedTile);
+            p->ResidualProducer::doCreateTile(level, tx, ty, slot);
             delete slot;
         } else {
-            modifiedTile = k->second;
+            for (int i = 0; i < tWidth * tWidth; ++i) {
+                modifiedTile[i] = oldTile[i];
+            }
         }
+        update->newTiles[t] = modifiedTile;
 
         int offset = 2 * tWidth + 2;
         float *tmp0 = tmp + offset;
         float *modifiedTile0 = modifiedTile + offset;
 
-        int l = level + getDeltaLevel();
-        int n = l < getMinLevel() ? 1 : (1 << (l - getMinLevel()));
-        int w = l < getMinLevel() ? tSize >> (getMinLevel() - l) : tSize;
+        int l = level + p->getDeltaLevel();
+        int n = l < p->getMinLevel() ? 1 : (1 << (l - p->getMinLevel()));
+        int w = l < p->getMinLevel() ? tSize >> (p->getMinLevel() - l) : tSize;
+
+        // finds the elevation deltas of this tile and of its neighbors
+        DeltaNeighborhood d;
+        d.tSize = tSize;
+        d.w = w;
+        d.n = n;
+        d.tx = tx;
+        d.ty = ty;
+        for (int j = 0; j < 3; ++j) {
+            for (int i = 0; i < 3; ++i) {
+                map<TileCache::Tile::Id, float*>::iterator k = p->deltaElevations.find(TileCache::Tile::getId(level, tx + i - 1, ty + j - 1));
+                d.tiles[i + 3 * j] = k == p->deltaElevations.end() ? NULL : k->second;
+            }
+        }
 
         // updates the modified residual tile content
         if (level == 0) {
             for (int y = -2; y <= w + 2; ++y) {
                 for (int x = -2; x <= w + 2; ++x) {
-                    modifiedTile0[x + y * tWidth] += getDeltaElevation(level, w, n, tx, ty, x, y);
+                    modifiedTile0[x + y * tWidth] += d.get(x, y);
                 }
             }
         } else {
@@ -192,30 +378,30 @@ void EditResidualProducer::updateResiduals()
             // unoptimized version
             for (int y = -2; y <= w + 2; ++y) {
                 for (int x = -2; x <= w + 2; ++x) {
-                    float z = getDeltaElevation(level, w, n, tx, ty, x, y);
+                    float z = d.get(x, y);
                     if (y%2 == 0) {
                         if (x % 2 == 0) {
                             z = 0.0f;
                         } else {
-                            float z0 = getDeltaElevation(level, w, n, tx, ty, x - 3, y);
-                            float z1 = getDeltaElevation(level, w, n, tx, ty, x - 1, y);
-                            float z2 = getDeltaElevation(level, w, n, tx, ty, x + 1, y);
-                            float z3 = getDeltaElevation(level, w, n, tx, ty, x + 3, y);
+                            float z0 = d.get(x - 3, y);
+                            float z1 = d.get(x - 1, y);
+                            float z2 = d.get(x + 1, y);
+                            float z3 = d.get(x + 3, y);
                             z -= ((z1 + z2) * 9.0f - (z0 + z3)) / 16.0f;
                         }
                     } else {
                         if (x % 2 == 0) {
-                            float z0 = getDeltaElevation(level, w, n, tx, ty, x, y - 3);
-                            float z1 = getDeltaElevation(level, w, n, tx, ty, x, y - 1);
-                            float z2 = getDeltaElevation(level, w, n, tx, ty, x, y + 1);
-                            float z3 = getDeltaElevation(level, w, n,tx, ty, x, y + 3);
+                            float z0 = d.get(x, y - 3);
+                            float z1 = d.get(x, y - 1);
+                            float z2 = d.get(x, y + 1);
+                            float z3 = d.get(x, y + 3);
                             z -= ((z1 + z2) * 9.0f - (z0 + z3)) / 16.0f;
                         } else {
                             for (int dy = -3; dy <= 3; dy += 2) {
                                 float f = dy == -3 || dy == 3 ? -1.0f / 16.0f : 9.0f / 16.0f;
                                 for (int dx = -3; dx <= 3; dx += 2) {
                                     float g = dx == -3 || dx == 3 ? -1.0f / 16.0f : 9.0f / 16.0f;
-                                    z -= f * g * getDeltaElevation(level, w, n, tx, ty, x + dx, y + dy);
+                                    z -= f * g * d.get(x + dx, y + dy);
                                 }
                             }
                         }
@@ -229,13 +415,13 @@ void EditResidualProducer::updateResiduals()
             // optimized version
             for (int y = -4; y <= w + 4; y += 2) {
                 for (int x = -2; x <= w + 2; x += 2) {
-                    tmp0[x + (y / 2) * tWidth] = getDeltaElevation(level, w, n, tx, ty, x, y);
+                    tmp0[x + (y / 2) * tWidth] = d.get(x, y);
                 }
                 for (int x = -1; x <= w + 2; x += 2) {
-                    float z0 = getDeltaElevation(level, w, n, tx, ty, x - 3, y);
-                    float z1 = getDeltaElevation(level, w, n, tx, ty, x - 1, y);
-                    float z2 = getDeltaElevation(level, w, n, tx, ty, x + 1, y);
-                    float z3 = getDeltaElevation(level, w,n, tx, ty, x + 3, y);
+                    float z0 = d.get(x - 3, y);
+                    float z1 = d.get(x - 1, y);
+                    float z2 = d.get(x + 1, y);
+                    float z3 = d.get(x + 3, y);
                     float z = (z1 + z2) * (9.0f / 16.0f) - (z0 + z3) * (1.0f / 16.0f);
                     tmp0[x + (y / 2) * tWidth] = z;
                 }
@@ -243,7 +429,7 @@ void EditResidualProducer::updateResiduals()
             for (int y = -2; y <= w + 2; y += 2) {
                 for (int x = -1; x <= w + 2; x += 2) {
                     float z = tmp0[x + (y / 2) * tWidth];
-                    modifiedTile0[x + y * tWidth] += getDeltaElevation(level, w, n, tx, ty, x, y) - z;
+                    modifiedTile0[x + y * tWidth] += d.get(x, y) - z;
                 }
             }
             for (int y = -1; y <= w + 2; y += 2) {
@@ -253,72 +439,134 @@ void EditResidualProducer::updateResiduals()
                     float z2 = tmp0[x + (y + 1) / 2 * tWidth];
                     float z3 = tmp0[x + (y + 3) / 2 * tWidth];
                     float z = (z1 + z2) * (9.0f / 16.0f) - (z0 + z3) * (1.0f / 16.0f);
-                    modifiedTile0[x + y * tWidth] += getDeltaElevation(level, w, n, tx, ty, x, y) - z;
+                    modifiedTile0[x + y * tWidth] += d.get(x, y) - z;
                 }
             }
         }
-
-        j++;
     }
 
     delete[] tmp;
-
-    i = deltaElevations.begin();
-    while (i != deltaElevations.end()) {
-        delete[] i->second;
-        i++;
-    }
-    deltaElevations.clear();
 }
 
 void EditResidualProducer::reset()
 {
-    map<TileCache::Tile::Id, float*>::iterator i = modifiedTiles.begin();
-    while (i != modifiedTiles.end()) {
-        delete[] i->second;
-        i++;
+    pthread_mutex_lock((pthread_mutex_t*) tilesMutex);
+    deleteTiles(modifiedTiles);
+    pthread_mutex_unlock((pthread_mutex_t*) tilesMutex);
+    if (journal != NULL) {
+        fclose(journal);
+        fopen(&journal, journalName.c_str(), "wb");
+        if (journal != NULL) {
+            fwrite(&tSize, sizeof(int), 1, journal);
+            fflush(journal);
+        }
     }
-    modifiedTiles.clear();
     invalidateTiles();
 }
 
-float EditResidualProducer::getDeltaElevation(int level, int w, int n, int tx, int ty, int x, int y)
+bool EditResidualProducer::writeResiduals(const char *file)
 {
-    x += tx * w;
-    y += ty * w;
-    int nw = n * w;
-    if (x >= 0 && x <= nw && y >= 0 && y <= nw) {
-        tx = min(x, nw - 1) / w;
-        ty = min(y, nw - 1) / w;
-        x = (x == nw ? w : x % w);
-        y = (y == nw ? w : y % w);
-
-        float *deltaElevation = NULL;
-        TileCache::Tile::Id id = TileCache::Tile::getId(level, tx, ty);
-        if (id == curId) {
-            deltaElevation = curDeltaElevation;
-        } else {
-            map<TileCache::Tile::Id, float*>::iterator i = deltaElevations.find(id);
-            if (i != deltaElevations.end()) {
-                deltaElevation = i->second;
+    updateResiduals();
+    return writeTiles(file, modifiedTiles);
+}
+
+void EditResidualProducer::openJournal()
+{
+    // the journal starts with the residual tile size, followed by records
+    // made of the level, tx, ty, x0, y0, x1, y1 values of an edited tile,
+    // followed by its [x0,x1]x[y0,y1] elevation deltas (see #editedTile),
+    // or by a JOURNAL_UPDATE record (see #updateResiduals)
+    FILE *f = NULL;
+    fopen(&f, journalName.c_str(), "rb");
+    long valid = 0;
+    long size = 0;
+    if (f != NULL) {
+        int s;
+        if (fread(&s, sizeof(int), 1, f) == 1) {
+            if (s != tSize) {
+                if (Logger::ERROR_LOGGER != NULL) {
+                    Logger::ERROR_LOGGER->log("EDIT", "Invalid tile size in journal '" + journalName + "'");
+                }
+                fclose(f);
+                journalName = "";
+                return;
+            }
+            valid = sizeof(int);
+            int record[7];
+            while (fread(record, sizeof(int), 1, f) == 1) {
+                if (record[0] == JOURNAL_UPDATE) {
+                    updateResiduals();
+                    valid = ftell(f);
+                    continue;
+                }
+                if (fread(record + 1, sizeof(int), 6, f) != 6 || record[0] < 0 || record[1] < 0 || record[2] < 0 ||
+                    record[3] < 0 || record[4] < 0 || record[5] > tSize || record[6] > tSize ||
+                    record[3] > record[5] || record[4] > record[6]) {
+                    break;
+                }
+                int w = record[5] - record[3] + 1;
+                float *deltaElevation = new float[(tSize + 1) * (tSize + 1)];
+                for (int p = 0; p < (tSize + 1) * (tSize + 1); ++p) {
+                    deltaElevation[p] = 0.0f;
+                }
+                bool ok = true;
+                for (int y = record[4]; y <= record[6] && ok; ++y) {
+                    ok = fread(deltaElevation + record[3] + y * (tSize + 1), sizeof(float), w, f) == (size_t) w;
+                }
+                if (!ok) {
+                    delete[] deltaElevation;
+                    break;
+                }
+                editedTile(record[0], record[1], record[2], deltaElevation);
             }
-            curId = id;
-            curDeltaElevation = deltaElevation;
+            fseek(f, 0, SEEK_END);
+            size = ftell(f);
         }
+        // discards the edits that were not followed by an update
+        deleteTiles(deltaElevations);
+    }
 
-        return deltaElevation == NULL ? 0.0f : deltaElevation[x + y * (tSize + 1)];
+    if (valid == 0) {
+        // new journal
+        if (f != NULL) {
+            fclose(f);
+        }
+        fopen(&journal, journalName.c_str(), "wb");
+        if (journal != NULL) {
+            fwrite(&tSize, sizeof(int), 1, journal);
+        }
+    } else if (valid < size) {
+        // incomplete or corrupted journal: keeps only its valid part
+        if (Logger::WARNING_LOGGER != NULL) {
+            Logger::WARNING_LOGGER->log("EDIT", "Discarding incomplete edits in journal '" + journalName + "'");
+        }
+        char *data = new char[valid];
+        fseek(f, 0, SEEK_SET);
+        fread(data, valid, 1, f);
+        fclose(f);
+        fopen(&journal, journalName.c_str(), "wb");
+        if (journal != NULL) {
+            fwrite(data, valid, 1, journal);
+        }
+        delete[] data;
     } else {
-        int x0 = clamp(x, 0, nw);
-        int y0 = clamp(y, 0, nw);
-        int x1 = 2 * x0 - x;
-        int y1 = 2 * y0 - y;
-        return 2.0f * getDeltaElevation(level, w, n, 0, 0, x0, y0) - getDeltaElevation(level, w, n, 0, 0, x1, y1);
+        fclose(f);
+        fopen(&journal, journalName.c_str(), "ab");
+    }
+
+    if (journal == NULL) {
+        if (Logger::ERROR_LOGGER != NULL) {
+            Logger::ERROR_LOGGER->log("EDIT", "Cannot open journal '" + journalName + "'");
+        }
+    } else {
+        fflush(journal);
     }
 }
 
 bool EditResidualProducer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *data)
 {
     TileCache::Tile::Id id = TileCache::Tile::getId(level, tx, ty);
+    pthread_mutex_lock((pthread_mutex_t*) tilesMutex);
     map<TileCache::Tile::Id, float*>::iterator it = modifiedTiles.find(id);
     if (it != modifiedTiles.end()) {
         float *src = it->second;
@@ -327,8 +575,10 @@ bool EditResidualProducer::doCreateTile(int level, int tx, int ty, TileStorage::
         for (int i = 0; i < tileWidth * tileWidth; ++i) {
             dst[i] = src[i];
         }
+        pthread_mutex_unlock((pthread_mutex_t*) tilesMutex);
         return true;
     } else {
+        pthread_mutex_unlock((pthread_mutex_t*) tilesMutex);
         return ResidualProducer::doCreateTile(level, tx, ty, data);
     }
 }
@@ -338,10 +588,11 @@ void EditResidualProducer::swap(ptr<EditResidualProducer> p)
     ResidualProducer::swap(p);
     std::swap(tWidth, p->tWidth);
     std::swap(tSize, p->tSize);
-    std::swap(curId, p->curId);
-    std::swap(curDeltaElevation, p->curDeltaElevation);
     std::swap(modifiedTiles, p->modifiedTiles);
+    std::swap(tilesMutex, p->tilesMutex);
     std::swap(deltaElevations, p->deltaElevations);
+    std::swap(journalName, p->journalName);
+    std::swap(journal, p->journal);
 }
 
 class EditResidualProducerResource : public ResourceTemplate<2, EditResidualProducer>
@@ -351,9 +602,13 @@ public:
         ResourceTemplate<2, EditResidualProducer>(manager, name, desc)
     {
         e = e == NULL ? desc->descriptor : e;
-        checkParameters(desc, e, "name,cache,file,delta,scale,");
+        checkParameters(desc, e, "name,cache,file,delta,scale,journal,");
         ResidualProducer::init(manager, this, name, desc, e);
-        init();
+        string journal;
+        if (e->Attribute("journal") != NULL) {
+            journal = getParameter(desc, e, "journal");
+        }
+        init(journal.c_str());
     }
 };
 
@@ -35,7 +35,13 @@ namespace proland
 
 /**
  * A ResidualProducer whose tiles can be edited at runtime.
- * Intended to be used with an EditElevationProducer.
+ * Intended to be used with an EditElevationProducer. The edits can be
+ * recorded in a journal file, in order to restore them when this producer
+ * is created again (e.g. after a restart of the application). This journal
+ * only contains the non zero part of the elevation deltas of each edited
+ * tile, in the order in which they were made. It can be merged into a new
+ * residual tiles file with #writeResiduals, in order to keep the journal
+ * short.
  * @ingroup edit
  * @authors Eric Bruneton, Antoine Begault
  */
@@ -45,8 +51,13 @@ public:
     /**
      * Creates a new EditResidualProducer.
      * See #ResidualProducer.
+     *
+     * @param journal the name of the file where the edits must be recorded.
+     *      If this file already exists, the edits it contains are replayed
+     *      first, and the new edits are appended to it. Maybe NULL to not
+     *      record the edits.
      */
-    EditResidualProducer(ptr<TileCache> cache, const char *name, int deltaLevel = 0, float zscale = 1.0);
+    EditResidualProducer(ptr<TileCache> cache, const char *name, int deltaLevel = 0, float zscale = 1.0, const char *journal = NULL);
 
     /**
      * Deletes this EditResidualProducer.
@@ -71,10 +82,24 @@ public:
     void updateResiduals();
 
     /**
-     * Cancels all editing operations performed on this producer.
+     * Cancels all editing operations performed on this producer. This also
+     * clears the journal file, if any.
      */
     void reset();
 
+    /**
+     * Writes a copy of the residual tiles file of this producer, including
+     * all the edits performed so far (see ResidualProducer#writeTiles). The
+     * journal file, if any, can then be deleted, and the new file can be
+     * used in place of the original one. This method can be used offline,
+     * with a producer created with a CPUTileStorage and a journal file.
+     *
+     * @param file the name of the file to write. Must be different from the
+     *      name of the residual tiles file of this producer.
+     * @return true if the file was successfully written.
+     */
+    bool writeResiduals(const char *file);
+
 protected:
     /**
      * Creates an uninitialized EditResidualProducer.
@@ -83,8 +108,11 @@ protected:
 
     /**
      * Initializes this EditResidualProducer.
+     *
+     * @param journal the name of the file where the edits must be recorded,
+     *      or NULL. See #EditResidualProducer.
      */
-    void init();
+    void init(const char *journal = NULL);
 
     virtual bool doCreateTile(int level, int tx, int ty, TileStorage::Slot *data);
 
@@ -102,46 +130,48 @@ private:
     int tSize;
 
     /**
-     * The id of the last elevation delta tile that was used in
-     * #getDeltaElevation. Optimization to avoid too many lookups in
-     * the #deltaElevations map.
+     * The residual tiles that have been modified.
      */
-    TileCache::Tile::Id curId;
+    std::map<TileCache::Tile::Id, float*> modifiedTiles;
 
     /**
-     * The last elevation delta tile that was used in #getDeltaElevation.
-     * Optimization to avoid too many lookups in the #deltaElevations map.
+     * A mutex used to serialize accesses to #modifiedTiles.
      */
-    float *curDeltaElevation;
+    void *tilesMutex;
 
     /**
-     * The residual tiles that have been modified.
+     * The elevation deltas from which to recompute the residual tiles.
      */
-    std::map<TileCache::Tile::Id, float*> modifiedTiles;
+    std::map<TileCache::Tile::Id, float*> deltaElevations;
 
     /**
-     * The elevation deltas from which to recompute the residual tiles.
+     * The name of the file where the edits are recorded. Empty if the
+     * edits are not recorded.
      */
-    std::map<TileCache::Tile::Id, float*> deltaElevations;
+    std::string journalName;
+
+    /**
+     * The file where the edits are recorded, opened in append mode.
+     * NULL if the edits are not recorded, or while the journal is replayed.
+     */
+    FILE *journal;
 
     /**
-     * Returns the elevation delta at the given location.
+     * Replays the edits recorded in #journalName, and opens #journal. An
+     * incomplete edit at the end of the journal (i.e. one that was not
+     * followed by a call to #updateResiduals) is discarded.
+     */
+    void openJournal();
+
+    /**
+     * Recomputes some modified residual tiles from #deltaElevations. This
+     * method is a ParallelLoopBody, called from #updateResiduals.
      *
-     * @param level a quadtree level.
-     * @param w the actual tile size at this level (without borders; can be
-     *      different than tSize for level less than minLevel).
-     * @param n the numbers of tiles per row or column in the quadtree at
-     *      this level (not simply 1 << level if minLevel != 0).
-     * @param tx a logical tile x coordinate.
-     * @param ty a logical tile y coordinate.
-     * @param x a pixel coordinate relatively to the lower left corner of
-     *      the (level,tx,ty) tile (without borders). Can be outside the
-     *      tile itself (then the value will be looked up in an adjacent tile).
-     * @param y a pixel coordinate relatively to the lower left corner of
-     *      the (level,tx,ty) tile (without borders). Can be outside the
-     *      tile itself (then the value will be looked up in an adjacent tile).
-     */
-    float getDeltaElevation(int level, int w, int n, int tx, int ty, int x, int y);
+     * @param context the modified residual tiles to update.
+     * @param begin the index of the first tile to update.
+     * @param end the index after the last tile to update.
+     */
+    static void updateResidualTiles(void *context, int begin, int end);
 };
 
 }
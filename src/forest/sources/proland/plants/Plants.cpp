@@ -27,9 +27,12 @@
 
 #include "proland/plants/Plants.h"
 
+#include <cstdio>
+
 #include "ork/resource/ResourceTemplate.h"
 
 #include "proland/math/noise.h"
+#include "proland/util/parallel.h"
 
 using namespace std;
 using namespace ork;
@@ -44,6 +47,18 @@ static const float TWO_PI = (float) (M_PI*2);
 // % of plane covered with disks when genereated with algorithm below
 #define POISSON_COVERAGE 0.6826
 
+/**
+ * Identifies the cache files of the plants patterns ("PLPT").
+ */
+#define PLANTS_PATTERNS_MAGIC 0x54504C50
+
+/**
+ * The format version of the cache files of the plants patterns. Must be
+ * incremented when PlantsPatternGenerator changes, to invalidate the
+ * patterns saved with previous versions.
+ */
+#define PLANTS_PATTERNS_VERSION 1
+
 /**
  * Allows fast-computing of the available area around a point, using
  * angles. Acquired from Qizhi Yu's implementation of his thesis, itself
@@ -224,7 +239,9 @@ private:
     void insertRange(int pos, float min, float max)
     {
         if (numRanges == rangesSize) {
-            rangesSize++;
+            // grows geometrically, so that the list is reallocated only a
+            // logarithmic number of times, and never after the first patterns
+            rangesSize *= 2;
             RangeEntry *tmp = new RangeEntry[rangesSize];
             memcpy(tmp, ranges, numRanges * sizeof(*tmp));
             delete[] ranges;
@@ -414,17 +431,26 @@ void Plants::swap(ptr<Plants> p)
     std::swap(patterns, p->patterns);
 }
 
-class PlantsResource : public ResourceTemplate<40, Plants>
+/**
+ * Generates Poisson-disk patterns of points in the unit square. Each
+ * generator has its own random number generator, grid and range list, so
+ * that several patterns can be generated concurrently.
+ */
+class PlantsPatternGenerator
 {
 public:
     long rand;
 
-    RangeList *ranges;
+    RangeList ranges;
 
     PlantsGrid *grid;
 
     float radius;
 
+    PlantsPatternGenerator(long seed) : rand(seed), grid(NULL), radius(0.0f)
+    {
+    }
+
     float randUnsignedInt() {
         union {
             float f;
@@ -434,16 +460,16 @@ public:
         return val.f;
     }
 
-    void generatePattern(ptr< Mesh<vec3f, unsigned short> > &pattern)
+    void generatePattern(int density, vector<vec3f> &pattern)
     {
-        ranges = new RangeList();
+        radius = 1.0 / sqrt(density * M_PI / POISSON_COVERAGE);
         grid = new PlantsGrid(4.0f * radius, 64);
 
         vector<vec2f> candidates;
 
         vec2f p(0.5, 0.5);
         candidates.push_back(p);
-        pattern->addVertex(vec3f(p.x, p.y, randUnsignedInt()));
+        pattern.push_back(vec3f(p.x, p.y, randUnsignedInt()));
         grid->addParticle(p);
 
         while (!candidates.empty()) {
@@ -454,47 +480,45 @@ public:
             candidates[c] = candidates[int(candidates.size()) - 1];
             candidates.pop_back();
 
-            ranges->reset(0.0f, 2.0f * M_PI);
+            ranges.reset(0.0f, 2.0f * M_PI);
             findNeighborRanges(p);
 
-            while (ranges->getRangeCount() != 0) {
+            while (ranges.getRangeCount() != 0) {
                 // selects a range at random
-                const RangeList::RangeEntry *re = ranges->getRange(lrandom(&rand) % ranges->getRangeCount());
+                const RangeList::RangeEntry *re = ranges.getRange(lrandom(&rand) % ranges.getRangeCount());
                 // selects a point at random in this range
                 float angle = re->min + (re->max - re->min) * frandom(&rand);
-                ranges->subtract(angle - M_PI / 3.0f, angle + M_PI / 3.0f);
+                ranges.subtract(angle - M_PI / 3.0f, angle + M_PI / 3.0f);
 
                 vec2f pt = p + vec2f(cos(angle), sin(angle)) * 2.0f * radius;
                 if (pt.x >= 0.0 && pt.x < 1.0 && pt.y >= 0.0 && pt.y < 1.0) {
                     candidates.push_back(pt);
-                    pattern->addVertex(vec3f(pt.x, pt.y, randUnsignedInt()));
+                    pattern.push_back(vec3f(pt.x, pt.y, randUnsignedInt()));
                     grid->addParticle(pt);
                 }
             }
         }
 
-        delete ranges;
         delete grid;
+        grid = NULL;
     }
 
-    void generateRandomPattern(ptr< Mesh<vec3f, unsigned short> > &pattern, int n) {
+    void generateRandomPattern(int n, vector<vec3f> &pattern) {
         for (int i = 0; i < n; ++i) {
             float x = frandom(&rand);
             float y = frandom(&rand);
-            pattern->addVertex(vec3f(x, y, randUnsignedInt()));
+            pattern.push_back(vec3f(x, y, randUnsignedInt()));
         }
     }
 
     void findNeighborRanges(const vec2f &p)
     {
-        vec2i gridSize = grid->getGridSize();
         vec2i cell = grid->getCell(p);
 
         float rangeSqrD = 16.0f * radius * radius;
 
         int n = grid->getCellSize(cell);
         vec2f *neighbors = grid->getCellContent(cell);
-        int count = 0;
         for (int j = 0; j < n; ++j) {
             vec2f ns = neighbors[j];
             if (ns == p) {
@@ -506,17 +530,111 @@ public:
                 float dist = sqrt(sqrD);
                 float angle = atan2(v.y, v.x);
                 float theta = safe_acos(0.25f * dist / radius);
-                count++;
-                ranges->subtract(angle - theta, angle + theta);
+                ranges.subtract(angle - theta, angle + theta);
             }
         }
     }
+};
+
+/**
+ * The patterns to be generated by a parallel PlantsPatternGenerator loop.
+ */
+struct PlantsPatterns
+{
+    vector<long> seeds;
+
+    vector<int> densities;
+
+    vector< vector<vec3f> > patterns;
+};
+
+static void generatePlantsPatterns(void *context, int begin, int end)
+{
+    PlantsPatterns *p = (PlantsPatterns*) context;
+    for (int i = begin; i < end; ++i) {
+        PlantsPatternGenerator generator(p->seeds[i]);
+        generator.generatePattern(p->densities[i], p->patterns[i]);
+    }
+}
 
+/**
+ * Loads Poisson-disk patterns from a pattern cache file. Returns false if
+ * the file does not exist, if it was created with other parameters or with
+ * another version of the pattern generator, or if it is corrupted.
+ */
+static bool loadPlantsPatterns(const string &file, const int key[4], vector< vector<vec3f> > &patterns)
+{
+    FILE *f;
+    fopen(&f, file.c_str(), "rb");
+    if (f == NULL) {
+        return false;
+    }
+    int header[6];
+    float coverage;
+    bool valid = fread(header, sizeof(int), 6, f) == 6 && fread(&coverage, sizeof(float), 1, f) == 1;
+    valid = valid && header[0] == PLANTS_PATTERNS_MAGIC && header[1] == PLANTS_PATTERNS_VERSION;
+    valid = valid && coverage == (float) POISSON_COVERAGE;
+    for (int i = 0; valid && i < 4; ++i) {
+        valid = header[i + 2] == key[i];
+    }
+    for (int i = 0; valid && i < key[3]; ++i) {
+        // a pattern has about 'density' points, and the disks of a Poisson
+        // pattern cannot cover more than 91% of the plane: bounds n to detect
+        // corrupted files before allocating memory
+        int n;
+        valid = fread(&n, sizeof(int), 1, f) == 1 && n > 0 && n <= 2 * key[2];
+        if (valid) {
+            patterns[i].resize(n);
+            valid = fread(&(patterns[i][0]), sizeof(vec3f), n, f) == (size_t) n;
+        }
+    }
+    fclose(f);
+    return valid;
+}
+
+/**
+ * Saves Poisson-disk patterns in a pattern cache file.
+ */
+static void savePlantsPatterns(const string &file, const int key[4], const vector< vector<vec3f> > &patterns)
+{
+    // writes a temporary file first, so that other sessions sharing the
+    // same cache directory never see a partially written file
+    string tmpFile = file + ".tmp";
+    FILE *f;
+    fopen(&f, tmpFile.c_str(), "wb");
+    bool valid = f != NULL;
+    if (valid) {
+        int header[6] = { PLANTS_PATTERNS_MAGIC, PLANTS_PATTERNS_VERSION, key[0], key[1], key[2], key[3] };
+        float coverage = (float) POISSON_COVERAGE;
+        valid = fwrite(header, sizeof(int), 6, f) == 6;
+        valid = valid && fwrite(&coverage, sizeof(float), 1, f) == 1;
+        for (int i = 0; valid && i < key[3]; ++i) {
+            int n = (int) patterns[i].size();
+            valid = fwrite(&n, sizeof(int), 1, f) == 1;
+            valid = valid && (n == 0 || fwrite(&(patterns[i][0]), sizeof(vec3f), n, f) == (size_t) n);
+        }
+        valid = fclose(f) == 0 && valid;
+    }
+    if (valid) {
+        remove(file.c_str());
+        valid = rename(tmpFile.c_str(), file.c_str()) == 0;
+    }
+    if (!valid) {
+        if (Logger::WARNING_LOGGER != NULL) {
+            Logger::WARNING_LOGGER->log("FOREST", "Cannot write plants pattern cache '" + file + "'");
+        }
+        remove(tmpFile.c_str());
+    }
+}
+
+class PlantsResource : public ResourceTemplate<40, Plants>
+{
+public:
     PlantsResource(ptr<ResourceManager> manager, const string &name, ptr<ResourceDescriptor> desc, const TiXmlElement *e = NULL) :
         ResourceTemplate<40, Plants>(manager, name, desc)
     {
         e = e == NULL ? desc->descriptor : e;
-        checkParameters(desc, e, "name,selectProg,shadowProg,renderProg,minLevel,maxLevel,tileCacheSize,maxDistance,lodDistance,minDensity,maxDensity,patternCount,");
+        checkParameters(desc, e, "name,selectProg,shadowProg,renderProg,minLevel,maxLevel,tileCacheSize,maxDistance,lodDistance,minDensity,maxDensity,patternCount,seed,patternCache,");
         int minLevel;
         int maxLevel;
         int tileCacheSize;
@@ -544,18 +662,48 @@ public:
             renderProg->getUniform1f("maxTreeDistance")->set(maxDistance);
         }
 
-        rand = 1234567;
+        int seed = 1234567;
+        if (e->Attribute("seed") != NULL) {
+            getIntParameter(desc, e, "seed", &seed);
+        }
+
+        // the pattern densities and random seeds are drawn sequentially, so
+        // that the patterns do not depend on the number of threads
+        PlantsPatterns p;
+        long rand = seed;
+        for (int i = 0; i < patternCount; ++i) {
+            p.densities.push_back(minDensity + int((maxDensity - minDensity) * frandom(&rand)));
+            p.seeds.push_back(lrandom(&rand));
+        }
+        p.patterns.resize(patternCount);
+
+        string cacheFile;
+        if (e->Attribute("patternCache") != NULL) {
+            char buf[256];
+            sprintf(buf, "/plants-%d-%d-%d-%d.dat", seed, minDensity, maxDensity, patternCount);
+            cacheFile = getParameter(desc, e, "patternCache") + buf;
+        }
+        int key[4] = { seed, minDensity, maxDensity, patternCount };
+        if (cacheFile.size() == 0 || !loadPlantsPatterns(cacheFile, key, p.patterns)) {
+            for (int i = 0; i < patternCount; ++i) {
+                p.patterns[i].clear();
+            }
+            parallelFor(0, patternCount, generatePlantsPatterns, &p);
+            if (cacheFile.size() > 0) {
+                savePlantsPatterns(cacheFile, key, p.patterns);
+            }
+        }
+
         int minVertices = 2 * maxDensity;
         int maxVertices = 0;
         for (int i = 0; i < patternCount; ++i) {
             ptr< Mesh<vec3f, unsigned short> > pattern;
-            int density = minDensity + int((maxDensity - minDensity) * frandom(&rand));
-            pattern = new Mesh<vec3f, unsigned short>(POINTS, GPU_STATIC, density, 0);
+            int n = (int) p.patterns[i].size();
+            pattern = new Mesh<vec3f, unsigned short>(POINTS, GPU_STATIC, n, 0);
             pattern->addAttributeType(0, 3, A32F, false);
-
-            radius = 1.0 / sqrt(density * M_PI / POISSON_COVERAGE);
-            generatePattern(pattern);
-            //generateRandomPattern(pattern, minDensity);
+            for (int j = 0; j < n; ++j) {
+                pattern->addVertex(p.patterns[i][j]);
+            }
 
             addPattern(pattern->getBuffers());
             minVertices = min(minVertices, pattern->getVertexCount());
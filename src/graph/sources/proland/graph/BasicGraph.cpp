@@ -241,8 +241,8 @@ void BasicGraph::loadIndexed(FileReader *fileReader, bool loadSubgraphs)
     vector<NodePtr> nodesTMP(nodeCount);
     for (int i = 0; i < nodeCount; i++) {
         float x, y;
-        x = fileReader->read<float>();
-        y = fileReader->read<float>();
+        fileReader->resetPoints();
+        fileReader->readPoint(x, y);
         nodesTMP[i] = newNode(vec2d(x, y));
         for (int j = 2; j < nParamsNodes; j++) {
             fileReader->read<float>();
@@ -270,11 +270,11 @@ void BasicGraph::loadIndexed(FileReader *fileReader, bool loadSubgraphs)
             fileReader->read<float>();
         }
         vector<Vertex> v;
+        fileReader->resetPoints();
         for (int j = 1; j < size - 1; j++) {
             float x, y;
             int isControl;
-            x = fileReader->read<float>();
-            y = fileReader->read<float>();
+            fileReader->readPoint(x, y);
             isControl = fileReader->read<int>();
             for (int k = 3; k < nParamsCurvePoints; k++) {
                 fileReader->read<float>();
@@ -382,8 +382,8 @@ void BasicGraph::load(FileReader *fileReader, bool loadSubgraphs)
     vector<NodePtr> nodesTMP(nodeCount);
     for (int i = 0; i < nodeCount; i++) {
         float x, y;
-        x = fileReader->read<float>();
-        y = fileReader->read<float>();
+        fileReader->resetPoints();
+        fileReader->readPoint(x, y);
         for (int j = 2; j < nParamsNodes; j++) {
             fileReader->read<float>();
         }
@@ -411,11 +411,11 @@ void BasicGraph::load(FileReader *fileReader, bool loadSubgraphs)
             fileReader->read<float>();
         }
         vector<Vertex> v;
+        fileReader->resetPoints();
         for (int j = 1; j < size - 1; j++) {
             float x, y;
             int isControl;
-            x = fileReader->read<float>();
-            y = fileReader->read<float>();
+            fileReader->readPoint(x, y);
             isControl = fileReader->read<int>();
             v.push_back(Vertex(x, y, -1, isControl == 1));
             for (int k = 3; k < nParamsCurvePoints; k++) {
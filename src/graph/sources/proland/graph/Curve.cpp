@@ -753,19 +753,28 @@ public:
 
 void Curve::flatten(float squareFlatness)
 {
-    vector<Vertex> *newVertices = new vector<Vertex> ();
+    vector<Vertex> buffer;
+    flatten(squareFlatness, getVertex(0), getVertex(getSize() - 1), buffer);
+    resetBounds();
+}
+
+void Curve::flatten(float squareFlatness, const Vertex &first, const Vertex &last, vector<Vertex> &buffer)
+{
+    buffer.clear();
 
-    Vertex p = getVertex(0);
-    FlatteningCurveIterator iterator(squareFlatness, newVertices);
+    Vertex p = first;
+    FlatteningCurveIterator iterator(squareFlatness, &buffer);
     iterator.moveTo(p.x, p.y, p.s);
     int n = getSize();
 
     for (int i = 1; i < n; ++i) {
-        p = getVertex(i);
+        p = i < n - 1 ? (*vertices)[i - 1] : last;
         if (p.isControl) {
-            Vertex q = getVertex(++i);
+            ++i;
+            Vertex q = i < n - 1 ? (*vertices)[i - 1] : last;
             if (q.isControl) {
-                Vertex r = getVertex(++i);
+                ++i;
+                Vertex r = i < n - 1 ? (*vertices)[i - 1] : last;
                 bool isEnd = i == n - 1;
                 iterator.curveTo(p.x, p.y, p.s, q.x, q.y, q.s, r.x, r.y, r.s, 0, isEnd);
             } else {
@@ -778,11 +787,7 @@ void Curve::flatten(float squareFlatness)
         }
     }
 
-    resetBounds();
-
-    delete vertices;
-
-    this->vertices = newVertices;
+    vertices->assign(buffer.begin(), buffer.end());
 }
 
 void Curve::computeCurvilinearCoordinates()
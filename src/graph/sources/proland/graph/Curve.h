@@ -576,6 +576,22 @@ public:
      */
     virtual void flatten(float squareFlatness);
 
+    /**
+     * Subdivides this curve like #flatten, but with the given extremities
+     * and using the given vector to store the new points before copying
+     * them in this curve. This vector can be reused from one curve to the
+     * next to avoid memory allocations. This method does not access the
+     * nodes of this curve and does not reset its bounds (see #resetBounds),
+     * so that it can be called concurrently on distinct curves.
+     *
+     * @param squareFlatness square of the maximum allowed distance between
+     * the limit curve and its polyline approximation.
+     * @param first the first vertex of this curve (see #getVertex).
+     * @param last the last vertex of this curve (see #getVertex).
+     * @param buffer a temporary vector to store the new points.
+     */
+    void flatten(float squareFlatness, const Vertex &first, const Vertex &last, vector<Vertex> &buffer);
+
     /**
      * Computes the Vertex#s coordinates for every Vertex of this curve.
      * This method also computes #s0 and #s1.
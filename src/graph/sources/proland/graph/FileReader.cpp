@@ -30,25 +30,43 @@
 namespace proland
 {
 
-FileReader::FileReader(const string &file, bool &isIndexed)
+/**
+ * The size of the blocks read after a seek.
+ */
+#define MIN_BLOCK_SIZE 4096
+
+/**
+ * The maximum size of the blocks read during sequential reads.
+ */
+#define MAX_BLOCK_SIZE 65536
+
+FileReader::FileReader(const string &file, bool &isIndexed) :
+    isCompact(false), quantum(1.0f), lastX(0), lastY(0), bufferOffset(0),
+    bufferPos(0), bufferSize(0), blockSize(MIN_BLOCK_SIZE), failed(false)
 {
+    buffer = new char[MAX_BLOCK_SIZE];
     in.open(file.c_str(), ifstream::binary);
     assert(in);
     isBinary = true;
     int i = this->read<int>();
     isBinary = false;
     isIndexed = false;
-    if (i == 0 || i == 1) {
+    if (i >= 0 && i <= 3) {
         isBinary = true;
-        if (i == 1) {
+        if (i == 1 || i == 3) {
             isIndexed = true;
         }
+        if (i >= 2) {
+            quantum = read<float>();
+            isCompact = true;
+        }
     } else {
         if ((char) i == '1') {
             isIndexed = true;
         }
     }
     if (!isBinary) {
+        in.clear();
         seekg(2, ios::beg);
     }
 }
@@ -56,21 +74,98 @@ FileReader::FileReader(const string &file, bool &isIndexed)
 FileReader::~FileReader()
 {
     in.close();
+    delete[] buffer;
+}
+
+void FileReader::readPoint(float &x, float &y)
+{
+    if (!isCompact) {
+        x = read<float>();
+        y = read<float>();
+        return;
+    }
+    // deltas are added modulo 2^32, as they were computed by FileWriter
+    lastX = int((unsigned int) lastX + (unsigned int) read<int>());
+    lastY = int((unsigned int) lastY + (unsigned int) read<int>());
+    x = float(lastX * (double) quantum);
+    y = float(lastY * (double) quantum);
+}
+
+void FileReader::resetPoints()
+{
+    lastX = 0;
+    lastY = 0;
+}
+
+bool FileReader::compact()
+{
+    return isCompact;
 }
 
 streampos FileReader::tellg()
 {
-    return in.tellg();
+    if (!isBinary) {
+        return in.tellg();
+    }
+    return bufferOffset + bufferPos;
 }
 
 void FileReader::seekg(streamoff off, ios_base::seekdir dir)
 {
+    if (!isBinary) {
+        in.seekg(off, dir);
+        return;
+    }
+    if (dir == ios::cur) {
+        off += bufferOffset + bufferPos;
+        dir = ios::beg;
+    }
+    if (dir == ios::beg && off >= bufferOffset && off <= bufferOffset + bufferSize) {
+        bufferPos = int(off - bufferOffset);
+        return;
+    }
+    in.clear();
     in.seekg(off, dir);
+    bufferOffset = in.tellg();
+    bufferPos = 0;
+    bufferSize = 0;
+    blockSize = MIN_BLOCK_SIZE;
 }
 
 bool FileReader::error()
 {
+    if (isBinary) {
+        return failed || in.bad();
+    }
     return !in.good();
 }
 
+bool FileReader::readBlock()
+{
+    bufferOffset += bufferSize;
+    bufferPos = 0;
+    in.read(buffer, blockSize);
+    bufferSize = int(in.gcount());
+    blockSize = min(2 * blockSize, MAX_BLOCK_SIZE);
+    return bufferSize > 0;
+}
+
+unsigned int FileReader::readVarint()
+{
+    unsigned int result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        unsigned char b;
+        if (bufferPos < bufferSize) {
+            b = (unsigned char) buffer[bufferPos++];
+        } else {
+            readBytes((char*) &b, 1);
+        }
+        result |= (unsigned int) (b & 0x7F) << shift;
+        if ((b & 0x80) == 0) {
+            break;
+        }
+    }
+    return result;
+}
+
 }
@@ -28,6 +28,8 @@
 #ifndef _PROLAND_FILEREADER_H_
 #define _PROLAND_FILEREADER_H_
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
@@ -40,7 +42,11 @@ namespace proland
 
 /**
  * FileReader handles file inputs for graph loading.
- * Handles binary & ascii.
+ * Handles binary & ascii, and the compact binary format written by
+ * FileWriter#setCompact. In this format int values are stored as variable
+ * length integers, and points as quantized deltas (see #readPoint). Hence
+ * values must be read with the type used to write them. Binary files are
+ * read by blocks, and decoded directly from memory.
  * @ingroup graph
  * @author Antoine Begault
  */
@@ -51,7 +57,7 @@ public:
      * Creates a new FileReader.
      *
      * @param file the path/name of the file to read.
-     * @param isIndexed after function call, will be true if the magic number was 1. False otherwise.
+     * @param isIndexed after function call, will be true if the magic number was 1 or 3. False otherwise.
      */
     FileReader(const string &file, bool &isIndexed);
 
@@ -69,14 +75,38 @@ public:
     template <typename T> T read()
     {
         T t;
+        if (isCompact && readVarint(t)) {
+            return t;
+        }
         if (isBinary) {
-            in.read((char*) &t, sizeof(T));
+            readBytes((char*) &t, sizeof(T));
         } else {
             in >> t;
         }
         return t;
     }
 
+    /**
+     * Reads a point written with FileWriter#writePoint. In the compact
+     * format, points are stored as quantized deltas from the previous point
+     * read since the last call to #resetPoints.
+     *
+     * @param[out] x the x coordinate of the point.
+     * @param[out] y the y coordinate of the point.
+     */
+    void readPoint(float &x, float &y);
+
+    /**
+     * Resets the reference point used to decode the points of the compact
+     * format. Must be called where FileWriter#resetPoints was called.
+     */
+    void resetPoints();
+
+    /**
+     * Returns true if this file uses the compact binary format.
+     */
+    bool compact();
+
     /**
      * Returns the position of the get pointer.
      */
@@ -113,6 +143,115 @@ private:
      * If true, file will be read as binary. Otherwise, ASCII.
      */
     bool isBinary;
+
+    /**
+     * If true, file will be read in the compact binary format.
+     */
+    bool isCompact;
+
+    /**
+     * The size of the quantization step of the points, in the compact format.
+     */
+    float quantum;
+
+    /**
+     * The last decoded quantized point, in the compact format.
+     */
+    int lastX, lastY;
+
+    /**
+     * The block of the binary file that is currently decoded.
+     */
+    char *buffer;
+
+    /**
+     * The file offset of the first byte of #buffer.
+     */
+    streamoff bufferOffset;
+
+    /**
+     * The position of the next byte to be read in #buffer.
+     */
+    int bufferPos;
+
+    /**
+     * The number of valid bytes in #buffer.
+     */
+    int bufferSize;
+
+    /**
+     * The number of bytes to read in the next call to #readBlock. Small
+     * blocks are read after a seek, and larger ones during sequential reads.
+     */
+    int blockSize;
+
+    /**
+     * True if a read went past the end of the file.
+     */
+    bool failed;
+
+    /**
+     * Reads the next block of the binary file in #buffer. Returns false if
+     * the end of the file is reached.
+     */
+    bool readBlock();
+
+    /**
+     * Reads the given number of bytes of the binary file.
+     */
+    void readBytes(char *data, int size)
+    {
+        if (bufferPos + size <= bufferSize) {
+            memcpy(data, buffer + bufferPos, size);
+            bufferPos += size;
+            return;
+        }
+        while (size > 0) {
+            if (bufferPos == bufferSize && !readBlock()) {
+                memset(data, 0, size);
+                failed = true;
+                return;
+            }
+            int n = min(size, bufferSize - bufferPos);
+            memcpy(data, buffer + bufferPos, n);
+            bufferPos += n;
+            data += n;
+            size -= n;
+        }
+    }
+
+    /**
+     * Reads an unsigned variable length integer.
+     */
+    unsigned int readVarint();
+
+    /**
+     * Reads a signed variable length integer. Returns true.
+     */
+    bool readVarint(int &t)
+    {
+        unsigned int u = readVarint();
+        t = int(u >> 1) ^ -int(u & 1);
+        return true;
+    }
+
+    /**
+     * Reads an unsigned variable length integer. Returns true.
+     */
+    bool readVarint(unsigned int &t)
+    {
+        t = readVarint();
+        return true;
+    }
+
+    /**
+     * Returns false: values of other types are not stored as variable
+     * length integers.
+     */
+    template <typename T> bool readVarint(T &t)
+    {
+        return false;
+    }
 };
 
 }
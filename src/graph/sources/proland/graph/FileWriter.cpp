@@ -27,6 +27,10 @@
 
 #include "proland/graph/FileWriter.h"
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
 namespace proland
 {
 
@@ -42,6 +46,10 @@ FileWriter::FileWriter(const string &file, bool binary)
     out.precision(3);
     out.setf(ios_base::fixed, ios_base::floatfield);
     isBinary = binary;
+    isCompact = false;
+    quantum = 1.0f;
+    lastX = 0;
+    lastY = 0;
 }
 
 FileWriter::~FileWriter()
@@ -49,6 +57,45 @@ FileWriter::~FileWriter()
     out.close();
 }
 
+void FileWriter::setCompact(float quantum)
+{
+    assert(isBinary && quantum > 0.0f);
+    write(quantum);
+    this->quantum = quantum;
+    isCompact = true;
+}
+
+/**
+ * Returns the given coordinate in quantization steps, clamped to the int range.
+ */
+static int quantize(float v, float quantum)
+{
+    double q = floor(v / (double) quantum + 0.5);
+    return int(max(double(INT_MIN + 1), min(double(INT_MAX), q)));
+}
+
+void FileWriter::writePoint(float x, float y)
+{
+    if (!isCompact) {
+        write(x);
+        write(y);
+        return;
+    }
+    int qx = quantize(x, quantum);
+    int qy = quantize(y, quantum);
+    // deltas are computed modulo 2^32, to avoid overflows
+    write(int((unsigned int) qx - (unsigned int) lastX));
+    write(int((unsigned int) qy - (unsigned int) lastY));
+    lastX = qx;
+    lastY = qy;
+}
+
+void FileWriter::resetPoints()
+{
+    lastX = 0;
+    lastY = 0;
+}
+
 streampos FileWriter::tellp()
 {
     return out.tellp();
@@ -40,7 +40,7 @@ namespace proland
 
 /**
  * FileWriter handles file outputs for graph saving.
- * Handles binary & ascii.
+ * Handles binary & ascii, and a compact binary format (see #setCompact).
  * @ingroup graph
  * @author Antoine Begault
  */
@@ -66,6 +66,9 @@ public:
      */
     template <typename T> void write(T t)
     {
+        if (isCompact && writeVarint(t)) {
+            return;
+        }
         if (isBinary) {
             out.write((char*) &t, sizeof(T));
         } else {
@@ -84,6 +87,36 @@ public:
         out.write((char *)&i,sizeof(int));
     }
 
+    /**
+     * Switches this binary writer to the compact format, and writes the
+     * given quantization step. In this format int values are written as
+     * variable length integers, so that small values use a single byte, and
+     * points are quantized and written as deltas from the previous point
+     * (see #writePoint). Other values are written as in the binary format.
+     * This method must be called after the magic number.
+     *
+     * @param quantum the quantization step of the coordinates of points.
+     */
+    void setCompact(float quantum);
+
+    /**
+     * Writes a point. In the compact format, the point is stored as the
+     * difference between its quantized coordinates and those of the
+     * previous point written since the last call to #resetPoints.
+     *
+     * @param x the x coordinate of the point.
+     * @param y the y coordinate of the point.
+     */
+    void writePoint(float x, float y);
+
+    /**
+     * Resets the reference point used to encode the points of the compact
+     * format. The points of a record that must be readable independently of
+     * the previous ones, e.g. by a LazyGraph, must be preceded by a call to
+     * this method.
+     */
+    void resetPoints();
+
     /**
      * Returns the position of the put pointer.
      */
@@ -117,6 +150,52 @@ private:
      * If true, the writer is in binary mode.
      */
     bool isBinary;
+
+    /**
+     * If true, the writer is in compact binary mode.
+     */
+    bool isCompact;
+
+    /**
+     * The quantization step of the points, in the compact format.
+     */
+    float quantum;
+
+    /**
+     * The last written quantized point, in the compact format.
+     */
+    int lastX, lastY;
+
+    /**
+     * Writes an unsigned variable length integer. Returns true.
+     */
+    bool writeVarint(unsigned int u)
+    {
+        while (u >= 0x80) {
+            out.put(char((u & 0x7F) | 0x80));
+            u >>= 7;
+        }
+        out.put(char(u));
+        return true;
+    }
+
+    /**
+     * Writes a signed variable length integer, with a zigzag encoding so
+     * that small negative values also use few bytes. Returns true.
+     */
+    bool writeVarint(int t)
+    {
+        return writeVarint(((unsigned int) t << 1) ^ (t < 0 ? ~0u : 0u));
+    }
+
+    /**
+     * Returns false: values of other types are not written as variable
+     * length integers.
+     */
+    template <typename T> bool writeVarint(T t)
+    {
+        return false;
+    }
 };
 
 }
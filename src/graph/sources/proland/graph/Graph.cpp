@@ -47,6 +47,7 @@ from "Graphics Gems", Academic Press, 1990
 #include "ork/core/Logger.h"
 
 #include <set>
+#include <queue>
 #include <iterator>
 
 #include "proland/graph/Area.h"
@@ -54,10 +55,16 @@ from "Graphics Gems", Academic Press, 1990
 #include "proland/graph/BasicCurvePart.h"
 #include "proland/graph/BasicGraph.h"
 #include "proland/graph/GraphListener.h"
+#include "proland/util/parallel.h"
 
 namespace proland
 {
 
+/**
+ * The maximum number of changes recorded by Graph#logChanges.
+ */
+#define MAX_CHANGES_LOG 64
+
 Graph::Graph() :
     Object("Graph"), parent(NULL)
 {
@@ -220,35 +227,95 @@ void Graph::setParent(Graph* p)
 // FLATTENING
 // ---------------------------------------------------------------------------
 
-void Graph::flatten(float squareFlatness)
+/**
+ * A curve to be flattened in a parallel loop. The extremities of the curve
+ * are read before the loop, since the nodes are shared between curves.
+ */
+struct FlattenedCurve
 {
-    ptr<CurveIterator> ci = getCurves();
+    CurvePtr curve;
+
+    Vertex first;
+
+    Vertex last;
+
+    FlattenedCurve(CurvePtr c) :
+        curve(c), first(c->getVertex(0)), last(c->getVertex(c->getSize() - 1))
+    {
+    }
+};
+
+/**
+ * The curves to be flattened in a parallel loop.
+ */
+struct CurveFlattening
+{
+    float squareFlatness;
+
+    vector<FlattenedCurve> curves;
+};
+
+/**
+ * Adds the curves of the given graph and of its subgraphs to the given list.
+ */
+static void getFlattenedCurves(Graph *g, vector<FlattenedCurve> &curves)
+{
+    ptr<Graph::CurveIterator> ci = g->getCurves();
     while (ci->hasNext()) {
-        ci->next()->flatten(squareFlatness);
+        curves.push_back(FlattenedCurve(ci->next()));
     }
-    ptr<AreaIterator> ai = getAreas();
+    ptr<Graph::AreaIterator> ai = g->getAreas();
     while (ai->hasNext()) {
         AreaPtr a = ai->next();
         if (a->getSubgraph() != NULL) {
-            a->getSubgraph()->flatten(squareFlatness);
+            getFlattenedCurves(a->getSubgraph().get(), curves);
         }
     }
 }
 
-void Graph::flattenUpdate(const Changes &changes, float squareFlatness)
+static void flattenCurves(void *context, int begin, int end)
+{
+    CurveFlattening *f = (CurveFlattening*) context;
+    // the temporary vertices of each curve are stored in the same vector
+    vector<Vertex> buffer;
+    for (int i = begin; i < end; ++i) {
+        FlattenedCurve &c = f->curves[i];
+        c.curve->flatten(f->squareFlatness, c.first, c.last, buffer);
+    }
+}
+
+void Graph::flatten(float squareFlatness, int threadCount)
+{
+    CurveFlattening f;
+    f.squareFlatness = squareFlatness;
+    getFlattenedCurves(this, f.curves);
+    parallelFor(0, (int) f.curves.size(), flattenCurves, &f, 64, threadCount);
+    // done sequentially since this also resets the bounds of shared areas
+    for (unsigned int i = 0; i < f.curves.size(); ++i) {
+        f.curves[i].curve->resetBounds();
+    }
+}
+
+void Graph::flattenUpdate(const Changes &changes, float squareFlatness, int threadCount)
 {
     if ((int) changes.changedArea.size() > 0) {
         Changes c = changes;
         AreaId a = *(c.changedArea.begin());
         c.changedArea.pop_front();
-        return getArea(a)->getSubgraph()->flattenUpdate(c, squareFlatness);
+        return getArea(a)->getSubgraph()->flattenUpdate(c, squareFlatness, threadCount);
     }
+    CurveFlattening f;
+    f.squareFlatness = squareFlatness;
     set<CurveId>::const_iterator i = changes.addedCurves.begin();
     while (i != changes.addedCurves.end()) {
-        CurvePtr c = getCurve(*i);
-        c->flatten(squareFlatness);
+        f.curves.push_back(FlattenedCurve(getCurve(*i)));
         ++i;
     }
+    parallelFor(0, (int) f.curves.size(), flattenCurves, &f, 64, threadCount);
+    // done sequentially since this also resets the bounds of shared areas
+    for (unsigned int i = 0; i < f.curves.size(); ++i) {
+        f.curves[i].curve->resetBounds();
+    }
 }
 
 
@@ -1579,21 +1646,52 @@ void Graph::buildAreas()
         includedCurves.insert(c->getId());
     }
 
-    while (true) {
-        bool removed = false;
-        set<CurveId>::iterator i = includedCurves.begin();
-        while (i != includedCurves.end()) {
-            set<CurveId>::iterator j = i++;
-            CurvePtr c = getCurve(*j);
-            if (c->getStart()->getCurveCount(includedCurves) == 1 ||
-                    c->getEnd()->getCurveCount(includedCurves) == 1) {
-                includedCurves.erase(j);
-                excludedCurves.insert(c->getId());
-                removed = true;
+    // removes the curves with a free end, i.e. with an extremity used by no
+    // other included curve. Removing a curve can free an end of its
+    // neighbors, which are then checked again. The number of included curves
+    // using each node is updated incrementally, so that each curve is only
+    // checked again when one of its extremities changes.
+    map<NodeId, int> nodeCurveCounts;
+    vector<CurveId> candidates(includedCurves.begin(), includedCurves.end());
+    for (set<CurveId>::iterator i = includedCurves.begin(); i != includedCurves.end(); ++i) {
+        CurvePtr c = getCurve(*i);
+        NodePtr ends[2] = { c->getStart(), c->getEnd() };
+        for (int k = 0; k < 2; ++k) {
+            if (nodeCurveCounts.find(ends[k]->getId()) == nodeCurveCounts.end()) {
+                nodeCurveCounts[ends[k]->getId()] = ends[k]->getCurveCount(includedCurves);
             }
         }
-        if (!removed) {
-            break;
+    }
+    while (!candidates.empty()) {
+        CurveId id = candidates.back();
+        candidates.pop_back();
+        if (includedCurves.find(id) == includedCurves.end()) {
+            continue;
+        }
+        CurvePtr c = getCurve(id);
+        NodePtr start = c->getStart();
+        NodePtr end = c->getEnd();
+        if (nodeCurveCounts[start->getId()] != 1 && nodeCurveCounts[end->getId()] != 1) {
+            continue;
+        }
+        includedCurves.erase(id);
+        excludedCurves.insert(id);
+        NodePtr ends[2] = { start, end };
+        for (int k = 0; k < (start == end ? 1 : 2); ++k) {
+            NodePtr n = ends[k];
+            int &count = nodeCurveCounts[n->getId()];
+            for (int j = 0; j < (int) n->curves.size(); ++j) {
+                if (n->curves[j] == id) {
+                    --count;
+                }
+            }
+            if (count == 1) {
+                for (int j = 0; j < (int) n->curves.size(); ++j) {
+                    if (includedCurves.find(n->curves[j]) != includedCurves.end()) {
+                        candidates.push_back(n->curves[j]);
+                    }
+                }
+            }
         }
     }
 
@@ -1640,38 +1738,142 @@ void Graph::decimateCurves(float minDistance)
     }
 }
 
-#if 0
-void Graph::decimate(float minDistance)
+/**
+ * Returns the length of the polyline formed by the vertices of a curve.
+ */
+static float getCurveLength(CurvePtr c)
 {
-    printf(">decimate\n");
-    while(true)
-    {
-        bool found = false;
+    double l = 0.0;
+    vec2d p = c->getXY(0);
+    for (int i = 1; i < c->getSize(); ++i) {
+        vec2d q = c->getXY(i);
+        l += (q - p).length();
+        p = q;
+    }
+    return (float) l;
+}
 
-        ptr<CurveIterator> iter = getCurves();
+Graph::Changes Graph::decimate(float minDistance)
+{
+    typedef pair<float, CurveId> QueueEntry;
+    priority_queue< QueueEntry, vector<QueueEntry>, greater<QueueEntry> > queue;
+    Changes changed;
 
-        while(iter->hasNext())
-        {
-            CurvePtr c = iter->next();
-            vec2d start = c->getStart()->getPos();
-            vec2d end = c->getEnd()->getPos();
-            if ((start - end).squaredlength() < minDistance * minDistance)
-            {
-                found = true;
-                // merge points
+    ptr<CurveIterator> ci = getCurves();
+    while (ci->hasNext()) {
+        CurvePtr c = ci->next();
+        float l = getCurveLength(c);
+        if (l < minDistance) {
+            queue.push(make_pair(l, c->getId()));
+        }
+    }
 
-                mergeNodes( c->getStart()->getId(), c->getEnd()->getId());
+    while (!queue.empty()) {
+        QueueEntry e = queue.top();
+        queue.pop();
+        if (changed.removedCurves.find(e.second) != changed.removedCurves.end() &&
+                changed.addedCurves.find(e.second) == changed.addedCurves.end()) {
+            continue; // curve already removed
+        }
+        CurvePtr c = getCurve(e.second);
+        if (c == NULL || c->area1.id != NULL_ID) {
+            continue;
+        }
+        // the queue entries are not updated when a curve changes, so we
+        // check that this entry is still valid (there is always another,
+        // valid, entry for the curve if it became shorter)
+        if (getCurveLength(c) != e.first) {
+            continue;
+        }
 
-                break;
+        NodePtr a = c->getStart();
+        NodePtr b = c->getEnd();
+        if (a == b) {
+            // a short loop: simply removes it
+            changed.addedCurves.erase(e.second);
+            changed.removedCurves.insert(e.second);
+            a = NULL;
+            b = NULL;
+            removeCurve(e.second);
+            continue;
+        }
+
+        // merges the least connected node b into the most connected one a
+        if (b->getCurveCount() > a->getCurveCount()) {
+            NodePtr tmp = a;
+            a = b;
+            b = tmp;
+        }
+        vec2d oldPos = a->getPos();
+        vec2d newPos = a->getCurveCount() == b->getCurveCount() ? (oldPos + b->getPos()) * 0.5 : oldPos;
+
+        // moves the curves of b, except c, to a
+        vector<CurveId> bcurves = b->curves;
+        for (unsigned int i = 0; i < bcurves.size(); ++i) {
+            if (bcurves[i] == e.second) {
+                continue;
+            }
+            CurvePtr d = getCurve(bcurves[i]);
+            bool isStart = d->getStart() == b;
+            bool isEnd = d->getEnd() == b;
+            if (isStart) {
+                d->addVertex(a->getId(), 0);
+            }
+            if (isEnd) {
+                d->addVertex(a->getId(), 1);
+            }
+            b->removeCurve(bcurves[i]);
+            a->addCurve(bcurves[i]);
+            changed.removedCurves.insert(bcurves[i]);
+            changed.addedCurves.insert(bcurves[i]);
+        }
+
+        // removes c, which also removes b since it has no more curves (and
+        // a if c was its only curve)
+        bool isolated = a->getCurveCount() == 1;
+        changed.addedCurves.erase(e.second);
+        changed.removedCurves.insert(e.second);
+        b = NULL;
+        removeCurve(e.second);
+        if (isolated) {
+            a = NULL;
+            continue;
+        }
+
+        bool moved = newPos != oldPos;
+        if (moved) {
+            a->setPos(newPos);
+            if (mapping != NULL) {
+                map<vec2d, Node*, Cmp>::iterator i = mapping->find(oldPos);
+                if (i != mapping->end() && i->second == a.get()) {
+                    mapping->erase(i);
+                }
+                mapping->insert(make_pair(newPos, a.get()));
             }
+        }
 
+        // updates the curves of the merged node, and pushes those that are
+        // now shorter than minDistance in the queue
+        for (int i = 0; i < a->getCurveCount(); ++i) {
+            CurvePtr d = a->getCurve(i);
+            if (moved || find(bcurves.begin(), bcurves.end(), d->getId()) != bcurves.end()) {
+                changed.removedCurves.insert(d->getId());
+                changed.addedCurves.insert(d->getId());
+                d->resetBounds();
+                d->computeCurvilinearCoordinates();
+            }
+            float l = getCurveLength(d);
+            if (l < minDistance) {
+                queue.push(make_pair(l, d->getId()));
+            }
         }
-        if(!found) break; // no more curves to remove
     }
-    printf("<decimate\n");
 
+    // the areas whose curves changed are also changed
+    getAreasFromCurves(changed.addedCurves, changed.removedAreas);
+    changed.addedAreas = changed.removedAreas;
+    return changed;
 }
-#endif
 
 void Graph::build(bool useType, GraphPtr result)
 {
@@ -2000,15 +2202,22 @@ void Graph::fitCubicCurve(vector<vec2d> points, vector<vec2d> &output, float err
     fitCubic(pts2, output, 0, pts2.size() - 1, t0, t1, error);
 }
 
-void Graph::save(const string &file, bool saveAreas, bool saveBinary, bool isIndexed)
+void Graph::save(const string &file, bool saveAreas, bool saveBinary, bool isIndexed, float quantum)
 {
     FileWriter *fileWriter = new FileWriter(file, saveBinary);
+    bool compact = saveBinary && quantum > 0.0f;
 
     if (isIndexed) {
-        fileWriter->write(1);
+        fileWriter->write(compact ? 3 : 1);
+        if (compact) {
+            fileWriter->setCompact(quantum);
+        }
         indexedSave(fileWriter, saveAreas);
     } else {
-        fileWriter->write(0);
+        fileWriter->write(compact ? 2 : 0);
+        if (compact) {
+            fileWriter->setCompact(quantum);
+        }
         save(fileWriter, saveAreas);
     }
 
@@ -2063,8 +2272,8 @@ void Graph::save(FileWriter *fileWriter, bool saveAreas)
     for (int i = 0; i < (int) nodeList.size(); i++) {
     //for (map<NodePtr, int>::iterator i = nindices.begin(); i != nindices.end(); i++) {
         NodePtr n = nodeList[i];
-        fileWriter->write(n->getPos().x);
-        fileWriter->write(n->getPos().y);
+        fileWriter->resetPoints();
+        fileWriter->writePoint((float) n->getPos().x, (float) n->getPos().y);
         fileWriter->write(n->getCurveCount());
         for (int j = 0; j < n->getCurveCount(); j++) {
             fileWriter->write(cindices[n->getCurve(j)]);
@@ -2082,9 +2291,9 @@ void Graph::save(FileWriter *fileWriter, bool saveAreas)
         int s = nindices[c->getStart()];
         int e = nindices[c->getEnd()];
         fileWriter->write(s);
+        fileWriter->resetPoints();
         for (int j = 1; j < c->getSize() - 1; ++j) {
-            fileWriter->write(c->getXY(j).x);
-            fileWriter->write(c->getXY(j).y);
+            fileWriter->writePoint((float) c->getXY(j).x, (float) c->getXY(j).y);
             fileWriter->write(c->getIsControl(j) ? 1 : 0);
         }
         fileWriter->write(e);
@@ -2182,8 +2391,8 @@ void Graph::indexedSave(FileWriter *fileWriter, bool saveAreas)
     //for (map<NodePtr, int>::iterator i = nindices.begin(); i != nindices.end(); i++) {
         NodePtr n = nodeList[i];
         offsets.push_back(fileWriter->tellp());
-        fileWriter->write(n->getPos().x);
-        fileWriter->write(n->getPos().y);
+        fileWriter->resetPoints();
+        fileWriter->writePoint((float) n->getPos().x, (float) n->getPos().y);
         fileWriter->write(n->getCurveCount());
         for (int j = 0; j < n->getCurveCount(); j++) {
             fileWriter->write(cindices[n->getCurve(j)]);
@@ -2202,9 +2411,9 @@ void Graph::indexedSave(FileWriter *fileWriter, bool saveAreas)
         int s = nindices[c->getStart()];
         int e = nindices[c->getEnd()];
         fileWriter->write(s);
+        fileWriter->resetPoints();
         for (int j = 1; j < c->getSize() - 1; ++j) {
-            fileWriter->write(c->getXY(j).x);
-            fileWriter->write(c->getXY(j).y);
+            fileWriter->writePoint((float) c->getXY(j).x, (float) c->getXY(j).y);
             fileWriter->write(c->getIsControl(j) ? 1 : 0);
         }
         fileWriter->write(e);
@@ -2402,6 +2611,7 @@ int Graph::getListenerCount()
 void Graph::notifyListeners()
 {
     version++;
+    logChanges(version - 1);
     for (int i = 0; i < getListenerCount(); i++) {
         listeners[i]->graphChanged();
     }
@@ -2436,6 +2646,50 @@ Graph::Changes Graph::merge(Graph::Changes old, Graph::Changes c)
     return res;
 }
 
+void Graph::logChanges(unsigned int fromVersion)
+{
+    changesLog.push_back(make_pair(make_pair(fromVersion, version), changes));
+    while (changesLog.size() > MAX_CHANGES_LOG) {
+        changesLog.pop_front();
+    }
+}
+
+bool Graph::getChangesSince(unsigned int fromVersion, Graph::Changes &result)
+{
+    // finds the recorded changes starting at fromVersion, and checks that
+    // they form a contiguous sequence up to the current version
+    list< pair< pair<unsigned int, unsigned int>, Changes > >::iterator i = changesLog.end();
+    unsigned int v = version;
+    while (v != fromVersion) {
+        if (i == changesLog.begin()) {
+            return false;
+        }
+        --i;
+        if (i->first.second != v || i->first.first >= v || i->first.first < fromVersion) {
+            return false;
+        }
+        v = i->first.first;
+    }
+    result.clear();
+    if (i == changesLog.end()) {
+        return true;
+    }
+    result = i->second;
+    while (++i != changesLog.end()) {
+        // Graph#clipUpdate can only update one subgraph at a time
+        if (!(result.changedArea == i->second.changedArea)) {
+            return false;
+        }
+        result = merge(result, i->second);
+    }
+    return true;
+}
+
+void Graph::clearChangesLog()
+{
+    changesLog.clear();
+}
+
 void Graph::checkDefaultParams(int nodes, int curves, int areas, int curveExtremities, int curvePoints, int areaCurves, int subgraphs)
 {
     assert(nParamsNodes == 2);
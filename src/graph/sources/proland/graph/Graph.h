@@ -486,9 +486,13 @@ public:
      * @param isBinary if true, will save in binary mode.
      * @param isIndexed if true, will save in indexed mode, used to
      *      accelerate LazyGraph loading.
+     * @param quantum if strictly positive, will save in the compact binary
+     *      format, with coordinates rounded to multiples of this value (see
+     *      FileWriter#setCompact). Otherwise the coordinates are saved as
+     *      floats.
      */
     virtual void save(const string &file, bool saveAreas = true,
-            bool isBinary = true, bool isIndexed = false);
+            bool isBinary = true, bool isIndexed = false, float quantum = 0.0f);
 
     /**
      * Saves this graph from a basic file.
@@ -514,8 +518,11 @@ public:
      *
      * @param squareFlatness square of the maximum allowed distance between
      *      a limit curve and its polyline approximation.
+     * @param threadCount the maximum number of threads used to flatten the
+     *      curves, or 0 to use one thread per processor (see parallelFor).
+     *      Must be 1 when called from a task executed by the ork::Scheduler.
      */
-    void flatten(float squareFlatness);
+    void flatten(float squareFlatness, int threadCount = 0);
 
     /**
      * Subdivides the given curves where necessary to satisfy the given
@@ -524,8 +531,11 @@ public:
      * @param changedCurves a list of curves that have changed.
      * @param squareFlatness square of the maximum allowed distance between
      *      a limit curve and its polyline approximation.
+     * @param threadCount the maximum number of threads used to flatten the
+     *      curves, or 0 to use one thread per processor (see parallelFor).
+     *      Must be 1 when called from a task executed by the ork::Scheduler.
      */
-    void flattenUpdate(const Changes &changes, float squareFlatness);
+    void flattenUpdate(const Changes &changes, float squareFlatness, int threadCount = 0);
 
     /**
      * Clips this graph with the given clip region. A specific margin is
@@ -618,13 +628,21 @@ public:
     void buildAreas();
 
     /**
-     * Merge connected nodes below a minimum distance.
-     * Slow, intended for preprocessing.
-     * COMPLETELY BROKEN DO NOT USE
+     * Merges connected nodes below a minimum distance. The curves shorter
+     * than minDistance are collapsed in increasing length order, using a
+     * priority queue, by merging their least connected node into their most
+     * connected one (or their end node into their start node if both have
+     * the same number of curves). The merged node keeps its position, or
+     * moves to the middle of the two nodes if they have the same number of
+     * curves. Curves that belong to an area are never collapsed, so this
+     * method should be called before #buildAreas. Nodes that are not
+     * connected by a curve are never merged.
+     *
+     * @param minDistance the minimum length of the curves in the result.
+     * @return the curves and areas that were changed or removed. Changed
+     *      curves and areas are both in the removed and added sets.
      */
-#if 0
-    void decimate(float minDistance);
-#endif
+    Changes decimate(float minDistance);
 
     /**
      * Merge vertex in Curves which are longer than minDistance.
@@ -821,6 +839,31 @@ public:
      */
     unsigned int version;
 
+    /**
+     * Records #changes as the changes from the given version to the current
+     * #version. Called by #notifyListeners. The number of recorded changes
+     * is bounded, the oldest ones being discarded first.
+     *
+     * @param fromVersion the version of this graph before #changes.
+     */
+    void logChanges(unsigned int fromVersion);
+
+    /**
+     * Returns the changes from the given version to the current #version,
+     * merged with #merge, if they are still recorded (see #logChanges).
+     *
+     * @param fromVersion a previous version of this graph.
+     * @param[out] result the changes from fromVersion to the current version.
+     * @return false if these changes are no longer recorded, or if they
+     *      cannot be merged (e.g. if they concern different subgraphs).
+     */
+    bool getChangesSince(unsigned int fromVersion, Graph::Changes &result);
+
+    /**
+     * Clears the changes recorded with #logChanges.
+     */
+    void clearChangesLog();
+
     /**
      * Adds a node to this graph.
      *
@@ -1007,6 +1050,13 @@ private:
      */
     vector<GraphListener *> listeners;
 
+    /**
+     * The changes recorded with #logChanges, from the oldest to the most
+     * recent ones. Each element contains the versions before and after
+     * the changes, and the changes themselves.
+     */
+    list< pair< pair<unsigned int, unsigned int>, Changes > > changesLog;
+
     /**
      * Checks if two points are symmetric with respect to another point.
      *
@@ -0,0 +1,368 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "proland/graph/GraphProximityIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "proland/graph/Area.h"
+#include "proland/math/seg2.h"
+
+using namespace std;
+
+namespace proland
+{
+
+/**
+ * The average number of vertices per grid cell.
+ */
+#define VERTICES_PER_CELL 4
+
+/**
+ * The maximum number of grid cells in each direction.
+ */
+#define MAX_GRID_SIZE 1024
+
+/**
+ * The minimum number of curves that #update can add or remove before the
+ * index must be rebuilt. Above, this number is the number of curves in the
+ * index when it was built.
+ */
+#define MIN_CHANGED_CURVES 64
+
+GraphProximityIndex::GraphProximityIndex(GraphPtr graph) :
+    Object("GraphProximityIndex"), root(graph), gridSize(1), changedCurves(0)
+{
+    int vertexCount = 0;
+    AreaId noArea;
+    noArea.id = NULL_ID;
+    addGraph(graph.get(), -1, noArea, list<AreaId>(), vertexCount);
+
+    if (vertexCount > 0) {
+        gridSize = (int) ceil(sqrt(vertexCount / (double) VERTICES_PER_CELL));
+        gridSize = max(1, min(gridSize, MAX_GRID_SIZE));
+    }
+    vertices.resize(gridSize * gridSize);
+    segments.resize(gridSize * gridSize);
+
+    for (int c = 0; c < (int) curves.size(); ++c) {
+        addCurve(c);
+    }
+}
+
+GraphProximityIndex::~GraphProximityIndex()
+{
+}
+
+GraphPtr GraphProximityIndex::getGraph() const
+{
+    return root;
+}
+
+bool GraphProximityIndex::isValid() const
+{
+    for (unsigned int i = 0; i < graphs.size(); ++i) {
+        if (graphs[i].graph->version != graphs[i].version) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GraphProximityIndex::update()
+{
+    if (isValid()) {
+        return true;
+    }
+    // the subgraphs can only change through the changes of the root graph
+    for (unsigned int i = 1; i < graphs.size(); ++i) {
+        if (graphs[i].graph->version != graphs[i].version) {
+            return false;
+        }
+    }
+    Graph::Changes changes;
+    if (!root->getChangesSince(graphs[0].version, changes)) {
+        return false;
+    }
+
+    // finds the graph containing the changed curves
+    Graph *g = root.get();
+    list<AreaId>::const_iterator i = changes.changedArea.begin();
+    while (i != changes.changedArea.end()) {
+        AreaPtr a = g->getArea(*(i++));
+        if (a == NULL || a->getSubgraph() == NULL) {
+            return false;
+        }
+        g = a->getSubgraph().get();
+    }
+    int gi = 0;
+    while (gi < (int) graphs.size() && graphs[gi].graph != g) {
+        ++gi;
+    }
+    if (gi == (int) graphs.size()) {
+        return false;
+    }
+
+    // the removed or added areas must not have indexed subgraphs
+    set<AreaId>::const_iterator j = changes.removedAreas.begin();
+    while (j != changes.removedAreas.end()) {
+        for (unsigned int k = 0; k < graphs.size(); ++k) {
+            if (graphs[k].parent == gi && graphs[k].area.id == j->id) {
+                return false;
+            }
+        }
+        ++j;
+    }
+    j = changes.addedAreas.begin();
+    while (j != changes.addedAreas.end()) {
+        AreaPtr a = g->getArea(*(j++));
+        if (a != NULL && a->getSubgraph() != NULL) {
+            return false;
+        }
+    }
+
+    changedCurves += (int) (changes.removedCurves.size() + changes.addedCurves.size());
+    if (changedCurves > max((int) curves.size(), MIN_CHANGED_CURVES)) {
+        return false;
+    }
+
+    // removes the old versions of the removed and modified curves, and
+    // adds the new ones (parts outside the bounds go to the border cells)
+    map<CurveId, int> &indexes = graphs[gi].curves;
+    set<CurveId>::const_iterator k = changes.removedCurves.begin();
+    while (k != changes.removedCurves.end()) {
+        map<CurveId, int>::iterator l = indexes.find(*(k++));
+        if (l != indexes.end()) {
+            removeCurve(l->second);
+            indexes.erase(l);
+        }
+    }
+    k = changes.addedCurves.begin();
+    while (k != changes.addedCurves.end()) {
+        CurvePtr cp = g->getCurve(*(k++));
+        if (cp != NULL && indexes.find(cp->getId()) == indexes.end()) {
+            IndexedCurve c;
+            c.curve = cp;
+            c.graph = gi;
+            curves.push_back(c);
+            indexes[cp->getId()] = (int) curves.size() - 1;
+            addCurve((int) curves.size() - 1);
+        }
+    }
+
+    graphs[0].version = root->version;
+    graphs[gi].version = g->version;
+    return true;
+}
+
+bool GraphProximityIndex::find(double x, double y, float tolerance, GraphPtr &graph, list<AreaId> &areas, CurvePtr &curve, int &segment, int &point) const
+{
+    if (curves.empty()) {
+        return false;
+    }
+    int x0 = getCell(x - tolerance, bounds.xmin, bounds.xmax);
+    int x1 = getCell(x + tolerance, bounds.xmin, bounds.xmax);
+    int y0 = getCell(y - tolerance, bounds.ymin, bounds.ymax);
+    int y1 = getCell(y + tolerance, bounds.ymin, bounds.ymax);
+
+    const Entry *best = NULL;
+    double bestDistSq = 0.0;
+    vec2d bestXY;
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            const vector<Entry> &cell = vertices[cx + cy * gridSize];
+            for (unsigned int i = 0; i < cell.size(); ++i) {
+                vec2d pt = curves[cell[i].curve].curve->getXY(cell[i].index);
+                if (abs(x - pt.x) < tolerance && abs(y - pt.y) < tolerance) {
+                    double d = (pt - vec2d(x, y)).squaredLength();
+                    if (best == NULL || d < bestDistSq) {
+                        best = &cell[i];
+                        bestDistSq = d;
+                        bestXY = pt;
+                    }
+                }
+            }
+        }
+    }
+    if (best != NULL) {
+        getResult(*best, graph, areas, curve);
+        point = curve->getVertex(bestXY);
+        return point != -1;
+    }
+
+    vec2d cur;
+    vec2d next;
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            const vector<Entry> &cell = segments[cx + cy * gridSize];
+            for (unsigned int i = 0; i < cell.size(); ++i) {
+                CurvePtr cp = curves[cell[i].curve].curve;
+                vec2d a = cp->getXY(cell[i].index);
+                vec2d b = cp->getXY(cell[i].index + 1);
+                double d = seg2d(a, b).segmentDistSq(vec2d(x, y));
+                if (d < tolerance * tolerance && (best == NULL || d < bestDistSq)) {
+                    best = &cell[i];
+                    bestDistSq = d;
+                    cur = a;
+                    next = b;
+                }
+            }
+        }
+    }
+    if (best != NULL) {
+        getResult(*best, graph, areas, curve);
+        int p1 = curve->getVertex(cur);
+        int p2 = curve->getVertex(next);
+        segment = min(p1, p2);
+        if (curve->getStart() == curve->getEnd()) {
+            if (min(p1, p2) == 0 && max(p1, p2) != 1) {
+                segment = max(p1, p2);
+            }
+        }
+        return segment != -1;
+    }
+    return false;
+}
+
+void GraphProximityIndex::addGraph(Graph *g, int parent, AreaId area, const list<AreaId> &areas, int &vertexCount)
+{
+    int index = (int) graphs.size();
+    IndexedGraph ig;
+    ig.graph = g;
+    ig.version = g->version;
+    ig.areas = areas;
+    ig.parent = parent;
+    ig.area = area;
+    graphs.push_back(ig);
+
+    ptr<Graph::CurveIterator> ci = g->getCurves();
+    while (ci->hasNext()) {
+        IndexedCurve c;
+        c.curve = ci->next();
+        c.graph = index;
+        curves.push_back(c);
+        graphs[index].curves[c.curve->getId()] = (int) curves.size() - 1;
+        vertexCount += c.curve->getSize();
+        bounds = bounds.enlarge(c.curve->getBounds());
+    }
+
+    ptr<Graph::AreaIterator> ai = g->getAreas();
+    while (ai->hasNext()) {
+        AreaPtr a = ai->next();
+        GraphPtr sub = a->getSubgraph();
+        if (sub != NULL) {
+            list<AreaId> subAreas(areas);
+            subAreas.push_back(a->getAncestor()->getId());
+            addGraph(sub.get(), index, a->getId(), subAreas, vertexCount);
+        }
+    }
+}
+
+void GraphProximityIndex::addCurve(int c)
+{
+    CurvePtr cp = curves[c].curve;
+    vector<int> &cells = curves[c].cells;
+    int n = cp->getSize();
+    for (int i = 0; i < n; ++i) {
+        vec2d a = cp->getXY(i);
+        int cx = getCell(a.x, bounds.xmin, bounds.xmax);
+        int cy = getCell(a.y, bounds.ymin, bounds.ymax);
+        vertices[cx + cy * gridSize].push_back(Entry(c, i));
+        cells.push_back(cx + cy * gridSize);
+        if (i < n - 1) {
+            addSegment(Entry(c, i), a, cp->getXY(i + 1), cells);
+        }
+    }
+    sort(cells.begin(), cells.end());
+    cells.erase(unique(cells.begin(), cells.end()), cells.end());
+}
+
+void GraphProximityIndex::removeCurve(int c)
+{
+    vector<int> &cells = curves[c].cells;
+    for (unsigned int i = 0; i < cells.size(); ++i) {
+        for (int k = 0; k < 2; ++k) {
+            vector<Entry> &cell = k == 0 ? vertices[cells[i]] : segments[cells[i]];
+            unsigned int n = 0;
+            for (unsigned int j = 0; j < cell.size(); ++j) {
+                if (cell[j].curve != c) {
+                    cell[n++] = cell[j];
+                }
+            }
+            cell.resize(n, Entry(0, 0));
+        }
+    }
+    cells.clear();
+    curves[c].curve = NULL;
+}
+
+void GraphProximityIndex::addSegment(const Entry &e, const vec2d &a, const vec2d &b, vector<int> &cells)
+{
+    // walks along the segment with steps smaller than a cell, and adds the
+    // segment to the cells covered by the bounding box of each step (this
+    // avoids adding long diagonal segments to all the cells of their bounds)
+    double cellSize = min(bounds.xmax - bounds.xmin, bounds.ymax - bounds.ymin) / gridSize;
+    double length = max(abs(b.x - a.x), abs(b.y - a.y));
+    int steps = cellSize > 0.0 ? max(1, (int) ceil(2.0 * length / cellSize)) : 1;
+    steps = min(steps, 4 * gridSize);
+    vec2d p = a;
+    for (int s = 1; s <= steps; ++s) {
+        vec2d q = s == steps ? b : a + (b - a) * (s / (double) steps);
+        int x0 = getCell(min(p.x, q.x), bounds.xmin, bounds.xmax);
+        int x1 = getCell(max(p.x, q.x), bounds.xmin, bounds.xmax);
+        int y0 = getCell(min(p.y, q.y), bounds.ymin, bounds.ymax);
+        int y1 = getCell(max(p.y, q.y), bounds.ymin, bounds.ymax);
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                vector<Entry> &cell = segments[x + y * gridSize];
+                if (cell.empty() || cell.back().curve != e.curve || cell.back().index != e.index) {
+                    cell.push_back(e);
+                    cells.push_back(x + y * gridSize);
+                }
+            }
+        }
+        p = q;
+    }
+}
+
+int GraphProximityIndex::getCell(double v, double vmin, double vmax) const
+{
+    int c = vmax > vmin ? (int) floor((v - vmin) / (vmax - vmin) * gridSize) : 0;
+    return c < 0 ? 0 : (c >= gridSize ? gridSize - 1 : c);
+}
+
+void GraphProximityIndex::getResult(const Entry &e, GraphPtr &graph, list<AreaId> &areas, CurvePtr &curve) const
+{
+    const IndexedCurve &c = curves[e.curve];
+    const IndexedGraph &g = graphs[c.graph];
+    graph = g.graph->getAncestor();
+    curve = c.curve->getAncestor();
+    areas.insert(areas.begin(), g.areas.begin(), g.areas.end());
+}
+
+}
@@ -0,0 +1,263 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _PROLAND_GRAPH_PROXIMITY_INDEX_H_
+#define _PROLAND_GRAPH_PROXIMITY_INDEX_H_
+
+#include "proland/graph/Graph.h"
+
+namespace proland
+{
+
+/**
+ * A spatial index to quickly find the curve vertices and segments of a Graph,
+ * and of the subgraphs of its areas, that are close to a given point. The
+ * vertices and segments are stored in a regular grid covering the graph
+ * bounds. The index records the versions of the indexed graphs, so that
+ * #isValid can tell when it is out of date, and #update can then update
+ * the cells of the changed curves only. This class does not depend on any
+ * rendering state, and can be used to pick curves outside of an editor.
+ * @ingroup graph
+ */
+PROLAND_API class GraphProximityIndex : public Object
+{
+public:
+    /**
+     * Creates a new GraphProximityIndex.
+     *
+     * @param graph the graph to be indexed, with the subgraphs of its areas.
+     */
+    GraphProximityIndex(GraphPtr graph);
+
+    /**
+     * Deletes this GraphProximityIndex.
+     */
+    virtual ~GraphProximityIndex();
+
+    /**
+     * Returns the indexed graph.
+     */
+    GraphPtr getGraph() const;
+
+    /**
+     * Returns true if the indexed graph and its subgraphs have not changed
+     * since this index was built (see Graph#version).
+     */
+    bool isValid() const;
+
+    /**
+     * Updates this index after changes of the indexed graph. Only the cells
+     * of the added and removed curves are updated, using the changes
+     * recorded by the indexed graph (see Graph#getChangesSince). This is not
+     * possible if these changes are no longer recorded, if they add or
+     * remove subgraphs, or if they change too many curves since this index
+     * was built (its grid would then become unbalanced).
+     *
+     * @return true if this index is up to date, or false if it could not be
+     *      updated and must be recreated.
+     */
+    bool update();
+
+    /**
+     * Finds the vertex closest to the given point, in a square of size
+     * 2*tolerance centered on this point. If there is no such vertex, finds
+     * the segment closest to the given point, at a distance less than
+     * tolerance from this point. The returned graph, curve, vertex and
+     * segment are those of the ancestor graph of the indexed graph (see
+     * Graph#getAncestor), as in EditGraphOrthoLayer#findCurve.
+     *
+     * @param x x coordinate of the point to search.
+     * @param y y coordinate of the point to search.
+     * @param tolerance the search distance.
+     * @param[out] graph owner graph of the selected Curve, if any.
+     * @param[out] areas the ancestor ids of the areas containing the subgraph
+     *      of the selected curve, from the outermost to the innermost one.
+     * @param[out] curve will contain the selected curve, NULL if none.
+     * @param[out] segment will contain the selected segment's rank in 'curve', -1 if none.
+     * @param[out] point will contain the selected point's rank in 'curve', -1 if none.
+     * @return true if something was selected.
+     */
+    bool find(double x, double y, float tolerance, GraphPtr &graph, std::list<AreaId> &areas, CurvePtr &curve, int &segment, int &point) const;
+
+private:
+    /**
+     * An indexed graph, i.e., the root graph or the subgraph of an area.
+     */
+    struct IndexedGraph
+    {
+        /**
+         * The indexed graph. Subgraphs are kept alive by their areas.
+         */
+        Graph *graph;
+
+        /**
+         * The version of #graph when this index was built.
+         */
+        unsigned int version;
+
+        /**
+         * The ancestor ids of the areas containing #graph.
+         */
+        std::list<AreaId> areas;
+
+        /**
+         * The index in #graphs of the parent graph of #graph, or -1 for the
+         * root graph.
+         */
+        int parent;
+
+        /**
+         * The id, in the parent graph, of the area whose subgraph is #graph.
+         */
+        AreaId area;
+
+        /**
+         * The indexes in #curves of the curves of #graph.
+         */
+        std::map<CurveId, int> curves;
+    };
+
+    /**
+     * An indexed curve.
+     */
+    struct IndexedCurve
+    {
+        /**
+         * The indexed curve, or NULL if it has been removed by #update.
+         */
+        CurvePtr curve;
+
+        /**
+         * The index of the graph containing this curve in #graphs.
+         */
+        int graph;
+
+        /**
+         * The grid cells containing the vertices or segments of this curve.
+         */
+        std::vector<int> cells;
+    };
+
+    /**
+     * A vertex or a segment stored in the grid. For a segment, 'index' is
+     * the index of its first vertex.
+     */
+    struct Entry
+    {
+        /**
+         * The index of the curve of this entry in #curves.
+         */
+        int curve;
+
+        /**
+         * The index of the vertex, or of the first segment vertex, in this curve.
+         */
+        int index;
+
+        Entry(int curve, int index) : curve(curve), index(index)
+        {
+        }
+    };
+
+    /**
+     * The indexed graph.
+     */
+    GraphPtr root;
+
+    /**
+     * The indexed graph and its subgraphs.
+     */
+    std::vector<IndexedGraph> graphs;
+
+    /**
+     * The curves of all the indexed graphs.
+     */
+    std::vector<IndexedCurve> curves;
+
+    /**
+     * The bounds of the indexed vertices.
+     */
+    box2d bounds;
+
+    /**
+     * The number of grid cells in each direction.
+     */
+    int gridSize;
+
+    /**
+     * The number of curves added or removed by #update since this index
+     * was built.
+     */
+    int changedCurves;
+
+    /**
+     * The vertices in each grid cell.
+     */
+    std::vector< std::vector<Entry> > vertices;
+
+    /**
+     * The segments intersecting each grid cell.
+     */
+    std::vector< std::vector<Entry> > segments;
+
+    /**
+     * Adds a graph and its subgraphs to #graphs and #curves, and computes
+     * their bounds and their number of vertices.
+     */
+    void addGraph(Graph *g, int parent, AreaId area, const std::list<AreaId> &areas, int &vertexCount);
+
+    /**
+     * Adds a curve of #curves to the grid cells containing its vertices
+     * and segments.
+     */
+    void addCurve(int c);
+
+    /**
+     * Removes a curve of #curves from the grid cells.
+     */
+    void removeCurve(int c);
+
+    /**
+     * Adds a segment to the grid cells it intersects.
+     */
+    void addSegment(const Entry &e, const vec2d &a, const vec2d &b, std::vector<int> &cells);
+
+    /**
+     * Returns the grid cell containing the given coordinate, clamped to
+     * the grid.
+     */
+    int getCell(double v, double vmin, double vmax) const;
+
+    /**
+     * Returns the selected curve, graph and areas for the given entry.
+     */
+    void getResult(const Entry &e, GraphPtr &graph, std::list<AreaId> &areas, CurvePtr &curve) const;
+};
+
+}
+
+#endif
@@ -189,8 +189,8 @@ NodePtr LazyGraph::loadNode(long int offset, NodeId id)
     long int oldOffset = fileReader->tellg();
     float x, y;
     fileReader->seekg(offset, ios::beg);
-    x = fileReader->read<float>();
-    y = fileReader->read<float>();
+    fileReader->resetPoints();
+    fileReader->readPoint(x, y);
     for (int j = 2; j < nParamsNodes; j++) {
         fileReader->read<float>();
     }
@@ -232,11 +232,11 @@ CurvePtr LazyGraph::loadCurve(long int offset, CurveId id)
     nis.id = start;
     c->loadVertex(nis);
 
+    fileReader->resetPoints();
     for (int j = 1; j < size - 1; j++) {
         float x, y;
         int isControl;
-        x = fileReader->read<float>();
-        y = fileReader->read<float>();
+        fileReader->readPoint(x, y);
         isControl = fileReader->read<int>();
         c->loadVertex(x, y, -1, isControl == 1);
 
@@ -359,6 +359,7 @@ NodePtr LazyGraph::getNode(NodeId id)
     if (j != nodeOffsets.end()) {
         offset = j->second;
         r = loadNode(offset, id);
+        nodeCache->misses++;
         nodes[id] = r.get();
         mapping->insert(make_pair(r->getPos(), r.get()));
         return r;
@@ -398,6 +399,7 @@ CurvePtr LazyGraph::getCurve(CurveId id)
     if (j != curveOffsets.end()) {
         offset = j->second;
         r = loadCurve(offset, id);
+        curveCache->misses++;
         curves.insert(make_pair(id, r.get()));
         return r;
     }
@@ -436,6 +438,7 @@ AreaPtr LazyGraph::getArea(AreaId id)
     if (j != areaOffsets.end()) {
         offset = j->second;
         r = loadArea(offset, id);
+        areaCache->misses++;
         areas[id] = r.get();
         return r;
     }
@@ -485,7 +488,7 @@ void LazyGraph::releaseNode(NodeId id)
         return;
     }
 
-    if (find(nodeCache->changedResources.begin(), nodeCache->changedResources.end(), i->second) != nodeCache->changedResources.end()) {
+    if (nodeCache->isChanged(i->second)) {
         return;
     }
 
@@ -512,7 +515,7 @@ void LazyGraph::releaseCurve(CurveId id)
         return;
     }
 
-    if (find(curveCache->changedResources.begin(), curveCache->changedResources.end(), i->second) != curveCache->changedResources.end()) {
+    if (curveCache->isChanged(i->second)) {
         return;
     }
 
@@ -536,7 +539,7 @@ void LazyGraph::releaseArea(AreaId id)
         return;
     }
 
-    if (find(areaCache->changedResources.begin(), areaCache->changedResources.end(), i->second) != areaCache->changedResources.end()) {
+    if (areaCache->isChanged(i->second)) {
         return;
     }
 
@@ -761,6 +764,13 @@ void LazyGraph::clean()
 {
 }
 
+void LazyGraph::skipCurveParams()
+{
+    for (int j = 3; j < nParamsCurves; j++) {
+        fileReader->read<float>();
+    }
+}
+
 void LazyGraph::readSubgraph()
 {
     fileReader->read<int>();//nParams
@@ -773,8 +783,11 @@ void LazyGraph::readSubgraph()
 
     int nodeCount = fileReader->read<int>();
     for (int i = 0; i < nodeCount; i++) {
-        for (int k = 0; k < nParamsNodes; k++) {
-            fileReader->read<float>(); //x,y
+        float x, y;
+        fileReader->resetPoints();
+        fileReader->readPoint(x, y);
+        for (int k = 2; k < nParamsNodes; k++) {
+            fileReader->read<float>();
         }
         int s = fileReader->read<int>();//number of curves
         for (int i = 0; i < s; i++) {
@@ -785,19 +798,25 @@ void LazyGraph::readSubgraph()
     int curveCount = fileReader->read<int>();
     for (int i = 0; i < curveCount; i++) {
         int s = fileReader->read<int>();//size
-        for (int k = 1; k < nParamsCurves; k++) {
-            fileReader->read<float>(); // params
-        }
-        for (int k = 0; k < nParamsCurveExtremities; k++) { //start
+        fileReader->read<float>();//width
+        fileReader->read<int>();//type
+        skipCurveParams();
+        fileReader->read<int>();//start
+        for (int k = 1; k < nParamsCurveExtremities; k++) {
             fileReader->read<float>();
         }
 
+        fileReader->resetPoints();
         for (int j = 1; j < s - 1; j++) {
-            for (int k = 0; k < nParamsCurvePoints; k++) {
-                fileReader->read<float>();//points
+            float x, y;
+            fileReader->readPoint(x, y);//points
+            fileReader->read<int>();//isControl
+            for (int k = 3; k < nParamsCurvePoints; k++) {
+                fileReader->read<float>();
             }
         }
-        for (int k = 0; k < nParamsCurveExtremities; k++) {//end
+        fileReader->read<int>();//end
+        for (int k = 1; k < nParamsCurveExtremities; k++) {
             fileReader->read<float>();
         }
         fileReader->read<int>();//area1
@@ -815,14 +834,16 @@ void LazyGraph::readSubgraph()
             fileReader->read<float>();
         }
         for (int j = 0; j < s; j++) {
-        for (int k = 0; k < nParamsAreaCurves; k++) {//areaCurves
-            fileReader->read<float>();
-        }
+            fileReader->read<int>();//curve
+            fileReader->read<int>();//orientation
+            for (int k = 2; k < nParamsAreaCurves; k++) {//areaCurves
+                fileReader->read<float>();
+            }
         }
-        fileReader->read<int>();//parent
         for (int k = 0; k < nParamsSubgraphs; k++) {//subgraphs
             fileReader->read<float>();
         }
+        fileReader->read<int>();//parent
     }
     for (int i = 0; i < subGraphs; ++i) {
         readSubgraph();
@@ -869,11 +890,12 @@ void LazyGraph::load(bool loadSubgraphs)
         NodeId nid = nextNodeId;
         nextNodeId.id++;
         nodeOffsets.insert(make_pair(nid, fileReader->tellg()));
-        for (int j = 0; j < nParamsNodes; j++) {
+        float x, y;
+        fileReader->resetPoints();
+        fileReader->readPoint(x, y);
+        for (int j = 2; j < nParamsNodes; j++) {
             fileReader->read<float>();
         }
-//        fileReader->read<float>(); //x
-//        fileReader->read<float>(); //y
         int size = fileReader->read<int>(); //number of curves
         for (int j = 0; j < size; j++) {
             fileReader->read<int>(); //curves
@@ -886,22 +908,28 @@ void LazyGraph::load(bool loadSubgraphs)
         nextCurveId.id++;
         curveOffsets.insert(make_pair(cid, fileReader->tellg()));
         int s = fileReader->read<int>(); //size
+        fileReader->read<float>(); //width
+        fileReader->read<int>(); //type
 
-        for (int j = 1; j < nParamsCurves; j++) {
-            fileReader->read<float>();
-        }
+        skipCurveParams();
 
-        for (int j = 0; j < nParamsCurveExtremities; j++) {
+        fileReader->read<int>(); //start
+        for (int j = 1; j < nParamsCurveExtremities; j++) {
             fileReader->read<float>();
         }
 
+        fileReader->resetPoints();
         for (int j = 1; j < s - 1; j++) {
-            for (int k = 0; k < nParamsCurvePoints; k++) {
+            float x, y;
+            fileReader->readPoint(x, y);
+            fileReader->read<int>(); //isControl
+            for (int k = 3; k < nParamsCurvePoints; k++) {
                 fileReader->read<float>();
             }
         }
 
-        for (int j = 0; j < nParamsCurveExtremities; j++) {
+        fileReader->read<int>(); //end
+        for (int j = 1; j < nParamsCurveExtremities; j++) {
             fileReader->read<float>();
         }
 
@@ -927,14 +955,16 @@ void LazyGraph::load(bool loadSubgraphs)
             subgraphedAreas.push_back(aid);
         }
         for (int j = 0; j < s; j++) {
-            for (int k = 0; k < nParamsAreaCurves; k++) {
+            fileReader->read<int>(); //curve
+            fileReader->read<int>(); //orientation
+            for (int k = 2; k < nParamsAreaCurves; k++) {
                 fileReader->read<float>();
             }
         }
-        fileReader->read<int>(); //parent
         for (int j = 0; j < nParamsSubgraphs; j++) {
             fileReader->read<float>();
         }
+        fileReader->read<int>(); //parent
     }
     if (loadSubgraphs) {
         for (int i = 0; i < (int) subgraphedAreas.size(); ++i) {
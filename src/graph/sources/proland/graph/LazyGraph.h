@@ -133,6 +133,10 @@ public:
 
     /**
      * Templated cache used to store unused graph items (nodes, curves, areas..).
+     * Unused items are kept in a hash table whose entries are linked in least
+     * recently used order, so that adding, removing and finding an item take
+     * a constant time. The cache also counts its hits, misses and evictions,
+     * to help tuning its capacity (see LazyGraph#setNodeCacheSize).
      */
     template<typename T>
     class GraphCache
@@ -146,10 +150,8 @@ public:
          */
         bool remove(ptr<T> t)
         {
-            typename map<ptr<T> , typename list<ptr<T> >::iterator>::iterator i = unusedResources.find(t);
-            if (i != unusedResources.end()) {
-                unusedResourcesOrder.erase(i->second);
-                unusedResources.erase(i);
+            if (unusedResources.erase(t.get())) {
+                ++hits;
                 return true;
             }
             //t->owner = owner;
@@ -167,8 +169,7 @@ public:
          */
         void add(T* t, bool modified = false)
         {
-            typename set<ptr<T> >::iterator i = find(changedResources.begin(), changedResources.end(), t);
-            if (i != changedResources.end()) {
+            if (changedResources.find(t) != -1) {
                 return;
             }
 
@@ -177,20 +178,282 @@ public:
                 return;
             }
 
-            typename list<ptr<T> >::iterator j;
-            if (unusedResourcesOrder.size() == size) {
-                j = unusedResourcesOrder.begin();
-                ptr<T> r = *j;
-                unusedResources.erase(r);
-                unusedResourcesOrder.erase(j);
+            if (unusedResources.find(t) != -1) {
+                return;
+            }
+            while (unusedResources.size() > 0 && unusedResources.size() >= size) {
+                ptr<T> r = unusedResources.front();
+                unusedResources.erase(r.get());
                 r->setOwner(NULL);
                 r = NULL;
+                ++evictions;
             }
-            j = unusedResourcesOrder.insert(unusedResourcesOrder.end(), t);
-            unusedResources.insert(make_pair(t, j));
+            unusedResources.insert(t);
+        }
+
+        /**
+         * Returns true if the given resource was added as a modified resource.
+         */
+        bool isChanged(T *t) const
+        {
+            return changedResources.find(t) != -1;
+        }
+
+        /**
+         * Returns the maximum number of unused resources in this cache.
+         */
+        unsigned int getCapacity() const
+        {
+            return size;
+        }
+
+        /**
+         * Returns the current number of unused resources in this cache.
+         */
+        unsigned int getSize() const
+        {
+            return unusedResources.size();
+        }
+
+        /**
+         * Returns the number of resources that were found in this cache
+         * when they were requested again.
+         */
+        unsigned int getHits() const
+        {
+            return hits;
+        }
+
+        /**
+         * Returns the number of resources that had to be loaded from the
+         * graph file because they were not in memory.
+         */
+        unsigned int getMisses() const
+        {
+            return misses;
+        }
+
+        /**
+         * Returns the number of unused resources that were deleted to make
+         * room for more recently used ones.
+         */
+        unsigned int getEvictions() const
+        {
+            return evictions;
+        }
+
+        /**
+         * Resets the hits, misses and evictions counters to 0.
+         */
+        void resetCounters()
+        {
+            hits = 0;
+            misses = 0;
+            evictions = 0;
         }
 
     private:
+        /**
+         * A hash table of resources, indexed by their address. The entries
+         * are stored in a single vector, with free entries reused, and are
+         * linked in insertion order.
+         */
+        class Table
+        {
+        public:
+            Table() : head(-1), tail(-1), freeEntries(-1), count(0)
+            {
+            }
+
+            /**
+             * Returns the number of resources in this table.
+             */
+            unsigned int size() const
+            {
+                return count;
+            }
+
+            /**
+             * Returns the index of the entry containing the given resource,
+             * or -1 if it is not in this table.
+             */
+            int find(T *t) const
+            {
+                if (buckets.empty()) {
+                    return -1;
+                }
+                int e = buckets[getBucket(t)];
+                while (e != -1 && entries[e].resource.get() != t) {
+                    e = entries[e].chain;
+                }
+                return e;
+            }
+
+            /**
+             * Returns the oldest resource of this table, or NULL if empty.
+             */
+            T *front() const
+            {
+                return head == -1 ? NULL : entries[head].resource.get();
+            }
+
+            /**
+             * Adds a resource at the end of this table. The resource must
+             * not already be in this table.
+             */
+            void insert(T *t)
+            {
+                if (count >= buckets.size()) {
+                    rehash(buckets.empty() ? 16 : 2 * (unsigned int) buckets.size());
+                }
+                int e = freeEntries;
+                if (e == -1) {
+                    e = (int) entries.size();
+                    entries.push_back(Entry());
+                } else {
+                    freeEntries = entries[e].chain;
+                }
+                Entry &n = entries[e];
+                n.resource = t;
+                unsigned int b = getBucket(t);
+                n.chain = buckets[b];
+                buckets[b] = e;
+                n.prev = tail;
+                n.next = -1;
+                if (tail == -1) {
+                    head = e;
+                } else {
+                    entries[tail].next = e;
+                }
+                tail = e;
+                ++count;
+            }
+
+            /**
+             * Removes a resource from this table.
+             *
+             * @return true if the resource was in this table.
+             */
+            bool erase(T *t)
+            {
+                if (buckets.empty()) {
+                    return false;
+                }
+                int *p = &buckets[getBucket(t)];
+                while (*p != -1 && entries[*p].resource.get() != t) {
+                    p = &entries[*p].chain;
+                }
+                if (*p == -1) {
+                    return false;
+                }
+                int e = *p;
+                // the reference is released only when this table is in a
+                // consistent state, since this can delete the resource
+                ptr<T> r = entries[e].resource;
+                entries[e].resource = NULL;
+                *p = entries[e].chain;
+                if (entries[e].prev == -1) {
+                    head = entries[e].next;
+                } else {
+                    entries[entries[e].prev].next = entries[e].next;
+                }
+                if (entries[e].next == -1) {
+                    tail = entries[e].prev;
+                } else {
+                    entries[entries[e].next].prev = entries[e].prev;
+                }
+                entries[e].chain = freeEntries;
+                freeEntries = e;
+                --count;
+                return true;
+            }
+
+            /**
+             * Removes all the resources of this table.
+             */
+            void clear()
+            {
+                vector<Entry> e;
+                e.swap(entries);
+                buckets.clear();
+                head = -1;
+                tail = -1;
+                freeEntries = -1;
+                count = 0;
+            }
+
+        private:
+            /**
+             * An entry of the table.
+             */
+            struct Entry
+            {
+                /**
+                 * The resource of this entry, or NULL for a free entry.
+                 */
+                ptr<T> resource;
+
+                /**
+                 * The next entry in the same bucket, or in the free list.
+                 */
+                int chain;
+
+                /**
+                 * The previous and next entries in insertion order.
+                 */
+                int prev, next;
+            };
+
+            /**
+             * The entries of this table.
+             */
+            vector<Entry> entries;
+
+            /**
+             * The first entry of each bucket. The number of buckets is a
+             * power of two.
+             */
+            vector<int> buckets;
+
+            /**
+             * The oldest and the newest entries.
+             */
+            int head, tail;
+
+            /**
+             * The first free entry.
+             */
+            int freeEntries;
+
+            /**
+             * The number of resources in this table.
+             */
+            unsigned int count;
+
+            /**
+             * Returns the bucket of the given resource.
+             */
+            unsigned int getBucket(T *t) const
+            {
+                size_t h = (size_t) t;
+                h ^= (h >> 4) ^ (h >> 12);
+                return (unsigned int) h & ((unsigned int) buckets.size() - 1);
+            }
+
+            /**
+             * Changes the number of buckets.
+             */
+            void rehash(unsigned int n)
+            {
+                buckets.assign(n, -1);
+                for (int e = head; e != -1; e = entries[e].next) {
+                    unsigned int b = getBucket(entries[e].resource.get());
+                    entries[e].chain = buckets[b];
+                    buckets[b] = e;
+                }
+            }
+        };
+
         /**
          * Creates a new GraphCache.
          *
@@ -199,7 +462,7 @@ public:
          *      (doesn't include modified items).
          */
         GraphCache(Graph* g, unsigned int size = 0) :
-            owner(g), size(size)
+            owner(g), size(size), hits(0), misses(0), evictions(0)
         {
         }
 
@@ -209,7 +472,6 @@ public:
         ~GraphCache()
         {
             unusedResources.clear();
-            unusedResourcesOrder.clear();
             changedResources.clear();
         }
 
@@ -219,26 +481,35 @@ public:
         Graph *owner;
 
         /**
-         * This lists allows to get the least recently used item in order to
-         * delete it when cache is full.
+         * The unused resources, from the least to the most recently used.
          */
-        list<ptr<T> > unusedResourcesOrder;
+        Table unusedResources;
 
         /**
-         * Complete list of unused resources.
+         * The changed resources. These resources doesn't count in the number
+         * of unused resources.
          */
-        map<ptr<T>, typename list<ptr<T> >::iterator> unusedResources;
+        Table changedResources;
 
         /**
-         * Complete list of changed resources. These resources doesn't count in
-         * the number of unused resources.
+         * Maximum size of the cache.
          */
-        set<ptr<T> > changedResources;
+        unsigned int size;
 
         /**
-         * Maximum size of the cache.
+         * The number of calls to #remove that found the resource.
          */
-        unsigned int size;
+        unsigned int hits;
+
+        /**
+         * The number of resources loaded from the graph file.
+         */
+        unsigned int misses;
+
+        /**
+         * The number of resources evicted from this cache.
+         */
+        unsigned int evictions;
 
         friend class LazyNode;
 
@@ -566,6 +837,15 @@ protected:
      */
     virtual GraphPtr loadSubgraph(long int offset, AreaId id);
 
+    /**
+     * Skips the curve parameters stored after the size, width and type of a
+     * curve, when the file is scanned without loading its curves. The default
+     * implementation skips floats. Subclasses storing other parameters must
+     * override this method to read them with their real types, since ints
+     * and floats do not have the same size in compact files.
+     */
+    virtual void skipCurveParams();
+
     /**
      * Removes a Node from this graph. This method is called when editing
      * the Graph.
@@ -0,0 +1,269 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "proland/graph/producer/CPURasterizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace std;
+
+namespace proland
+{
+
+/**
+ * The number of sub scanlines per pixel row.
+ */
+#define SUB_SCANLINES 8
+
+static bool compareEdges(const pair<double, int> &a, const pair<double, int> &b)
+{
+    return a.first < b.first;
+}
+
+CPURasterizer::CPURasterizer(unsigned char *data, int width, int height, int channels) :
+    Object("CPURasterizer"), data(data), width(width), height(height), channels(channels)
+{
+    assert(channels >= 1 && channels <= 4);
+    coverage.resize(width + 1, 0.0f);
+}
+
+CPURasterizer::~CPURasterizer()
+{
+}
+
+int CPURasterizer::getWidth() const
+{
+    return width;
+}
+
+int CPURasterizer::getHeight() const
+{
+    return height;
+}
+
+void CPURasterizer::beginPolygon()
+{
+    edges.clear();
+    contour.clear();
+}
+
+void CPURasterizer::beginContour()
+{
+    contour.clear();
+}
+
+void CPURasterizer::newVertex(double x, double y)
+{
+    contour.push_back(toPixel(vec2d(x, y)));
+}
+
+void CPURasterizer::endContour()
+{
+    int n = (int) contour.size();
+    if (n >= 3) {
+        for (int i = 0; i < n; ++i) {
+            addEdge(contour[i], contour[(i + 1) % n]);
+        }
+    }
+    contour.clear();
+}
+
+void CPURasterizer::addTriangle(const vec2d &a, const vec2d &b, const vec2d &c)
+{
+    vec2d pa = toPixel(a);
+    vec2d pb = toPixel(b);
+    vec2d pc = toPixel(c);
+    double area = (pb.x - pa.x) * (pc.y - pa.y) - (pb.y - pa.y) * (pc.x - pa.x);
+    if (area > 0.0) {
+        addEdge(pa, pb);
+        addEdge(pb, pc);
+        addEdge(pc, pa);
+    } else if (area < 0.0) {
+        addEdge(pa, pc);
+        addEdge(pc, pb);
+        addEdge(pb, pa);
+    }
+}
+
+void CPURasterizer::addTriangleStrip(const vector<vec2d> &strip)
+{
+    for (int i = 2; i < (int) strip.size(); ++i) {
+        addTriangle(strip[i - 2], strip[i - 1], strip[i]);
+    }
+}
+
+void CPURasterizer::fill(const vec4f &color, FillRule rule, bool blend, int writeMask)
+{
+    if (edges.empty()) {
+        contour.clear();
+        return;
+    }
+
+    double ymin = edges[0].y0;
+    double ymax = edges[0].y1;
+    for (unsigned int i = 1; i < edges.size(); ++i) {
+        ymin = min(ymin, edges[i].y0);
+        ymax = max(ymax, edges[i].y1);
+    }
+    int row0 = max(0, (int) floor(ymin));
+    int row1 = min(height - 1, (int) ceil(ymax));
+
+    // sorts the edges by increasing y0, so that they can be added to the
+    // active edge list in order while going up
+    vector< pair<double, int> > order;
+    order.reserve(edges.size());
+    for (unsigned int i = 0; i < edges.size(); ++i) {
+        order.push_back(make_pair(edges[i].y0, (int) i));
+    }
+    sort(order.begin(), order.end(), compareEdges);
+
+    float value[4];
+    for (int c = 0; c < 4; ++c) {
+        value[c] = min(max(color[c], 0.0f), 1.0f) * 255.0f;
+    }
+    float alpha = blend ? min(max(color.w, 0.0f), 1.0f) : 1.0f;
+    float subCover = 1.0f / SUB_SCANLINES;
+
+    unsigned int next = 0;
+    active.clear();
+    for (int row = row0; row <= row1; ++row) {
+        double xmin = width;
+        double xmax = 0.0;
+        for (int s = 0; s < SUB_SCANLINES; ++s) {
+            double y = row + (s + 0.5) / SUB_SCANLINES;
+            while (next < order.size() && order[next].first <= y) {
+                active.push_back(order[next++].second);
+            }
+            crossings.clear();
+            for (unsigned int i = 0; i < active.size();) {
+                const Edge &e = edges[active[i]];
+                if (e.y1 <= y) {
+                    active[i] = active.back();
+                    active.pop_back();
+                    continue;
+                }
+                double x = e.x0 + (y - e.y0) * (e.x1 - e.x0) / (e.y1 - e.y0);
+                crossings.push_back(make_pair(x, e.dir));
+                ++i;
+            }
+            if (crossings.empty()) {
+                continue;
+            }
+            sort(crossings.begin(), crossings.end(), compareEdges);
+            int winding = 0;
+            double start = 0.0;
+            for (unsigned int i = 0; i < crossings.size(); ++i) {
+                bool wasInside = rule == NON_ZERO ? winding != 0 : (winding & 1) != 0;
+                winding += crossings[i].second;
+                bool inside = rule == NON_ZERO ? winding != 0 : (winding & 1) != 0;
+                if (inside && !wasInside) {
+                    start = crossings[i].first;
+                } else if (wasInside && !inside) {
+                    addSpan(start, crossings[i].first, subCover);
+                    xmin = min(xmin, start);
+                    xmax = max(xmax, crossings[i].first);
+                }
+            }
+        }
+        if (xmax <= xmin) {
+            continue;
+        }
+
+        // blends the covered pixels of this row with the polygon color
+        int x0 = max(0, (int) floor(xmin));
+        int x1 = min(width - 1, (int) floor(xmax));
+        unsigned char *pixel = data + (row * width + x0) * channels;
+        for (int x = x0; x <= x1; ++x, pixel += channels) {
+            float a = min(coverage[x], 1.0f) * alpha;
+            coverage[x] = 0.0f;
+            if (a <= 0.0f) {
+                continue;
+            }
+            for (int c = 0; c < channels; ++c) {
+                if ((writeMask & (1 << c)) != 0) {
+                    pixel[c] = (unsigned char) (pixel[c] + (value[c] - pixel[c]) * a + 0.5f);
+                }
+            }
+        }
+    }
+
+    edges.clear();
+    contour.clear();
+}
+
+void CPURasterizer::addEdge(const vec2d &a, const vec2d &b)
+{
+    if (a.y == b.y) {
+        return;
+    }
+    Edge e;
+    if (a.y < b.y) {
+        e.x0 = a.x;
+        e.y0 = a.y;
+        e.x1 = b.x;
+        e.y1 = b.y;
+        e.dir = 1;
+    } else {
+        e.x0 = b.x;
+        e.y0 = b.y;
+        e.x1 = a.x;
+        e.y1 = a.y;
+        e.dir = -1;
+    }
+    edges.push_back(e);
+}
+
+void CPURasterizer::addSpan(double x0, double x1, float cover)
+{
+    x0 = max(x0, 0.0);
+    x1 = min(x1, (double) width);
+    if (x1 <= x0) {
+        return;
+    }
+    int i0 = (int) floor(x0);
+    int i1 = (int) floor(x1);
+    if (i0 == i1) {
+        coverage[i0] += (float) (x1 - x0) * cover;
+        return;
+    }
+    coverage[i0] += (float) (i0 + 1 - x0) * cover;
+    for (int i = i0 + 1; i < i1; ++i) {
+        coverage[i] += cover;
+    }
+    if (i1 < width) {
+        coverage[i1] += (float) (x1 - i1) * cover;
+    }
+}
+
+vec2d CPURasterizer::toPixel(const vec2d &p) const
+{
+    return vec2d((p.x + 1.0) * 0.5 * width, (p.y + 1.0) * 0.5 * height);
+}
+
+}
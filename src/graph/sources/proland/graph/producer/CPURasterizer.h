@@ -0,0 +1,230 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _PROLAND_CPU_RASTERIZER_H_
+#define _PROLAND_CPU_RASTERIZER_H_
+
+#include <vector>
+
+#include "ork/core/Object.h"
+#include "ork/math/vec2.h"
+#include "ork/math/vec4.h"
+
+using namespace ork;
+
+namespace proland
+{
+
+/**
+ * An anti-aliased scanline rasterizer to draw 2D polygons in a CPU buffer of
+ * unsigned char pixels. This is the CPU counterpart of a FrameBuffer used
+ * with a Tesselator: polygons are defined by a set of contours or triangles,
+ * with vertex coordinates in normalized device coordinates (i.e. -1,-1 and
+ * 1,1 are the lower left and upper right corners of the buffer, and the
+ * first row of the buffer is the bottom one, as for an uploaded texture).
+ * Pixel coverage is computed with several sub scanlines per pixel row, and
+ * with an exact horizontal coverage along each sub scanline. A
+ * CPURasterizer is not thread safe, but several rasterizers can be used in
+ * parallel on distinct buffers.
+ * @ingroup producer
+ * @author Eric Bruneton
+ */
+PROLAND_API class CPURasterizer : public Object
+{
+public:
+    /**
+     * The rules to decide which points are inside a polygon.
+     */
+    enum FillRule
+    {
+        NON_ZERO, ///< points with a non zero winding number are inside.
+        EVEN_ODD ///< points with an odd winding number are inside.
+    };
+
+    /**
+     * Creates a new CPURasterizer.
+     *
+     * @param data the buffer where polygons must be drawn. Pixels are stored
+     *      row by row, from the bottom row to the top one, each pixel
+     *      having 'channels' components.
+     * @param width the width of the buffer in pixels.
+     * @param height the height of the buffer in pixels.
+     * @param channels the number of components per pixel (between 1 and 4).
+     */
+    CPURasterizer(unsigned char *data, int width, int height, int channels);
+
+    /**
+     * Deletes this CPURasterizer.
+     */
+    virtual ~CPURasterizer();
+
+    /**
+     * Returns the width of the buffer in pixels.
+     */
+    int getWidth() const;
+
+    /**
+     * Returns the height of the buffer in pixels.
+     */
+    int getHeight() const;
+
+    /**
+     * Starts a new polygon. This clears the contours and triangles of the
+     * previous polygon, if they have not been drawn with #fill.
+     */
+    void beginPolygon();
+
+    /**
+     * Starts a new contour in the current polygon.
+     */
+    void beginContour();
+
+    /**
+     * Defines a new vertex in the current contour.
+     */
+    void newVertex(double x, double y);
+
+    /**
+     * Ends the current contour. The contour is automatically closed.
+     */
+    void endContour();
+
+    /**
+     * Adds a triangle to the current polygon. The triangle is reoriented if
+     * necessary, so that a set of triangles drawn with the NON_ZERO rule
+     * covers the union of these triangles (this can be used to draw the
+     * triangle strips built for a Mesh).
+     */
+    void addTriangle(const vec2d &a, const vec2d &b, const vec2d &c);
+
+    /**
+     * Adds the triangles of a triangle strip to the current polygon.
+     *
+     * @param strip the vertices of the triangle strip.
+     */
+    void addTriangleStrip(const std::vector<vec2d> &strip);
+
+    /**
+     * Draws the current polygon in the buffer, and starts a new one. Each
+     * pixel is blended with the given color, with a factor equal to the
+     * pixel coverage, multiplied by the alpha component of the color if
+     * 'blend' is true.
+     *
+     * @param color the polygon color, with components between 0 and 1.
+     * @param rule the rule to decide which points are inside the polygon.
+     * @param blend true to multiply the pixel coverage with color.w.
+     * @param writeMask the components of the buffer that must be written,
+     *      bit i corresponding to component i.
+     */
+    void fill(const vec4f &color, FillRule rule, bool blend = true, int writeMask = 15);
+
+private:
+    /**
+     * A polygon edge, in pixel coordinates, with y0 < y1.
+     */
+    struct Edge
+    {
+        double x0;
+
+        double y0;
+
+        double x1;
+
+        double y1;
+
+        /**
+         * +1 if the original edge goes upward, -1 otherwise.
+         */
+        int dir;
+    };
+
+    /**
+     * The buffer where polygons must be drawn.
+     */
+    unsigned char *data;
+
+    /**
+     * The width of the buffer in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the buffer in pixels.
+     */
+    int height;
+
+    /**
+     * The number of components per pixel.
+     */
+    int channels;
+
+    /**
+     * The edges of the current polygon.
+     */
+    std::vector<Edge> edges;
+
+    /**
+     * The vertices of the current contour, in pixel coordinates.
+     */
+    std::vector<vec2d> contour;
+
+    /**
+     * The edges of #edges that intersect the current sub scanline.
+     */
+    std::vector<int> active;
+
+    /**
+     * The intersections of the current sub scanline with the active edges,
+     * with the direction of the corresponding edges.
+     */
+    std::vector< std::pair<double, int> > crossings;
+
+    /**
+     * The coverage of each pixel of the current row.
+     */
+    std::vector<float> coverage;
+
+    /**
+     * Adds an edge to #edges, ignoring horizontal ones.
+     */
+    void addEdge(const vec2d &a, const vec2d &b);
+
+    /**
+     * Adds the given coverage to the pixels of the current row covered by
+     * the span [x0,x1).
+     */
+    void addSpan(double x0, double x1, float cover);
+
+    /**
+     * Converts normalized device coordinates to pixel coordinates.
+     */
+    vec2d toPixel(const vec2d &p) const;
+};
+
+}
+
+#endif
@@ -28,14 +28,90 @@
 #include "proland/graph/producer/GraphLayer.h"
 
 #include "proland/producer/CPUTileStorage.h"
+#include "proland/producer/ObjectTileStorage.h"
 #include "proland/graph/Area.h"
 #include "proland/graph/GraphListener.h"
 
+#include <pthread.h>
+
 namespace proland
 {
 
+/**
+ * Adds the indices of a triangle strip to a mesh in TRIANGLES mode.
+ *
+ * @param base the index of the first strip vertex in the mesh.
+ * @param count the number of strip vertices.
+ */
+template<class vertex>
+static void addStripIndices(unsigned int base, unsigned int count, Mesh<vertex, unsigned int> &mesh)
+{
+    for (unsigned int i = 0; i + 3 < count; i += 2) {
+        mesh.addIndice(base + i);
+        mesh.addIndice(base + i + 1);
+        mesh.addIndice(base + i + 2);
+        mesh.addIndice(base + i + 2);
+        mesh.addIndice(base + i + 1);
+        mesh.addIndice(base + i + 3);
+    }
+}
+
+/**
+ * A Task to build the meshes of a GraphLayer tile, before the task that
+ * draws this tile. Unlike the drawing task, this task does not need an
+ * OpenGL context, and can be executed by any Scheduler thread.
+ */
+class BuildTileMeshesTask : public Task
+{
+public:
+    /**
+     * The layer whose tile meshes must be built.
+     */
+    GraphLayer *owner;
+
+    /**
+     * The level of the tile.
+     */
+    int level;
+
+    /**
+     * The x coordinate of the tile.
+     */
+    int tx;
+
+    /**
+     * The y coordinate of the tile.
+     */
+    int ty;
+
+    BuildTileMeshesTask(GraphLayer *owner, int level, int tx, int ty, unsigned int deadline) :
+        Task("BuildTileMeshesTask", false, deadline), owner(owner), level(level), tx(tx), ty(ty)
+    {
+    }
+
+    virtual ~BuildTileMeshesTask()
+    {
+    }
+
+    virtual bool run()
+    {
+        TileCache::Tile *t = owner->graphProducer->findTile(level, tx, ty);
+        assert(t != NULL);
+        ObjectTileStorage::ObjectSlot *graphData = dynamic_cast<ObjectTileStorage::ObjectSlot*>(t->getData());
+        GraphPtr g = graphData->data.cast<Graph>();
+        vector< ptr<Object> > meshes;
+        if (g != NULL) {
+            owner->buildTileMeshes(level, tx, ty, g, meshes);
+        }
+        owner->putTileMeshes(level, tx, ty, meshes);
+        return true;
+    }
+};
+
 GraphLayer::GraphLayer(const char *name) : TileLayer(name)
 {
+    tileMeshesMutex = new pthread_mutex_t;
+    pthread_mutex_init((pthread_mutex_t*) tileMeshesMutex, NULL);
     graphProducer = NULL;
     displayLevel = 0;
     storeGraphTiles = false;
@@ -45,12 +121,17 @@ GraphLayer::GraphLayer(const char *name) : TileLayer(name)
 GraphLayer::GraphLayer(const char *name, ptr<GraphProducer> graphProducer, ptr<Program> layerProgram,int displayLevel, bool quality, bool storeGraphTiles, bool deform) :
     TileLayer(name)
 {
+    tileMeshesMutex = new pthread_mutex_t;
+    pthread_mutex_init((pthread_mutex_t*) tileMeshesMutex, NULL);
     init(graphProducer, layerProgram, displayLevel, quality, storeGraphTiles, deform);
 }
 
 GraphLayer::~GraphLayer()
 {
     usedTiles.clear();
+    tileMeshes.clear();
+    pthread_mutex_destroy((pthread_mutex_t*) tileMeshesMutex);
+    delete (pthread_mutex_t*) tileMeshesMutex;
 }
 
 void GraphLayer::init(ptr<GraphProducer> graphProducer, ptr<Program> layerProgram, int displayLevel, bool quality, bool storeGraphTiles, bool deform)
@@ -131,6 +212,10 @@ void GraphLayer::stopCreateTile(int level, int tx, int ty)
             usedTiles.erase(p);
         }
 
+        pthread_mutex_lock((pthread_mutex_t*) tileMeshesMutex);
+        tileMeshes.erase(id);
+        pthread_mutex_unlock((pthread_mutex_t*) tileMeshesMutex);
+
         TileCache::Tile *t = graphProducer->findTile(level, tx, ty);
         assert(t != NULL);
         graphProducer->putTile(t);
@@ -160,97 +245,12 @@ void GraphLayer::drawCurve(const vec3d &tileCoords, CurvePtr p, float width, flo
 {
     int n = p->getSize();
     if (width * scale > 0.0002) {
-        float w = width / 2;
+        vector<vec2d> strip;
+        getCurveStrip(tileCoords, p, width / 2, strip, nx, ny, lx, ly);
         mesh.setMode(TRIANGLE_STRIP);
         mesh.clear();
-        if (isDeformed()) {
-            vec2d prev = vec2d(0.f, 0.f);
-            vec2d cur = p->getXY(0);
-            vec2d next = p->getXY(1);
-            for (int i = 0; i < n; ++i) {
-                float dx, dy;
-                if (i == 0) {
-                    float x = next.x - cur.x;
-                    float y = next.y - cur.y;
-                    dx = nx->x * x + ny->x * y;
-                    dy = nx->y * x + ny->y * y;
-                    float f = w / ((*lx) * dx + (*ly) * dy).length();
-                    dx *= f;
-                    dy *= f;
-                } else if (i == n - 1) {
-                    float x = cur.x - prev.x;
-                    float y = cur.y - prev.y;
-                    dx = nx->x * x + ny->x * y;
-                    dy = nx->y * x + ny->y * y;
-                    float f = w / ((*lx) * dx + (*ly) * dy).length();
-                    dx *= f;
-                    dy *= f;
-                } else {
-                    float dx0 = cur.x - prev.x;
-                    float dy0 = cur.y - prev.y;
-                    float dx1 = next.x - cur.x;
-                    float dy1 = next.y - cur.y;
-                    float det = dx0 * dy1 - dy0 * dx1;
-                    if (abs(atan2(det, dx0 * dx1 + dy0 * dy1)) > 0.5) {
-                        float k0 = w / ((*lx) * dy0 - (*ly) * dx0).length();
-                        float k1 = w / ((*lx) * dy1 - (*ly) * dx1).length();
-                        float t = (dy1*(k0*dy0-k1*dy1) - dx1*(k1*dx1-k0*dx0)) / det;
-                        dx = -k0*dy0 + t*dx0;
-                        dy = k0*dx0 + t*dy0;
-                    } else {
-                        float Dx0 = nx->x * dx0 + ny->x * dy0;
-                        float Dy0 = nx->y * dx0 + ny->y * dy0;
-                        float f0 = w / ((*lx) * Dx0 + (*ly) * Dy0).length();
-                        float Dx1 = nx->x * dx1 + ny->x * dy1;
-                        float Dy1 = nx->y * dx1 + ny->y * dy1;
-                        float f1 = w / ((*lx) * Dx1 + (*ly) * Dy1).length();
-                        dx = 0.5 * (Dx0 * f0 + Dx1 * f1);
-                        dy = 0.5 * (Dy0 * f0 + Dy1 * f1);
-                    }
-                }
-                mesh.addVertex(((vec2d(cur.x + dx, cur.y + dy) - tileCoords.xy()) * tileCoords.z).cast<float>());
-                mesh.addVertex(((vec2d(cur.x - dx, cur.y - dy) - tileCoords.xy()) * tileCoords.z).cast<float>());
-                prev = cur;
-                cur = next;
-                if (i < n - 2) {
-                    next = p->getXY(i + 2);
-                }
-            }
-        } else {
-            vec2d prev = vec2d(0.f, 0.f);
-            vec2d cur = p->getXY(0);
-            vec2d next = p->getXY(1);
-            float prevl = 0.0f;
-            float nextl = (next - cur).length();
-            for (int i = 0; i < n; ++i) {
-                float dx, dy;
-                if (i == 0) {
-                    dx = (next.x - cur.x) / nextl;
-                    dy = (next.y - cur.y) / nextl;
-                } else if (i == n - 1) {
-                    dx = (cur.x - prev.x) / prevl;
-                    dy = (cur.y - prev.y) / prevl;
-                } else {
-                    dx = (cur.x - prev.x) / prevl;
-                    dy = (cur.y - prev.y) / prevl;
-                    dx += (next.x - cur.x) / nextl;
-                    dy += (next.y - cur.y) / nextl;
-                    float l = (float) ((dx*dx + dy*dy) * 0.5);
-                    dx = dx / l;
-                    dy = dy / l;
-                }
-                dx = dx * w;
-                dy = dy * w;
-                mesh.addVertex(((vec2d(cur.x - dy, cur.y + dx) - tileCoords.xy()) * tileCoords.z).cast<float>());
-                mesh.addVertex(((vec2d(cur.x + dy, cur.y - dx) - tileCoords.xy()) * tileCoords.z).cast<float>());
-                prev = cur;
-                prevl = nextl;
-                cur = next;
-                if (i < n - 2) {
-                    next = p->getXY(i + 2);
-                    nextl = (next - cur).length();
-                }
-            }
+        for (unsigned int i = 0; i < strip.size(); ++i) {
+            mesh.addVertex(strip[i].cast<float>());
         }
     } else {
         mesh.setMode(LINE_STRIP);
@@ -874,4 +874,218 @@ void GraphLayer::drawArea(const vec3d &tileCoords, AreaPtr a, Tesselator &tess)
     tess.endContour();
 }
 
+void GraphLayer::addCurve(const vec3d &tileCoords, CurvePtr p, float width, float scale, Mesh<vec2f, unsigned int> &mesh, vec2d *nx, vec2d *ny, vec2d *lx, vec2d *ly)
+{
+    float w = width / 2;
+    if (width * scale <= 0.0002) {
+        // thin curves are drawn with lines in #drawCurve; here we use
+        // triangles of one pixel width instead
+        w = 1.0f / float(tileCoords.z * getTileSize());
+    }
+    vector<vec2d> strip;
+    getCurveStrip(tileCoords, p, w, strip, nx, ny, lx, ly);
+    unsigned int base = mesh.getVertexCount();
+    for (unsigned int i = 0; i < strip.size(); ++i) {
+        mesh.addVertex(strip[i].cast<float>());
+    }
+    addStripIndices(base, strip.size(), mesh);
+}
+
+void GraphLayer::addCurve(const vec3d &tileCoords, CurvePtr p, CurveData *data, float width, Mesh<vec4f, unsigned int> &mesh, vec2d *nx, vec2d *ny, vec2d *lx, vec2d *ly)
+{
+    float w = width / 2;
+    vector<vec2d> strip;
+    getCurveStrip(tileCoords, p, w, strip, nx, ny, lx, ly);
+    unsigned int base = mesh.getVertexCount();
+    for (unsigned int i = 0; i < strip.size(); i += 2) {
+        float curvl = data == NULL ? 0 : data->getCurvilinearLength(p->getS(i / 2));
+        mesh.addVertex(vec4f(strip[i].x, strip[i].y, curvl, -w));
+        mesh.addVertex(vec4f(strip[i + 1].x, strip[i + 1].y, curvl, w));
+    }
+    addStripIndices(base, strip.size(), mesh);
+}
+
+void GraphLayer::rasterizeCurve(const vec3d &tileCoords, CurvePtr p, float width, CPURasterizer &r)
+{
+    float w = max(width, 2.0f / float(tileCoords.z * r.getWidth())) / 2;
+    vector<vec2d> strip;
+    getCurveStrip(tileCoords, p, w, strip);
+    r.addTriangleStrip(strip);
+}
+
+void GraphLayer::rasterizeArea(const vec3d &tileCoords, AreaPtr a, CPURasterizer &r)
+{
+    r.beginContour();
+    for (int j = 0; j < a->getCurveCount(); ++j) {
+        int orientation;
+        CurvePtr p = a->getCurve(j, orientation);
+        if (orientation == 0) {
+            for (int k = 0; k < p->getSize(); ++k) {
+                vec2d cp = (p->getXY(k) - tileCoords.xy()) * tileCoords.z;
+                r.newVertex(cp.x, cp.y);
+            }
+        } else {
+            for (int k = p->getSize() - 1; k >= 0; --k) {
+                vec2d cp = (p->getXY(k) - tileCoords.xy()) * tileCoords.z;
+                r.newVertex(cp.x, cp.y);
+            }
+        }
+    }
+    r.endContour();
+}
+
+ptr<CPURasterizer> GraphLayer::createRasterizer(TileStorage::Slot *data)
+{
+    CPUTileStorage<unsigned char>::CPUSlot *cpuData = dynamic_cast<CPUTileStorage<unsigned char>::CPUSlot*>(data);
+    if (cpuData == NULL) {
+        return NULL;
+    }
+    CPUTileStorage<unsigned char> *storage = dynamic_cast<CPUTileStorage<unsigned char>*>(cpuData->getOwner());
+    assert(storage != NULL);
+    int tileSize = storage->getTileSize();
+    return new CPURasterizer(cpuData->data, tileSize, tileSize, storage->getChannels());
+}
+
+void GraphLayer::rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r)
+{
+}
+
+ptr<Task> GraphLayer::startBuildTileMeshes(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> result)
+{
+    if (result == NULL || level < displayLevel) {
+        return task;
+    }
+    // tiles drawn on CPU do not need meshes
+    if (dynamic_cast<CPUTileStorage<unsigned char>*>(getCache()->getStorage().get()) != NULL) {
+        return task;
+    }
+    ptr<Task> t = new BuildTileMeshesTask(this, level, tx, ty, deadline);
+    result->addTask(t);
+    result->addDependency(task, t);
+    return t;
+}
+
+void GraphLayer::buildTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes)
+{
+}
+
+void GraphLayer::getTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes)
+{
+    TileCache::Tile::Id id = TileCache::Tile::getId(level, tx, ty);
+    pthread_mutex_lock((pthread_mutex_t*) tileMeshesMutex);
+    map<TileCache::Tile::Id, vector< ptr<Object> > >::iterator i = tileMeshes.find(id);
+    bool found = i != tileMeshes.end();
+    if (found) {
+        meshes.swap(i->second);
+        tileMeshes.erase(i);
+    }
+    pthread_mutex_unlock((pthread_mutex_t*) tileMeshesMutex);
+    if (!found) {
+        buildTileMeshes(level, tx, ty, g, meshes);
+    }
+}
+
+void GraphLayer::putTileMeshes(int level, int tx, int ty, vector< ptr<Object> > &meshes)
+{
+    TileCache::Tile::Id id = TileCache::Tile::getId(level, tx, ty);
+    pthread_mutex_lock((pthread_mutex_t*) tileMeshesMutex);
+    tileMeshes[id].swap(meshes);
+    pthread_mutex_unlock((pthread_mutex_t*) tileMeshesMutex);
+}
+
+void GraphLayer::getCurveStrip(const vec3d &tileCoords, CurvePtr p, float w, vector<vec2d> &strip, vec2d *nx, vec2d *ny, vec2d *lx, vec2d *ly)
+{
+    int n = p->getSize();
+    strip.reserve(strip.size() + 2 * n);
+    if (isDeformed() && nx != NULL) {
+        vec2d prev = vec2d(0.f, 0.f);
+        vec2d cur = p->getXY(0);
+        vec2d next = p->getXY(1);
+        for (int i = 0; i < n; ++i) {
+            float dx, dy;
+            if (i == 0) {
+                float x = next.x - cur.x;
+                float y = next.y - cur.y;
+                dx = nx->x * x + ny->x * y;
+                dy = nx->y * x + ny->y * y;
+                float f = w / ((*lx) * dx + (*ly) * dy).length();
+                dx *= f;
+                dy *= f;
+            } else if (i == n - 1) {
+                float x = cur.x - prev.x;
+                float y = cur.y - prev.y;
+                dx = nx->x * x + ny->x * y;
+                dy = nx->y * x + ny->y * y;
+                float f = w / ((*lx) * dx + (*ly) * dy).length();
+                dx *= f;
+                dy *= f;
+            } else {
+                float dx0 = cur.x - prev.x;
+                float dy0 = cur.y - prev.y;
+                float dx1 = next.x - cur.x;
+                float dy1 = next.y - cur.y;
+                float det = dx0 * dy1 - dy0 * dx1;
+                if (abs(atan2(det, dx0 * dx1 + dy0 * dy1)) > 0.5) {
+                    float k0 = w / ((*lx) * dy0 - (*ly) * dx0).length();
+                    float k1 = w / ((*lx) * dy1 - (*ly) * dx1).length();
+                    float t = (dy1*(k0*dy0-k1*dy1) - dx1*(k1*dx1-k0*dx0)) / det;
+                    dx = -k0*dy0 + t*dx0;
+                    dy = k0*dx0 + t*dy0;
+                } else {
+                    float Dx0 = nx->x * dx0 + ny->x * dy0;
+                    float Dy0 = nx->y * dx0 + ny->y * dy0;
+                    float f0 = w / ((*lx) * Dx0 + (*ly) * Dy0).length();
+                    float Dx1 = nx->x * dx1 + ny->x * dy1;
+                    float Dy1 = nx->y * dx1 + ny->y * dy1;
+                    float f1 = w / ((*lx) * Dx1 + (*ly) * Dy1).length();
+                    dx = 0.5 * (Dx0 * f0 + Dx1 * f1);
+                    dy = 0.5 * (Dy0 * f0 + Dy1 * f1);
+                }
+            }
+            strip.push_back((vec2d(cur.x + dx, cur.y + dy) - tileCoords.xy()) * tileCoords.z);
+            strip.push_back((vec2d(cur.x - dx, cur.y - dy) - tileCoords.xy()) * tileCoords.z);
+            prev = cur;
+            cur = next;
+            if (i < n - 2) {
+                next = p->getXY(i + 2);
+            }
+        }
+    } else {
+        vec2d prev = vec2d(0.f, 0.f);
+        vec2d cur = p->getXY(0);
+        vec2d next = p->getXY(1);
+        float prevl = 0.0f;
+        float nextl = (next - cur).length();
+        for (int i = 0; i < n; ++i) {
+            float dx, dy;
+            if (i == 0) {
+                dx = (next.x - cur.x) / nextl;
+                dy = (next.y - cur.y) / nextl;
+            } else if (i == n - 1) {
+                dx = (cur.x - prev.x) / prevl;
+                dy = (cur.y - prev.y) / prevl;
+            } else {
+                dx = (cur.x - prev.x) / prevl;
+                dy = (cur.y - prev.y) / prevl;
+                dx += (next.x - cur.x) / nextl;
+                dy += (next.y - cur.y) / nextl;
+                float l = (float) ((dx*dx + dy*dy) * 0.5);
+                dx = dx / l;
+                dy = dy / l;
+            }
+            dx = dx * w;
+            dy = dy * w;
+            strip.push_back((vec2d(cur.x - dy, cur.y + dx) - tileCoords.xy()) * tileCoords.z);
+            strip.push_back((vec2d(cur.x + dy, cur.y - dx) - tileCoords.xy()) * tileCoords.z);
+            prev = cur;
+            prevl = nextl;
+            cur = next;
+            if (i < n - 2) {
+                next = p->getXY(i + 2);
+                nextl = (next - cur).length();
+            }
+        }
+    }
+}
+
 }
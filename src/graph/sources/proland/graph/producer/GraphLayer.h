@@ -35,6 +35,7 @@
 #include "proland/graph/producer/GraphProducer.h"
 #include "proland/graph/producer/CurveData.h"
 #include "proland/graph/producer/Tesselator.h"
+#include "proland/graph/producer/CPURasterizer.h"
 
 using namespace ork;
 
@@ -44,6 +45,9 @@ namespace proland
 /**
  * An abstract Layer sub class for layers using graphs. Contains
  * drawing methods to draw curves and areas using a user defined GLSL Program.
+ * Also contains methods to draw curves and areas with a CPURasterizer, for
+ * layers whose TileProducer stores its tiles in a CPUTileStorage of unsigned
+ * char type (see #createRasterizer and #rasterizeTile).
  * @ingroup producer
  * @author Antoine Begault, Guillaume Piolat
  */
@@ -178,6 +182,39 @@ public:
             Mesh<vec4f, unsigned int> &mesh, vec2d *nx = NULL, vec2d *ny = NULL,
             vec2d *dx = NULL, vec2d *ly = NULL);
 
+    /**
+     * Adds a curve to a mesh, without drawing it. This method produces the
+     * same triangles as the corresponding #drawCurve method, but as
+     * indexed triangles, so that many curves can be drawn with a single
+     * draw call. Curves thinner than the #drawCurve threshold are added
+     * with a one pixel width.
+     *
+     * @param p the curve to be added.
+     * @param width the curve's width (can be different from the initial
+     *      curve's width).
+     * @param scale the scale, depending of the display level.
+     * @param mesh a vec2 Mesh in AttributeBuffer#TRIANGLES mode.
+     */
+    void addCurve(const vec3d &tileCoords, CurvePtr p, float width, float scale,
+            Mesh<vec2f, unsigned int> &mesh, vec2d *nx = NULL, vec2d *ny = NULL,
+            vec2d *lx = NULL, vec2d *ly = NULL);
+
+    /**
+     * Adds a curve to a mesh, without drawing it. This method produces the
+     * same vertices as the corresponding #drawCurve method without cap,
+     * but as indexed triangles, so that many curves can be drawn with a
+     * single draw call.
+     *
+     * @param p the curve to be added.
+     * @param data the CurveData containing data about Curve p.
+     * @param width the curve's width (can be different from the initial
+     *      curve's width).
+     * @param mesh a vec4 Mesh in AttributeBuffer#TRIANGLES mode.
+     */
+    void addCurve(const vec3d &tileCoords, CurvePtr p, CurveData *data, float width,
+            Mesh<vec4f, unsigned int> &mesh, vec2d *nx = NULL, vec2d *ny = NULL,
+            vec2d *lx = NULL, vec2d *ly = NULL);
+
     /**
      * Checks whether a Node is the extremity of a Curve.
      *
@@ -196,6 +233,31 @@ public:
      */
     void drawArea(const vec3d &tileCoords, AreaPtr a, Tesselator &tess);
 
+    /**
+     * Adds a curve to the current polygon of a CPURasterizer. This is the
+     * CPU counterpart of #drawCurve, without stripes and without spherical
+     * deformation. Curves thinner than a pixel are drawn one pixel wide.
+     * The curves added to the same polygon should be drawn with the
+     * CPURasterizer#NON_ZERO rule, in order to draw their union.
+     *
+     * @param p the curve to be drawn.
+     * @param width the curve's width (can be different from the initial
+     *      curve's width).
+     * @param r the rasterizer where the curve must be drawn.
+     */
+    void rasterizeCurve(const vec3d &tileCoords, CurvePtr p, float width, CPURasterizer &r);
+
+    /**
+     * Adds an area to the current polygon of a CPURasterizer. This is the
+     * CPU counterpart of #drawArea. The areas added to the same polygon
+     * should be drawn with the CPURasterizer#EVEN_ODD rule, as with a
+     * Tesselator.
+     *
+     * @param a the Area to be drawn.
+     * @param r the rasterizer where the area must be drawn.
+     */
+    void rasterizeArea(const vec3d &tileCoords, AreaPtr a, CPURasterizer &r);
+
     /**
      * Adds a list of tiles used by each tile of this layer. They will
      * require a call to TileProducer#put() when the task has been done.
@@ -242,6 +304,65 @@ protected:
      */
     bool quality;
 
+    /**
+     * Returns a CPURasterizer to draw in the given tile, if this tile is
+     * stored in a CPUTileStorage of unsigned char type. Returns NULL
+     * otherwise, i.e. if the tile must be drawn on GPU.
+     *
+     * @param data where the tile data must be stored.
+     */
+    ptr<CPURasterizer> createRasterizer(TileStorage::Slot *data);
+
+    /**
+     * Draws a graph tile with a CPURasterizer. This method is called from
+     * #doCreateTile instead of the GPU drawing code when #createRasterizer
+     * does not return NULL. It can be called in parallel for different
+     * tiles, from the threads of the Scheduler. The default implementation
+     * does nothing.
+     *
+     * @param tileCoords the tile offset and scale, as for #drawCurve.
+     * @param g the graph tile to be drawn.
+     * @param r the rasterizer where the graph must be drawn.
+     */
+    virtual void rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r);
+
+    /**
+     * Adds a task to build the meshes of the given tile with
+     * #buildTileMeshes, before the task that draws this tile. This method
+     * must be called from #startCreateTile by the layers that implement
+     * #buildTileMeshes. The returned task must then be passed to
+     * GraphLayer#startCreateTile, so that the meshes are built after the
+     * graph tile has been produced.
+     *
+     * @param task the task that draws the tile.
+     * @param result the task graph containing this task, or NULL.
+     * @return the task that builds the tile meshes, or task itself if no
+     *      such task was created (the meshes are then built by
+     *      #getTileMeshes, when the tile is drawn).
+     */
+    ptr<Task> startBuildTileMeshes(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> result);
+
+    /**
+     * Builds the meshes to draw a graph tile. These meshes contain all the
+     * curves or areas that can be drawn with the same uniforms, so that a
+     * tile can be drawn with a few draw calls. This method does not use
+     * OpenGL, and can be called from any thread. The default
+     * implementation does nothing.
+     *
+     * @param g the graph tile to be drawn.
+     * @param[out] meshes the built meshes.
+     */
+    virtual void buildTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes);
+
+    /**
+     * Returns the meshes built for the given tile by #startBuildTileMeshes,
+     * or builds them with #buildTileMeshes if they are not available.
+     *
+     * @param g the graph tile to be drawn.
+     * @param[out] meshes the meshes to draw this tile.
+     */
+    void getTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes);
+
     virtual void swap(ptr<GraphLayer> p);
 
 private:
@@ -264,6 +385,34 @@ private:
      * to used tiles and to the TileProducer that produces those tiles.
      */
     map<TileCache::Tile::Id, pair<TileProducer *, set<TileCache::Tile*> > > usedTiles;
+
+    /**
+     * The meshes built by #startBuildTileMeshes tasks and not yet used
+     * by #getTileMeshes.
+     */
+    map<TileCache::Tile::Id, vector< ptr<Object> > > tileMeshes;
+
+    /**
+     * A mutex to serialize accesses to #tileMeshes.
+     */
+    void *tileMeshesMutex;
+
+    /**
+     * Computes the vertices of the triangle strip used to draw a curve
+     * in #drawCurve, #addCurve and #rasterizeCurve.
+     *
+     * @param w the half width of the curve.
+     * @param[out] strip the strip vertices, in normalized device coordinates.
+     */
+    void getCurveStrip(const vec3d &tileCoords, CurvePtr p, float w, vector<vec2d> &strip,
+            vec2d *nx = NULL, vec2d *ny = NULL, vec2d *lx = NULL, vec2d *ly = NULL);
+
+    /**
+     * Stores the meshes built by a #startBuildTileMeshes task.
+     */
+    void putTileMeshes(int level, int tx, int ty, vector< ptr<Object> > &meshes);
+
+    friend class BuildTileMeshesTask;
 };
 
 }
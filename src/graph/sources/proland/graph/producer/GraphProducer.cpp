@@ -27,8 +27,14 @@
 
 #include "proland/graph/producer/GraphProducer.h"
 
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
 #include "ork/taskgraph/TaskGraph.h"
 #include "proland/producer/ObjectTileStorage.h"
+#include "proland/graph/FileReader.h"
+#include "proland/graph/FileWriter.h"
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
@@ -40,6 +46,49 @@ using namespace ork;
 namespace proland
 {
 
+/**
+ * Identifies the files of the persistent cache of clipped tiles ("PGCT").
+ */
+#define CLIPPED_TILE_MAGIC 0x54434750
+
+/**
+ * The version of the clipped tile file format. Must be incremented when
+ * Graph#clip, Graph#flatten or the graph file format change, to invalidate
+ * the tiles saved with previous versions.
+ */
+#define CLIPPED_TILE_VERSION 1
+
+/**
+ * Updates a FNV-1a hash with the given bytes.
+ */
+static unsigned int hashBytes(unsigned int hash, const void *data, int size)
+{
+    const unsigned char *bytes = (const unsigned char*) data;
+    for (int i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Returns a FNV-1a hash of the content of the given file, or 0 if this
+ * file cannot be read.
+ */
+static unsigned int hashFile(const string &file)
+{
+    ifstream in(file.c_str(), ifstream::binary);
+    if (!in) {
+        return 0;
+    }
+    unsigned int hash = 2166136261u;
+    char buf[65536];
+    while (in) {
+        in.read(buf, sizeof(buf));
+        hash = hashBytes(hash, buf, (int) in.gcount());
+    }
+    return hash;
+}
+
 GraphProducer::GraphFactory::GraphFactory() : Object("GraphFactory")
 {
 }
@@ -80,6 +129,7 @@ GraphProducer::GraphCache::GraphCache(GraphPtr root, string graphName, ptr<Resou
     this->manager = manager;
     this->graphName = graphName;
     this->loadSubgraphs = loadSubgraphs;
+    this->graphHash = 0;
 }
 
 GraphProducer::GraphCache::~GraphCache()
@@ -151,12 +201,109 @@ GraphPtr GraphProducer::GraphCache::getTile(TileCache::Tile::Id tileId)
     return tmp;
 }
 
+void GraphProducer::GraphCache::setClipCache(const string &dir)
+{
+    GraphPtr root = graphs.find(TileCache::Tile::getId(0, 0, 0))->second;
+    if (dynamic_cast<BasicGraph*>(root.get()) != NULL) {
+        if (Logger::WARNING_LOGGER != NULL) {
+            Logger::WARNING_LOGGER->log("GRAPH", "Clip cache disabled for '" + graphName + "' (BasicGraph ids are not persistent)");
+        }
+        return;
+    }
+    char fileName[100];
+    sprintf(fileName, "%s.graph", graphName.c_str());
+    graphHash = hashFile(manager->getLoader()->findResource(fileName));
+    clipCacheDir = dir;
+}
+
+bool GraphProducer::GraphCache::hasClipCache()
+{
+    return clipCacheDir.size() > 0;
+}
+
+string GraphProducer::GraphCache::getClippedTileFile(TileCache::Tile::Id id)
+{
+    string::size_type slash = graphName.rfind('/');
+    string graphBase = slash == string::npos ? graphName : graphName.substr(slash + 1);
+    ostringstream oss;
+    oss << clipCacheDir << "/" << graphBase << "_" << hex << graphHash << dec;
+    oss << "_" << id.first << "_" << id.second.first << "_" << id.second.second << ".graph";
+    return oss.str();
+}
+
+GraphPtr GraphProducer::GraphCache::loadClippedTile(TileCache::Tile::Id id, unsigned int key)
+{
+    string file = getClippedTileFile(id);
+    if (!ifstream(file.c_str(), ifstream::binary)) {
+        return NULL;
+    }
+    bool isIndexed;
+    FileReader *fileReader = new FileReader(file, isIndexed);
+    bool valid = !isIndexed;
+    valid = valid && fileReader->read<int>() == CLIPPED_TILE_MAGIC;
+    valid = valid && fileReader->read<int>() == CLIPPED_TILE_VERSION;
+    valid = valid && fileReader->read<unsigned int>() == graphHash;
+    valid = valid && fileReader->read<unsigned int>() == key;
+    valid = valid && fileReader->read<int>() == id.first;
+    valid = valid && fileReader->read<int>() == id.second.first;
+    valid = valid && fileReader->read<int>() == id.second.second;
+    valid = valid && !fileReader->error();
+
+    GraphPtr tmp = NULL;
+    if (valid) {
+        GraphPtr root = graphs.find(TileCache::Tile::getId(0, 0, 0))->second;
+        tmp = root->createChild();
+        tmp->setParent(root.get());
+        tmp->load(fileReader, loadSubgraphs);
+        if (fileReader->error()) {
+            tmp = NULL;
+        }
+    }
+    delete fileReader;
+
+    if (Logger::DEBUG_LOGGER != NULL) {
+        ostringstream oss;
+        oss << (tmp == NULL ? "Outdated clipped tile " : "Loaded clipped tile ") << file;
+        Logger::DEBUG_LOGGER->log("GRAPH", oss.str());
+    }
+    return tmp;
+}
+
+void GraphProducer::GraphCache::saveClippedTile(TileCache::Tile::Id id, unsigned int key, GraphPtr graph)
+{
+    // writes a temporary file first, so that other sessions sharing the
+    // same cache directory never see a partially written tile
+    string file = getClippedTileFile(id);
+    string tmpFile = file + ".tmp";
+    FileWriter *fileWriter = new FileWriter(tmpFile, true);
+    fileWriter->write(0);
+    fileWriter->write(CLIPPED_TILE_MAGIC);
+    fileWriter->write(CLIPPED_TILE_VERSION);
+    fileWriter->write(graphHash);
+    fileWriter->write(key);
+    fileWriter->write(id.first);
+    fileWriter->write(id.second.first);
+    fileWriter->write(id.second.second);
+    graph->save(fileWriter, loadSubgraphs);
+    delete fileWriter;
+
+    remove(file.c_str());
+    if (rename(tmpFile.c_str(), file.c_str()) != 0) {
+        if (Logger::WARNING_LOGGER != NULL) {
+            Logger::WARNING_LOGGER->log("GRAPH", "Cannot save clipped tile " + file);
+        }
+        remove(tmpFile.c_str());
+    }
+}
+
 void GraphProducer::GraphCache::swap(ptr<GraphProducer::GraphCache> p)
 {
     std::swap(graphs, p->graphs);
     std::swap(manager, p->manager);
     std::swap(loadSubgraphs, p->loadSubgraphs);
     std::swap(graphName, p->graphName);
+    std::swap(clipCacheDir, p->clipCacheDir);
+    std::swap(graphHash, p->graphHash);
 }
 
 GraphProducer::GraphProducer(string name, ptr<TileCache> cache, ptr<GraphCache> precomputedGraphs, set<int> precomputedLevels, bool doFlatten, float flatnessFactor, bool storeParents, int maxNodes) :
@@ -279,6 +426,23 @@ void GraphProducer::updateFlattenCurve(const set<CurveId> &changedCurves)
     }
 }
 
+unsigned int GraphProducer::getClipKey(int level, double clipSize)
+{
+    // the per curve and per area margins cannot be hashed: the clip cache
+    // must be cleared if the layers using this producer change
+    float rootQuadSize = getRootQuadSize();
+    double margin = margins->getMargin(clipSize);
+    int flatten = doFlatten ? 1 : 0;
+    unsigned int key = 2166136261u;
+    key = hashBytes(key, &level, sizeof(int));
+    key = hashBytes(key, &rootQuadSize, sizeof(float));
+    key = hashBytes(key, &tileSize, sizeof(int));
+    key = hashBytes(key, &flatten, sizeof(int));
+    key = hashBytes(key, &flatnessFactor, sizeof(float));
+    key = hashBytes(key, &margin, sizeof(double));
+    return key;
+}
+
 bool GraphProducer::isPrecomputedLevel(int level)
 {
     return precomputedLevels.find(level) != precomputedLevels.end();
@@ -412,15 +576,25 @@ bool GraphProducer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *d
             float flat = l / tileSize * flatnessFactor;
             float squareFlat = max(0.1f, flat * flat);
 
-            if (versionDiff == 1 && objectData->data != NULL && id == objectData->id) {
+            // the changes of the parent graph since the last update of this
+            // tile, possibly accumulated over several versions
+            Graph::Changes parentChanges;
+            bool incremental = versionDiff > 0 && objectData->data != NULL && id == objectData->id;
+            incremental = incremental && clipCacheTiles.find(tileId) == clipCacheTiles.end();
+            incremental = incremental && parentGraph->getChangesSince(objectData->data.cast<Graph>()->version, parentChanges);
+
+            if (incremental) {
                 // incremental clip
                 GraphPtr graph = objectData->data.cast<Graph>();
+                unsigned int oldVersion = graph->version;
                 graph->changes.clear();
-                graph->version++;
-                parentGraph->clipUpdate(parentGraph->changes, clip, margins, *graph, graph->changes);
+                graph->version = parentGraph->version;
+                parentGraph->clipUpdate(parentChanges, clip, margins, *graph, graph->changes);
                 if (doFlatten) {
-                    graph->flattenUpdate(graph->changes, squareFlat);
+                    // this task already runs on a scheduler thread
+                    graph->flattenUpdate(graph->changes, squareFlat, 1);
                 }
+                graph->logChanges(oldVersion);
                 if (graph->changes.empty()) { // No changes in this tile
                     res = false;
                 }
@@ -430,15 +604,32 @@ bool GraphProducer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *d
                 if (isPrecomputedLevel(level)) {
                     graph = precomputedGraphs->getTile(tileId);
                 }
+                // the clip cache can only be used if the root graph has
+                // not been edited since it was loaded
+                bool useClipCache = !isPrecomputedLevel(level) && precomputedGraphs->hasClipCache() && getRoot()->version == 0;
+                unsigned int clipKey = useClipCache ? getClipKey(level, l) : 0;
+                clipCacheTiles.erase(tileId);
+                if (graph == NULL && useClipCache) {
+                    graph = precomputedGraphs->loadClippedTile(tileId, clipKey);
+                    if (graph != NULL) {
+                        clipCacheTiles.insert(tileId);
+                    }
+                }
                 if (graph == NULL) {
                     graph = parentGraph->clip(clip, margins);
                     if (doFlatten) {
-                        graph->flatten(squareFlat);
+                        // this task already runs on a scheduler thread
+                        graph->flatten(squareFlat, 1);
                     }
                     if (isPrecomputedLevel(level)) {
                         precomputedGraphs->add(tileId, graph);
+                    } else if (useClipCache) {
+                        precomputedGraphs->saveClippedTile(tileId, clipKey, graph);
                     }
                 }
+                // the changes recorded for a previous content of this tile
+                // cannot be used to update its children incrementally
+                graph->clearChangesLog();
                 graph->version = parentGraph->version;
                 objectData->data = graph;
             }
@@ -485,6 +676,7 @@ void GraphProducer::swap(ptr<GraphProducer> p)
     std::swap(storeParents, p->storeParents);
     std::swap(flattenCurves, p->flattenCurves);
     std::swap(flattenCurveCount, p->flattenCurveCount);
+    std::swap(clipCacheTiles, p->clipCacheTiles);
 }
 
 class GraphFactoryResource : public ResourceTemplate<3, GraphProducer::GraphFactory>
@@ -532,7 +724,7 @@ public:
         set<int> precomputedLevels;
         precomputedLevels.insert(0);
         int maxNodes = 0;
-        checkParameters(desc, e, "name,factory,cache,file,loadSubgraphs,storeParents,doFlatten,flattness,nodeCacheSize,curveCacheSize,areaCacheSize,precomputedLevel,precomputedLevels,maxNodes,");
+        checkParameters(desc, e, "name,factory,cache,file,loadSubgraphs,storeParents,doFlatten,flattness,nodeCacheSize,curveCacheSize,areaCacheSize,precomputedLevel,precomputedLevels,maxNodes,clipCache,");
         gname = getParameter(desc, e, "name");
         cache = manager->loadResource(getParameter(desc, e, "cache")).cast<TileCache>();
         graphName = getParameter(desc, e, "file");
@@ -603,6 +795,9 @@ public:
         root->load(filePath, loadSubgraphs);
 
         ptr<GraphCache> precomputedGraphs = new GraphCache(root, graphName, manager, loadSubgraphs);
+        if (e->Attribute("clipCache") != NULL) {
+            precomputedGraphs->setClipCache(getParameter(desc, e, "clipCache"));
+        }
 
         init(gname, cache, precomputedGraphs, precomputedLevels, doFlatten, flatnessFactor, storeParents, maxNodes);
     }
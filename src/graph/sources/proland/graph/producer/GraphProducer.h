@@ -137,6 +137,45 @@ public:
          */
         void add(TileCache::Tile::Id id, GraphPtr graph);
 
+        /**
+         * Enables the persistent cache of clipped tiles. When enabled, the
+         * tiles clipped by a GraphProducer at non precomputed levels are
+         * saved in the given directory, so that they can be reloaded
+         * instead of being clipped again in later sessions. The saved tiles
+         * are keyed by a hash of the root graph file, so that they are not
+         * reused if this file changes. This cache requires a root graph
+         * with persistent ids, i.e., not a BasicGraph.
+         *
+         * @param dir an existing directory where clipped tiles are saved.
+         */
+        void setClipCache(const string &dir);
+
+        /**
+         * Returns true if the persistent cache of clipped tiles is enabled.
+         */
+        bool hasClipCache();
+
+        /**
+         * Loads a clipped tile from the persistent cache of clipped tiles.
+         * The parent of the returned graph is the root graph, as for
+         * precomputed tiles.
+         *
+         * @param id the id of the tile to load.
+         * @param key a hash of the parameters used to clip this tile. The
+         *      tile is not loaded if it was saved with another key.
+         * @return the clipped graph, or NULL if it is not in the cache.
+         */
+        GraphPtr loadClippedTile(TileCache::Tile::Id id, unsigned int key);
+
+        /**
+         * Saves a clipped tile in the persistent cache of clipped tiles.
+         *
+         * @param id the id of the tile to save.
+         * @param key a hash of the parameters used to clip this tile.
+         * @param graph the clipped graph.
+         */
+        void saveClippedTile(TileCache::Tile::Id id, unsigned int key, GraphPtr graph);
+
     protected:
         virtual void swap(ptr<GraphCache> p);
 
@@ -162,6 +201,23 @@ public:
          * Maps Tile Ids with Graphs.
          */
         map<TileCache::Tile::Id, GraphPtr> graphs;
+
+        /**
+         * The directory of the persistent cache of clipped tiles, or the
+         * empty string if this cache is disabled.
+         */
+        string clipCacheDir;
+
+        /**
+         * A hash of the root graph file, used to detect outdated clipped
+         * tiles. Computed when the clip cache is enabled.
+         */
+        unsigned int graphHash;
+
+        /**
+         * Returns the name of the file containing the given clipped tile.
+         */
+        string getClippedTileFile(TileCache::Tile::Id id);
     };
 
     /**
@@ -335,6 +391,15 @@ protected:
     virtual void swap(ptr<GraphProducer> p);
 
 private:
+    /**
+     * Returns a hash of the parameters used to clip the given tile, which
+     * identifies this tile in the persistent cache of clipped tiles.
+     *
+     * @param level the tile's quadtree level.
+     * @param clipSize the tile's size in world coordinates.
+     */
+    unsigned int getClipKey(int level, double clipSize);
+
     /**
      * Updates the cache of flatten curves and their associated CurveDatas.
      * When a Curve is changed, it's data will need to be recomputed.
@@ -412,6 +477,14 @@ private:
      * Reference counts for each flattened Curve.
      */
     map<CurvePtr, int> flattenCurveCount;
+
+    /**
+     * The tiles loaded from the persistent cache of clipped tiles. The
+     * curves of these tiles have the root graph curves as parents, instead
+     * of the curves of their parent tile, so they cannot be updated
+     * incrementally (see Graph#clipUpdate), and are clipped again instead.
+     */
+    set<TileCache::Tile::Id> clipCacheTiles;
 };
 
 }
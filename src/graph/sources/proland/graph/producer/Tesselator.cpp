@@ -25,134 +25,818 @@
  * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
  */
 
+/*
+ * The ear clipping triangulation code in this file (TessNode and the
+ * functions operating on it) is a C++ port of earcut
+ * (https://github.com/mapbox/earcut), distributed under the following
+ * license:
+ *
+ * ISC License
+ *
+ * Copyright (c) 2016, Mapbox
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any purpose
+ * with or without fee is hereby granted, provided that the above copyright notice
+ * and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND ISC DISCLAIMS ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS.
+ * IN NO EVENT SHALL ISC BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA
+ * OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,
+ * ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
 #include "proland/graph/producer/Tesselator.h"
 
-#include <GL/glu.h>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+#include "ork/math/box2.h"
+
+using namespace std;
+
+namespace proland
+{
+
+/**
+ * A vertex of a contour, in a doubly linked list. The contours with their
+ * holes are triangulated with the ear clipping algorithm of earcut (see
+ * the license above), itself based on "Triangulation by Ear Clipping",
+ * David Eberly, 2008, with a z-order index to quickly find the vertices
+ * inside a candidate ear.
+ */
+struct TessNode
+{
+    /**
+     * The index of this vertex in Tesselator#points.
+     */
+    int i;
+
+    double x;
+
+    double y;
+
+    /**
+     * The previous and next vertex in the contour.
+     */
+    TessNode *prev;
+
+    TessNode *next;
+
+    /**
+     * The z-order code of this vertex, or 0 if not yet computed.
+     */
+    int z;
 
-#ifdef _WIN32
-#define CALLBACK __stdcall
-typedef void (CALLBACK *TessCallBack)();
-#else
-#define CALLBACK
-typedef void (*TessCallBack)();
-#endif
+    /**
+     * The previous and next vertex in z-order.
+     */
+    TessNode *prevZ;
 
-#ifdef _LP64
-typedef long _int;
-#else
-typedef int _int;
-#endif
+    TessNode *nextZ;
 
-extern "C"
+    /**
+     * True if this vertex is a degenerate hole, which must not be removed
+     * by #filterPoints.
+     */
+    bool steiner;
+
+    TessNode(int i, double x, double y) :
+        i(i), x(x), y(y), prev(NULL), next(NULL), z(0), prevZ(NULL), nextZ(NULL), steiner(false)
+    {
+    }
+};
+
+/**
+ * The nodes of a triangulation. A deque is used so that nodes do not move
+ * in memory when new ones are added.
+ */
+typedef deque<TessNode> TessNodes;
+
+/**
+ * Contours with less vertices than this are triangulated without z-order
+ * index.
+ */
+#define Z_ORDER_THRESHOLD 80
+
+static double area(const TessNode *p, const TessNode *q, const TessNode *r)
+{
+    return (q->y - p->y) * (r->x - q->x) - (q->x - p->x) * (r->y - q->y);
+}
+
+static bool equals(const TessNode *p, const TessNode *q)
 {
+    return p->x == q->x && p->y == q->y;
+}
 
-int mode;
-int prevprev;
-int previous;
+static int sign(double v)
+{
+    return v > 0 ? 1 : (v < 0 ? -1 : 0);
+}
 
-void CALLBACK errorCallback(GLenum code, ork::Mesh<vec2f, unsigned int> *m)
+static bool onSegment(const TessNode *p, const TessNode *q, const TessNode *r)
 {
-    assert(false);
+    return q->x <= max(p->x, r->x) && q->x >= min(p->x, r->x) && q->y <= max(p->y, r->y) && q->y >= min(p->y, r->y);
 }
 
-void CALLBACK beginCallback(GLenum which, ork::Mesh<vec2f, unsigned int> *m)
+static bool intersects(const TessNode *p1, const TessNode *q1, const TessNode *p2, const TessNode *q2)
 {
-    mode = which;
-    prevprev = -1;
-    previous = -1;
+    int o1 = sign(area(p1, q1, p2));
+    int o2 = sign(area(p1, q1, q2));
+    int o3 = sign(area(p2, q2, p1));
+    int o4 = sign(area(p2, q2, q1));
+    if (o1 != o2 && o3 != o4) {
+        return true;
+    }
+    return (o1 == 0 && onSegment(p1, p2, q1)) || (o2 == 0 && onSegment(p1, q2, q1)) ||
+        (o3 == 0 && onSegment(p2, p1, q2)) || (o4 == 0 && onSegment(p2, q1, q2));
 }
 
-void CALLBACK vertexCallback(GLvoid *vertex, ork::Mesh<vec2f, unsigned int> *m)
+static bool pointInTriangle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py)
 {
-    switch (mode) {
-        case GL_TRIANGLES:
-            m->addIndice((_int) vertex);
-            break;
-        case GL_TRIANGLE_STRIP:
-            if (prevprev == -1) {
-                prevprev = (_int) vertex;
-            } else if (previous == -1) {
-                previous = (_int) vertex;
-            } else {
-                m->addIndice(prevprev);
-                m->addIndice(previous);
-                m->addIndice((_int) vertex);
-                prevprev = previous;
-                previous = (_int) vertex;
+    return (cx - px) * (ay - py) >= (ax - px) * (cy - py) &&
+        (ax - px) * (by - py) >= (bx - px) * (ay - py) &&
+        (bx - px) * (cy - py) >= (cx - px) * (by - py);
+}
+
+/**
+ * Returns true if the diagonal ab is locally inside the polygon at a.
+ */
+static bool locallyInside(const TessNode *a, const TessNode *b)
+{
+    if (area(a->prev, a, a->next) < 0) {
+        return area(a, b, a->next) >= 0 && area(a, a->prev, b) >= 0;
+    }
+    return area(a, b, a->prev) < 0 || area(a, a->next, b) < 0;
+}
+
+/**
+ * Returns true if the middle of the diagonal ab is inside the polygon.
+ */
+static bool middleInside(const TessNode *a, const TessNode *b)
+{
+    const TessNode *p = a;
+    bool inside = false;
+    double px = (a->x + b->x) / 2;
+    double py = (a->y + b->y) / 2;
+    do {
+        if (((p->y > py) != (p->next->y > py)) && p->next->y != p->y &&
+            px < (p->next->x - p->x) * (py - p->y) / (p->next->y - p->y) + p->x) {
+            inside = !inside;
+        }
+        p = p->next;
+    } while (p != a);
+    return inside;
+}
+
+/**
+ * Returns true if the diagonal ab intersects a polygon edge.
+ */
+static bool intersectsPolygon(const TessNode *a, const TessNode *b)
+{
+    const TessNode *p = a;
+    do {
+        if (p->i != a->i && p->next->i != a->i && p->i != b->i && p->next->i != b->i && intersects(p, p->next, a, b)) {
+            return true;
+        }
+        p = p->next;
+    } while (p != a);
+    return false;
+}
+
+/**
+ * Returns true if ab is a valid diagonal to split the polygon in two.
+ */
+static bool isValidDiagonal(const TessNode *a, const TessNode *b)
+{
+    if (a->next->i == b->i || a->prev->i == b->i || intersectsPolygon(a, b)) {
+        return false;
+    }
+    if (locallyInside(a, b) && locallyInside(b, a) && middleInside(a, b) &&
+        (area(a->prev, a, b->prev) != 0 || area(a, b->prev, b) != 0)) {
+        return true;
+    }
+    return equals(a, b) && area(a->prev, a, a->next) > 0 && area(b->prev, b, b->next) > 0;
+}
+
+static TessNode *insertNode(TessNodes &nodes, int i, const vec2f &p, TessNode *last)
+{
+    nodes.push_back(TessNode(i, p.x, p.y));
+    TessNode *n = &nodes.back();
+    if (last == NULL) {
+        n->prev = n;
+        n->next = n;
+    } else {
+        n->next = last->next;
+        n->prev = last;
+        last->next->prev = n;
+        last->next = n;
+    }
+    return n;
+}
+
+static void removeNode(TessNode *p)
+{
+    p->next->prev = p->prev;
+    p->prev->next = p->next;
+    if (p->prevZ != NULL) {
+        p->prevZ->nextZ = p->nextZ;
+    }
+    if (p->nextZ != NULL) {
+        p->nextZ->prevZ = p->prevZ;
+    }
+}
+
+/**
+ * Links a and b with a bridge, splitting the polygon in two if a and b are
+ * in the same polygon, or merging two polygons otherwise. Returns the
+ * duplicate of b.
+ */
+static TessNode *splitPolygon(TessNodes &nodes, TessNode *a, TessNode *b)
+{
+    nodes.push_back(TessNode(a->i, a->x, a->y));
+    TessNode *a2 = &nodes.back();
+    nodes.push_back(TessNode(b->i, b->x, b->y));
+    TessNode *b2 = &nodes.back();
+    TessNode *an = a->next;
+    TessNode *bp = b->prev;
+    a->next = b;
+    b->prev = a;
+    a2->next = an;
+    an->prev = a2;
+    b2->next = a2;
+    a2->prev = b2;
+    bp->next = b2;
+    b2->prev = bp;
+    return b2;
+}
+
+/**
+ * Creates a circular linked list from a contour, in counter clockwise
+ * order if 'ccw' is true, or in clockwise order otherwise.
+ */
+static TessNode *linkedList(TessNodes &nodes, const vector<vec2f> &points, int start, int end, bool ccw)
+{
+    double sum = 0.0;
+    for (int i = start, j = end - 1; i < end; j = i++) {
+        sum += (double(points[j].x) - points[i].x) * (double(points[i].y) + points[j].y);
+    }
+    TessNode *last = NULL;
+    if (ccw == (sum > 0)) {
+        for (int i = start; i < end; ++i) {
+            last = insertNode(nodes, i, points[i], last);
+        }
+    } else {
+        for (int i = end - 1; i >= start; --i) {
+            last = insertNode(nodes, i, points[i], last);
+        }
+    }
+    if (last != NULL && equals(last, last->next)) {
+        removeNode(last);
+        last = last->next;
+    }
+    return last;
+}
+
+/**
+ * Removes duplicate and collinear vertices.
+ */
+static TessNode *filterPoints(TessNode *start, TessNode *end = NULL)
+{
+    if (start == NULL) {
+        return start;
+    }
+    if (end == NULL) {
+        end = start;
+    }
+    TessNode *p = start;
+    bool again;
+    do {
+        again = false;
+        if (!p->steiner && (equals(p, p->next) || area(p->prev, p, p->next) == 0)) {
+            removeNode(p);
+            p = end = p->prev;
+            if (p == p->next) {
+                break;
             }
-            break;
-        case GL_TRIANGLE_FAN:
-            if (prevprev == -1) {
-                prevprev = (_int) vertex;
-            } else if (previous == -1) {
-                previous = (_int) vertex;
-            } else {
-                m->addIndice(prevprev);
-                m->addIndice(previous);
-                m->addIndice((_int) vertex);
-                previous = (_int) vertex;
+            again = true;
+        } else {
+            p = p->next;
+        }
+    } while (again || p != end);
+    return end;
+}
+
+static int zOrder(double x, double y, double minX, double minY, double invSize)
+{
+    int ix = int((x - minX) * invSize);
+    int iy = int((y - minY) * invSize);
+    ix = (ix | (ix << 8)) & 0x00FF00FF;
+    ix = (ix | (ix << 4)) & 0x0F0F0F0F;
+    ix = (ix | (ix << 2)) & 0x33333333;
+    ix = (ix | (ix << 1)) & 0x55555555;
+    iy = (iy | (iy << 8)) & 0x00FF00FF;
+    iy = (iy | (iy << 4)) & 0x0F0F0F0F;
+    iy = (iy | (iy << 2)) & 0x33333333;
+    iy = (iy | (iy << 1)) & 0x55555555;
+    return ix | (iy << 1);
+}
+
+/**
+ * Sorts the z-order linked list starting at 'list' with a merge sort.
+ */
+static void sortLinked(TessNode *list)
+{
+    int inSize = 1;
+    int numMerges;
+    do {
+        TessNode *p = list;
+        TessNode *tail = NULL;
+        list = NULL;
+        numMerges = 0;
+        while (p != NULL) {
+            ++numMerges;
+            TessNode *q = p;
+            int pSize = 0;
+            for (int i = 0; i < inSize; ++i) {
+                ++pSize;
+                q = q->nextZ;
+                if (q == NULL) {
+                    break;
+                }
+            }
+            int qSize = inSize;
+            while (pSize > 0 || (qSize > 0 && q != NULL)) {
+                TessNode *e;
+                if (pSize != 0 && (qSize == 0 || q == NULL || p->z <= q->z)) {
+                    e = p;
+                    p = p->nextZ;
+                    --pSize;
+                } else {
+                    e = q;
+                    q = q->nextZ;
+                    --qSize;
+                }
+                if (tail != NULL) {
+                    tail->nextZ = e;
+                } else {
+                    list = e;
+                }
+                e->prevZ = tail;
+                tail = e;
+            }
+            p = q;
+        }
+        tail->nextZ = NULL;
+        inSize *= 2;
+    } while (numMerges > 1);
+}
+
+static void indexCurve(TessNode *start, double minX, double minY, double invSize)
+{
+    TessNode *p = start;
+    do {
+        if (p->z == 0) {
+            p->z = zOrder(p->x, p->y, minX, minY, invSize);
+        }
+        p->prevZ = p->prev;
+        p->nextZ = p->next;
+        p = p->next;
+    } while (p != start);
+    p->prevZ->nextZ = NULL;
+    p->prevZ = NULL;
+    sortLinked(p);
+}
+
+/**
+ * Returns true if n is a reflex vertex inside the triangle abc.
+ */
+static bool blocksEar(const TessNode *n, const TessNode *a, const TessNode *b, const TessNode *c,
+    double x0, double y0, double x1, double y1)
+{
+    return n != a && n != c && n->x >= x0 && n->x <= x1 && n->y >= y0 && n->y <= y1 &&
+        pointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, n->x, n->y) &&
+        area(n->prev, n, n->next) >= 0;
+}
+
+static bool isEar(const TessNode *ear, bool hashed, double minX, double minY, double invSize)
+{
+    const TessNode *a = ear->prev;
+    const TessNode *c = ear->next;
+    if (area(a, ear, c) >= 0) {
+        return false; // reflex vertex
+    }
+    double x0 = min(a->x, min(ear->x, c->x));
+    double y0 = min(a->y, min(ear->y, c->y));
+    double x1 = max(a->x, max(ear->x, c->x));
+    double y1 = max(a->y, max(ear->y, c->y));
+
+    if (!hashed) {
+        for (const TessNode *p = c->next; p != a; p = p->next) {
+            if (blocksEar(p, a, ear, c, x0, y0, x1, y1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int minZ = zOrder(x0, y0, minX, minY, invSize);
+    int maxZ = zOrder(x1, y1, minX, minY, invSize);
+    const TessNode *p = ear->prevZ;
+    const TessNode *n = ear->nextZ;
+    while (p != NULL && p->z >= minZ && n != NULL && n->z <= maxZ) {
+        if (blocksEar(p, a, ear, c, x0, y0, x1, y1) || blocksEar(n, a, ear, c, x0, y0, x1, y1)) {
+            return false;
+        }
+        p = p->prevZ;
+        n = n->nextZ;
+    }
+    while (p != NULL && p->z >= minZ) {
+        if (blocksEar(p, a, ear, c, x0, y0, x1, y1)) {
+            return false;
+        }
+        p = p->prevZ;
+    }
+    while (n != NULL && n->z <= maxZ) {
+        if (blocksEar(n, a, ear, c, x0, y0, x1, y1)) {
+            return false;
+        }
+        n = n->nextZ;
+    }
+    return true;
+}
+
+static void addTriangle(vector<unsigned int> &triangles, const TessNode *a, const TessNode *b, const TessNode *c)
+{
+    triangles.push_back(a->i);
+    triangles.push_back(b->i);
+    triangles.push_back(c->i);
+}
+
+/**
+ * Removes the small self intersections of a polygon (of the form abcd,
+ * where ab and cd intersect), by adding the triangle bcd.
+ */
+static TessNode *cureLocalIntersections(TessNode *start, vector<unsigned int> &triangles)
+{
+    TessNode *p = start;
+    do {
+        TessNode *a = p->prev;
+        TessNode *b = p->next->next;
+        if (!equals(a, b) && intersects(a, p, p->next, b) && locallyInside(a, b) && locallyInside(b, a)) {
+            addTriangle(triangles, a, p, b);
+            removeNode(p);
+            removeNode(p->next);
+            p = start = b;
+        }
+        p = p->next;
+    } while (p != start);
+    return filterPoints(p);
+}
+
+static void earcutLinked(TessNodes &nodes, TessNode *ear, vector<unsigned int> &triangles,
+    bool hashed, double minX, double minY, double invSize, int pass);
+
+/**
+ * Splits a polygon that could not be triangulated with ear clipping into
+ * two polygons, along a valid diagonal, and triangulates them separately.
+ */
+static void splitEarcut(TessNodes &nodes, TessNode *start, vector<unsigned int> &triangles,
+    bool hashed, double minX, double minY, double invSize)
+{
+    TessNode *a = start;
+    do {
+        TessNode *b = a->next->next;
+        while (b != a->prev) {
+            if (a->i != b->i && isValidDiagonal(a, b)) {
+                TessNode *c = splitPolygon(nodes, a, b);
+                a = filterPoints(a, a->next);
+                c = filterPoints(c, c->next);
+                earcutLinked(nodes, a, triangles, hashed, minX, minY, invSize, 0);
+                earcutLinked(nodes, c, triangles, hashed, minX, minY, invSize, 0);
+                return;
+            }
+            b = b->next;
+        }
+        a = a->next;
+    } while (a != start);
+}
+
+/**
+ * Triangulates a polygon with ear clipping. When no more ears can be found,
+ * the polygon is first filtered (pass 1), then its local self intersections
+ * are removed (pass 2), and it is finally split in two (pass 3).
+ */
+static void earcutLinked(TessNodes &nodes, TessNode *ear, vector<unsigned int> &triangles,
+    bool hashed, double minX, double minY, double invSize, int pass)
+{
+    if (ear == NULL) {
+        return;
+    }
+    if (pass == 0 && hashed) {
+        indexCurve(ear, minX, minY, invSize);
+    }
+    TessNode *stop = ear;
+    while (ear->prev != ear->next) {
+        TessNode *prev = ear->prev;
+        TessNode *next = ear->next;
+        if (isEar(ear, hashed, minX, minY, invSize)) {
+            addTriangle(triangles, prev, ear, next);
+            removeNode(ear);
+            ear = next->next;
+            stop = next->next;
+            continue;
+        }
+        ear = next;
+        if (ear == stop) {
+            if (pass == 0) {
+                earcutLinked(nodes, filterPoints(ear), triangles, hashed, minX, minY, invSize, 1);
+            } else if (pass == 1) {
+                ear = cureLocalIntersections(filterPoints(ear), triangles);
+                earcutLinked(nodes, ear, triangles, hashed, minX, minY, invSize, 2);
+            } else if (pass == 2) {
+                splitEarcut(nodes, ear, triangles, hashed, minX, minY, invSize);
             }
             break;
+        }
     }
 }
 
-void CALLBACK combineCallback(GLdouble coords[3], GLvoid *vertex_data[4], GLfloat weight[4], GLvoid **outData, ork::Mesh<vec2f, unsigned int> *m)
+/**
+ * Returns true if the sector of m contains the sector of p (both vertices
+ * being at the same position).
+ */
+static bool sectorContainsSector(const TessNode *m, const TessNode *p)
+{
+    return area(m->prev, m, p->prev) < 0 && area(p->next, m, m->next) < 0;
+}
+
+/**
+ * Finds a vertex of the outer polygon that can be connected to the given
+ * hole vertex without intersecting any edge (David Eberly's algorithm).
+ */
+static TessNode *findHoleBridge(TessNode *hole, TessNode *outer)
 {
-    int v = m->getVertexCount();
-    m->addVertex(vec2f((float) coords[0], (float) coords[1]));
-    *outData = (GLvoid*) v;
+    TessNode *p = outer;
+    TessNode *m = NULL;
+    double hx = hole->x;
+    double hy = hole->y;
+    double qx = -HUGE_VAL;
+    // finds a segment intersected by a ray from the hole's leftmost point
+    // to the left; the segment's endpoint with lesser x will be a potential
+    // connection point
+    do {
+        if (hy <= p->y && hy >= p->next->y && p->next->y != p->y) {
+            double x = p->x + (hy - p->y) * (p->next->x - p->x) / (p->next->y - p->y);
+            if (x <= hx && x > qx) {
+                qx = x;
+                m = p->x < p->next->x ? p : p->next;
+                if (x == hx) {
+                    return m; // the hole touches the outer segment
+                }
+            }
+        }
+        p = p->next;
+    } while (p != outer);
+    if (m == NULL) {
+        return NULL;
+    }
+    // looks for points inside the triangle of hole point, segment
+    // intersection and endpoint; if there are none, m is the bridge point.
+    // Otherwise uses the point with the minimum angle with the ray
+    const TessNode *stop = m;
+    double mx = m->x;
+    double my = m->y;
+    double tanMin = HUGE_VAL;
+    p = m;
+    do {
+        if (hx >= p->x && p->x >= mx && hx != p->x &&
+            pointInTriangle(hy < my ? hx : qx, hy, mx, my, hy < my ? qx : hx, hy, p->x, p->y)) {
+            double tan = abs(hy - p->y) / (hx - p->x);
+            if (locallyInside(p, hole) &&
+                (tan < tanMin || (tan == tanMin && (p->x > m->x || (p->x == m->x && sectorContainsSector(m, p)))))) {
+                m = p;
+                tanMin = tan;
+            }
+        }
+        p = p->next;
+    } while (p != stop);
+    return m;
 }
 
+static bool compareX(const TessNode *a, const TessNode *b)
+{
+    return a->x < b->x;
 }
 
-namespace proland
+/**
+ * Returns true if the given point is strictly inside the given contour
+ * (with the odd winding rule). Sets 'boundary' to true if it is on the
+ * contour.
+ */
+static bool insideContour(const vector<vec2f> &points, int start, int end, const vec2f &q, bool &boundary)
 {
+    bool inside = false;
+    boundary = false;
+    for (int i = start, j = end - 1; i < end; j = i++) {
+        const vec2f &a = points[j];
+        const vec2f &b = points[i];
+        double cross = (double(b.x) - a.x) * (double(q.y) - a.y) - (double(b.y) - a.y) * (double(q.x) - a.x);
+        if (cross == 0 && q.x >= min(a.x, b.x) && q.x <= max(a.x, b.x) && q.y >= min(a.y, b.y) && q.y <= max(a.y, b.y)) {
+            boundary = true;
+            return false;
+        }
+        if ((a.y > q.y) != (b.y > q.y) && q.x < (double(b.x) - a.x) * (double(q.y) - a.y) / (double(b.y) - a.y) + a.x) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
 
-Tesselator::Tesselator() : Object("Tesselator")
+Tesselator::Tesselator() : Object("Tesselator"), vertices(NULL), indices(NULL)
 {
-    tess = gluNewTess();
-    gluTessCallback((GLUtesselator*) tess, GLU_TESS_ERROR_DATA, (TessCallBack) errorCallback);
-    gluTessCallback((GLUtesselator*) tess, GLU_TESS_BEGIN_DATA, (TessCallBack) beginCallback);
-    gluTessCallback((GLUtesselator*) tess, GLU_TESS_VERTEX_DATA, (TessCallBack) vertexCallback);
-    gluTessCallback((GLUtesselator*) tess, GLU_TESS_COMBINE_DATA, (TessCallBack) combineCallback);
+    nodes = new TessNodes();
 }
 
 Tesselator::~Tesselator()
 {
-    gluDeleteTess((GLUtesselator*) tess);
+    delete (TessNodes*) nodes;
 }
 
 void Tesselator::beginPolygon(ptr< Mesh<vec2f, unsigned int> > mesh)
 {
     this->mesh = mesh;
-    gluTessBeginPolygon((GLUtesselator*) tess, mesh.get());
+    this->vertices = NULL;
+    this->indices = NULL;
+    points.clear();
+    contours.clear();
+}
+
+void Tesselator::beginPolygon(vector<vec2f> &vertices, vector<unsigned int> &indices)
+{
+    this->mesh = NULL;
+    this->vertices = &vertices;
+    this->indices = &indices;
+    points.clear();
+    contours.clear();
 }
 
 void Tesselator::beginContour()
 {
-    gluTessBeginContour((GLUtesselator*) tess);
+    contours.push_back(int(points.size()));
 }
 
 void Tesselator::newVertex(float x, float y)
 {
-    GLdouble coords[3];
-    coords[0] = x;
-    coords[1] = y;
-    coords[2] = 0;
-    int v = mesh->getVertexCount();
-    mesh->addVertex(vec2f(x, y));
-    gluTessVertex((GLUtesselator*) tess, coords, (GLvoid*) v);
+    points.push_back(vec2f(x, y));
 }
 
 void Tesselator::endContour()
 {
-    gluTessEndContour((GLUtesselator*) tess);
 }
 
 void Tesselator::endPolygon()
 {
-    gluTessEndPolygon((GLUtesselator*) tess);
+    TessNodes &nodes = *((TessNodes*) this->nodes);
+    int n = int(contours.size());
+    vector<box2f> bounds(n);
+    for (int c = 0; c < n; ++c) {
+        int end = c + 1 < n ? contours[c + 1] : int(points.size());
+        for (int i = contours[c]; i < end; ++i) {
+            bounds[c] = bounds[c].enlarge(points[i]);
+        }
+    }
+
+    // computes the nesting depth of each contour, and the contour directly
+    // enclosing each hole (contours at odd depths are holes)
+    vector<int> depth(n, 0);
+    vector<int> parent(n, -1);
+    for (int c = 0; c < n; ++c) {
+        int start = contours[c];
+        int end = c + 1 < n ? contours[c + 1] : int(points.size());
+        for (int d = 0; d < n; ++d) {
+            int dstart = contours[d];
+            int dend = d + 1 < n ? contours[d + 1] : int(points.size());
+            if (d == c || dend - dstart < 3 || !bounds[d].contains(bounds[c])) {
+                continue;
+            }
+            // uses the first vertex of c which is not on the boundary of d
+            for (int i = start; i < end; ++i) {
+                bool boundary;
+                bool inside = insideContour(points, dstart, dend, points[i], boundary);
+                if (!boundary) {
+                    if (inside) {
+                        ++depth[c];
+                    }
+                    break;
+                }
+            }
+        }
+    }
+    for (int c = 0; c < n; ++c) {
+        if (depth[c] % 2 == 0) {
+            continue;
+        }
+        int start = contours[c];
+        int end = c + 1 < n ? contours[c + 1] : int(points.size());
+        for (int d = 0; d < n && parent[c] == -1; ++d) {
+            int dstart = contours[d];
+            int dend = d + 1 < n ? contours[d + 1] : int(points.size());
+            if (d == c || depth[d] != depth[c] - 1 || dend - dstart < 3 || !bounds[d].contains(bounds[c])) {
+                continue;
+            }
+            for (int i = start; i < end; ++i) {
+                bool boundary;
+                bool inside = insideContour(points, dstart, dend, points[i], boundary);
+                if (!boundary) {
+                    if (inside) {
+                        parent[c] = d;
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    triangles.clear();
+    for (int c = 0; c < n; ++c) {
+        if (depth[c] % 2 != 0) {
+            continue;
+        }
+        nodes.clear();
+        int start = contours[c];
+        int end = c + 1 < n ? contours[c + 1] : int(points.size());
+        TessNode *outer = linkedList(nodes, points, start, end, true);
+        if (outer == NULL || outer->next == outer->prev) {
+            continue;
+        }
+        int vertexCount = end - start;
+
+        // connects the holes of this contour to it, from left to right
+        vector<TessNode*> holes;
+        for (int h = 0; h < n; ++h) {
+            if (parent[h] == c) {
+                int hstart = contours[h];
+                int hend = h + 1 < n ? contours[h + 1] : int(points.size());
+                TessNode *list = linkedList(nodes, points, hstart, hend, false);
+                if (list == NULL) {
+                    continue;
+                }
+                if (list == list->next) {
+                    list->steiner = true;
+                }
+                TessNode *leftmost = list;
+                TessNode *p = list;
+                do {
+                    if (p->x < leftmost->x || (p->x == leftmost->x && p->y < leftmost->y)) {
+                        leftmost = p;
+                    }
+                    p = p->next;
+                } while (p != list);
+                holes.push_back(leftmost);
+                vertexCount += hend - hstart;
+            }
+        }
+        sort(holes.begin(), holes.end(), compareX);
+        for (unsigned int h = 0; h < holes.size(); ++h) {
+            TessNode *bridge = findHoleBridge(holes[h], outer);
+            if (bridge != NULL) {
+                TessNode *bridgeReverse = splitPolygon(nodes, bridge, holes[h]);
+                filterPoints(bridgeReverse, bridgeReverse->next);
+                outer = filterPoints(bridge, bridge->next);
+            }
+        }
+
+        // uses a z-order index for large polygons
+        bool hashed = vertexCount > Z_ORDER_THRESHOLD;
+        double minX = bounds[c].xmin;
+        double minY = bounds[c].ymin;
+        double size = max(bounds[c].xmax - bounds[c].xmin, bounds[c].ymax - bounds[c].ymin);
+        double invSize = size > 0 ? 32767.0 / size : 0.0;
+        earcutLinked(nodes, outer, triangles, hashed && invSize > 0, minX, minY, invSize, 0);
+    }
+    nodes.clear();
+
+    if (mesh != NULL) {
+        unsigned int base = mesh->getVertexCount();
+        for (unsigned int i = 0; i < points.size(); ++i) {
+            mesh->addVertex(points[i]);
+        }
+        for (unsigned int i = 0; i < triangles.size(); ++i) {
+            mesh->addIndice(base + triangles[i]);
+        }
+    } else if (vertices != NULL) {
+        unsigned int base = vertices->size();
+        vertices->insert(vertices->end(), points.begin(), points.end());
+        for (unsigned int i = 0; i < triangles.size(); ++i) {
+            indices->push_back(base + triangles[i]);
+        }
+    }
     this->mesh = NULL;
+    this->vertices = NULL;
+    this->indices = NULL;
 }
 
 }
@@ -28,6 +28,8 @@
 #ifndef _PROLAND_TESSELATOR_H_
 #define _PROLAND_TESSELATOR_H_
 
+#include <vector>
+
 #include "ork/math/vec2.h"
 #include "ork/render/Mesh.h"
 
@@ -37,8 +39,20 @@ namespace proland
 {
 
 /**
- * A tesselator to triangulate arbitrary 2D surfaces defined by a set of
- * contours. Nested contours define holes.
+ * A tesselator to triangulate 2D surfaces defined by a set of contours.
+ * Nested contours define holes (with the odd winding rule: a point is
+ * inside the surface if it is inside an odd number of contours). The
+ * triangulation is done by ear clipping, after the holes have been
+ * connected to their enclosing contour. It does not depend on OpenGL, and
+ * distinct Tesselator instances can be used concurrently from several
+ * threads.
+ * Contrary to the GLU tesselator, the intersections between contours are
+ * not computed. Hence the odd winding rule is only applied to contours
+ * that are nested or disjoint. Contours that cross each other are
+ * triangulated independently, so that their common part is covered twice
+ * (while it is not covered with the odd winding rule of GLU). The
+ * contours of a graph area (its boundary and the boundaries of its holes)
+ * normally do not cross each other, so this only affects invalid areas.
  * @ingroup producer
  * @author Antoine Begault
  */
@@ -64,6 +78,18 @@ public:
      */
     void beginPolygon(ptr< Mesh<vec2f, unsigned int> > mesh);
 
+    /**
+     * Starts a new triangulation whose result is stored in the given
+     * arrays, instead of a Mesh. This result can then be cached, or copied
+     * into several meshes.
+     *
+     * @param vertices the array where the vertices of the triangles are
+     *      added.
+     * @param indices the array where the triangles are added, as triplets
+     *      of indices in 'vertices'.
+     */
+    void beginPolygon(std::vector<vec2f> &vertices, std::vector<unsigned int> &indices);
+
     /**
      * Starts a new contour.
      */
@@ -87,7 +113,36 @@ public:
 private:
     ptr< Mesh<vec2f, unsigned int> > mesh;
 
-    void *tess;
+    /**
+     * The array where the vertices are added, if #mesh is NULL.
+     */
+    std::vector<vec2f> *vertices;
+
+    /**
+     * The array where the triangles are added, if #mesh is NULL.
+     */
+    std::vector<unsigned int> *indices;
+
+    /**
+     * The vertices of the current triangulation.
+     */
+    std::vector<vec2f> points;
+
+    /**
+     * The index in #points of the first vertex of each contour.
+     */
+    std::vector<int> contours;
+
+    /**
+     * The triangles of the current triangulation, as indices in #points.
+     */
+    std::vector<unsigned int> triangles;
+
+    /**
+     * The linked list nodes used to triangulate the contours (reused from
+     * one triangulation to the next).
+     */
+    void *nodes;
 };
 
 }
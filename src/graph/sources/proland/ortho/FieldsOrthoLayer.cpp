@@ -134,15 +134,21 @@ bool FieldsOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot
         GraphPtr g = graphData->data.cast<Graph>();
 
         if (g != NULL) {
-            ptr<FrameBuffer> fb = SceneManager::getCurrentFrameBuffer();
-
             vec3d q = getTileCoords(level, tx, ty);
 
             bool init = false;
 
             float scale = 2.0f * (1.0f - 2.0f * getTileBorder() / getTileSize()) / q.z;
-            fillOffsetU->set(vec3f(q.x + q.z / 2, q.y + q.z / 2, scale));
             vec3d tileOffset = vec3d(q.x + q.z / 2, q.y + q.z / 2, scale);
+
+            ptr<CPURasterizer> r = createRasterizer(data);
+            if (r != NULL) {
+                rasterizeTile(tileOffset, g, *r);
+                return true;
+            }
+
+            ptr<FrameBuffer> fb = SceneManager::getCurrentFrameBuffer();
+            fillOffsetU->set(vec3f(q.x + q.z / 2, q.y + q.z / 2, scale));
             //tileOffsetU->set(vec3f(q.x + q.z / 2, q.y + q.z / 2, scale));
             tileOffsetU->set(vec3f(0.0, 0.0, 1.0));
 
@@ -245,6 +251,46 @@ bool FieldsOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot
     return true;
 }
 
+void FieldsOrthoLayer::rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r)
+{
+    // the fields are drawn without stripes
+    float scale = tileCoords.z;
+    ptr<Graph::AreaIterator> ai = g->getAreas();
+    while (ai->hasNext()) {
+        AreaPtr a = ai->next();
+        GraphPtr sg = a->getSubgraph();
+        if (sg == NULL || sg->getCurveCount() == 0) {
+            continue;
+        }
+
+        ptr<Graph::CurveIterator> ci = sg->getCurves();
+        while (ci->hasNext()) {
+            CurvePtr p = ci->next();
+            float pwidth = p->getWidth();
+            float swidth = pwidth * scale;
+            if (swidth > 0.1 && p->getArea2() != NULL) {
+                float alpha = min(1.0f, swidth);
+                rasterizeCurve(tileCoords, p, pwidth, r);
+                r.fill(vec4f(COLOR[9].x, COLOR[9].y, COLOR[9].z, alpha), CPURasterizer::NON_ZERO);
+            }
+        }
+
+        ptr<Graph::AreaIterator> aj = sg->getAreas();
+        while (aj->hasNext()) {
+            AreaPtr sa = aj->next();
+            mat3f *dcolor;
+            vec3f *stripeSize;
+            vec2f stripeDir;
+            vec4f *color = getColor(sa, &dcolor, &stripeSize, stripeDir);
+            if (stripeDir.x == 0 && stripeDir.y == 0) {
+                continue;
+            }
+            rasterizeArea(tileCoords, sa, r);
+            r.fill(*color, CPURasterizer::EVEN_ODD, false);
+        }
+    }
+}
+
 vec4f* FieldsOrthoLayer::getColor(AreaPtr field, mat3f **dcolor, vec3f **stripeSize, vec2f &stripeDir)
 {
     int t = abs(field->getInfo()) % 9;
@@ -81,6 +81,8 @@ protected:
     void init(ptr<GraphProducer> graphProducer, ptr<Program> layerProgram,
         ptr<Program> fillProgram, int displayLevel = 0, bool quality = true);
 
+    virtual void rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r);
+
     virtual void swap(ptr<FieldsOrthoLayer> p);
 
 private:
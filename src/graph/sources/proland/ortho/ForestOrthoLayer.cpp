@@ -81,8 +81,6 @@ bool ForestOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot
         Logger::DEBUG_LOGGER->log("ORTHO", oss.str());
     }
     if (level >= displayLevel) {
-        ptr<FrameBuffer> fb  = SceneManager::getCurrentFrameBuffer();
-
         TileCache::Tile * t = graphProducer->findTile(level, tx, ty);
         assert(t != NULL);
         ObjectTileStorage::ObjectSlot *graphData = dynamic_cast<ObjectTileStorage::ObjectSlot*>(t->getData());
@@ -92,6 +90,14 @@ bool ForestOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot
             vec3d q = getTileCoords(level, tx, ty);
             float scale = 2.0f * (1.0f - getTileBorder() * 2.0f / getTileSize()) / q.z;
             vec3d tileOffset = vec3d(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale);
+
+            ptr<CPURasterizer> r = createRasterizer(data);
+            if (r != NULL) {
+                rasterizeTile(tileOffset, g, *r);
+                return true;
+            }
+
+            ptr<FrameBuffer> fb  = SceneManager::getCurrentFrameBuffer();
             //offsetU->set(vec3f(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale));
             offsetU->set(vec3f(0.0, 0.0, 1.0));
             colorU->set(vec4f(color.x, color.y, color.z, color.w));
@@ -117,6 +123,16 @@ bool ForestOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot
     return true;
 }
 
+void ForestOrthoLayer::rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r)
+{
+    ptr<Graph::AreaIterator> ai = g->getAreas();
+    while (ai->hasNext()) {
+        AreaPtr a = ai->next();
+        rasterizeArea(tileCoords, a, r);
+        r.fill(color, CPURasterizer::EVEN_ODD, false);
+    }
+}
+
 void ForestOrthoLayer::swap(ptr<ForestOrthoLayer> p)
 {
     GraphLayer::swap(p);
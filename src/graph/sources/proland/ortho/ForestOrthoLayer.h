@@ -76,6 +76,8 @@ protected:
     void init(ptr<GraphProducer> graphProducer, ptr<Program> layerProgram,
         int displayLevel = 0, bool quality = true, vec4f color = vec4f(0, 0, 0, 0));
 
+    virtual void rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r);
+
     virtual void swap(ptr<ForestOrthoLayer> p);
 
 private:
@@ -41,17 +41,16 @@ LineOrthoLayer::LineOrthoLayer() : GraphLayer("LineOrthoLayer")
 {
 }
 
-LineOrthoLayer::LineOrthoLayer(ptr<GraphProducer> graphProducer, ptr<Program> layerProgram, int displayLevel) :
+LineOrthoLayer::LineOrthoLayer(ptr<GraphProducer> graphProducer, ptr<Program> layerProgram, int displayLevel, vec4f color) :
     GraphLayer("LineOrthoLayer")
 {
-    init(graphProducer, layerProgram, displayLevel);
+    init(graphProducer, layerProgram, displayLevel, color);
 }
 
-void LineOrthoLayer::init(ptr<GraphProducer> graphProducer, ptr<Program> layerProgram, int displayLevel)
+void LineOrthoLayer::init(ptr<GraphProducer> graphProducer, ptr<Program> layerProgram, int displayLevel, vec4f color)
 {
     GraphLayer::init(graphProducer, layerProgram, displayLevel);
-    mesh = new Mesh<vec2f, unsigned int>(LINE_STRIP, GPU_STREAM);
-    mesh->addAttributeType(0, 2, A32F, false);
+    this->color = color;
 
     tileOffsetU = layerProgram->getUniform3f("tileOffset");
 }
@@ -60,6 +59,12 @@ LineOrthoLayer::~LineOrthoLayer()
 {
 }
 
+void LineOrthoLayer::startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> result)
+{
+    ptr<Task> t = startBuildTileMeshes(level, tx, ty, deadline, task, result);
+    GraphLayer::startCreateTile(level, tx, ty, deadline, t, result);
+}
+
 bool LineOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *data)
 {
     if (Logger::DEBUG_LOGGER != NULL) {
@@ -77,29 +82,63 @@ bool LineOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *
         vec3d tileCoords = getTileCoords(level, tx, ty);
         float scale = 2.0f * (1.0f - getTileBorder() * 2.0f / getTileSize()) / tileCoords.z;
 
+        ptr<CPURasterizer> r = createRasterizer(data);
+        if (r != NULL) {
+            vec3d tileOffset = vec3d(tileCoords.x + tileCoords.z / 2.0f, tileCoords.y + tileCoords.z / 2.0f, scale);
+            rasterizeTile(tileOffset, graphForThisTile, *r);
+            return true;
+        }
+
         ptr<FrameBuffer> fb = SceneManager::getCurrentFrameBuffer();
         tileOffsetU->set(vec3f(tileCoords.x + tileCoords.z / 2.0f, tileCoords.y + tileCoords.z / 2.0f, scale));
 
-        ptr<Graph::CurveIterator> curveIterator = graphForThisTile->getCurves();
-        while (curveIterator->hasNext()) {
-            CurvePtr curve = curveIterator->next();
-            int numberOfPoints = curve->getSize();
-            assert(numberOfPoints >= 2);
-            mesh->clear();
-            for (int i = 0; i < numberOfPoints; ++i) {
-                vec2f vertexPosition = curve->getXY(i).cast<float>();
-                mesh->addVertex(vertexPosition);
-            }
-            fb->draw(layerProgram, *mesh);
+        vector< ptr<Object> > meshes;
+        getTileMeshes(level, tx, ty, graphForThisTile, meshes);
+        for (unsigned int i = 0; i < meshes.size(); ++i) {
+            fb->draw(layerProgram, *(meshes[i].cast< Mesh<vec2f, unsigned int> >()));
         }
     }
     return true;
 }
 
+void LineOrthoLayer::buildTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes)
+{
+    ptr< Mesh<vec2f, unsigned int> > m = new Mesh<vec2f, unsigned int>(LINES, GPU_STREAM);
+    m->addAttributeType(0, 2, A32F, false);
+    ptr<Graph::CurveIterator> curveIterator = g->getCurves();
+    while (curveIterator->hasNext()) {
+        CurvePtr curve = curveIterator->next();
+        int numberOfPoints = curve->getSize();
+        assert(numberOfPoints >= 2);
+        unsigned int base = m->getVertexCount();
+        for (int i = 0; i < numberOfPoints; ++i) {
+            vec2f vertexPosition = curve->getXY(i).cast<float>();
+            m->addVertex(vertexPosition);
+            if (i > 0) {
+                m->addIndice(base + i - 1);
+                m->addIndice(base + i);
+            }
+        }
+    }
+    if (m->getVertexCount() > 0) {
+        meshes.push_back(m);
+    }
+}
+
+void LineOrthoLayer::rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r)
+{
+    ptr<Graph::CurveIterator> curveIterator = g->getCurves();
+    while (curveIterator->hasNext()) {
+        CurvePtr curve = curveIterator->next();
+        rasterizeCurve(tileCoords, curve, 0.0f, r);
+    }
+    r.fill(color, CPURasterizer::NON_ZERO);
+}
+
 void LineOrthoLayer::swap(ptr<LineOrthoLayer> p)
 {
     GraphLayer::swap(p);
-    std::swap(mesh, p->mesh);
+    std::swap(color, p->color);
     std::swap(tileOffsetU, p->tileOffsetU);
 }
 
@@ -113,8 +152,9 @@ public:
         e = e == NULL ? desc->descriptor : e;
         ptr<GraphProducer>graphProducer;
         int displayLevel = 0;
+        vec4f color = vec4f(1.0f, 0.0f, 0.0f, 1.0f);
 
-        checkParameters(desc, e, "name,graph,renderProg,level,");
+        checkParameters(desc, e, "name,graph,renderProg,level,color,");
         string g = getParameter(desc, e, "graph");
 
         graphProducer = manager->loadResource(g).cast<GraphProducer>();
@@ -124,8 +164,19 @@ public:
         }
         assert(displayLevel >= 0);
 
+        if (e->Attribute("color") != NULL) {
+            string c = getParameter(desc, e, "color") + ",";
+            string::size_type start = 0;
+            string::size_type index;
+            for (int i = 0; i < 3; i++) {
+                index = c.find(',', start);
+                color[i] = (float) atof(c.substr(start, index - start).c_str()) / 255;
+                start = index + 1;
+            }
+        }
+
         ptr<Program> layerProgram = manager->loadResource(getParameter(desc, e, "renderProg")).cast<Program>();
-        init(graphProducer, layerProgram, displayLevel);
+        init(graphProducer, layerProgram, displayLevel, color);
     }
 
     virtual bool prepareUpdate()
@@ -49,14 +49,19 @@ public:
      * @param layerProgram the Program to be used to draw the graphs.
      * @param displayLevel the quadtree level at which the display of
      *      this layer must start.
+     * @param color the color of the lines, when they are drawn on CPU
+     *      (on GPU this color is defined by layerProgram).
      */
-    LineOrthoLayer(ptr<GraphProducer> graphProducer, ptr<Program> layerProgram, int displayLevel = 0);
+    LineOrthoLayer(ptr<GraphProducer> graphProducer, ptr<Program> layerProgram, int displayLevel = 0,
+        vec4f color = vec4f(1, 0, 0, 1));
 
     /**
      * Deletes this LineOrthoLayer.
      */
     virtual ~LineOrthoLayer();
 
+    virtual void startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> result);
+
     virtual bool doCreateTile(int level, int tx, int ty, TileStorage::Slot *data);
 
 protected:
@@ -68,15 +73,24 @@ protected:
     /**
      * Initializes this LineOrthoLayer. See #LineOrthoLayer.
      */
-    void init(ptr<GraphProducer> graphProducer, ptr<Program> layerProgram, int displayLevel = 0);
+    void init(ptr<GraphProducer> graphProducer, ptr<Program> layerProgram, int displayLevel = 0,
+        vec4f color = vec4f(1, 0, 0, 1));
+
+    virtual void rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r);
+
+    /**
+     * Builds a single mesh, in LINES mode, containing all the curves of
+     * the given tile.
+     */
+    virtual void buildTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes);
 
     virtual void swap(ptr<LineOrthoLayer> p);
 
 private:
     /**
-     * The mesh used for drawing curves.
+     * The color of the lines, when they are drawn on CPU.
      */
-    ptr<Mesh<vec2f, unsigned int> > mesh;
+    vec4f color;
 
     ptr<Uniform3f> tileOffsetU;
 };
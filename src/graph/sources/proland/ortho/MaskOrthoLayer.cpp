@@ -61,9 +61,6 @@ void MaskOrthoLayer::init(ptr<GraphProducer> graphs, set<int> ignored, ptr<Progr
     this->widthFactor = widthFactor;
     this->blendParams = blendParams;
     this->blendColor = blendColor;
-    this->mesh = new Mesh<vec2f, unsigned int>(TRIANGLES, GPU_STREAM);
-    this->mesh->addAttributeType(0, 2, A32F, false);
-    this->tess = new Tesselator();
 
     tileOffsetU = layerProgram->getUniform3f("tileOffset");
     depthU = layerProgram->getUniform1f("depth");
@@ -77,6 +74,12 @@ void MaskOrthoLayer::setTileSize(int tileSize, int tileBorder, float rootQuadSiz
     graphProducer->addMargin(new OrthoMargin(tileSize - 2 * tileBorder, borderFactor, 1.0f));
 }
 
+void MaskOrthoLayer::startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> result)
+{
+    ptr<Task> t = startBuildTileMeshes(level, tx, ty, deadline, task, result);
+    GraphLayer::startCreateTile(level, tx, ty, deadline, t, result);
+}
+
 bool MaskOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *data)
 {
     if (Logger::DEBUG_LOGGER != NULL) {
@@ -90,6 +93,16 @@ bool MaskOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *
         ObjectTileStorage::ObjectSlot *graphData = dynamic_cast<ObjectTileStorage::ObjectSlot*>(t->getData());
         GraphPtr g = graphData->data.cast<Graph>();
         if (g != NULL) {
+            vec3d q = getTileCoords(level, tx, ty);
+            float scale = 2.0f * (1.0f - getTileBorder() * 2.0f / getTileSize()) / q.z;
+            vec3d tileOffset = vec3d(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale);
+
+            ptr<CPURasterizer> r = createRasterizer(data);
+            if (r != NULL) {
+                rasterizeTile(tileOffset, g, *r);
+                return true;
+            }
+
             ptr<FrameBuffer> fb = SceneManager::getCurrentFrameBuffer();
             FrameBuffer::Parameters old = fb->getParameters();
 
@@ -106,45 +119,15 @@ bool MaskOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *
             fb->setDepthMask(0 != (writeMask & 16));
             fb->setStencilMask(0 != (writeMask & 32), 0 != (writeMask & 64));
 
-            vec3d q = getTileCoords(level, tx, ty);
-            float scale = 2.0f * (1.0f - getTileBorder() * 2.0f / getTileSize()) / q.z;
-            float scale2 = 2.0f * (getTileSize() - 2.0f * getTileBorder()) / q.z;
-
-            vec2d nx, ny, lx, ly;
-            getDeformParameters(q, nx, ny, lx, ly);
-
-            vec3d tileOffset = vec3d(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale);
             //tileOffsetU->set(vec3f(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale));
             tileOffsetU->set(vec3f(0.0, 0.0, 1.0));
             colorU->set(vec4f(color.x, color.y, color.z, color.w));
             depthU->set(depth);
 
-            mesh->setMode(TRIANGLES);
-            mesh->clear();
-            ptr<Graph::AreaIterator> ai = g->getAreas();
-            tess->beginPolygon(mesh);
-            while (ai->hasNext()) {
-                AreaPtr a = ai->next();
-                drawArea(tileOffset, a, *tess);
-            }
-            tess->endPolygon();
-            fb->draw(layerProgram, *mesh);
-            ptr<Graph::CurveIterator> ci = g->getCurves();
-            while (ci->hasNext()) {
-                CurvePtr p = ci->next();
-                if (ignored.find(p->getType()) != ignored.end()) {
-                    continue;
-                }
-
-                float pwidth = widthFactor * p->getWidth();
-                float swidth = pwidth * scale2;
-                if (swidth > 0.1) {
-                    if (isDeformed()) {
-                        drawCurve(tileOffset, p, pwidth, scale * getTileSize(), fb, layerProgram, *mesh, &nx, &ny, &lx, &ly);
-                    } else {
-                        drawCurve(tileOffset, p, pwidth, scale, fb, layerProgram, *mesh);
-                    }
-                }
+            vector< ptr<Object> > meshes;
+            getTileMeshes(level, tx, ty, g, meshes);
+            for (unsigned int i = 0; i < meshes.size(); ++i) {
+                fb->draw(layerProgram, *(meshes[i].cast< Mesh<vec2f, unsigned int> >()));
             }
             fb->setColorMask(true, true, true, true);
             fb->setDepthMask(true);
@@ -162,6 +145,75 @@ bool MaskOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *
     return true;
 }
 
+void MaskOrthoLayer::buildTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes)
+{
+    vec3d q = getTileCoords(level, tx, ty);
+    float scale = 2.0f * (1.0f - getTileBorder() * 2.0f / getTileSize()) / q.z;
+    float scale2 = 2.0f * (getTileSize() - 2.0f * getTileBorder()) / q.z;
+    vec3d tileOffset = vec3d(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale);
+
+    vec2d nx, ny, lx, ly;
+    getDeformParameters(q, nx, ny, lx, ly);
+
+    ptr< Mesh<vec2f, unsigned int> > m = new Mesh<vec2f, unsigned int>(TRIANGLES, GPU_STREAM);
+    m->addAttributeType(0, 2, A32F, false);
+    ptr<Tesselator> tess = new Tesselator();
+    ptr<Graph::AreaIterator> ai = g->getAreas();
+    tess->beginPolygon(m);
+    while (ai->hasNext()) {
+        AreaPtr a = ai->next();
+        drawArea(tileOffset, a, *tess);
+    }
+    tess->endPolygon();
+
+    ptr<Graph::CurveIterator> ci = g->getCurves();
+    while (ci->hasNext()) {
+        CurvePtr p = ci->next();
+        if (ignored.find(p->getType()) != ignored.end()) {
+            continue;
+        }
+
+        float pwidth = widthFactor * p->getWidth();
+        float swidth = pwidth * scale2;
+        if (swidth > 0.1) {
+            if (isDeformed()) {
+                addCurve(tileOffset, p, pwidth, scale * getTileSize(), *m, &nx, &ny, &lx, &ly);
+            } else {
+                addCurve(tileOffset, p, pwidth, scale, *m);
+            }
+        }
+    }
+    if (m->getVertexCount() > 0) {
+        meshes.push_back(m);
+    }
+}
+
+void MaskOrthoLayer::rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r)
+{
+    // the blending equations are approximated with an alpha blending
+    float scale2 = tileCoords.z * getTileSize();
+    ptr<Graph::AreaIterator> ai = g->getAreas();
+    while (ai->hasNext()) {
+        AreaPtr a = ai->next();
+        rasterizeArea(tileCoords, a, r);
+    }
+    r.fill(color, CPURasterizer::EVEN_ODD, blendParams.enable, writeMask & 15);
+
+    ptr<Graph::CurveIterator> ci = g->getCurves();
+    while (ci->hasNext()) {
+        CurvePtr p = ci->next();
+        if (ignored.find(p->getType()) != ignored.end()) {
+            continue;
+        }
+        float pwidth = widthFactor * p->getWidth();
+        float swidth = pwidth * scale2;
+        if (swidth > 0.1) {
+            rasterizeCurve(tileCoords, p, pwidth, r);
+        }
+    }
+    r.fill(color, CPURasterizer::NON_ZERO, blendParams.enable, writeMask & 15);
+}
+
 void MaskOrthoLayer::swap(ptr<MaskOrthoLayer> p)
 {
     GraphLayer::swap(p);
@@ -172,8 +224,6 @@ void MaskOrthoLayer::swap(ptr<MaskOrthoLayer> p)
     std::swap(tileOffsetU, p->tileOffsetU);
     std::swap(colorU, p->colorU);
     std::swap(depthU, p->depthU);
-    std::swap(mesh, p->mesh);
-    std::swap(tess, p->tess);
     std::swap(ignored, p->ignored);
 }
 
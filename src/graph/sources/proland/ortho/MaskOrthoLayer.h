@@ -105,6 +105,8 @@ public:
 
     virtual void setTileSize(int tileSize, int tileBorder, float rootQuadSize);
 
+    virtual void startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> result);
+
     virtual bool doCreateTile(int level, int tx, int ty, TileStorage::Slot *data);
 
 protected:
@@ -118,6 +120,14 @@ protected:
      */
     void init(ptr<GraphProducer> graphs, set<int> ignored, ptr<Program> layerProgram, int writeMask, vec4f color, float depth, float widthFactor, BlendParams blendParams, vec4f blendColor, int displayLevel, bool deform = false);
 
+    virtual void rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r);
+
+    /**
+     * Builds a single mesh containing all the areas and curves to be drawn
+     * in the given tile.
+     */
+    virtual void buildTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes);
+
     void swap(ptr<MaskOrthoLayer> p);
 
 private:
@@ -157,16 +167,6 @@ private:
      */
     vec4f blendColor;
 
-    /**
-     * The mesh used to draw curves and areas.
-     */
-    ptr<Mesh< vec2f, unsigned int> > mesh;
-
-    /**
-     * The tesselator used to draw areas.
-     */
-    ptr<Tesselator> tess;
-
     ptr<Uniform3f> tileOffsetU;
 
     ptr<Uniform4f> colorU;
@@ -61,9 +61,7 @@ void RoadOrthoLayer::init(ptr<GraphProducer> graphProducer, ptr<Program> layerPr
     this->border_width = border_width;
     this->inner_border_width = inner_border_width;
 
-    this->mesh = new Mesh<vec2f, unsigned int>(TRIANGLE_STRIP, CPU);
     this->meshuv = new Mesh<vec4f, unsigned int>(TRIANGLE_STRIP, CPU);
-    this->mesh->addAttributeType(0, 2, A32F, false);   // pos
     this->meshuv->addAttributeType(0, 2, A32F, false); // pos
     this->meshuv->addAttributeType(1, 2, A32F, false); // uv
 
@@ -100,7 +98,8 @@ void RoadOrthoLayer::startCreateTile(int level, int tx, int ty, unsigned int dea
             result->addDependency(task, t);
         }
     }
-    GraphLayer::startCreateTile(level, tx, ty, deadline, t == NULL ? task : t, result);
+    ptr<Task> m = startBuildTileMeshes(level, tx, ty, deadline, t == NULL ? task : t, result);
+    GraphLayer::startCreateTile(level, tx, ty, deadline, m, result);
 }
 
 bool RoadOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *data)
@@ -112,8 +111,6 @@ bool RoadOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *
         Logger::DEBUG_LOGGER->log("GRAPH", oss.str());
     }
     if (level >= displayLevel) {
-        ptr<FrameBuffer> fb = SceneManager::getCurrentFrameBuffer();
-
         TileCache::Tile * t = graphProducer->findTile(level, tx, ty);
         assert(t != NULL);
         ObjectTileStorage::ObjectSlot *graphData = dynamic_cast<ObjectTileStorage::ObjectSlot*>(t->getData());
@@ -122,10 +119,19 @@ bool RoadOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *
         vec3d q = getTileCoords(level, tx, ty);
         float scale = 2.0f * (1.0f - getTileBorder() * 2.0f / getTileSize()) / q.z;
 
+        vec3d tileOffset = vec3d(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale);
+
+        ptr<CPURasterizer> r = createRasterizer(data);
+        if (r != NULL) {
+            rasterizeTile(tileOffset, g, *r);
+            return true;
+        }
+
+        ptr<FrameBuffer> fb = SceneManager::getCurrentFrameBuffer();
+
         vec2d nx, ny, lx, ly;
         getDeformParameters(q, nx, ny, lx, ly);
 
-        vec3d tileOffset = vec3d(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale);
         //tileOffsetU->set(vec3f(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale));
         tileOffsetU->set(vec3f(0.0, 0.0, 1.0));
 
@@ -179,23 +185,14 @@ bool RoadOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *
                 fb->setBlend(false);
             }
 
-            colorU->set(color);
+            vector< ptr<Object> > meshes;
+            getTileMeshes(level, tx, ty, g, meshes);
             blendSizeU->set(vec2f::ZERO);
-            ci = g->getCurves();
-            while (ci->hasNext()) { // Drawing Roads
-                CurvePtr p = ci->next();
-                float pwidth = p->getWidth();
-                if (p->getType() == ROAD && pwidth > 0) {
-                    if (pwidth * scale2 <= 2) {
-                        continue;
-                    }
-                    CurveData *d = findCurveData(p);
-                    if (pwidth == 1) {
-                        colorU->set(vec4f(dirt.xyz(), 0.0));
-                    } else {
-                        colorU->set(color);
-                    }
-                    drawCurve(tileOffset, p, d, pwidth, 0, scale2, fb, layerProgram, *meshuv, &nx, &ny, &lx, &ly);
+            for (unsigned int i = 0; i < meshes.size(); ++i) { // Drawing dirt roads, then roads
+                ptr< Mesh<vec4f, unsigned int> > m = meshes[i].cast< Mesh<vec4f, unsigned int> >();
+                if (m->getVertexCount() > 0) {
+                    colorU->set(i == 0 ? vec4f(dirt.xyz(), 0.0) : color);
+                    fb->draw(layerProgram, *m);
                 }
             }
             colorU->set(color);
@@ -236,13 +233,10 @@ bool RoadOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *
         } else {
             colorU->set(color);
             stripeSizeU->set(vec3f::ZERO);
-            ci = g->getCurves();
-            while (ci->hasNext()) {
-                CurvePtr p = ci->next();
-                float pwidth = p->getWidth();
-                if (p->getType() == ROAD && pwidth > 0) {
-                    drawCurve(tileOffset, p, pwidth, scale2, fb, layerProgram, *mesh, &nx, &ny, &lx, &ly);
-                }
+            vector< ptr<Object> > meshes;
+            getTileMeshes(level, tx, ty, g, meshes);
+            for (unsigned int i = 0; i < meshes.size(); ++i) {
+                fb->draw(layerProgram, *(meshes[i].cast< Mesh<vec2f, unsigned int> >()));
             }
         }
     }
@@ -255,6 +249,112 @@ void RoadOrthoLayer::stopCreateTile(int level, int tx, int ty)
     GraphLayer::stopCreateTile(level, tx, ty);
 }
 
+void RoadOrthoLayer::buildTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes)
+{
+    vec3d q = getTileCoords(level, tx, ty);
+    float scale = 2.0f * (1.0f - getTileBorder() * 2.0f / getTileSize()) / q.z;
+    float scale2 = scale * getTileSize();
+    vec3d tileOffset = vec3d(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale);
+
+    vec2d nx, ny, lx, ly;
+    getDeformParameters(q, nx, ny, lx, ly);
+
+    ptr<Graph::CurveIterator> ci = g->getCurves();
+    if (quality) {
+        // the road bodies are drawn without stripes or blending, and do
+        // not need the curvilinear coordinates of their CurveData
+        ptr< Mesh<vec4f, unsigned int> > dirtMesh = new Mesh<vec4f, unsigned int>(TRIANGLES, CPU);
+        ptr< Mesh<vec4f, unsigned int> > roadMesh = new Mesh<vec4f, unsigned int>(TRIANGLES, CPU);
+        dirtMesh->addAttributeType(0, 2, A32F, false); // pos
+        dirtMesh->addAttributeType(1, 2, A32F, false); // uv
+        roadMesh->addAttributeType(0, 2, A32F, false); // pos
+        roadMesh->addAttributeType(1, 2, A32F, false); // uv
+        while (ci->hasNext()) {
+            CurvePtr p = ci->next();
+            float pwidth = p->getWidth();
+            if (p->getType() == ROAD && pwidth > 0 && pwidth * scale2 > 2) {
+                addCurve(tileOffset, p, NULL, pwidth, pwidth == 1 ? *dirtMesh : *roadMesh, &nx, &ny, &lx, &ly);
+            }
+        }
+        meshes.push_back(dirtMesh);
+        meshes.push_back(roadMesh);
+    } else {
+        ptr< Mesh<vec2f, unsigned int> > m = new Mesh<vec2f, unsigned int>(TRIANGLES, CPU);
+        m->addAttributeType(0, 2, A32F, false);
+        while (ci->hasNext()) {
+            CurvePtr p = ci->next();
+            float pwidth = p->getWidth();
+            if (p->getType() == ROAD && pwidth > 0) {
+                addCurve(tileOffset, p, pwidth, scale2, *m, &nx, &ny, &lx, &ly);
+            }
+        }
+        if (m->getVertexCount() > 0) {
+            meshes.push_back(m);
+        }
+    }
+}
+
+void RoadOrthoLayer::rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r)
+{
+    // the roads are drawn without stripes and without road ends, and the
+    // blending of their borders is approximated with opaque borders
+    float scale2 = tileCoords.z * getTileSize();
+    ptr<Graph::CurveIterator> ci;
+
+    if (quality) {
+        if (border_width > 1.0f) {
+            ci = g->getCurves();
+            while (ci->hasNext()) { // Drawing borders
+                CurvePtr p = ci->next();
+                if (p->getType() == ROAD) {
+                    float pwidth = p->getWidth();
+                    float swidth = pwidth * scale2;
+                    if (swidth > 2 && pwidth > 1) {
+                        rasterizeCurve(tileCoords, p, pwidth * border_width, r);
+                    }
+                }
+            }
+            r.fill(vec4f(border.xyz(), 1.0f), CPURasterizer::NON_ZERO);
+
+            ci = g->getCurves();
+            while (ci->hasNext()) { // Drawing thin roads
+                CurvePtr p = ci->next();
+                if (p->getType() == ROAD) {
+                    float pwidth = p->getWidth();
+                    float swidth = pwidth * scale2;
+                    if (swidth > 0.1 && !(swidth > 2 && pwidth > 1)) {
+                        float alpha = min(1.0f, swidth);
+                        rasterizeCurve(tileCoords, p, pwidth, r);
+                        r.fill(vec4f(pwidth == 1 ? dirt.xyz() : color.xyz(), alpha), CPURasterizer::NON_ZERO);
+                    }
+                }
+            }
+        }
+
+        for (int pass = 0; pass < 2; ++pass) { // Drawing dirt roads, then roads
+            ci = g->getCurves();
+            while (ci->hasNext()) {
+                CurvePtr p = ci->next();
+                float pwidth = p->getWidth();
+                if (p->getType() == ROAD && pwidth > 0 && pwidth * scale2 > 2 && (pwidth == 1) == (pass == 0)) {
+                    rasterizeCurve(tileCoords, p, pwidth, r);
+                }
+            }
+            r.fill(pass == 0 ? dirt : color, CPURasterizer::NON_ZERO, false);
+        }
+    } else {
+        ci = g->getCurves();
+        while (ci->hasNext()) {
+            CurvePtr p = ci->next();
+            float pwidth = p->getWidth();
+            if (p->getType() == ROAD && pwidth > 0) {
+                rasterizeCurve(tileCoords, p, pwidth, r);
+            }
+        }
+        r.fill(color, CPURasterizer::NON_ZERO, false);
+    }
+}
+
 void RoadOrthoLayer::drawRoadEnd(const vec3d &tileOffset, ptr<FrameBuffer> fb, const vec2d &p, const vec2d &n, double length, float w, float scale, vec2d *nx, vec2d *ny, vec2d *lx, vec2d *ly)
 {
     //TODO antialiasing
@@ -365,7 +465,6 @@ void RoadOrthoLayer::swap(ptr<RoadOrthoLayer> p)
     std::swap(border, p->border);
     std::swap(border_width, p->border_width);
     std::swap(inner_border_width, p->inner_border_width);
-    std::swap(mesh, p->mesh);
     std::swap(meshuv, p->meshuv);
     std::swap(stripeSizeU, p->stripeSizeU);
     std::swap(colorU, p->colorU);
@@ -105,6 +105,17 @@ protected:
         float border_width = 1.2f, float inner_border_width = 2.0f,
         bool deform = false);
 
+    virtual void rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r);
+
+    /**
+     * Builds the meshes of the roads to be drawn in the given tile. In
+     * quality mode these meshes contain the dirt roads and then the other
+     * roads, without their borders, stripes and road ends (which are still
+     * drawn one by one in #doCreateTile). Otherwise a single mesh contains
+     * all the roads.
+     */
+    virtual void buildTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes);
+
     virtual void swap(ptr<RoadOrthoLayer> p);
 
 private:
@@ -133,12 +144,6 @@ private:
      */
     vec4f border;
 
-    /**
-     * The mesh used for drawing curves.
-     * Contains XY coordinates of each vertex.
-     */
-    ptr< Mesh<vec2f, unsigned int> > mesh;
-
     /**
      * The mesh used for drawing curves.
      * Contains XY coordinates + UV parameters for each vertex.
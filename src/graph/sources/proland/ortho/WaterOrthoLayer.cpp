@@ -56,7 +56,6 @@ void WaterOrthoLayer::init(ptr<GraphProducer> graphProducer, ptr<Program> layerP
     this->color = color;
     this->mesh = new Mesh<vec2f, unsigned int>(TRIANGLE_STRIP, GPU_STREAM);
     this->mesh->addAttributeType(0, 2, A32F, false);
-    this->tess = new Tesselator();
 
     tileOffsetU = layerProgram->getUniform3f("tileOffset");
     colorU = layerProgram->getUniform4f("color");
@@ -73,6 +72,12 @@ void WaterOrthoLayer::setTileSize(int tileSize, int tileBorder, float rootQuadSi
     graphProducer->addMargin(new OrthoMargin(tileSize - 2 * tileBorder, borderFactor, 1.0f));
 }
 
+void WaterOrthoLayer::startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> result)
+{
+    ptr<Task> t = startBuildTileMeshes(level, tx, ty, deadline, task, result);
+    GraphLayer::startCreateTile(level, tx, ty, deadline, t, result);
+}
+
 bool WaterOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *data)
 {
     if (Logger::DEBUG_LOGGER != NULL) {
@@ -86,8 +91,6 @@ bool WaterOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot
         ObjectTileStorage::ObjectSlot *graphData = dynamic_cast<ObjectTileStorage::ObjectSlot*>(t->getData());
         GraphPtr g = graphData->data.cast<Graph>();
         if (g != NULL) {
-            ptr<FrameBuffer> fb = SceneManager::getCurrentFrameBuffer();
-
             vec3d q = getTileCoords(level, tx, ty);
             vec2d nx, ny, lx, ly;
             getDeformParameters(q, nx, ny, lx, ly);
@@ -95,30 +98,43 @@ bool WaterOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot
             float scale = 2.0f * (1.0f - getTileBorder() * 2.0f / getTileSize()) / q.z;
             float scale2 = 2.0f * (getTileSize() - 2.0f * getTileBorder()) / q.z;
             vec3d tileOffset = vec3d(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale);
+
+            ptr<CPURasterizer> r = createRasterizer(data);
+            if (r != NULL) {
+                rasterizeTile(tileOffset, g, *r);
+                return true;
+            }
+
+            ptr<FrameBuffer> fb = SceneManager::getCurrentFrameBuffer();
             //tileOffsetU->set(vec3f(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale));
             tileOffsetU->set(vec3f(0.0, 0.0, 1.0));
             colorU->set(color);
-            mesh->setMode(TRIANGLES);
-            mesh->clear();
-            tess->beginPolygon(mesh);
-            ptr<Graph::AreaIterator> ai = g->getAreas();
-            while (ai->hasNext()) {
-                AreaPtr a = ai->next();
-                drawArea(tileOffset, a, *tess);
+            vector< ptr<Object> > meshes;
+            getTileMeshes(level, tx, ty, g, meshes);
+            ptr< Mesh<vec2f, unsigned int> > areas = NULL;
+            ptr< Mesh<vec2f, unsigned int> > rivers = NULL;
+            if (meshes.size() == 2) {
+                areas = meshes[0].cast< Mesh<vec2f, unsigned int> >();
+                rivers = meshes[1].cast< Mesh<vec2f, unsigned int> >();
+            }
+            if (areas != NULL && areas->getVertexCount() > 0) {
+                fb->draw(layerProgram, *areas);
             }
-            tess->endPolygon();
-            fb->draw(layerProgram, *mesh);
 
             fb->setBlend(true, ADD, SRC_ALPHA, ONE_MINUS_SRC_ALPHA, ADD, ONE, ZERO);
 
+            // opaque water first, then the semi transparent thin rivers
+            if (rivers != NULL && rivers->getVertexCount() > 0) {
+                colorU->set(vec4f(color.xyz(), 1.0f));
+                fb->draw(layerProgram, *rivers);
+            }
             ptr<Graph::CurveIterator> ci = g->getCurves();
             while (ci->hasNext()) {
                 CurvePtr p = ci->next();
                 float pwidth = p->getWidth();
                 float swidth = pwidth * scale2;
-                if (pwidth > 0 && p->getType() == RIVER && swidth > 0.1) {
-                    float alpha = min(1.0f, swidth);
-                    colorU->set(vec4f(color.xyz(), alpha));
+                if (pwidth > 0 && p->getType() == RIVER && swidth > 0.1 && swidth < 1.0f) {
+                    colorU->set(vec4f(color.xyz(), swidth));
                     drawCurve(tileOffset, p, pwidth, scale, fb, layerProgram, *mesh, &nx, &ny, &lx, &ly);
                 }
             }
@@ -134,12 +150,71 @@ bool WaterOrthoLayer::doCreateTile(int level, int tx, int ty, TileStorage::Slot
     return true;
 }
 
+void WaterOrthoLayer::buildTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes)
+{
+    vec3d q = getTileCoords(level, tx, ty);
+    vec2d nx, ny, lx, ly;
+    getDeformParameters(q, nx, ny, lx, ly);
+
+    float scale = 2.0f * (1.0f - getTileBorder() * 2.0f / getTileSize()) / q.z;
+    float scale2 = 2.0f * (getTileSize() - 2.0f * getTileBorder()) / q.z;
+    vec3d tileOffset = vec3d(q.x + q.z / 2.0f, q.y + q.z / 2.0f, scale);
+
+    ptr< Mesh<vec2f, unsigned int> > areas = new Mesh<vec2f, unsigned int>(TRIANGLES, GPU_STREAM);
+    areas->addAttributeType(0, 2, A32F, false);
+    ptr<Tesselator> tess = new Tesselator();
+    tess->beginPolygon(areas);
+    ptr<Graph::AreaIterator> ai = g->getAreas();
+    while (ai->hasNext()) {
+        AreaPtr a = ai->next();
+        drawArea(tileOffset, a, *tess);
+    }
+    tess->endPolygon();
+
+    ptr< Mesh<vec2f, unsigned int> > rivers = new Mesh<vec2f, unsigned int>(TRIANGLES, GPU_STREAM);
+    rivers->addAttributeType(0, 2, A32F, false);
+    ptr<Graph::CurveIterator> ci = g->getCurves();
+    while (ci->hasNext()) {
+        CurvePtr p = ci->next();
+        float pwidth = p->getWidth();
+        float swidth = pwidth * scale2;
+        if (pwidth > 0 && p->getType() == RIVER && swidth >= 1.0f) {
+            addCurve(tileOffset, p, pwidth, scale, *rivers, &nx, &ny, &lx, &ly);
+        }
+    }
+    meshes.push_back(areas);
+    meshes.push_back(rivers);
+}
+
+void WaterOrthoLayer::rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r)
+{
+    float scale2 = tileCoords.z * getTileSize();
+
+    ptr<Graph::AreaIterator> ai = g->getAreas();
+    while (ai->hasNext()) {
+        AreaPtr a = ai->next();
+        rasterizeArea(tileCoords, a, r);
+    }
+    r.fill(color, CPURasterizer::EVEN_ODD, false);
+
+    ptr<Graph::CurveIterator> ci = g->getCurves();
+    while (ci->hasNext()) {
+        CurvePtr p = ci->next();
+        float pwidth = p->getWidth();
+        float swidth = pwidth * scale2;
+        if (pwidth > 0 && p->getType() == RIVER && swidth > 0.1) {
+            float alpha = min(1.0f, swidth);
+            rasterizeCurve(tileCoords, p, pwidth, r);
+            r.fill(vec4f(color.xyz(), alpha), CPURasterizer::NON_ZERO);
+        }
+    }
+}
+
 void WaterOrthoLayer::swap(ptr<WaterOrthoLayer> p)
 {
     GraphLayer::swap(p);
     std::swap(color, p->color);
     std::swap(mesh, p->mesh);
-    std::swap(tess, p->tess);
     std::swap(colorU, p->colorU);
     std::swap(tileOffsetU, p->tileOffsetU);
 }
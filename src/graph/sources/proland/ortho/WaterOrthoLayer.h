@@ -78,6 +78,8 @@ public:
 
     virtual void setTileSize(int tileSize, int tileBorder, float rootQuadSize);
 
+    virtual void startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> result);
+
     virtual bool doCreateTile(int level, int tx, int ty, TileStorage::Slot *data);
 
 protected:
@@ -93,6 +95,16 @@ protected:
         int displayLevel = 0, bool quality = true, vec4f color = vec4f(0, 0, 0, 0),
         bool deform = true);
 
+    virtual void rasterizeTile(const vec3d &tileCoords, GraphPtr g, CPURasterizer &r);
+
+    /**
+     * Builds a mesh containing the areas of the given tile, and a mesh
+     * containing all the rivers that are drawn with an opaque color in this
+     * tile. Thinner rivers, drawn with a width dependent transparency, are
+     * drawn one by one in #doCreateTile.
+     */
+    virtual void buildTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes);
+
     virtual void swap(ptr<WaterOrthoLayer> p);
 
 private:
@@ -106,11 +118,6 @@ private:
      */
     ptr< Mesh<vec2f, unsigned int> > mesh;
 
-    /**
-     * The tesselator used for drawing areas.
-     */
-    ptr<Tesselator> tess;
-
     ptr<Uniform3f> tileOffsetU;
 
     ptr<Uniform4f> colorU;
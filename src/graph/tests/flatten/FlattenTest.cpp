@@ -0,0 +1,130 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+/*
+ * Checks that Graph#flatten and Graph#flattenUpdate give exactly the same
+ * curves when executed sequentially (as in GraphProducer tasks) and with
+ * several threads. Returns 0 if this is the case, 1 otherwise.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "proland/graph/BasicGraph.h"
+
+using namespace std;
+using namespace ork;
+using namespace proland;
+
+/**
+ * Returns a pseudo random number between 0 and max.
+ */
+static double frand(double max)
+{
+    return (rand() % 100000) / 100000.0 * max;
+}
+
+/**
+ * Adds 'count' curves made of line segments and of quadratic and cubic
+ * Bezier arcs to the given graph. The graph content only depends on
+ * 'seed'. The added curves are stored in 'curves' and in
+ * changes.addedCurves.
+ */
+static void addCurves(Graph *g, int count, unsigned int seed, vector<CurvePtr> &curves, Graph::Changes &changes)
+{
+    srand(seed);
+    for (int i = 0; i < count; ++i) {
+        vec2d a(frand(1000), frand(1000));
+        vec2d b = a + vec2d(frand(100) - 50, frand(100) - 50);
+        CurvePtr c = g->addCurve(a, b, changes);
+        int n = 1 + rand() % 9;
+        for (int j = 0; j < n; ++j) {
+            vec2d p = a + (b - a) * ((j + 1.0) / (n + 1)) + vec2d(frand(20) - 10, frand(20) - 10);
+            // never more than two consecutive control vertices
+            c->addVertex(p, j + 1, j % 3 != 0);
+        }
+        curves.push_back(c);
+        changes.addedCurves.insert(c->getId());
+    }
+}
+
+/**
+ * Returns the number of curves in 'c' that are not bit identical to the
+ * corresponding curves in 'd'. The curves must be compared in creation
+ * order since the curve ids of a BasicGraph are pointers.
+ */
+static int compareCurves(const vector<CurvePtr> &c, const vector<CurvePtr> &d)
+{
+    int errors = 0;
+    for (unsigned int i = 0; i < c.size(); ++i) {
+        bool equal = c[i]->getSize() == d[i]->getSize();
+        for (int j = 0; equal && j < c[i]->getSize(); ++j) {
+            Vertex u = c[i]->getVertex(j);
+            Vertex v = d[i]->getVertex(j);
+            equal = u.x == v.x && u.y == v.y && u.s == v.s && u.isControl == v.isControl;
+        }
+        if (!equal) {
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+int main(int argc, char* argv[])
+{
+    const float squareFlatness = 0.01f;
+    int errors = 0;
+
+    GraphPtr serial = new BasicGraph();
+    GraphPtr parallel = new BasicGraph();
+    Graph::Changes serialChanges;
+    Graph::Changes parallelChanges;
+    vector<CurvePtr> serialCurves;
+    vector<CurvePtr> parallelCurves;
+    addCurves(serial.get(), 5000, 1, serialCurves, serialChanges);
+    addCurves(parallel.get(), 5000, 1, parallelCurves, parallelChanges);
+
+    serial->flatten(squareFlatness, 1);
+    parallel->flatten(squareFlatness, 4);
+    int flattenErrors = compareCurves(serialCurves, parallelCurves);
+    printf("flatten: %d different curves\n", flattenErrors);
+    errors += flattenErrors;
+
+    serialChanges.clear();
+    parallelChanges.clear();
+    addCurves(serial.get(), 1000, 2, serialCurves, serialChanges);
+    addCurves(parallel.get(), 1000, 2, parallelCurves, parallelChanges);
+
+    serial->flattenUpdate(serialChanges, squareFlatness, 1);
+    parallel->flattenUpdate(parallelChanges, squareFlatness, 4);
+    int updateErrors = compareCurves(serialCurves, parallelCurves);
+    printf("flattenUpdate: %d different curves\n", updateErrors);
+    errors += updateErrors;
+
+    return errors == 0 ? 0 : 1;
+}
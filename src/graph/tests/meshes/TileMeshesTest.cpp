@@ -0,0 +1,162 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+/*
+ * Builds the meshes of a synthetic graph tile with GraphLayer#addCurve, as
+ * in the GraphLayer#buildTileMeshes methods of the ortho layers, and checks
+ * that each curve of n vertices is batched as 2*n vertices and 6*(n-1)
+ * indices referring only to its own vertices. This does not need an OpenGL
+ * context. Returns 0 if all the checks succeed, 1 otherwise.
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "proland/graph/BasicGraph.h"
+#include "proland/graph/producer/GraphLayer.h"
+
+using namespace std;
+using namespace ork;
+using namespace proland;
+
+/**
+ * A GraphLayer that batches all the curves of a graph tile in two meshes,
+ * one with vec2f vertices and one with vec4f vertices.
+ */
+class TileMeshesLayer : public GraphLayer
+{
+public:
+    TileMeshesLayer() : GraphLayer("TileMeshesLayer")
+    {
+    }
+
+    virtual bool doCreateTile(int level, int tx, int ty, TileStorage::Slot *data)
+    {
+        return true;
+    }
+
+    void getMeshes(GraphPtr g, vector< ptr<Object> > &meshes)
+    {
+        getTileMeshes(0, 0, 0, g, meshes);
+    }
+
+protected:
+    virtual void buildTileMeshes(int level, int tx, int ty, GraphPtr g, vector< ptr<Object> > &meshes)
+    {
+        vec3d tileOffset = vec3d(0.0, 0.0, 0.01);
+        ptr< Mesh<vec2f, unsigned int> > m2 = new Mesh<vec2f, unsigned int>(TRIANGLES, CPU);
+        ptr< Mesh<vec4f, unsigned int> > m4 = new Mesh<vec4f, unsigned int>(TRIANGLES, CPU);
+        ptr<Graph::CurveIterator> ci = g->getCurves();
+        while (ci->hasNext()) {
+            CurvePtr p = ci->next();
+            addCurve(tileOffset, p, p->getWidth(), 1.0f, *m2);
+            addCurve(tileOffset, p, NULL, p->getWidth(), *m4);
+        }
+        meshes.push_back(m2);
+        meshes.push_back(m4);
+    }
+};
+
+/**
+ * Checks the vertices and indices of the given mesh, which must contain
+ * the given curves, in this order. Returns the number of errors.
+ */
+template<typename vertex>
+static int checkMesh(const char *name, Mesh<vertex, unsigned int> *mesh, const vector<CurvePtr> &curves)
+{
+    int errors = 0;
+    int vertexCount = 0;
+    int indiceCount = 0;
+    for (unsigned int i = 0; i < curves.size(); ++i) {
+        int n = curves[i]->getSize();
+        unsigned int base = vertexCount;
+        for (int j = indiceCount; j < indiceCount + 6 * (n - 1) && j < mesh->getIndiceCount(); ++j) {
+            unsigned int k = mesh->getIndice(j);
+            if (k < base || k >= base + 2 * n) {
+                printf("%s: curve %d uses vertex %d, outside [%d,%d[\n", name, i, k, base, base + 2 * n);
+                ++errors;
+                break;
+            }
+        }
+        vertexCount += 2 * n;
+        indiceCount += 6 * (n - 1);
+    }
+    if (mesh->getVertexCount() != vertexCount) {
+        printf("%s: %d vertices instead of %d\n", name, mesh->getVertexCount(), vertexCount);
+        ++errors;
+    }
+    if (mesh->getIndiceCount() != indiceCount) {
+        printf("%s: %d indices instead of %d\n", name, mesh->getIndiceCount(), indiceCount);
+        ++errors;
+    }
+    printf("%s: %d curves, %d vertices, %d indices: %s\n", name, (int) curves.size(), vertexCount, indiceCount, errors == 0 ? "ok" : "FAILED");
+    return errors;
+}
+
+int main(int argc, char* argv[])
+{
+    // a synthetic tile graph with curves of 2 to 17 vertices, some of them
+    // sharing their extremities
+    GraphPtr g = new BasicGraph();
+    Graph::Changes changes;
+    vector<CurvePtr> added;
+    NodePtr prev = NULL;
+    for (int i = 0; i < 64; ++i) {
+        vec2d a = vec2d(10.0 * (i % 8), 10.0 * (i / 8));
+        vec2d b = a + vec2d(8.0, 3.0);
+        CurvePtr c = prev != NULL && i % 4 != 0 ? g->addCurve(prev->getId(), b, changes) : g->addCurve(a, b, changes);
+        vec2d s = c->getXY(0);
+        int n = i % 16;
+        for (int j = 0; j < n; ++j) {
+            double t = (j + 1.0) / (n + 1.0);
+            c->addVertex(s + (b - s) * t + vec2d(0.0, (j % 2) * 0.5), j + 1, false);
+        }
+        c->setWidth(1.0f + (i % 3));
+        prev = c->getEnd();
+        added.push_back(c);
+    }
+
+    ptr<TileMeshesLayer> layer = new TileMeshesLayer();
+    vector< ptr<Object> > meshes;
+    layer->getMeshes(g, meshes);
+
+    // the curves must be checked in the order of the graph iterator
+    vector<CurvePtr> curves;
+    ptr<Graph::CurveIterator> ci = g->getCurves();
+    while (ci->hasNext()) {
+        curves.push_back(ci->next());
+    }
+
+    int errors = 0;
+    if (meshes.size() != 2 || curves.size() != added.size()) {
+        printf("%d meshes, %d curves\n", (int) meshes.size(), (int) curves.size());
+        return 1;
+    }
+    errors += checkMesh("vec2f mesh", meshes[0].cast< Mesh<vec2f, unsigned int> >().get(), curves);
+    errors += checkMesh("vec4f mesh", meshes[1].cast< Mesh<vec4f, unsigned int> >().get(), curves);
+    return errors == 0 ? 0 : 1;
+}
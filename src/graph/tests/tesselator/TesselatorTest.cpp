@@ -0,0 +1,233 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+/*
+ * Reference cases for the Tesselator: triangulates simple surfaces and
+ * checks the number of triangles, their total area, and how many times
+ * some sample points are covered. Returns 0 if all the cases give the
+ * expected results, 1 otherwise.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "proland/graph/producer/Tesselator.h"
+
+using namespace std;
+using namespace ork;
+using namespace proland;
+
+/**
+ * The contours of a surface to triangulate.
+ */
+typedef vector< vector<vec2f> > Contours;
+
+/**
+ * A sample point, and the number of triangles that must cover it.
+ */
+struct Sample
+{
+    float x;
+
+    float y;
+
+    int coverage;
+};
+
+/**
+ * Returns a rectangle, in counter clockwise order if 'ccw' is true.
+ */
+static vector<vec2f> rectangle(float xmin, float ymin, float xmax, float ymax, bool ccw = true)
+{
+    vector<vec2f> r;
+    r.push_back(vec2f(xmin, ymin));
+    if (ccw) {
+        r.push_back(vec2f(xmax, ymin));
+        r.push_back(vec2f(xmax, ymax));
+        r.push_back(vec2f(xmin, ymax));
+    } else {
+        r.push_back(vec2f(xmin, ymax));
+        r.push_back(vec2f(xmax, ymax));
+        r.push_back(vec2f(xmax, ymin));
+    }
+    return r;
+}
+
+/**
+ * Returns a star polygon with n branches, whose vertices are alternatively
+ * at distance r0 and r1 from the origin.
+ */
+static vector<vec2f> star(int n, float r0, float r1)
+{
+    vector<vec2f> s;
+    for (int i = 0; i < 2 * n; ++i) {
+        double a = M_PI * i / n;
+        double r = i % 2 == 0 ? r1 : r0;
+        s.push_back(vec2f(float(r * cos(a)), float(r * sin(a))));
+    }
+    return s;
+}
+
+/**
+ * Returns twice the signed area of the triangle abc.
+ */
+static double cross(const vec2f &a, const vec2f &b, const vec2f &c)
+{
+    return double(b.x - a.x) * double(c.y - a.y) - double(b.y - a.y) * double(c.x - a.x);
+}
+
+/**
+ * Triangulates the given contours, and checks the number of triangles,
+ * their total area, and the coverage of the given sample points. Returns
+ * true if the result is the expected one.
+ */
+static bool check(const char *name, const Contours &contours, int triangleCount, double area, const Sample *samples, int sampleCount)
+{
+    vector<vec2f> vertices;
+    vector<unsigned int> indices;
+    Tesselator t;
+    t.beginPolygon(vertices, indices);
+    for (unsigned int i = 0; i < contours.size(); ++i) {
+        t.beginContour();
+        for (unsigned int j = 0; j < contours[i].size(); ++j) {
+            t.newVertex(contours[i][j].x, contours[i][j].y);
+        }
+        t.endContour();
+    }
+    t.endPolygon();
+
+    bool ok = indices.size() == 3 * (unsigned int) triangleCount;
+    if (!ok) {
+        printf("%s: %d triangles instead of %d\n", name, (int) indices.size() / 3, triangleCount);
+    }
+    double a = 0.0;
+    for (unsigned int i = 0; i < indices.size(); i += 3) {
+        a += fabs(cross(vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]])) / 2.0;
+    }
+    if (fabs(a - area) > 1e-3 * area) {
+        printf("%s: area %g instead of %g\n", name, a, area);
+        ok = false;
+    }
+    for (int i = 0; i < sampleCount; ++i) {
+        vec2f p = vec2f(samples[i].x, samples[i].y);
+        int coverage = 0;
+        for (unsigned int j = 0; j < indices.size(); j += 3) {
+            double d0 = cross(vertices[indices[j]], vertices[indices[j + 1]], p);
+            double d1 = cross(vertices[indices[j + 1]], vertices[indices[j + 2]], p);
+            double d2 = cross(vertices[indices[j + 2]], vertices[indices[j]], p);
+            if ((d0 > 0 && d1 > 0 && d2 > 0) || (d0 < 0 && d1 < 0 && d2 < 0)) {
+                ++coverage;
+            }
+        }
+        if (coverage != samples[i].coverage) {
+            printf("%s: point (%g,%g) covered %d times instead of %d\n", name, p.x, p.y, coverage, samples[i].coverage);
+            ok = false;
+        }
+    }
+    printf("%s: %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    int errors = 0;
+    Contours c;
+
+    // a square with a square hole, with both orientations for the hole
+    Sample squareHole[] = { { 0.5f, 0.25f, 0 }, { 5.5f, 0.25f, 1 }, { 0.5f, -7.25f, 1 }, { 9.5f, 0.25f, 0 } };
+    c.clear();
+    c.push_back(rectangle(-8, -8, 8, 8));
+    c.push_back(rectangle(-3, -3, 3, 3));
+    errors += !check("square with hole", c, 8, 220.0, squareHole, 4);
+    c.clear();
+    c.push_back(rectangle(-8, -8, 8, 8));
+    c.push_back(rectangle(-3, -3, 3, 3, false));
+    errors += !check("square with reversed hole", c, 8, 220.0, squareHole, 4);
+
+    // nested squares (odd winding rule)
+    Sample nested[] = { { 0.5f, 0.25f, 1 }, { 4.5f, 0.25f, 0 }, { 7.5f, 0.25f, 1 }, { 9.5f, 0.25f, 0 } };
+    c.clear();
+    c.push_back(rectangle(-9, -9, 9, 9));
+    c.push_back(rectangle(-6, -6, 6, 6));
+    c.push_back(rectangle(-3, -3, 3, 3));
+    errors += !check("nested squares", c, 10, 216.0, nested, 4);
+
+    // adjacent squares sharing edges, with both orientations
+    Sample adjacent[] = { { -4.5f, -4.25f, 1 }, { 4.5f, -4.25f, 1 }, { -4.5f, 4.25f, 1 }, { 4.5f, 4.25f, 1 } };
+    c.clear();
+    c.push_back(rectangle(-8, -8, 0, 0));
+    c.push_back(rectangle(0, -8, 8, 0, false));
+    c.push_back(rectangle(-8, 0, 0, 8));
+    c.push_back(rectangle(0, 0, 8, 8));
+    errors += !check("adjacent squares", c, 8, 256.0, adjacent, 4);
+
+    // a square with duplicated points, and a closing point
+    Sample square[] = { { 0.5f, 0.25f, 1 }, { -7.5f, 7.25f, 1 }, { 9.5f, 0.25f, 0 } };
+    vector<vec2f> r = rectangle(-8, -8, 8, 8);
+    vector<vec2f> duplicates;
+    for (unsigned int i = 0; i < r.size(); ++i) {
+        duplicates.push_back(r[i]);
+        duplicates.push_back(r[i]);
+    }
+    duplicates.push_back(r[0]);
+    c.clear();
+    c.push_back(duplicates);
+    errors += !check("duplicate points", c, 2, 256.0, square, 3);
+
+    // a square with collinear points in the middle of its edges
+    vector<vec2f> collinear;
+    collinear.push_back(vec2f(-8, -8));
+    collinear.push_back(vec2f(0, -8));
+    collinear.push_back(vec2f(8, -8));
+    collinear.push_back(vec2f(8, 8));
+    collinear.push_back(vec2f(-8, 8));
+    collinear.push_back(vec2f(-8, 0));
+    c.clear();
+    c.push_back(collinear);
+    errors += !check("collinear points", c, 4, 256.0, square, 3);
+
+    // a star polygon with 12 branches, alone and with a hole
+    double starArea = 24 * 0.5 * 4 * 9 * sin(M_PI / 12);
+    Sample starSamples[] = { { 0.5f, 0.25f, 1 }, { 8.5f, 0.05f, 1 }, { 6.0f, 1.5f, 0 } };
+    c.clear();
+    c.push_back(star(12, 4, 9));
+    errors += !check("star", c, 22, starArea, starSamples, 3);
+    Sample starHoleSamples[] = { { 0.5f, 0.25f, 0 }, { 2.5f, 0.25f, 1 }, { 8.5f, 0.05f, 1 } };
+    c.push_back(rectangle(-1, -1, 1, 1));
+    errors += !check("star with hole", c, 28, starArea - 4.0, starHoleSamples, 3);
+
+    // crossing contours: triangulated independently, so that their common
+    // part is covered twice (the GLU tesselator leaves it empty)
+    Sample crossing[] = { { 2.5f, 2.25f, 2 }, { -2.5f, -2.25f, 1 }, { 6.5f, 6.25f, 1 }, { -2.5f, 6.25f, 0 } };
+    c.clear();
+    c.push_back(rectangle(-4, -4, 4, 4));
+    c.push_back(rectangle(0, 0, 8, 8));
+    errors += !check("crossing squares", c, 4, 128.0, crossing, 4);
+
+    return errors == 0 ? 0 : 1;
+}
@@ -28,11 +28,14 @@
 #include "proland/rivers/AnimatedPerlinWaveTile.h"
 
 #include <climits>
+#include <sstream>
 #include "GL/glew.h"
 
 #include "ork/render/CPUBuffer.h"
 #include "ork/resource/ResourceTemplate.h"
 
+#include "proland/util/parallel.h"
+
 using namespace std;
 using namespace ork;
 
@@ -183,128 +186,79 @@ AnimatedPerlinWaveTile::AnimatedPerlinWaveTile() : WaveTile()
 {
 }
 
-AnimatedPerlinWaveTile::AnimatedPerlinWaveTile(string &name, int gridSize, int tileSize, float waveLength, int timeLoop)
+AnimatedPerlinWaveTile::AnimatedPerlinWaveTile(string &name, int gridSize, int tileSize, float waveLength, int timeLoop, const string &cacheDir)
 {
-    init(name, gridSize, tileSize, waveLength, timeLoop);
+    init(name, gridSize, tileSize, waveLength, timeLoop, cacheDir);
 }
 
 AnimatedPerlinWaveTile::~AnimatedPerlinWaveTile()
 {
 }
 
-void AnimatedPerlinWaveTile::init(ptr<Texture2D> texture, int size, int numLodLevel, int t, unsigned int seed)
+/**
+ * The data used to compute the frames of an AnimatedPerlinWaveTile.
+ */
+struct AnimatedPerlinWaveFrames
 {
-    Noise noise(seed);
-    int tw = 4;
-//    m_normalMaps = new GLuint[tsize];
-//    m_texNormalMaps = new TextureID[tsize];
+    const void *noise;
 
-    float** hd = new float*[numLodLevel];
-    int nsize = size;
-    for(int i = 0; i < numLodLevel;i++)
-    {
-        hd[i] = new float[nsize*nsize];
-        nsize /= 2;
-    }
+    int size;
 
+    int numLodLevels;
 
-    //generate height field;
-    int n = 4;//m_numOctave;
-    float p = 0.5;//m_persistence;
-    for(int i = 0; i < size*size; i++)
-        hd[0][i]=0;
+    int timeLoop;
 
-    int w = 32;
-    float u = 1.0;
+    float *data;
+};
 
-    for(int k = 0; k < n; k++)
-    {
+void AnimatedPerlinWaveTile::computeFrames(void *context, int begin, int end)
+{
+    AnimatedPerlinWaveFrames *f = (AnimatedPerlinWaveFrames*) context;
+    const Noise &noise = *((const Noise*) f->noise);
+    int size = f->size;
+    int frameSize = getWaveDataSize(size, f->numLodLevels);
+    int tw = 4;
+
+    float *heights = new float[size * size];
+    for (int t = begin; t < end; ++t) {
+        //generate height field;
+        int n = 4;//m_numOctave;
+        float p = 0.5;//m_persistence;
+        for (int i = 0; i < size * size; i++) {
+            heights[i] = 0;
+        }
+
+        int w = 32;
+        float u = 1.0;
+        for (int k = 0; k < n; k++) {
             int i = 0;
-            for(int r = 0; r < size; r++)
-            {
-                for(int c = 0; c < size; c++)
-                {
-                    float x = (c/(float)size) * w;
-                    float y = (r/(float)size) * w;
-                    float z = (t/(float)timeLoop) * tw;
-
-                    float pn = noise(x, y, z, w, tw);
-                    pn *= u;
-                    hd[0][i] += pn;
-                    i++;
+            for (int r = 0; r < size; r++) {
+                for (int c = 0; c < size; c++) {
+                    float x = (c / (float) size) * w;
+                    float y = (r / (float) size) * w;
+                    float z = (t / (float) f->timeLoop) * tw;
+                    heights[i++] += noise(x, y, z, w, tw) * u;
                 }
             }
             u *= p;
             w *= 2;
-    }
-
-
-    //generate mipmap
-    nsize = size;
-    for(int i = 1; i < numLodLevel; i++)
-    {
-        int hsize = nsize/2;
-        for(int r = 0; r < hsize; r++)
-        {
-            for(int c = 0; c < hsize; c++)
-            {
-                int k = r * hsize + c;
-                int k0 = (2*r) * nsize + (2*c);
-                int k1 = (2*r) * nsize + (2*c)+1;
-                int k2 = (2*r+1) * nsize + (2*c);
-                int k3 = (2*r+1) * nsize + (2*c)+1;
-
-                hd[i][k] = 1/4.0*(hd[i-1][k0]+hd[i-1][k1]+hd[i-1][k2]+hd[i-1][k3]);
-
-            }
         }
-
-        nsize /= 2;
-    }
-
-    float* texData = new float[size * size * 3];
-
-    float scale = .5;
-    nsize = size;
-    for(int level = 0; level < numLodLevel; level++)
-    {
-        int k = 0;
-        for(int r = 0; r < nsize; r++)
-        {
-            for(int c = 0; c <nsize; c++)
-            {
-
-                float nx;
-                if ( c < (nsize -1 ))
-                    nx = hd[level][ r * nsize + c + 1 ] - hd[level][ r * nsize + c];
-                else
-                    nx = hd[level][r*nsize] - hd[level][r*nsize + c];
-
-                float ny;
-                if ( r > 0)
-                    ny = hd[level][ (r - 1) * nsize + c] - hd[level][ r * nsize + c];
-                else
-                    ny = hd[level][ r * nsize + c] - hd[level][c];
-
-
-                texData[3*k] = nx * scale;//rand()/(float)RAND_MAX; //nx  ;
-                texData[3*k + 1] =ny * scale;//rand()/(float)RAND_MAX;//ny; //exData[3*k];
-                texData[3*k + 2] = 1.0;
-
-                k++;
-            }
-        }
-
-
-        texture->setSubImage(level, 0, 0, nsize, nsize, RGB, FLOAT, Buffer::Parameters(), CPUBuffer(texData));
-        nsize /= 2;
+        computeWaveLevels(heights, size, f->numLodLevels, f->data + t * frameSize);
     }
+    delete[] heights;
+}
 
-    delete []texData;
-    for(int i = 0; i < numLodLevel; i++)
-        delete []hd[i];
-    delete []hd;
-
+float *AnimatedPerlinWaveTile::createWaveData(int size, int numLodLevels, int timeLoop, unsigned int seed, int threadCount)
+{
+    Noise noise(seed);
+    AnimatedPerlinWaveFrames f;
+    f.noise = &noise;
+    f.size = size;
+    f.numLodLevels = numLodLevels;
+    f.timeLoop = timeLoop;
+    f.data = new float[timeLoop * getWaveDataSize(size, numLodLevels)];
+    parallelFor(0, timeLoop, computeFrames, &f, 1, threadCount);
+    return f.data;
 }
 
 void AnimatedPerlinWaveTile::updateUniform(ptr<Program> p)
@@ -328,19 +282,42 @@ void AnimatedPerlinWaveTile::updateUniform(ptr<Program> p)
     }
 }
 
-void AnimatedPerlinWaveTile::init(string &name, int gridSize, int tileSize, float waveLength, int timeLoop)
+void AnimatedPerlinWaveTile::init(string &name, int gridSize, int tileSize, float waveLength, int timeLoop, const string &cacheDir)
 {
     WaveTile::init(name, NULL, gridSize, tileSize, waveLength, timeLoop);
 
     int size = gridSize;
     int numLodLevel = int(log((double)size) / log(2.0)) + 1;
+    int frameSize = getWaveDataSize(size, numLodLevel);
 
     unsigned int seed = rand();
+
+    string file;
+    vector<int> key;
+    float *data = NULL;
+    if (cacheDir.size() > 0) {
+        ostringstream oss;
+        oss << cacheDir << "/animatedPerlinWaveTile_" << size << "_" << timeLoop << "_" << seed << ".dat";
+        file = oss.str();
+        key.push_back(size);
+        key.push_back(numLodLevel);
+        key.push_back(timeLoop);
+        key.push_back(int(seed));
+        data = loadWaveData(file, key, timeLoop * frameSize);
+    }
+    if (data == NULL) {
+        data = createWaveData(size, numLodLevel, timeLoop, seed);
+        if (cacheDir.size() > 0) {
+            saveWaveData(file, key, data, timeLoop * frameSize);
+        }
+    }
+
     for (int i = 0; i < timeLoop; i++) {
         ptr<Texture2D> T = new Texture2D(size, size, RGB16F, RGB, FLOAT, Texture::Parameters().wrapS(REPEAT).wrapT(REPEAT).min(LINEAR_MIPMAP_LINEAR).mag(LINEAR).lodMin(0).lodMax(numLodLevel).maxAnisotropyEXT(16.0f), Buffer::Parameters(), CPUBuffer(0));
-        init(T, size, numLodLevel, i, seed);
+        setWaveLevels(T, size, numLodLevel, data + i * frameSize);
         tex.push_back(T);
     }
+    delete[] data;
 }
 
 void AnimatedPerlinWaveTile::swap(ptr<AnimatedPerlinWaveTile> t)
@@ -357,7 +334,7 @@ public:
     {
         e = e == NULL ? desc->descriptor : e;
 
-        checkParameters(desc, e, "name,samplerName,tileSize,gridSize,waveLength,timeLoop,");
+        checkParameters(desc, e, "name,samplerName,tileSize,gridSize,waveLength,timeLoop,cacheDir,");
 
         int gridSize = 256;
         int tileSize = 1;
@@ -377,7 +354,11 @@ public:
         if (e->Attribute("timeLoop") != NULL) {
             getIntParameter(desc, e, "timeLoop", &timeLoop);
         }
-        init(sName, gridSize, tileSize, waveLength, timeLoop);
+        string cacheDir;
+        if (e->Attribute("cacheDir") != NULL) {
+            cacheDir = getParameter(desc, e, "cacheDir");
+        }
+        init(sName, gridSize, tileSize, waveLength, timeLoop, cacheDir);
     }
 };
 
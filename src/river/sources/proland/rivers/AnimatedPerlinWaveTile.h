@@ -46,14 +46,35 @@ public:
     /**
      * Creates a new AnimatedPerlinWaveTile.
      * See WaveTile#WaveTile().
+     *
+     * @param cacheDir an optional directory where the computed wave profiles
+     *      are saved, to be reloaded instead of being recomputed when
+     *      another AnimatedPerlinWaveTile with the same parameters is created.
      */
-    AnimatedPerlinWaveTile(std::string &name, int tileSize, int gridSize, float waveLength, int timeLoop);
+    AnimatedPerlinWaveTile(std::string &name, int tileSize, int gridSize, float waveLength, int timeLoop, const std::string &cacheDir = "");
 
     /**
      * Deletes an AnimatedPerlinWaveTile.
      */
     virtual ~AnimatedPerlinWaveTile();
 
+    /**
+     * Computes the wave profiles of an AnimatedPerlinWaveTile on CPU. The
+     * profiles of each frame are stored one after the other, in the format
+     * described in WaveTile#computeWaveLevels. The frames are computed in
+     * parallel.
+     *
+     * @param size the texture size.
+     * @param numLodLevels the number of mipmap levels to compute.
+     * @param timeLoop the number of frames.
+     * @param seed the seed of the noise function.
+     * @param threadCount the maximum number of threads to use, or 0 to use
+     *      one thread per processor. The result does not depend on this value.
+     * @return the computed data, of size timeLoop*WaveTile#getWaveDataSize.
+     *      The caller must delete it.
+     */
+    static float *createWaveData(int size, int numLodLevels, int timeLoop, unsigned int seed, int threadCount = 0);
+
     /**
      * See WaveTile#updateUniform().
      */
@@ -104,15 +125,15 @@ protected:
 
     /**
      * Initializes the fields of a AnimatedPerlinWaveTile.
-     * See WaveTile#init().
+     * See #AnimatedPerlinWaveTile.
      */
-    void init(ptr<Texture2D> t, int size, int numLodLevels, int timeLoop, unsigned int seed);
+    virtual void init(std::string &name, int tileSize, int gridSize, float waveLength, int timeLoop, const std::string &cacheDir = "");
 
     /**
-     * Initializes the fields of a AnimatedPerlinWaveTile.
-     * See WaveTile#init().
+     * Computes some frames of #createWaveData. This method is a
+     * ParallelLoopBody.
      */
-    virtual void init(std::string &name, int tileSize, int gridSize, float waveLength, int timeLoop);
+    static void computeFrames(void *context, int begin, int end);
 
     virtual void swap(ptr<AnimatedPerlinWaveTile> t);
 
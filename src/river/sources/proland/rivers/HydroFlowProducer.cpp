@@ -77,12 +77,12 @@ HydroFlowProducer::HydroFlowProducer() : TileProducer("HydroFlowProducer", "Crea
 {
 }
 
-HydroFlowProducer::HydroFlowProducer(ptr<GraphProducer> graphs, ptr<TileCache> cache, int displayTileSize, float slipParameter, float searchRadiusFactor, float potentialDelta, int minLevel) : TileProducer("HydroFlowProducer", "CreateHydroData")
+HydroFlowProducer::HydroFlowProducer(ptr<GraphProducer> graphs, ptr<TileCache> cache, int displayTileSize, float slipParameter, float searchRadiusFactor, float potentialDelta, int minLevel, bool precomputePotentials) : TileProducer("HydroFlowProducer", "CreateHydroData")
 {
-    init(graphs, cache, displayTileSize, slipParameter, searchRadiusFactor, potentialDelta, minLevel);
+    init(graphs, cache, displayTileSize, slipParameter, searchRadiusFactor, potentialDelta, minLevel, precomputePotentials);
 }
 
-void HydroFlowProducer::init(ptr<GraphProducer> graphs, ptr<TileCache> cache, int displayTileSize, float slipParameter, float searchRadiusFactor, float potentialDelta, int minLevel)
+void HydroFlowProducer::init(ptr<GraphProducer> graphs, ptr<TileCache> cache, int displayTileSize, float slipParameter, float searchRadiusFactor, float potentialDelta, int minLevel, bool precomputePotentials)
 {
     TileProducer::init(cache, false);
     CurveDataFactory::init(graphs);
@@ -92,6 +92,7 @@ void HydroFlowProducer::init(ptr<GraphProducer> graphs, ptr<TileCache> cache, in
     this->searchRadiusFactor = searchRadiusFactor;
     this->potentialDelta = potentialDelta;
     this->minLevel = minLevel;
+    this->precomputePotentials = precomputePotentials;
 
     float borderFactor = displayTileSize / (displayTileSize - 1.0f - 2.0f * getBorder()) - 1.0f;
     this->graphs->addMargin(new RiverMargin(displayTileSize - 2 * getBorder(), borderFactor));
@@ -301,6 +302,9 @@ bool HydroFlowProducer::doCreateTile(int level, int tx, int ty, TileStorage::Slo
             }
             hydroData = new HydroFlowTile(ox, oy, quadSize, slipParameter, min((int) (quadSize / potentialDelta), displayTileSize), searchRadiusFactor);
             hydroData->addBanks(banks, width);
+            if (precomputePotentials) {
+                hydroData->computePotentials();
+            }
         } else {
             hydroData = new HydroFlowTile(ox, oy, quadSize, slipParameter, min((int) (quadSize / potentialDelta), displayTileSize), searchRadiusFactor);
         }
@@ -340,6 +344,7 @@ void HydroFlowProducer::swap(ptr<HydroFlowProducer> p)
     std::swap(searchRadiusFactor, p->searchRadiusFactor);
     std::swap(potentialDelta, p->potentialDelta);
     std::swap(minLevel, p->minLevel);
+    std::swap(precomputePotentials, p->precomputePotentials);
 }
 
 class HydroFlowProducerResource : public ResourceTemplate<30, HydroFlowProducer>
@@ -356,8 +361,9 @@ public:
         float searchRadiusFactor = 1.0f;
         float potentialDelta = 0.01f;
         int minLevel = 0;
+        bool precomputePotentials = false;
 
-        checkParameters(desc, e, "name,cache,graphs,displayTileSize,slip,searchRadiusFactor, potentialDelta,minLevel,");
+        checkParameters(desc, e, "name,cache,graphs,displayTileSize,slip,searchRadiusFactor, potentialDelta,minLevel,precomputePotentials,");
         cache = manager->loadResource(getParameter(desc, e, "cache")).cast<TileCache>();
         graphs = manager->loadResource(getParameter(desc, e, "graphs")).cast<GraphProducer>();
         if (e->Attribute("displayTileSize") != NULL) {
@@ -375,8 +381,11 @@ public:
         if (e->Attribute("minLevel") != NULL) {
             getIntParameter(desc, e, "minLevel", &minLevel);
         }
+        if (e->Attribute("precomputePotentials") != NULL) {
+            precomputePotentials = strcmp(e->Attribute("precomputePotentials"), "true") == 0;
+        }
 
-        init(graphs, cache, displayTileSize, slip, searchRadiusFactor, potentialDelta, minLevel);
+        init(graphs, cache, displayTileSize, slip, searchRadiusFactor, potentialDelta, minLevel, precomputePotentials);
     }
 };
 
@@ -88,10 +88,14 @@ public:
      * @param searchRadiusFactor determines the radius of a DistCell coverage.
      * @param potentialDelta radius used for potential computation.
      * @param minLevel minimum level to start creating tiles.
+     * @param precomputePotentials true to compute all the potentials of a
+     *      tile when it is created (see HydroFlowTile#computePotentials),
+     *      false to compute them lazily when particles need them.
      */
     HydroFlowProducer(ptr<GraphProducer> graphs,
         ptr<TileCache> cache, int displayTileSize, float slipParameter,
-        float searchRadiusFactor, float potentialDelta, int minLevel);
+        float searchRadiusFactor, float potentialDelta, int minLevel,
+        bool precomputePotentials = false);
 
     /**
      * Deletes this HydroFlowProducer.
@@ -175,7 +179,8 @@ protected:
      */
     void init(ptr<GraphProducer> graphs,
         ptr<TileCache> cache, int displayTileSize, float slipParameter,
-        float searchRadiusFactor, float potentialDelta, int minLevel);
+        float searchRadiusFactor, float potentialDelta, int minLevel,
+        bool precomputePotentials = false);
 
     virtual ptr<Task> startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> owner);
 
@@ -225,6 +230,12 @@ private:
      */
     int minLevel;
 
+    /**
+     * True to compute all the potentials of a tile when it is created.
+     * See HydroFlowTile#computePotentials.
+     */
+    bool precomputePotentials;
+
     friend class HydroFlowTile;
 
 };
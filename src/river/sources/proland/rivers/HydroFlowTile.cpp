@@ -584,6 +584,65 @@ void HydroFlowTile::getFourPotentials(vec2d &pos, vec4f &res, int &type)
     swLoop->end();
 }
 
+void HydroFlowTile::computePotentials()
+{
+    if (numDistCells == 0 || (int) banks.size() == 0) {
+        return;
+    }
+
+    float arrayCellSize = size / cacheSize;
+    float queryCellSize = size / (cacheSize - 1);
+    float cellSize = size / numDistCells;
+    set<int> bankIds;
+    map<int, float> distances;
+
+    for (int j = 0; j < cacheSize; ++j) {
+        for (int i = 0; i < cacheSize; ++i) {
+            float &potential = potentials[i + j * cacheSize];
+            if (isFinite(potential) || potential < 0) {
+                continue;
+            }
+            vec2d pos = vec2d(ox, oy) + vec2d(i * arrayCellSize, j * arrayCellSize);
+            potential = -INFINITY;
+            // in #getFourPotentials the river and banks used to compute
+            // this potential are those of the particle; here we use those
+            // of this point or, if it is not in a river, of the center of
+            // one of the cells that have this point as corner
+            for (int k = 0; k < 5; ++k) {
+                vec2d q = pos;
+                if (k > 0) {
+                    int ci = i - 1 + (k - 1) % 2;
+                    int cj = j - 1 + (k - 1) / 2;
+                    if (ci < 0 || cj < 0 || ci >= cacheSize - 1 || cj >= cacheSize - 1) {
+                        continue;
+                    }
+                    q = vec2d(ox, oy) + vec2d((ci + 0.5) * queryCellSize, (cj + 0.5) * queryCellSize);
+                }
+                int x = min((int) ((q.x - ox) / cellSize), numDistCells - 1);
+                int y = min((int) ((q.y - oy) / cellSize), numDistCells - 1);
+                DistCell *d = &distCells[x + y * numDistCells];
+                int riverId;
+                if ((int) d->bankIds.size() < 3 || !isInRiver(q, d, riverId)) {
+                    continue;
+                }
+                bankIds.clear();
+                getLinkedEdges(q, d, riverId, bankIds);
+                if (bankIds.size() < 2) {
+                    continue;
+                }
+                float p = 0.0f;
+                int type = FlowTile::OUTSIDE;
+                getDistancesToBanks(pos, d, bankIds, distances);
+                getPotential(pos, distances, p, type);
+                if (type < FlowTile::OUTSIDE && isFinite(p)) {
+                    potential = p;
+                }
+                break;
+            }
+        }
+    }
+}
+
 void HydroFlowTile::getVelocity(vec2d &pos, vec2d &velocity, int &type)
 {
     swTotalH->start();
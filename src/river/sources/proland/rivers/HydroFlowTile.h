@@ -98,6 +98,21 @@ public:
      */
     virtual void getVelocity(vec2d &pos, vec2d &velocity, int &type);
 
+    /**
+     * Computes the potentials at all the points of the potentials cache
+     * that have not been computed yet. Otherwise these potentials are
+     * computed lazily, in #getVelocity, the first time a particle enters
+     * the corresponding cell. After this method has been called,
+     * #getVelocity only performs lookups in this cache. The velocity is
+     * the gradient of the bilinear interpolation of the 4 potentials
+     * around the particle, so its error is the same as in lazy mode (it
+     * depends on the cache resolution size / cacheSize). But the cells
+     * where the velocity is defined can be slightly different near the
+     * banks, since the banks used for a potential do not depend on the
+     * particle that triggered its computation.
+     */
+    void computePotentials();
+
     /**
      * Checks if a given tile has the corresponding parameters.
      * Returns false if the tile has any of its fields different from those parameters.
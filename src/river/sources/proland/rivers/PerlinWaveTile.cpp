@@ -27,9 +27,13 @@
 
 #include "proland/rivers/PerlinWaveTile.h"
 
+#include <sstream>
+
 #include "ork/render/CPUBuffer.h"
 #include "ork/resource/ResourceTemplate.h"
 
+#include "proland/util/parallel.h"
+
 using namespace std;
 using namespace ork;
 
@@ -132,139 +136,91 @@ PerlinWaveTile::PerlinWaveTile() : WaveTile()
 {
 }
 
-PerlinWaveTile::PerlinWaveTile(string &name, int gridSize, int tileSize, float waveLength, int timeLoop) : WaveTile()
+PerlinWaveTile::PerlinWaveTile(string &name, int gridSize, int tileSize, float waveLength, int timeLoop, const string &cacheDir) : WaveTile()
 {
-    init(name, gridSize, tileSize, waveLength, timeLoop);
+    init(name, gridSize, tileSize, waveLength, timeLoop, cacheDir);
 }
 
 PerlinWaveTile::~PerlinWaveTile()
 {
 }
 
-void PerlinWaveTile::init(ptr<Texture2D> tex, int size, int numLodLevel)
+/**
+ * The data used to compute the height field of a PerlinWaveTile.
+ */
+struct PerlinWaveHeights
 {
-    Noise noise;
-       float** hd = new float* [numLodLevel];
-    int nsize = size;
-
-    for(int i = 0; i < numLodLevel;i++)
-    {
-        hd[i] = new float[nsize*nsize];
-        nsize /= 2;
-    }
-
-    //generate height field;
-    int n = 4;//m_numOctave;
-    float p = 0.5;//m_persistence;
-    for(int i = 0; i < size*size; i++) {
-        hd[0][i]=0;
-    }
-
-    int w = 32;
-    float u = 1.0;
+    const void *noise;
 
-    for(int k = 0; k < n; k++)
-    {
-        int i = 0;
-        for(int r = 0; r < size; r++)
-        {
-            for(int c = 0; c < size; c++)
-            {
-                float x = (c / (float)size) * w;
-                float y = (r / (float)size) * w;
-
-                float t = noise(x, y, w);
-                t *= u;
-                hd[0][i] += t;
-                i++;
-            }
-        }
-        u *= p;
-        w *= 2;
-    }
-
-    //generate mipmap
-    nsize = size;
-    for(int i = 1; i < numLodLevel; i++)
-    {
-        int hsize = nsize/2;
-        for(int r = 0; r < hsize; r++)
-        {
-            for(int c = 0; c < hsize; c++)
-            {
-                int k = r * hsize + c;
-                int k0 = (2 * r) * nsize + (2 * c);
-                int k1 = (2 * r) * nsize + (2 * c) + 1;
-                int k2 = (2 * r + 1) * nsize + (2 * c);
-                int k3 = (2 * r + 1) * nsize + (2 * c) + 1;
-
-                hd[i][k] = 1 / 4.0 * (hd[i - 1][k0] + hd[i - 1][k1] + hd[i - 1][k2] + hd[i - 1][k3]);
-
-            }
-        }
+    int size;
 
-        nsize /= 2;
-    }
-
-
-
-
-    //generate texture
-
-//int w, int h, internalformat tf, format f, type t, const Buffer &pixels,
-//    wrap ws, wrap wt, filter min, filter mag, int minLOD, int maxLOD, float maxAnisotropy, bool shadow, int si
-    float* texData = new float[size * size * 3];
+    float *heights;
+};
 
-    float scale = .5;
-    nsize = size;
-    for(int level = 0; level < numLodLevel; level++)
-    {
-        int k = 0;
-        for(int r = 0; r < nsize; r++)
-        {
-            for(int c = 0; c <nsize; c++)
-            {
-
-                float nx;
-                if ( c < (nsize -1 ))
-                    nx = hd[level][ r * nsize + c + 1 ] - hd[level][ r * nsize + c];
-                else
-                    nx = hd[level][r*nsize] - hd[level][r*nsize + c];
-
-                float ny;
-                if ( r > 0)
-                    ny = hd[level][ (r - 1) * nsize + c] - hd[level][ r * nsize + c];
-                else
-                    ny = hd[level][ r * nsize + c] - hd[level][c];
-
-
-                //if( level > 1) scale = 0;
-
-                    texData[3 * k] = nx * scale;//rand()/(float)RAND_MAX; //nx  ;
-                    texData[3 * k + 1] = ny * scale;//rand()/(float)RAND_MAX;//ny; //exData[3*k];
-                    texData[3 * k + 2] = 1.0;
-                k++;
+void PerlinWaveTile::computeHeights(void *context, int begin, int end)
+{
+    PerlinWaveHeights *h = (PerlinWaveHeights*) context;
+    const Noise &noise = *((const Noise*) h->noise);
+    int size = h->size;
+    for (int r = begin; r < end; ++r) {
+        for (int c = 0; c < size; ++c) {
+            float height = 0;
+            int w = 32;
+            float u = 1.0;
+            for (int k = 0; k < 4; ++k) { // octaves
+                float x = (c / (float) size) * w;
+                float y = (r / (float) size) * w;
+                height += noise(x, y, w) * u;
+                u *= 0.5; // persistence
+                w *= 2;
             }
+            h->heights[r * size + c] = height;
         }
-        tex->setSubImage(level, 0, 0, nsize, nsize, RGB, FLOAT, Buffer::Parameters(), CPUBuffer(texData));
-
-        nsize /= 2;
     }
+}
 
-    delete []texData;
-    for(int i = 0; i < numLodLevel; i++)
-        delete []hd[i];
-    delete []hd;
+float *PerlinWaveTile::createWaveData(int size, int numLodLevels, int threadCount)
+{
+    Noise noise;
+    PerlinWaveHeights h;
+    h.noise = &noise;
+    h.size = size;
+    h.heights = new float[size * size];
+    parallelFor(0, size, computeHeights, &h, 1, threadCount);
+
+    float *data = new float[getWaveDataSize(size, numLodLevels)];
+    computeWaveLevels(h.heights, size, numLodLevels, data);
+    delete[] h.heights;
+    return data;
 }
 
-void PerlinWaveTile::init(string &name, int gridSize, int tileSize, float waveLength, int timeLoop)
+void PerlinWaveTile::init(string &name, int gridSize, int tileSize, float waveLength, int timeLoop, const string &cacheDir)
 {
     int size = gridSize;
     int numLodLevel = int(log((double)size) / log(2.0)) + 1;
 
     ptr<Texture2D> t = new Texture2D(size, size, RGB16F, RGB, FLOAT, Texture::Parameters().wrapS(REPEAT).wrapT(REPEAT).min(LINEAR_MIPMAP_LINEAR).mag(LINEAR).lodMin(0).lodMax(numLodLevel).maxAnisotropyEXT(16.0f), Buffer::Parameters(), CPUBuffer(0));
 
-    init(t, size, numLodLevel);
+    string file;
+    vector<int> key;
+    float *data = NULL;
+    if (cacheDir.size() > 0) {
+        ostringstream oss;
+        oss << cacheDir << "/perlinWaveTile_" << size << ".dat";
+        file = oss.str();
+        key.push_back(size);
+        key.push_back(numLodLevel);
+        data = loadWaveData(file, key, getWaveDataSize(size, numLodLevel));
+    }
+    if (data == NULL) {
+        data = createWaveData(size, numLodLevel);
+        if (cacheDir.size() > 0) {
+            saveWaveData(file, key, data, getWaveDataSize(size, numLodLevel));
+        }
+    }
+    setWaveLevels(t, size, numLodLevel, data);
+    delete[] data;
+
     WaveTile::init(name, t, gridSize, tileSize, waveLength, timeLoop);
 }
 
@@ -281,7 +237,7 @@ public:
     {
         e = e == NULL ? desc->descriptor : e;
 
-        checkParameters(desc, e, "name,samplerName,tileSize,gridSize,waveLength,timeLoop,");
+        checkParameters(desc, e, "name,samplerName,tileSize,gridSize,waveLength,timeLoop,cacheDir,");
 
         int gridSize = 256;
         int tileSize = 1;
@@ -301,7 +257,11 @@ public:
         if (e->Attribute("timeLoop") != NULL) {
             getIntParameter(desc, e, "timeLoop", &timeLoop);
         }
-        init(sName, gridSize, tileSize, waveLength, timeLoop);
+        string cacheDir;
+        if (e->Attribute("cacheDir") != NULL) {
+            cacheDir = getParameter(desc, e, "cacheDir");
+        }
+        init(sName, gridSize, tileSize, waveLength, timeLoop, cacheDir);
     }
 };
 
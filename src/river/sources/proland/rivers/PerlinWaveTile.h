@@ -46,14 +46,31 @@ public:
     /**
      * Creates a new PerlinWaveTile.
      * See WaveTile#WaveTile().
+     *
+     * @param cacheDir an optional directory where the computed wave profiles
+     *      are saved, to be reloaded instead of being recomputed when
+     *      another PerlinWaveTile with the same parameters is created.
      */
-    PerlinWaveTile(std::string &name, int tileSize, int gridSize, float waveLength, int timeLoop);
+    PerlinWaveTile(std::string &name, int tileSize, int gridSize, float waveLength, int timeLoop, const std::string &cacheDir = "");
 
     /**
      * Deletes this PerlinWaveTile.
      */
     virtual ~PerlinWaveTile();
 
+    /**
+     * Computes the wave profiles of a PerlinWaveTile on CPU, in the format
+     * described in WaveTile#computeWaveLevels. The height field is computed
+     * in parallel.
+     *
+     * @param size the texture size.
+     * @param numLodLevels the number of mipmap levels to compute.
+     * @param threadCount the maximum number of threads to use, or 0 to use
+     *      one thread per processor. The result does not depend on this value.
+     * @return the computed data. The caller must delete it.
+     */
+    static float *createWaveData(int size, int numLodLevels, int threadCount = 0);
+
 protected:
     /**
      * 2D Noise generator. Taken from Qizhi's implementation.
@@ -99,15 +116,15 @@ protected:
 
     /**
      * Initializes the fields of a PerlinWaveTile.
-     * See WaveTile#init().
+     * See #PerlinWaveTile.
      */
-    void init(ptr<Texture2D> tex, int size, int numLodLevel);
+    virtual void init(std::string &name, int tileSize, int gridSize, float waveLength, int timeLoop, const std::string &cacheDir = "");
 
     /**
-     * Initializes the fields of a PerlinWaveTile.
-     * See WaveTile#init().
+     * Computes some rows of the height field of #createWaveData. This
+     * method is a ParallelLoopBody.
      */
-    virtual void init(std::string &name, int tileSize, int gridSize, float waveLength, int timeLoop);
+    static void computeHeights(void *context, int begin, int end);
 
     virtual void swap(ptr<PerlinWaveTile> t);
 };
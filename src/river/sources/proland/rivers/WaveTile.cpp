@@ -27,6 +27,9 @@
 
 #include "proland/rivers/WaveTile.h"
 
+#include <cstdio>
+
+#include "ork/render/CPUBuffer.h"
 #include "ork/resource/ResourceTemplate.h"
 
 using namespace std;
@@ -35,6 +38,16 @@ using namespace ork;
 namespace proland
 {
 
+/**
+ * Identifies the cache files of the wave profiles ("PWAV").
+ */
+#define WAVE_DATA_MAGIC 0x56415750
+
+/**
+ * The format version of the cache files of the wave profiles.
+ */
+#define WAVE_DATA_VERSION 1
+
 WaveTile::WaveTile() : Object("WaveTile"), tex(NULL), gridSize(0), tileSize(0), timeLoop(0), waveLength(1.0f)
 {
 }
@@ -65,6 +78,132 @@ void WaveTile::init(string &name, ptr<Texture2D> tex, int gridSize, int tileSize
     lastProgram = NULL;
 }
 
+int WaveTile::getWaveDataSize(int size, int numLodLevels)
+{
+    int n = 0;
+    for (int level = 0; level < numLodLevels; ++level) {
+        n += 3 * size * size;
+        size /= 2;
+    }
+    return n;
+}
+
+void WaveTile::computeWaveLevels(float *heights, int size, int numLodLevels, float *data)
+{
+    float scale = .5;
+    int nsize = size;
+    for (int level = 0; level < numLodLevels; ++level) {
+        if (level > 0) {
+            // computes the mipmap level in place (the values of the
+            // previous level are read before being overwritten)
+            int hsize = nsize / 2;
+            for (int r = 0; r < hsize; ++r) {
+                for (int c = 0; c < hsize; ++c) {
+                    int k = r * hsize + c;
+                    int k0 = (2 * r) * nsize + (2 * c);
+                    int k1 = (2 * r) * nsize + (2 * c) + 1;
+                    int k2 = (2 * r + 1) * nsize + (2 * c);
+                    int k3 = (2 * r + 1) * nsize + (2 * c) + 1;
+                    heights[k] = 1 / 4.0 * (heights[k0] + heights[k1] + heights[k2] + heights[k3]);
+                }
+            }
+            nsize = hsize;
+        }
+        int k = 0;
+        for (int r = 0; r < nsize; ++r) {
+            for (int c = 0; c < nsize; ++c) {
+                float nx;
+                if (c < nsize - 1) {
+                    nx = heights[r * nsize + c + 1] - heights[r * nsize + c];
+                } else {
+                    nx = heights[r * nsize] - heights[r * nsize + c];
+                }
+                float ny;
+                if (r > 0) {
+                    ny = heights[(r - 1) * nsize + c] - heights[r * nsize + c];
+                } else {
+                    ny = heights[r * nsize + c] - heights[c];
+                }
+                data[3 * k] = nx * scale;
+                data[3 * k + 1] = ny * scale;
+                data[3 * k + 2] = 1.0;
+                k++;
+            }
+        }
+        data += 3 * nsize * nsize;
+    }
+}
+
+void WaveTile::setWaveLevels(ptr<Texture2D> tex, int size, int numLodLevels, const float *data)
+{
+    int nsize = size;
+    for (int level = 0; level < numLodLevels; ++level) {
+        tex->setSubImage(level, 0, 0, nsize, nsize, RGB, FLOAT, Buffer::Parameters(), CPUBuffer(data));
+        data += 3 * nsize * nsize;
+        nsize /= 2;
+    }
+}
+
+float *WaveTile::loadWaveData(const string &file, const vector<int> &key, int size)
+{
+    FILE *f;
+    fopen(&f, file.c_str(), "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    int header[3];
+    bool valid = fread(header, sizeof(int), 3, f) == 3;
+    valid = valid && header[0] == WAVE_DATA_MAGIC && header[1] == WAVE_DATA_VERSION && header[2] == int(key.size());
+    for (unsigned int i = 0; valid && i < key.size(); ++i) {
+        int k;
+        valid = fread(&k, sizeof(int), 1, f) == 1 && k == key[i];
+    }
+    float *data = NULL;
+    if (valid) {
+        data = new float[size];
+        if (fread(data, sizeof(float), size, f) != size_t(size)) {
+            delete[] data;
+            data = NULL;
+        }
+    }
+    fclose(f);
+
+    if (Logger::DEBUG_LOGGER != NULL) {
+        Logger::DEBUG_LOGGER->log("RIVERS", (data == NULL ? "Outdated wave data " : "Loaded wave data ") + file);
+    }
+    return data;
+}
+
+void WaveTile::saveWaveData(const string &file, const vector<int> &key, const float *data, int size)
+{
+    // writes a temporary file first, so that other sessions sharing the
+    // same cache directory never see a partially written file
+    string tmpFile = file + ".tmp";
+    FILE *f;
+    fopen(&f, tmpFile.c_str(), "wb");
+    bool valid = f != NULL;
+    if (valid) {
+        int header[3];
+        header[0] = WAVE_DATA_MAGIC;
+        header[1] = WAVE_DATA_VERSION;
+        header[2] = int(key.size());
+        valid = fwrite(header, sizeof(int), 3, f) == 3;
+        valid = valid && (key.empty() || fwrite(&key[0], sizeof(int), key.size(), f) == key.size());
+        valid = valid && fwrite(data, sizeof(float), size, f) == size_t(size);
+        valid = fclose(f) == 0 && valid;
+    }
+    if (valid) {
+        remove(file.c_str());
+        valid = rename(tmpFile.c_str(), file.c_str()) == 0;
+    }
+    if (!valid) {
+        if (Logger::WARNING_LOGGER != NULL) {
+            Logger::WARNING_LOGGER->log("RIVERS", "Cannot save wave data " + file);
+        }
+        remove(tmpFile.c_str());
+    }
+}
+
 float WaveTile::getWaveLength() const
 {
     return waveLength;
@@ -28,6 +28,8 @@
 #ifndef _PROLAND_WAVETILE_H_
 #define _PROLAND_WAVETILE_H_
 
+#include <vector>
+
 #include "ork/core/Object.h"
 #include "ork/render/Program.h"
 #include "ork/render/Texture2D.h"
@@ -78,6 +80,15 @@ public:
 
     float getWaveLength() const;
 
+    /**
+     * Returns the number of floats of the data returned by
+     * #computeWaveLevels, i.e., of an RGB texture with its mipmap levels.
+     *
+     * @param size the texture size.
+     * @param numLodLevels the number of mipmap levels.
+     */
+    static int getWaveDataSize(int size, int numLodLevels);
+
 protected:
     /**
      * Creates a new WaveTile.
@@ -96,6 +107,45 @@ protected:
      */
     virtual void init(std::string &name, ptr<Texture2D> tex, int gridSize, int tileSize, float waveLength, int timeLoop);
 
+    /**
+     * Computes the wave profiles corresponding to a height field. The red
+     * and green channels contain the slopes of the height field, and the
+     * blue channel contains 1. The mipmap levels are stored one after the
+     * other, from the finest to the coarsest.
+     *
+     * @param heights the size*size values of the height field. This array
+     *      is used to compute the coarser mipmap levels, and is modified by
+     *      this method.
+     * @param size the height field size.
+     * @param numLodLevels the number of mipmap levels to compute.
+     * @param[out] data where the wave profiles must be stored. Its size
+     *      must be #getWaveDataSize.
+     */
+    static void computeWaveLevels(float *heights, int size, int numLodLevels, float *data);
+
+    /**
+     * Copies wave profiles computed with #computeWaveLevels into a texture.
+     */
+    static void setWaveLevels(ptr<Texture2D> tex, int size, int numLodLevels, const float *data);
+
+    /**
+     * Loads wave profiles from a cache file.
+     *
+     * @param file the cache file.
+     * @param key the parameters used to compute the wave profiles. They
+     *      must be equal to those stored in the cache file.
+     * @param size the number of floats of the wave profiles.
+     * @return the loaded data, or NULL if the cache file does not exist or
+     *      does not match the given key and size. The caller must delete
+     *      it.
+     */
+    static float *loadWaveData(const std::string &file, const std::vector<int> &key, int size);
+
+    /**
+     * Saves wave profiles in a cache file (see #loadWaveData).
+     */
+    static void saveWaveData(const std::string &file, const std::vector<int> &key, const float *data, int size);
+
     /**
      * Current wave tile's name.
      */
@@ -175,10 +175,6 @@ void HydroGraph::load(FileReader * fileReader, bool loadSubgraphs)
 {
     assert(fileReader != 0);
 
-    int nodeCount;
-    int curveCount;
-    int areaCount;
-
     nParamsNodes = fileReader->read<int>();
     nParamsCurves = fileReader->read<int>();
     nParamsAreas = fileReader->read<int>();
@@ -189,162 +185,23 @@ void HydroGraph::load(FileReader * fileReader, bool loadSubgraphs)
 
     checkParams(nParamsNodes, nParamsCurves, nParamsAreas, nParamsCurveExtremities, nParamsCurvePoints, nParamsAreaCurves, nParamsSubgraphs);
 
-    nodeCount = fileReader->read<int>();
-    vector<NodePtr> nodesTMP(nodeCount);
-    for (int i = 0; i < nodeCount; i++) {
-        float x, y;
-        x = fileReader->read<float>();
-        y = fileReader->read<float>();
-        for (int k = 2; k < nParamsNodes; k++) {
-            fileReader->read<float>();
-        }
-        nodesTMP[i] = newNode(vec2d(x, y));
-        int size = fileReader->read<int>();
-        for (int i = 0; i < size; i++) {
-            fileReader->read<int>();
-        }
-    }
-
-    curveCount = fileReader->read<int>();
-    vector<CurvePtr> curvesTMP(curveCount);
-    CurveId nullCid;
-    nullCid.id = NULL_ID;
-
-    int riverId;
-    map<ptr<HydroCurve>, int> associatedRivers;
-
-    for (int i = 0; i < curveCount; i++) {
-        int size;
-        float width;
-        int type;
-        float potential = -1.f;
-        size = fileReader->read<int>();
-        width = fileReader->read<float>();
-        type = fileReader->read<int>();
-        if (nParamsCurves >= 5) {
-            potential = fileReader->read<float>();
-            riverId = fileReader->read<int>();
-        } else {
-            potential = -1.f;
-            riverId = -1;
-        }
-        for (int j = 5; j < nParamsCurves; j++) {
-            fileReader->read<float>();
-        }
-        for (int k = 5; k < nParamsCurves; k++) {
-            fileReader->read<float>();
-        }
-
-        int start = fileReader->read<int>();
-        for (int k = 1; k < nParamsCurveExtremities; k++) {
-            fileReader->read<float>();
-        }
-        vector<Vertex> v;
-        for (int j = 1; j < size - 1; j++) {
-            float x, y;
-            int isControl;
-            x = fileReader->read<float>();
-            y = fileReader->read<float>();
-            isControl = fileReader->read<int>();
-            v.push_back(Vertex(x, y, -1, isControl == 1));
-            for (int k = 3; k < nParamsCurvePoints; k++) {
-                fileReader->read<float>();
-            }
-        }
-        int end = fileReader->read<int>();
-        for (int k = 1; k < nParamsCurveExtremities; k++) {
-            fileReader->read<float>();
-        }
-
-        fileReader->read<int>();
-        fileReader->read<int>();
-        CurveId parentId;
-        parentId.id= (unsigned int) fileReader->read<int>();
+    vector<NodePtr> nodesTMP(fileReader->read<int>());
+    loadNodes(fileReader, nodesTMP);
 
-        ptr<HydroCurve> c;
-        if (getParent() != NULL) {
-            c = newCurve(getParent()->getCurve(parentId), parentId.id != NULL_ID).cast<HydroCurve>();
-        } else {
-            c = newCurve(NULL, false).cast<HydroCurve>();
-        }
-        c->setWidth(width);
-        c->setType(type);
-        c->addVertex(nodesTMP[start]->getId());
-        c->addVertex(nodesTMP[end]->getId());
-        c->setPotential(potential);
-        associatedRivers.insert(make_pair(c, riverId));
-        nodesTMP[start]->addCurve(c->getId());
-        nodesTMP[end]->addCurve(c->getId());
-        for (vector<Vertex>::iterator j = v.begin(); j != v.end(); j++) {
-            c->addVertex(*j);
-        }
+    vector<CurvePtr> curvesTMP(fileReader->read<int>());
+    loadCurves(fileReader, nodesTMP, curvesTMP);
 
-        c->computeCurvilinearCoordinates();
-        curvesTMP[i] = c;
-    }
-    for (map<ptr<HydroCurve>, int> ::iterator i = associatedRivers.begin(); i != associatedRivers.end(); i++) {
-        CurveId river;
-        if (i->second == -1) {
-            river.id = NULL_ID;
-        } else {
-            river = curvesTMP[i->second]->getId();
-        }
-        i->first->setRiver(river);
-    }
+    vector<AreaPtr> areasTMP(fileReader->read<int>());
+    loadAreas(fileReader, curvesTMP, loadSubgraphs, areasTMP);
 
-    areaCount = fileReader->read<int>();
-    vector<AreaPtr> areasTMP(areaCount);
-    for (int i = 0; i < areaCount; i++) {
-        int size;
-        int info;
-        int subgraph;
-        size = fileReader->read<int>();
-        info = fileReader->read<int>();
-        subgraph = fileReader->read<int>();
-        for (int k = 3; k < nParamsAreas; k++) {
-            fileReader->read<float>();
-        }
-
-        vector<pair<int, int> > v;
-        for (int j = 0; j < size; j++) {
-            int index;
-            int orientation;
-            index = fileReader->read<int>();
-            orientation = fileReader->read<int>();
-            for (int k = 2; k < nParamsAreaCurves; k++) {
-                fileReader->read<float>();
-            }
-            v.push_back(make_pair(index, orientation));
-        }
-        AreaId parentId;
-        for (int k = 0; k < nParamsSubgraphs; k++) {
-            fileReader->read<float>();
-        }
-        parentId.id= (unsigned int) fileReader->read<int>();
-
-        AreaPtr a;
-        if (getParent() != NULL) {
-            a = newArea(getParent()->getArea(parentId), parentId.id != NULL_ID);
-        } else {
-            a = newArea(NULL, false);
-        }
-        a->setInfo(info);
-        a->setSubgraph(loadSubgraphs ? (subgraph == 1 ? createChild() : NULL) : NULL);
-        for (vector<pair<int, int> >::iterator j = v.begin(); j != v.end(); j++) {
-            a->addCurve(curvesTMP[j->first]->getId(), j->second);
-            curvesTMP[j->first]->addArea(a->getId());
-        }
-
-        areasTMP[i] = a;
-    }
-    for (int i = 0; i < areaCount; ++i) {
+    nodesTMP.clear();
+    curvesTMP.clear();
+    for (unsigned int i = 0; i < areasTMP.size(); ++i) {
         AreaPtr a = areasTMP[i];
         if (a->getSubgraph() != NULL) {
             a->getSubgraph()->load(fileReader, loadSubgraphs);
         }
     }
-
-    curvesTMP.clear();
 }
 
 void HydroGraph::loadIndexed(FileReader *fileReader, bool loadSubgraphs)
@@ -353,12 +210,7 @@ void HydroGraph::loadIndexed(FileReader *fileReader, bool loadSubgraphs)
     int nodeCount;
     int curveCount;
     int areaCount;
-    int subgraphCount;
-    //long int offset, begin;
 
-//    offset = fileReader->read<long int>();
-//    begin = fileReader->tellg();
-//    fileReader->seekg(offset, ios::beg);
     nParamsNodes = fileReader->read<int>();
     nParamsCurves = fileReader->read<int>();
     nParamsAreas = fileReader->read<int>();
@@ -375,47 +227,68 @@ void HydroGraph::loadIndexed(FileReader *fileReader, bool loadSubgraphs)
     nodeCount = fileReader->read<int>();
     curveCount = fileReader->read<int>();
     areaCount = fileReader->read<int>();
-    subgraphCount = fileReader->read<int>();
-
+    fileReader->read<int>(); // subgraph count
 
     fileReader->seekg(begin, ios::beg);
 
     vector<NodePtr> nodesTMP(nodeCount);
-    for (int i = 0; i < nodeCount; i++) {
+    loadNodes(fileReader, nodesTMP);
+
+    vector<CurvePtr> curvesTMP(curveCount);
+    loadCurves(fileReader, nodesTMP, curvesTMP);
+
+    vector<AreaPtr> areasTMP(areaCount);
+    loadAreas(fileReader, curvesTMP, loadSubgraphs, areasTMP);
+
+    nodesTMP.clear();
+    curvesTMP.clear();
+    for (int i = 0; i < areaCount; ++i) {
+        AreaPtr a = areasTMP[i];
+        if (a->getSubgraph() != NULL) {
+            a->getSubgraph()->load(fileReader, loadSubgraphs);
+        }
+    }
+}
+
+void HydroGraph::loadNodes(FileReader *fileReader, vector<NodePtr> &nodes)
+{
+    for (unsigned int i = 0; i < nodes.size(); i++) {
         float x, y;
-        x = fileReader->read<float>();
-        y = fileReader->read<float>();
-        nodesTMP[i] = newNode(vec2d(x, y));
+        fileReader->resetPoints();
+        fileReader->readPoint(x, y);
         for (int j = 2; j < nParamsNodes; j++) {
             fileReader->read<float>();
         }
+        nodes[i] = newNode(vec2d(x, y));
+        // the curves of the node are set when the curves are loaded
         int size = fileReader->read<int>();
         for (int j = 0; j < size; j++) {
             fileReader->read<int>();
         }
     }
+}
 
-    CurveId nullCid;
-    nullCid.id = NULL_ID;
-    vector<CurvePtr> curvesTMP(curveCount);
-    map<ptr<HydroCurve>, int> associatedRivers;
-    // For each curve that has a non-null river parameter, we store it and add it at the end of the loading part.
-    // This is used when a curve references another curve that is defined later in the file.
-    for (int i = 0; i < curveCount; i++) {
+void HydroGraph::loadCurves(FileReader *fileReader, const vector<NodePtr> &nodes, vector<CurvePtr> &curves)
+{
+    // the river of a curve can be defined later in the file, so the river
+    // indices are stored and resolved once all the curves are loaded
+    vector<int> rivers(curves.size());
+    // the vertices of each curve are read in the same vector
+    vector<Vertex> v;
+    for (unsigned int i = 0; i < curves.size(); i++) {
         int size;
         float width;
         int type;
         float potential;
-        int riverId;
         size = fileReader->read<int>();
         width = fileReader->read<float>();
         type = fileReader->read<int>();
         if (nParamsCurves >= 5) {
             potential = fileReader->read<float>();
-            riverId = fileReader->read<int>();
+            rivers[i] = fileReader->read<int>();
         } else {
             potential = -1.f;
-            riverId = -1;
+            rivers[i] = -1;
         }
         for (int j = 5; j < nParamsCurves; j++) {
             fileReader->read<float>();
@@ -425,14 +298,13 @@ void HydroGraph::loadIndexed(FileReader *fileReader, bool loadSubgraphs)
         for (int j = 1; j < nParamsCurveExtremities; j++) {
             fileReader->read<float>();
         }
-        vector<Vertex> v;
+        v.clear();
+        fileReader->resetPoints();
         for (int j = 1; j < size - 1; j++) {
             float x, y;
             int isControl;
-            x = fileReader->read<float>();
-            y = fileReader->read<float>();
+            fileReader->readPoint(x, y);
             isControl = fileReader->read<int>();
-
             for (int k = 3; k < nParamsCurvePoints; k++) {
                 fileReader->read<float>();
             }
@@ -447,7 +319,6 @@ void HydroGraph::loadIndexed(FileReader *fileReader, bool loadSubgraphs)
         CurveId parentId;
         parentId.id= (unsigned int) fileReader->read<int>();
 
-
         ptr<HydroCurve> c;
         if (getParent() != NULL) {
             c = newCurve(getParent()->getCurve(parentId), parentId.id != NULL_ID).cast<HydroCurve>();
@@ -456,31 +327,32 @@ void HydroGraph::loadIndexed(FileReader *fileReader, bool loadSubgraphs)
         }
         c->setWidth(width);
         c->setType(type);
-        associatedRivers.insert(make_pair(c, riverId));
         c->setPotential(potential);
-        c->addVertex(nodesTMP[start]->getId());
-        c->addVertex(nodesTMP[end]->getId());
-        nodesTMP[start]->addCurve(c->getId());
-        nodesTMP[end]->addCurve(c->getId());
+        c->addVertex(nodes[start]->getId());
+        c->addVertex(nodes[end]->getId());
+        nodes[start]->addCurve(c->getId());
+        nodes[end]->addCurve(c->getId());
         for (vector<Vertex>::iterator j = v.begin(); j != v.end(); j++) {
             c->addVertex(*j);
         }
 
         c->computeCurvilinearCoordinates();
-        curvesTMP[i] = c;
+        curves[i] = c;
     }
-    for (map<ptr<HydroCurve>, int> ::iterator i = associatedRivers.begin(); i != associatedRivers.end(); i++) {
-        CurveId river;
-        if (i->second == -1) {
-            river.id = NULL_ID;
-        } else {
-            river = curvesTMP[i->second]->getId();
-        }
-        i->first->setRiver(river);
+
+    CurveId nullCid;
+    nullCid.id = NULL_ID;
+    for (unsigned int i = 0; i < curves.size(); i++) {
+        CurveId river = rivers[i] == -1 ? nullCid : curves[rivers[i]]->getId();
+        curves[i].cast<HydroCurve>()->setRiver(river);
     }
+}
 
-    vector<AreaPtr> areasTMP(areaCount);
-    for (int i = 0; i < areaCount; i++) {
+void HydroGraph::loadAreas(FileReader *fileReader, const vector<CurvePtr> &curves, bool loadSubgraphs, vector<AreaPtr> &areas)
+{
+    // the curves of each area are read in the same vector
+    vector<pair<int, int> > v;
+    for (unsigned int i = 0; i < areas.size(); i++) {
         int size;
         int info;
         int subgraph;
@@ -491,13 +363,12 @@ void HydroGraph::loadIndexed(FileReader *fileReader, bool loadSubgraphs)
             fileReader->read<float>();
         }
 
-        vector<pair<int, int> > v;
+        v.clear();
         for (int j = 0; j < size; j++) {
             int index;
             int orientation;
             index = fileReader->read<int>();
             orientation = fileReader->read<int>();
-
             for (int k = 2; k < nParamsAreaCurves; k++) {
                 fileReader->read<float>();
             }
@@ -518,18 +389,11 @@ void HydroGraph::loadIndexed(FileReader *fileReader, bool loadSubgraphs)
         a->setInfo(info);
         a->setSubgraph(loadSubgraphs ? (subgraph == 1 ? createChild() : NULL) : NULL);
         for (vector<pair<int, int> >::iterator j = v.begin(); j != v.end(); j++) {
-            a->addCurve(curvesTMP[j->first]->getId(), j->second);
-            curvesTMP[j->first]->addArea(a->getId());
+            a->addCurve(curves[j->first]->getId(), j->second);
+            curves[j->first]->addArea(a->getId());
         }
 
-        areasTMP[i] = a;
-    }
-
-    for (int i = 0; i < areaCount; ++i) {
-        AreaPtr a = areasTMP[i];
-        if (a->getSubgraph() != NULL) {
-            a->getSubgraph()->load(fileReader, loadSubgraphs);
-        }
+        areas[i] = a;
     }
 }
 
@@ -596,8 +460,8 @@ void HydroGraph::save(Graph *graph, FileWriter * fileWriter, bool saveAreas)
     for (int i = 0; i < (int) nodeList.size(); i++) {
     //for (map<NodePtr, int>::iterator i = nindices.begin(); i != nindices.end(); i++) {
         NodePtr n = nodeList[i];
-        fileWriter->write(n->getPos().x);
-        fileWriter->write(n->getPos().y);
+        fileWriter->resetPoints();
+        fileWriter->writePoint((float) n->getPos().x, (float) n->getPos().y);
         fileWriter->write(n->getCurveCount());
         for (int j = 0; j < n->getCurveCount(); j++) {
             fileWriter->write(cindices[n->getCurve(j).cast<HydroCurve>()]);
@@ -617,9 +481,9 @@ void HydroGraph::save(Graph *graph, FileWriter * fileWriter, bool saveAreas)
         int s = nindices[c->getStart()];
         int e = nindices[c->getEnd()];
         fileWriter->write(s);
+        fileWriter->resetPoints();
         for (int j = 1; j < c->getSize() - 1; ++j) {
-            fileWriter->write(c->getXY(j).x);
-            fileWriter->write(c->getXY(j).y);
+            fileWriter->writePoint((float) c->getXY(j).x, (float) c->getXY(j).y);
             fileWriter->write(c->getIsControl(j) ? 1 : 0);
         }
         fileWriter->write(e);
@@ -733,8 +597,8 @@ void HydroGraph::indexedSave(Graph *graph, FileWriter * fileWriter, bool saveAre
     //for (map<NodePtr, int>::iterator i = nindices.begin(); i != nindices.end(); i++) {
         NodePtr n = nodeList[i];
         offsets.push_back(fileWriter->tellp());
-        fileWriter->write(n->getPos().x);
-        fileWriter->write(n->getPos().y);
+        fileWriter->resetPoints();
+        fileWriter->writePoint((float) n->getPos().x, (float) n->getPos().y);
         fileWriter->write(n->getCurveCount());
         for (int j = 0; j < n->getCurveCount(); j++) {
             fileWriter->write(cindices[n->getCurve(j)]);
@@ -755,9 +619,9 @@ void HydroGraph::indexedSave(Graph *graph, FileWriter * fileWriter, bool saveAre
         int s = nindices[c->getStart()];
         int e = nindices[c->getEnd()];
         fileWriter->write(s);
+        fileWriter->resetPoints();
         for (int j = 1; j < c->getSize() - 1; ++j) {
-            fileWriter->write(c->getXY(j).x);
-            fileWriter->write(c->getXY(j).y);
+            fileWriter->writePoint((float) c->getXY(j).x, (float) c->getXY(j).y);
             fileWriter->write(c->getIsControl(j) ? 1 : 0);
         }
         fileWriter->write(e);
@@ -104,6 +104,39 @@ public:
     virtual NodePtr addNode(CurvePtr c, int i, Graph::Changes &changed);
 
     virtual void print(bool detailed);
+
+protected:
+    /**
+     * Loads the nodes section of a basic or indexed file.
+     *
+     * @param fileReader the FileReader used to read the file.
+     * @param[out] nodes the loaded nodes. The size of this vector must be
+     *      the number of nodes to load.
+     */
+    void loadNodes(FileReader *fileReader, vector<NodePtr> &nodes);
+
+    /**
+     * Loads the curves section of a basic or indexed file, and sets the
+     * river of each loaded curve.
+     *
+     * @param fileReader the FileReader used to read the file.
+     * @param nodes the nodes loaded with #loadNodes.
+     * @param[out] curves the loaded curves. The size of this vector must be
+     *      the number of curves to load.
+     */
+    void loadCurves(FileReader *fileReader, const vector<NodePtr> &nodes, vector<CurvePtr> &curves);
+
+    /**
+     * Loads the areas section of a basic or indexed file. The subgraphs of
+     * these areas are created but not loaded.
+     *
+     * @param fileReader the FileReader used to read the file.
+     * @param curves the curves loaded with #loadCurves.
+     * @param loadSubgraphs if true, the subgraphs of the areas are created.
+     * @param[out] areas the loaded areas. The size of this vector must be
+     *      the number of areas to load.
+     */
+    void loadAreas(FileReader *fileReader, const vector<CurvePtr> &curves, bool loadSubgraphs, vector<AreaPtr> &areas);
 };
 
 }
@@ -135,6 +135,17 @@ Graph *LazyHydroGraph::createChild()
     return new HydroGraph();
 }
 
+void LazyHydroGraph::skipCurveParams()
+{
+    if (nParamsCurves >= 5) {
+        fileReader->read<float>(); //potential
+        fileReader->read<int>(); //river
+    }
+    for (int j = 5; j < nParamsCurves; j++) {
+        fileReader->read<float>();
+    }
+}
+
 CurvePtr LazyHydroGraph::loadCurve(long int offset, CurveId id)
 {
     assert(fileReader != NULL);
@@ -177,11 +188,11 @@ CurvePtr LazyHydroGraph::loadCurve(long int offset, CurveId id)
     nis.id = start;
     c->loadVertex(nis);
 
+    fileReader->resetPoints();
     for (int j = 1; j < size - 1; j++) {
         float x, y;
         int isControl;
-        x = fileReader->read<float>();
-        y = fileReader->read<float>();
+        fileReader->readPoint(x, y);
         isControl = fileReader->read<int>();
 
         c->loadVertex(x, y, -1, isControl == 1);
@@ -116,6 +116,12 @@ protected:
      */
     virtual CurvePtr loadCurve(long int offset, CurveId id);
 
+    /**
+     * Skips the potential (a float) and the river id (an int) of a curve,
+     * and its remaining float parameters if any.
+     */
+    virtual void skipCurveParams();
+
     friend class LazyHydroCurve;
 };
 
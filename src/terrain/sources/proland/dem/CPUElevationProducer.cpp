@@ -27,11 +27,13 @@
 
 #include "proland/dem/CPUElevationProducer.h"
 
+#include <algorithm>
 #include <sstream>
 
 #include "ork/core/Logger.h"
 #include "ork/resource/ResourceTemplate.h"
 #include "ork/taskgraph/TaskGraph.h"
+#include "proland/dem/ElevationProducer.h"
 #include "proland/producer/CPUTileStorage.h"
 
 using namespace std;
@@ -40,46 +42,120 @@ using namespace ork;
 namespace proland
 {
 
+// rounds a float value to half precision, like when it is stored in a R16F
+// texture (the noise texture used by ElevationProducer). The values to round
+// are supposed to be in the range -1..1.
+static float toHalfPrecision(float f)
+{
+    if (f == 0.0f) {
+        return f;
+    }
+    int e;
+    frexp(f, &e);
+    // half precision numbers have 11 significant bits, and are denormalized
+    // below 2^-14, where their precision is 2^-24
+    float scale = (float) ldexp(1.0, e >= -13 ? 11 - e : 24);
+    float x = f * scale;
+    float r = floor(x + 0.5f);
+    if (r - x == 0.5f && fmod(r, 2.0f) != 0.0f) {
+        r -= 1.0f; // round half to even
+    }
+    return r / scale;
+}
+
+// the filters used by the GPU upsampling shader to compute the slope and the
+// curvature of the coarse level at a fine pixel. filter[k][dy][dx] is the
+// weight of the coarse pixel (dx,dy) of the 4x4 coarse pixels around the fine
+// pixel, for the fine pixels with k = (i % 2) + 2 * (j % 2).
+
+static const float slopexFilter[4][4][4] = {
+    { { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+    { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.5f, 0.5f, -0.5f, -0.5f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+    { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.5f, 0.0f, -0.5f, 0.0f }, { 0.5f, 0.0f, -0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+    { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.25f, 0.25f, -0.25f, -0.25f }, { 0.25f, 0.25f, -0.25f, -0.25f }, { 0.0f, 0.0f, 0.0f, 0.0f } }
+};
+
+static const float slopeyFilter[4][4][4] = {
+    { { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+    { { 0.0f, 0.5f, 0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, -0.5f, -0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+    { { 0.0f, 0.5f, 0.0f, 0.0f }, { 0.0f, 0.5f, 0.0f, 0.0f }, { 0.0f, -0.5f, 0.0f, 0.0f }, { 0.0f, -0.5f, 0.0f, 0.0f } },
+    { { 0.0f, 0.25f, 0.25f, 0.0f }, { 0.0f, 0.25f, 0.25f, 0.0f }, { 0.0f, -0.25f, -0.25f, 0.0f }, { 0.0f, -0.25f, -0.25f, 0.0f } }
+};
+
+static const float curvatureFilter[4][4][4] = {
+    { { 0.0f, -1.0f, 0.0f, 0.0f }, { -1.0f, 4.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+    { { 0.0f, -0.5f, -0.5f, 0.0f }, { -0.5f, 1.5f, 1.5f, -0.5f }, { 0.0f, -0.5f, -0.5f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+    { { 0.0f, -0.5f, 0.0f, 0.0f }, { -0.5f, 1.5f, -0.5f, 0.0f }, { -0.5f, 1.5f, -0.5f, 0.0f }, { 0.0f, -0.5f, 0.0f, 0.0f } },
+    { { 0.0f, -0.25f, -0.25f, 0.0f }, { -0.25f, 0.5f, 0.5f, -0.25f }, { -0.25f, 0.5f, 0.5f, -0.25f }, { 0.0f, -0.25f, -0.25f, 0.0f } }
+};
+
 CPUElevationProducer::CPUElevationProducer(ptr<TileCache> cache, ptr<TileProducer> residualTiles) : TileProducer("CPUElevationProducer", "CreateCPUElevationTile")
 {
-    init(cache, residualTiles);
+    vector<float> noiseAmp;
+    init(cache, residualTiles, noiseAmp);
 }
 
-CPUElevationProducer::CPUElevationProducer() : TileProducer("CPUElevationProducer", "CreateCPUElevationTile")
+CPUElevationProducer::CPUElevationProducer(ptr<TileCache> cache, ptr<TileProducer> residualTiles,
+    vector<float> &noiseAmp, int face) : TileProducer("CPUElevationProducer", "CreateCPUElevationTile")
 {
+    init(cache, residualTiles, noiseAmp, face);
 }
 
-void CPUElevationProducer::init(ptr<TileCache> cache, ptr<TileProducer> residualTiles)
+CPUElevationProducer::CPUElevationProducer() : TileProducer("CPUElevationProducer", "CreateCPUElevationTile"), noise(NULL)
 {
-    TileProducer::init(cache, true);
+}
+
+void CPUElevationProducer::init(ptr<TileCache> cache, ptr<TileProducer> residualTiles, vector<float> &noiseAmp, int face)
+{
+    assert(residualTiles != NULL || !noiseAmp.empty());
+    // this producer does not use any OpenGL context, so its tiles can be
+    // produced in parallel by the worker threads of the scheduler
+    TileProducer::init(cache, false);
     this->residualTiles = residualTiles;
+    this->noiseAmp = noiseAmp;
+    this->face = face;
+    this->noise = NULL;
+    if (!noiseAmp.empty()) {
+        int tileWidth = cache->getStorage()->getTileSize();
+        noise = ElevationProducer::createNoiseArray(tileWidth);
+        for (int i = 0; i < 6 * tileWidth * tileWidth; ++i) {
+            noise[i] = toHalfPrecision(noise[i]);
+        }
+    }
 }
 
 CPUElevationProducer::~CPUElevationProducer()
 {
+    if (noise != NULL) {
+        delete[] noise;
+    }
 }
 
 void CPUElevationProducer::getReferencedProducers(vector< ptr<TileProducer> > &producers) const
 {
-    producers.push_back(residualTiles);
+    if (residualTiles != NULL) {
+        producers.push_back(residualTiles);
+    }
 }
 
 void CPUElevationProducer::setRootQuadSize(float size)
 {
     TileProducer::setRootQuadSize(size);
-    residualTiles->setRootQuadSize(size);
+    if (residualTiles != NULL) {
+        residualTiles->setRootQuadSize(size);
+    }
 }
 
 int CPUElevationProducer::getBorder()
 {
-    assert(residualTiles->getBorder() == 2);
+    assert(residualTiles == NULL || residualTiles->getBorder() == 2);
     return 2;
 }
 
 bool CPUElevationProducer::prefetchTile(int level, int tx, int ty)
 {
     bool b = TileProducer::prefetchTile(level, tx, ty);
-    if (!b) {
+    if (!b && residualTiles != NULL) {
         int tileSize = getCache()->getStorage()->getTileSize() - 5;
         int residualTileSize = residualTiles->getCache()->getStorage()->getTileSize() - 5;
         int mod = residualTileSize / tileSize;
@@ -136,14 +212,16 @@ ptr<Task> CPUElevationProducer::startCreateTile(int level, int tx, int ty, unsig
         result->addDependency(task, t->task);
     }
 
-    int tileSize = getCache()->getStorage()->getTileSize() - 5;
-    int residualTileSize = residualTiles->getCache()->getStorage()->getTileSize() - 5;
-    int mod = residualTileSize / tileSize;
-    if (residualTiles->hasTile(level, tx / mod, ty / mod)) {
-        TileCache::Tile *t = residualTiles->getTile(level, tx / mod, ty / mod, deadline);
-        assert(t != NULL);
-        result->addTask(t->task);
-        result->addDependency(task, t->task);
+    if (residualTiles != NULL) {
+        int tileSize = getCache()->getStorage()->getTileSize() - 5;
+        int residualTileSize = residualTiles->getCache()->getStorage()->getTileSize() - 5;
+        int mod = residualTileSize / tileSize;
+        if (residualTiles->hasTile(level, tx / mod, ty / mod)) {
+            TileCache::Tile *t = residualTiles->getTile(level, tx / mod, ty / mod, deadline);
+            assert(t != NULL);
+            result->addTask(t->task);
+            result->addDependency(task, t->task);
+        }
     }
 
     return result;
@@ -175,22 +253,39 @@ bool CPUElevationProducer::doCreateTile(int level, int tx, int ty, TileStorage::
         assert(parentCpuData != NULL);
     }
 
-    int residualTileWidth = residualTiles->getCache()->getStorage()->getTileSize();
-    int mod = (residualTileWidth - 2 * residualTiles->getBorder() - 1) / tileSize;
-
-    int rx = (tx % mod) * tileSize; // select the xy coord in residual
-    int ry = (ty % mod) * tileSize;
-    TileCache::Tile *t = residualTiles->findTile(level, tx / mod, ty / mod);
-
+    int residualTileWidth = 0;
+    int rx = 0;
+    int ry = 0;
     CPUTileStorage<float>::CPUSlot *cpuTile = NULL;
 
-    bool hasResidual = residualTiles->hasTile(level, tx / mod, ty / mod);
-    if (hasResidual) {
-        assert(t != NULL);
-        cpuTile = dynamic_cast<CPUTileStorage<float>::CPUSlot*>(t->getData());
-        assert(cpuTile != NULL);
+    bool hasResidual = false;
+    if (residualTiles != NULL) {
+        residualTileWidth = residualTiles->getCache()->getStorage()->getTileSize();
+        int mod = (residualTileWidth - 2 * residualTiles->getBorder() - 1) / tileSize;
+
+        rx = (tx % mod) * tileSize; // select the xy coord in residual
+        ry = (ty % mod) * tileSize;
+        hasResidual = residualTiles->hasTile(level, tx / mod, ty / mod);
+        if (hasResidual) {
+            TileCache::Tile *t = residualTiles->findTile(level, tx / mod, ty / mod);
+            assert(t != NULL);
+            cpuTile = dynamic_cast<CPUTileStorage<float>::CPUSlot*>(t->getData());
+            assert(cpuTile != NULL);
+        }
     }
 
+    // noise parameters, see ElevationProducer and the upsampling shader
+    float rs = level < int(noiseAmp.size()) ? noiseAmp[level] : 0.0f;
+    float *noiseLayer = NULL;
+    int noiseR = 0;
+    if (rs != 0.0f) {
+        int noiseL;
+        ElevationProducer::getNoiseLayer(face, level, tx, ty, &noiseR, &noiseL);
+        noiseLayer = noise + noiseL * tileWidth * tileWidth;
+    }
+    // size in meters of a pixel of this tile
+    float pixelSize = getRootQuadSize() / (1 << level) / tileSize;
+
     int px = 1 + (tx % 2) * tileSize / 2; //select the xy coord in the parent tile
     int py = 1 + (ty % 2) * tileSize / 2;
 
@@ -240,6 +335,35 @@ bool CPUElevationProducer::doCreateTile(int level, int tx, int ty, TileStorage::
             if (hasResidual) {
                 r = cpuTile->data[(int)(i + rx + (j + ry) * residualTileWidth)];
             }
+            if (noiseLayer != NULL) {
+                int c[4] = { i, j, tileWidth - 1 - i, tileWidth - 1 - j };
+                float n = noiseLayer[c[noiseR] + c[(noiseR + 1) % 4] * tileWidth];
+                if (rs < 0.0f) {
+                    r -= rs * n;
+                } else {
+                    // the noise amplitude depends on the slope and curvature
+                    // of the coarse level (both are 0 at the root level)
+                    float amp = 0.1f;
+                    if (level > 0) {
+                        int k = (i % 2) + 2 * (j % 2);
+                        float sx = 0.0f;
+                        float sy = 0.0f;
+                        float cv = 0.0f;
+                        for (int dj = 0; dj < 4; ++dj) {
+                            for (int di = 0; di < 4; ++di) {
+                                float cz = parentTile[i / 2 + di - 1 + px + (j / 2 + dj - 1 + py) * tileWidth];
+                                sx += slopexFilter[k][dj][di] * cz;
+                                sy += slopeyFilter[k][dj][di] * cz;
+                                cv += curvatureFilter[k][dj][di] * cz;
+                            }
+                        }
+                        float slope = sqrt(sx * sx + sy * sy) / (2.0f * pixelSize);
+                        float curvature = cv / pixelSize;
+                        amp = max(min(max(4.0f * curvature, 0.0f), 1.5f), min(max(2.0f * slope - 0.5f, 0.1f), 4.0f));
+                    }
+                    r += amp * rs * n;
+                }
+            }
             cpuData->data[i + j * tileWidth] = z + r;
         }
     }
@@ -259,13 +383,15 @@ void CPUElevationProducer::stopCreateTile(int level, int tx, int ty)
         putTile(t);
     }
 
-    int tileSize = getCache()->getStorage()->getTileSize() - 5;
-    int residualTileSize = residualTiles->getCache()->getStorage()->getTileSize() - 5;
-    int mod = residualTileSize / tileSize;
-    if (residualTiles->hasTile(level, tx / mod, ty / mod)) {
-        TileCache::Tile *t = residualTiles->findTile(level, tx / mod, ty / mod);
-        assert(t != NULL);
-        residualTiles->putTile(t);
+    if (residualTiles != NULL) {
+        int tileSize = getCache()->getStorage()->getTileSize() - 5;
+        int residualTileSize = residualTiles->getCache()->getStorage()->getTileSize() - 5;
+        int mod = residualTileSize / tileSize;
+        if (residualTiles->hasTile(level, tx / mod, ty / mod)) {
+            TileCache::Tile *t = residualTiles->findTile(level, tx / mod, ty / mod);
+            assert(t != NULL);
+            residualTiles->putTile(t);
+        }
     }
 }
 
@@ -273,6 +399,9 @@ void CPUElevationProducer::swap(ptr<CPUElevationProducer> p)
 {
     TileProducer::swap(p);
     std::swap(residualTiles, p->residualTiles);
+    std::swap(noiseAmp, p->noiseAmp);
+    std::swap(noise, p->noise);
+    std::swap(face, p->face);
 }
 
 class CPUElevationProducerResource : public ResourceTemplate<3, CPUElevationProducer>
@@ -284,10 +413,28 @@ public:
         e = e == NULL ? desc->descriptor : e;
         ptr<TileCache> cache;
         ptr<TileProducer> residuals;
-        checkParameters(desc, e, "name,cache,residuals,");
+        vector<float> noiseAmp;
+        int face;
+        checkParameters(desc, e, "name,cache,residuals,face,noise,");
         cache = manager->loadResource(getParameter(desc, e, "cache")).cast<TileCache>();
-        residuals = manager->loadResource(getParameter(desc, e, "residuals")).cast<TileProducer>();
-        init(cache, residuals);
+        if (e->Attribute("residuals") != NULL) {
+            residuals = manager->loadResource(getParameter(desc, e, "residuals")).cast<TileProducer>();
+        }
+        ElevationProducer::getNoiseAmplitudes(e, noiseAmp);
+        if (residuals == NULL && noiseAmp.empty()) {
+            if (Logger::ERROR_LOGGER != NULL) {
+                log(Logger::ERROR_LOGGER, desc, e, "Missing 'residuals' or 'noise' attribute");
+            }
+            throw exception();
+        }
+        if (e->Attribute("face") != NULL) {
+            getIntParameter(desc, e, "face", &face);
+        } else if (name.at(name.size() - 1) >= '1' && name.at(name.size() - 1) <= '6') {
+            face = name.at(name.size() - 1) - '0';
+        } else {
+            face = 0;
+        }
+        init(cache, residuals, noiseAmp, face);
     }
 };
 
@@ -25,8 +25,8 @@
  * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
  */
 
-#ifndef _PROLAND_ELEVATION_PRODUCER_H_
-#define _PROLAND_ELEVATION_PRODUCER_H_
+#ifndef _PROLAND_CPU_ELEVATION_PRODUCER_H_
+#define _PROLAND_CPU_ELEVATION_PRODUCER_H_
 
 #include "proland/producer/TileProducer.h"
 
@@ -35,6 +35,13 @@ namespace proland
 
 /**
  * A TileProducer to create elevation tiles on CPU from CPU residual tiles.
+ * Like ElevationProducer, this %producer can also add noise to the upsampled
+ * elevations, with an amplitude specified for each level. It uses the same
+ * upsampling kernel, the same noise values and the same slope and curvature
+ * based noise amplitude modulation as the default GPU upsampling shader, so
+ * that it produces the same elevations as an ElevationProducer without
+ * layers. In particular, when no residuals are specified, it can produce a
+ * fully random fractal %terrain on CPU, without any OpenGL context.
  * @ingroup dem
  * @authors Antoine Begault, Eric Bruneton
  */
@@ -53,6 +60,23 @@ public:
      */
     CPUElevationProducer(ptr<TileCache> cache, ptr<TileProducer> residualTiles);
 
+    /**
+     * Creates a new CPUElevationProducer.
+     *
+     * @param cache the cache to store the produced tiles. The underlying
+     *      storage must be a CPUTileStorage of float type.
+     * @param residualTiles the %producer producing the residual tiles. This
+     *      %producer should produce its tiles in a CPUTileStorage of float type.
+     *      Maybe NULL to create a fully random fractal %terrain. The size of
+     *      the residual tiles (without borders) must be a multiple of the size
+     *      of the elevation tiles (without borders).
+     * @param noiseAmp the amplitude of the noise to be added for each level
+     *      (one amplitude per level). See ElevationProducer.
+     * @param face the cube face ID for spherical terrains, or 0 for flat ones.
+     */
+    CPUElevationProducer(ptr<TileCache> cache, ptr<TileProducer> residualTiles,
+        std::vector<float> &noiseAmp, int face = 0);
+
     /**
      * Deletes this CPUElevationProducer.
      */
@@ -92,9 +116,14 @@ protected:
      * @param residualTiles the %producer producing the residual tiles. This
      *      %producer should produce its tiles in a CPUTileStorage of float type.
      *      The size of the residual tiles (without borders) must be a multiple
-     *      of the size of the elevation tiles (without borders).
+     *      of the size of the elevation tiles (without borders). Maybe NULL
+     *      if noiseAmp is not empty.
+     * @param noiseAmp the amplitude of the noise to be added for each level
+     *      (one amplitude per level). See ElevationProducer.
+     * @param face the cube face ID for spherical terrains, or 0 for flat ones.
      */
-    void init(ptr<TileCache> cache, ptr<TileProducer> residualTiles);
+    void init(ptr<TileCache> cache, ptr<TileProducer> residualTiles,
+        std::vector<float> &noiseAmp, int face = 0);
 
     virtual ptr<Task> startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> owner);
 
@@ -113,9 +142,27 @@ private:
      * The %producer producing the residual tiles. This %producer should produce
      * its tiles in a CPUTileStorage of float type. The size of the residual tiles
      * (without borders) must be a multiple of the size of the elevation tiles
-     * (without borders).
+     * (without borders). Maybe NULL to create a fully random fractal %terrain.
      */
     ptr<TileProducer> residualTiles;
+
+    /**
+     * The amplitude of the noise to be added for each level (one amplitude per level).
+     */
+    std::vector<float> noiseAmp;
+
+    /**
+     * The noise values added to the elevation tiles, in 6 layers. These values
+     * are those of ElevationProducer#createNoiseArray, rounded to half
+     * precision like in the GPU noise texture of ElevationProducer. NULL if
+     * #noiseAmp is empty.
+     */
+    float *noise;
+
+    /**
+     * Cube face ID for producers targeting spherical terrains.
+     */
+    int face;
 };
 
 }
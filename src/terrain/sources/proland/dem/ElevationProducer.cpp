@@ -47,7 +47,7 @@ using namespace ork;
 namespace proland
 {
 
-ptr<Texture2DArray> createDemNoise(int tileWidth)
+float *ElevationProducer::createNoiseArray(int tileWidth)
 {
     #define SETNOISE(x,y,v) n[(x) + (y) * tileWidth] = v
     const int layers[6] = {0, 1, 3, 5, 7, 15};
@@ -126,6 +126,12 @@ ptr<Texture2DArray> createDemNoise(int tileWidth)
             }
         }
     }
+    return noiseArray;
+}
+
+ptr<Texture2DArray> createDemNoise(int tileWidth)
+{
+    float *noiseArray = ElevationProducer::createNoiseArray(tileWidth);
     ptr<Texture2DArray> noiseTexture = new Texture2DArray(tileWidth, tileWidth, 6, R16F,
         RED, FLOAT, Texture::Parameters().wrapS(REPEAT).wrapT(REPEAT).min(NEAREST).mag(NEAREST), Buffer::Parameters(), CPUBuffer(noiseArray));
     delete[] noiseArray;
@@ -134,6 +140,84 @@ ptr<Texture2DArray> createDemNoise(int tileWidth)
 
 static_ptr< Factory< int, ptr<Texture2DArray> > > demNoiseFactory(new Factory< int, ptr<Texture2DArray> >(createDemNoise));
 
+void ElevationProducer::getNoiseLayer(int face, int level, int tx, int ty, int *noiseR, int *noiseL)
+{
+    // the noise values on each tile border are selected with the sign of a
+    // Perlin noise evaluated at the middle of this border (the same value is
+    // computed for the two tiles sharing a border, hence the continuity)
+    float x[4];
+    float y[4];
+    if (face == 1) {
+        int offset = 1 << level;
+        x[0] = tx + 0.5; y[0] = ty + offset;
+        if (tx == offset - 1) {
+            x[1] = ty + offset + 0.5; y[1] = offset;
+        } else {
+            x[1] = tx + 1; y[1] = ty + offset + 0.5;
+        }
+        if (ty == offset - 1) {
+            x[2] = (3 * offset - 1 - tx) + 0.5; y[2] = offset;
+        } else {
+            x[2] = tx + 0.5; y[2] = ty + offset + 1;
+        }
+        if (tx == 0) {
+            x[3] = (4 * offset - 1 - ty) + 0.5; y[3] = offset;
+        } else {
+            x[3] = tx; y[3] = ty + offset + 0.5;
+        }
+    } else if (face == 6) {
+        int offset = 1 << level;
+        if (ty == 0) {
+            x[0] = (3 * offset - 1 - tx) + 0.5; y[0] = 0;
+        } else {
+            x[0] = tx + 0.5; y[0] = ty - offset;
+        }
+        if (tx == offset - 1) {
+            x[1] = (2 * offset - 1 - ty) + 0.5; y[1] = 0;
+        } else {
+            x[1] = tx + 1; y[1] = ty - offset + 0.5;
+        }
+        x[2] = tx + 0.5; y[2] = ty - offset + 1;
+        if (tx == 0) {
+            x[3] = 3 * offset + ty + 0.5; y[3] = 0;
+        } else {
+            x[3] = tx; y[3] = ty - offset + 0.5;
+        }
+    } else {
+        int offset = (1 << level) * (face - 2);
+        x[0] = tx + offset + 0.5; y[0] = ty;
+        x[1] = (tx + offset + 1) % (4 << level); y[1] = ty + 0.5;
+        x[2] = tx + offset + 0.5; y[2] = ty + 1;
+        x[3] = tx + offset; y[3] = ty + 0.5;
+    }
+    float borders[4];
+    cnoise(4, x, y, borders);
+    int l = 0;
+    for (int i = 0; i < 4; ++i) {
+        l += borders[i] > 0.0 ? 1 << i : 0;
+    }
+    const int noiseRs[16] = { 0, 0, 1, 0, 2, 0, 1, 0, 3, 3, 1, 3, 2, 2, 1, 0 };
+    const int noiseLs[16] = { 0, 1, 1, 2, 1, 3, 2, 4, 1, 2, 3, 4, 2, 4, 4, 5 };
+    *noiseR = noiseRs[l];
+    *noiseL = noiseLs[l];
+}
+
+void ElevationProducer::getNoiseAmplitudes(const TiXmlElement *e, vector<float> &noiseAmp)
+{
+    if (e->Attribute("noise") != NULL) {
+        string noiseAmps = string(e->Attribute("noise")) + ",";
+        string::size_type start = 0;
+        string::size_type index;
+        while ((index = noiseAmps.find(',', start)) != string::npos) {
+            float value;
+            string amp = noiseAmps.substr(start, index - start);
+            sscanf(amp.c_str(), "%f", &value);
+            noiseAmp.push_back(value);
+            start = index + 1;
+        }
+    }
+}
+
 ptr<FrameBuffer> createDemFramebuffer(pair< ptr<Texture2D> , ptr<Texture2D> > textures)
 {
     int tileWidth = textures.first->getWidth();
@@ -344,33 +428,9 @@ bool ElevationProducer::doCreateTile(int level, int tx, int ty, TileStorage::Slo
 
     float rs = level < int(noiseAmp.size()) ? noiseAmp[level] : 0.0f;
 
-    int noiseL = 0;
-    if (face == 1) {
-        int offset = 1 << level;
-        int bottomB = cnoise(tx + 0.5, ty + offset) > 0.0 ? 1 : 0;
-        int rightB = (tx == offset - 1 ? cnoise(ty + offset + 0.5, offset) : cnoise(tx + 1, ty + offset + 0.5)) > 0.0 ? 2 : 0;
-        int topB = (ty == offset - 1 ? cnoise((3 * offset - 1 - tx) + 0.5, offset) : cnoise(tx + 0.5, ty + offset + 1)) > 0.0 ? 4 : 0;
-        int leftB = (tx == 0 ? cnoise((4 * offset - 1 - ty) + 0.5, offset) : cnoise(tx, ty + offset + 0.5)) > 0.0 ? 8 : 0;
-        noiseL = bottomB + rightB + topB + leftB;
-    } else if (face == 6) {
-        int offset = 1 << level;
-        int bottomB = (ty == 0 ? cnoise((3 * offset - 1 - tx) + 0.5, 0) : cnoise(tx + 0.5, ty - offset)) > 0.0 ? 1 : 0;
-        int rightB = (tx == offset - 1 ? cnoise((2 * offset - 1 - ty) + 0.5, 0) : cnoise(tx + 1, ty - offset + 0.5)) > 0.0 ? 2 : 0;
-        int topB = cnoise(tx + 0.5, ty - offset + 1) > 0.0 ? 4 : 0;
-        int leftB = (tx == 0 ? cnoise(3 * offset + ty + 0.5, 0) : cnoise(tx, ty - offset + 0.5)) > 0.0 ? 8 : 0;
-        noiseL = bottomB + rightB + topB + leftB;
-    } else {
-        int offset = (1 << level) * (face - 2);
-        int bottomB = cnoise(tx + offset + 0.5, ty) > 0.0 ? 1 : 0;
-        int rightB = cnoise((tx + offset + 1) % (4 << level), ty + 0.5) > 0.0 ? 2 : 0;
-        int topB = cnoise(tx + offset + 0.5, ty + 1) > 0.0 ? 4 : 0;
-        int leftB = cnoise(tx + offset, ty + 0.5) > 0.0 ? 8 : 0;
-        noiseL = bottomB + rightB + topB + leftB;
-    }
-    const int noiseRs[16] = { 0, 0, 1, 0, 2, 0, 1, 0, 3, 3, 1, 3, 2, 2, 1, 0 };
-    const int noiseLs[16] = { 0, 1, 1, 2, 1, 3, 2, 4, 1, 2, 3, 4, 2, 4, 4, 5 };
-    int noiseR = noiseRs[noiseL];
-    noiseL = noiseLs[noiseL];
+    int noiseR;
+    int noiseL;
+    getNoiseLayer(face, level, tx, ty, &noiseR, &noiseL);
 
     noiseSamplerU->set(noiseTexture);
     noiseUVLHU->set(vec4f(noiseR, (noiseR + 1) % 4, noiseL, rs));
@@ -485,18 +545,7 @@ void ElevationProducer::init(ptr<ResourceManager> manager, Resource *r, const st
     if (e->Attribute("gridSize") != NULL) {
         r->getIntParameter(desc, e, "gridSize", &gridSize);
     }
-    if (e->Attribute("noise") != NULL) {
-        string noiseAmps = string(e->Attribute("noise")) + ",";
-        string::size_type start = 0;
-        string::size_type index;
-        while ((index = noiseAmps.find(',', start)) != string::npos) {
-            float value;
-            string amp = noiseAmps.substr(start, index - start);
-            sscanf(amp.c_str(), "%f", &value);
-            noiseAmp.push_back(value);
-            start = index + 1;
-        }
-    }
+    getNoiseAmplitudes(e, noiseAmp);
     if (e->Attribute("flip") != NULL && strcmp(e->Attribute("flip"), "true") == 0) {
         flip = true;
     }
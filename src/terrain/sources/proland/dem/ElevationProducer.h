@@ -108,6 +108,42 @@ public:
 
     virtual int getBorder();
 
+    /**
+     * Returns the noise values added to the elevation tiles by this %producer.
+     * The returned array contains 6 layers of tileWidth*tileWidth values in
+     * the range -1..1. The layers differ by their border values, so that
+     * adjacent tiles can use noise values that match along their common
+     * border (see #getNoiseLayer). The caller must delete the returned array.
+     *
+     * @param tileWidth the elevation tile size, including borders.
+     */
+    static float *createNoiseArray(int tileWidth);
+
+    /**
+     * Returns the noise layer and the noise rotation that must be used to
+     * produce the given tile. The noise value at pixel (i,j) of this tile is
+     * the value at pixel (c[noiseR],c[(noiseR+1)%4]) of the layer noiseL of
+     * #createNoiseArray, where c=(i,j,tileWidth-1-i,tileWidth-1-j).
+     *
+     * @param face the cube face ID for spherical terrains, or 0 for flat ones.
+     * @param level the tile's quadtree level.
+     * @param tx the tile's quadtree x coordinate.
+     * @param ty the tile's quadtree y coordinate.
+     * @param[out] noiseR the noise rotation (between 0 and 3).
+     * @param[out] noiseL the noise layer (between 0 and 5).
+     */
+    static void getNoiseLayer(int face, int level, int tx, int ty, int *noiseR, int *noiseL);
+
+    /**
+     * Reads the per level noise amplitudes of an elevation %producer from
+     * the comma separated values of the 'noise' attribute of its resource
+     * descriptor, if present.
+     *
+     * @param e the XML element describing the %producer.
+     * @param[out] noiseAmp the noise amplitudes, one per level.
+     */
+    static void getNoiseAmplitudes(const TiXmlElement *e, std::vector<float> &noiseAmp);
+
 protected:
     ptr<FrameBuffer> frameBuffer;
 
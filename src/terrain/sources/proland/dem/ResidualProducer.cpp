@@ -35,9 +35,11 @@
 #include "ork/core/Logger.h"
 #include "ork/resource/ResourceTemplate.h"
 #include "proland/producer/CPUTileStorage.h"
+#include "proland/util/checksum.h"
 #include "proland/util/mfs.h"
 
 #include <pthread.h>
+#include <cmath>
 #include <cstring>
 
 using namespace std;
@@ -71,6 +73,7 @@ void ResidualProducer::init(ptr<TileCache> cache, const char *name, int deltaLev
 {
     TileProducer::init(cache, false);
     this->name = name;
+    this->checksums = NULL;
 
     if (strlen(name) == 0) {
         this->tileFile = NULL;
@@ -107,6 +110,7 @@ void ResidualProducer::init(ptr<TileCache> cache, const char *name, int deltaLev
         offsets = new unsigned int[ntiles * 2];
         if (tileFile != NULL) {
             fread(offsets, sizeof(unsigned int) * ntiles * 2, 1, tileFile);
+            checksums = readChecksums(tileFile, ntiles);
 #ifndef SINGLE_FILE
             fclose(tileFile);
             tileFile = NULL;
@@ -136,6 +140,7 @@ ResidualProducer::~ResidualProducer()
     delete (pthread_mutex_t*) mutex;
 #endif
     delete[] offsets;
+    delete[] checksums;
 }
 
 int ResidualProducer::getBorder()
@@ -245,6 +250,7 @@ void ResidualProducer::swap(ptr<ResidualProducer> p)
     std::swap(scale, p->scale);
     std::swap(header, p->header);
     std::swap(offsets, p->offsets);
+    std::swap(checksums, p->checksums);
     std::swap(mutex, p->mutex);
     std::swap(tileFile, p->tileFile);
     std::swap(producers, p->producers);
@@ -287,21 +293,28 @@ void ResidualProducer::readTile(int level, int tx, int ty,
         }
     } else {
         int tileid = getTileId(level, tx, ty);
-        int fsize = offsets[2 * tileid + 1] - offsets[2 * tileid];
-        assert(fsize < (tileSize + 5) * (tileSize + 5) * 2);
+        unsigned int start = offsets[2 * tileid];
+        unsigned int end = offsets[2 * tileid + 1];
+        int fsize = (int) (end - start);
+        bool ok = end > start && end - start <= MAX_TILE_SIZE * MAX_TILE_SIZE * 2;
 
+        if (ok) {
 #ifdef SINGLE_FILE
-        pthread_mutex_lock((pthread_mutex_t*) mutex);
-        fseek64(tileFile, header + offsets[2 * tileid], SEEK_SET);
-        fread(compressedData, fsize, 1, tileFile);
-        pthread_mutex_unlock((pthread_mutex_t*) mutex);
+            pthread_mutex_lock((pthread_mutex_t*) mutex);
+            fseek64(tileFile, header + start, SEEK_SET);
+            ok = fread(compressedData, fsize, 1, tileFile) == 1;
+            pthread_mutex_unlock((pthread_mutex_t*) mutex);
 #else
-        FILE *file;
-        fopen(&file, name.c_str(), "rb");
-        fseek64(file, header + offsets[2 * tileid], SEEK_SET);
-        fread(compressedData, fsize, 1, file);
-        fclose(file);
+            FILE *file;
+            fopen(&file, name.c_str(), "rb");
+            ok = file != NULL;
+            if (ok) {
+                fseek64(file, header + start, SEEK_SET);
+                ok = fread(compressedData, fsize, 1, file) == 1;
+                fclose(file);
+            }
 #endif
+        }
         /*ifstream fs(name.c_str(), ios::binary);
         fs.seekg(header + offsets[2 * tileid], ios::beg);
         fs.read((char*) compressedData, fsize);
@@ -309,14 +322,32 @@ void ResidualProducer::readTile(int level, int tx, int ty,
 
         // TODO compare perfs FILE vs ifstream vs mmap
 
-        mfs_file fd;
-        mfs_open(compressedData, fsize, (char *)"r", &fd);
-        TIFF* tf = TIFFClientOpen("name", "r", &fd,
-            (TIFFReadWriteProc) mfs_read, (TIFFReadWriteProc) mfs_write, (TIFFSeekProc) mfs_lseek,
-            (TIFFCloseProc) mfs_close, (TIFFSizeProc) mfs_size, (TIFFMapFileProc) mfs_map,
-            (TIFFUnmapFileProc) mfs_unmap);
-        TIFFReadEncodedStrip(tf, 0, uncompressedData, (tsize_t) -1);
-        TIFFClose(tf);
+        if (ok && checksums != NULL && checksum(compressedData, fsize) != checksums[tileid]) {
+            ok = false;
+        }
+        if (ok) {
+            mfs_file fd;
+            mfs_open(compressedData, fsize, (char *)"r", &fd);
+            TIFF* tf = TIFFClientOpen("name", "r", &fd,
+                (TIFFReadWriteProc) mfs_read, (TIFFReadWriteProc) mfs_write, (TIFFSeekProc) mfs_lseek,
+                (TIFFCloseProc) mfs_close, (TIFFSizeProc) mfs_size, (TIFFMapFileProc) mfs_map,
+                (TIFFUnmapFileProc) mfs_unmap);
+            // the strip size is bounded by the tile size, so that a corrupted
+            // TIFF header cannot overflow the tile data
+            ok = tf != NULL && TIFFReadEncodedStrip(tf, 0, uncompressedData, tilesize * tilesize * 2) == tilesize * tilesize * 2;
+            if (tf != NULL) {
+                TIFFClose(tf);
+            }
+        }
+        if (!ok) {
+            // null residuals, i.e. the upsampled parent tile
+            if (Logger::WARNING_LOGGER != NULL) {
+                ostringstream oss;
+                oss << "Corrupted tile " << level << " " << tx << " " << ty << " in '" << name << "', using parent tile";
+                Logger::WARNING_LOGGER->log("DEM", oss.str());
+            }
+            memset(uncompressedData, 0, tilesize * tilesize * 2);
+        }
 
         if (tile != NULL) {
             for (int j = 0; j < tilesize; ++j) {
@@ -383,6 +414,175 @@ void ResidualProducer::upsample(int level, int tx, int ty, float *parentTile, fl
     }
 }
 
+bool ResidualProducer::writeTiles(const char *file, const map<TileCache::Tile::Id, float*> &tiles)
+{
+    FILE *in = NULL;
+    if ((int) name.size() > 0 && maxLevel >= 0 && name != file) {
+        fopen(&in, name.c_str(), "rb");
+    }
+    if (in == NULL) {
+        if (Logger::ERROR_LOGGER != NULL) {
+            Logger::ERROR_LOGGER->log("DEM", "Cannot write residual tiles to '" + string(file) + "'");
+        }
+        return false;
+    }
+    FILE *out;
+    fopen(&out, file, "wb");
+    if (out == NULL) {
+        if (Logger::ERROR_LOGGER != NULL) {
+            Logger::ERROR_LOGGER->log("DEM", "Cannot open file '" + string(file) + "'");
+        }
+        fclose(in);
+        return false;
+    }
+
+    // finds the stored tile id and level of each replaced tile
+    map<int, pair<int, float*> > replacedTiles;
+    map<TileCache::Tile::Id, float*>::const_iterator i = tiles.begin();
+    while (i != tiles.end()) {
+        int l = i->first.first + deltaLevel - rootLevel;
+        int tx = i->first.second.first;
+        int ty = i->first.second.second;
+        if (l >= 0 && l <= maxLevel && (tx >> l) == rootTx && (ty >> l) == rootTy) {
+            int id = getTileId(l, tx - (rootTx << l), ty - (rootTy << l));
+            replacedTiles.insert(make_pair(id, make_pair(l, i->second)));
+        }
+        i++;
+    }
+
+    // copies the header of the original file; the scale stored in this
+    // header does not include the zscale factor, which is therefore not
+    // applied twice when the new file is loaded
+    int params[6];
+    float fileScale;
+    fread(params, sizeof(int), 6, in);
+    fread(&fileScale, sizeof(float), 1, in);
+    int ntiles = minLevel + ((1 << (max(maxLevel - minLevel, 0) * 2 + 2)) - 1) / 3;
+    unsigned int *newOffsets = new unsigned int[ntiles * 2];
+    unsigned int *newChecksums = new unsigned int[ntiles];
+    fwrite(params, sizeof(int), 6, out);
+    fwrite(&fileScale, sizeof(float), 1, out);
+    fwrite(offsets, sizeof(unsigned int) * ntiles * 2, 1, out);
+
+    int n = tileSize + 5;
+    unsigned char *buffer = new unsigned char[MAX_TILE_SIZE * MAX_TILE_SIZE * 4];
+    unsigned char *compressedData = buffer;
+    unsigned char *uncompressedData = buffer + MAX_TILE_SIZE * MAX_TILE_SIZE * 2;
+    float *residuals = new float[n * n];
+    float *tmp = new float[n * n];
+    int clamped = 0;
+
+    // original offset -> id of the first copy, to keep shared (constant)
+    // tiles shared
+    map<unsigned int, int> copiedTiles;
+    unsigned int offset = 0;
+    for (int id = 0; id < ntiles; ++id) {
+        map<int, pair<int, float*> >::iterator j = replacedTiles.find(id);
+        if (j == replacedTiles.end()) {
+            unsigned int start = offsets[2 * id];
+            unsigned int size = offsets[2 * id + 1] - start;
+            map<unsigned int, int>::iterator k = copiedTiles.find(start);
+            if (k != copiedTiles.end()) {
+                newOffsets[2 * id] = newOffsets[2 * k->second];
+                newOffsets[2 * id + 1] = newOffsets[2 * k->second + 1];
+                newChecksums[id] = newChecksums[k->second];
+                continue;
+            }
+            fseek64(in, header + start, SEEK_SET);
+            fread(compressedData, size, 1, in);
+            fwrite(compressedData, size, 1, out);
+            // keeps the original checksum, if any, so that a corrupted tile
+            // in the original file is still detected in the new one
+            newChecksums[id] = checksums != NULL ? checksums[id] : checksum(compressedData, size);
+            copiedTiles.insert(make_pair(start, id));
+            newOffsets[2 * id] = offset;
+            offset += size;
+            newOffsets[2 * id + 1] = offset;
+            continue;
+        }
+
+        int level = j->second.first;
+        float *tile = j->second.second;
+        int tilesize = getTileSize(level) + 5;
+        if (deltaLevel > 0 && level == deltaLevel) {
+            // the root tile of this producer is the sum of the upsampled
+            // stored tiles of levels 0 to deltaLevel: only the residuals
+            // of level deltaLevel are changed
+            readTile(0, 0, 0, compressedData, uncompressedData, NULL, residuals);
+            for (int l = 1; l < deltaLevel; ++l) {
+                upsample(l, 0, 0, residuals, tmp);
+                readTile(l, 0, 0, compressedData, uncompressedData, tmp, residuals);
+            }
+            upsample(deltaLevel, 0, 0, residuals, tmp);
+            for (int p = 0; p < n * n; ++p) {
+                residuals[p] = tile[p] - tmp[p];
+            }
+        } else {
+            for (int p = 0; p < n * n; ++p) {
+                residuals[p] = tile[p];
+            }
+        }
+
+        for (int y = 0; y < tilesize; ++y) {
+            for (int x = 0; x < tilesize; ++x) {
+                float zf = floor(residuals[x + y * n] / scale + 0.5f);
+                if (zf < -32768.0f || zf > 32767.0f) {
+                    zf = zf < 0.0f ? -32768.0f : 32767.0f;
+                    ++clamped;
+                }
+                short z = short(zf);
+                int off = 2 * (x + y * tilesize);
+                uncompressedData[off] = z & 0xFF;
+                uncompressedData[off + 1] = (z >> 8) & 0xFF;
+            }
+        }
+
+        mfs_file fd;
+        mfs_open(NULL, 0, (char*)"w", &fd);
+        TIFF* tf = TIFFClientOpen("", "w", &fd,
+            (TIFFReadWriteProc) mfs_read, (TIFFReadWriteProc) mfs_write, (TIFFSeekProc) mfs_lseek,
+            (TIFFCloseProc) mfs_close, (TIFFSizeProc) mfs_size, (TIFFMapFileProc) mfs_map,
+            (TIFFUnmapFileProc) mfs_unmap);
+        TIFFSetField(tf, TIFFTAG_IMAGEWIDTH, tilesize);
+        TIFFSetField(tf, TIFFTAG_IMAGELENGTH, tilesize);
+        TIFFSetField(tf, TIFFTAG_COMPRESSION, COMPRESSION_DEFLATE);
+        TIFFSetField(tf, TIFFTAG_ORIENTATION, ORIENTATION_BOTLEFT);
+        TIFFSetField(tf, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tf, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tf, TIFFTAG_SAMPLESPERPIXEL, 2);
+        TIFFSetField(tf, TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFWriteEncodedStrip(tf, 0, uncompressedData, tilesize * tilesize * 2);
+        TIFFClose(tf);
+
+        fwrite(fd.buf, fd.buf_size, 1, out);
+        newChecksums[id] = checksum(fd.buf, fd.buf_size);
+        free(fd.buf);
+
+        newOffsets[2 * id] = offset;
+        offset += fd.buf_size;
+        newOffsets[2 * id + 1] = offset;
+    }
+
+    writeChecksums(out, newChecksums, ntiles);
+    fseek(out, sizeof(int) * 6 + sizeof(float), SEEK_SET);
+    fwrite(newOffsets, sizeof(unsigned int) * ntiles * 2, 1, out);
+    fclose(out);
+    fclose(in);
+
+    if (clamped > 0 && Logger::WARNING_LOGGER != NULL) {
+        ostringstream oss;
+        oss << clamped << " residuals out of range clamped in '" << file << "'";
+        Logger::WARNING_LOGGER->log("DEM", oss.str());
+    }
+
+    delete[] newOffsets;
+    delete[] newChecksums;
+    delete[] buffer;
+    delete[] residuals;
+    delete[] tmp;
+    return true;
+}
+
 void ResidualProducer::init(ptr<ResourceManager> manager, Resource *r, const string &name, ptr<ResourceDescriptor> desc, const TiXmlElement *e)
 {
     e = e == NULL ? desc->descriptor : e;
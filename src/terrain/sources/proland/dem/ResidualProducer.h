@@ -28,6 +28,7 @@
 #ifndef _PROLAND_RESIDUAL_PRODUCER_H_
 #define _PROLAND_RESIDUAL_PRODUCER_H_
 
+#include <map>
 #include <string>
 
 #include "ork/resource/Resource.h"
@@ -138,6 +139,24 @@ protected:
      */
     void upsample(int level, int tx, int ty, float *parentTile, float *result);
 
+    /**
+     * Writes a copy of the file containing the residual tiles, in which some
+     * tiles are replaced with new content. The replaced tiles are quantized
+     * and compressed in the same way as the original ones. The other tiles
+     * are copied without being uncompressed. The new file can then be used
+     * in place of the original one.
+     *
+     * @param file the name of the file to write. Must be different from the
+     *      name of the file from which this %producer loads its tiles.
+     * @param tiles the tiles to replace, indexed by their coordinates in this
+     *      %producer (and not by their stored tile coordinates). Each tile
+     *      must contain the elevations that #doCreateTile should produce,
+     *      borders included. Tiles that are not stored in the file of this
+     *      %producer (i.e. tiles produced by subproducers) are ignored.
+     * @return true if the file was successfully written.
+     */
+    bool writeTiles(const char *file, const std::map<TileCache::Tile::Id, float*> &tiles);
+
 private:
     /**
      * The name of the file containing the residual tiles to load.
@@ -210,6 +229,12 @@ private:
      */
     unsigned int* offsets;
 
+    /**
+     * The checksum of each tile on disk, for each tile id (see #getTileId),
+     * or NULL if the file storing the tiles does not contain checksums.
+     */
+    unsigned int *checksums;
+
     /**
      * A mutex used to serializes accesses to the file storing the tiles.
      */
@@ -253,7 +278,8 @@ private:
 
     /**
      * Reads compressed tile data on disk, uncompress it and scale it with
-     * #scale.
+     * #scale. If the tile is missing or corrupted, null residuals are used
+     * instead, i.e., the tile is replaced with its upsampled parent tile.
      *
      * @param level the level of the tile.
      * @param tx the logical x coordinate of the tile.
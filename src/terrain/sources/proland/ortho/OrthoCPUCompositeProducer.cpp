@@ -0,0 +1,481 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#include "proland/ortho/OrthoCPUCompositeProducer.h"
+
+#include <sstream>
+
+#include "ork/core/Logger.h"
+#include "ork/resource/ResourceTemplate.h"
+#include "ork/taskgraph/TaskGraph.h"
+
+#include "proland/producer/CPUTileStorage.h"
+#include "proland/ortho/OrthoCPUProducer.h"
+
+using namespace std;
+using namespace ork;
+
+namespace proland
+{
+
+/**
+ * Decodes the 4 colors of a DXT color block, as RGB triplets.
+ *
+ * @param block the 8 bytes of the color block.
+ * @param dxt1 true to use the 3 colors mode of DXT1 when c0 <= c1.
+ * @param[out] colors the decoded colors.
+ */
+static void getDXTColors(const unsigned char *block, bool dxt1, int colors[4][3])
+{
+    int c0 = block[0] | (block[1] << 8);
+    int c1 = block[2] | (block[3] << 8);
+    for (int i = 0; i < 2; ++i) {
+        int c = i == 0 ? c0 : c1;
+        int r = (c >> 11) & 31;
+        int g = (c >> 5) & 63;
+        int b = c & 31;
+        colors[i][0] = (r << 3) | (r >> 2);
+        colors[i][1] = (g << 2) | (g >> 4);
+        colors[i][2] = (b << 3) | (b >> 2);
+    }
+    for (int k = 0; k < 3; ++k) {
+        int a = colors[0][k];
+        int b = colors[1][k];
+        if (dxt1 && c0 <= c1) {
+            colors[2][k] = (a + b) / 2;
+            colors[3][k] = 0;
+        } else {
+            colors[2][k] = (2 * a + b + 1) / 3;
+            colors[3][k] = (a + 2 * b + 1) / 3;
+        }
+    }
+}
+
+/**
+ * Decodes the 8 alpha values of a DXT5 alpha block.
+ *
+ * @param block the 8 bytes of the alpha block.
+ * @param[out] alphas the decoded alpha values.
+ */
+static void getDXTAlphas(const unsigned char *block, int alphas[8])
+{
+    int a0 = block[0];
+    int a1 = block[1];
+    alphas[0] = a0;
+    alphas[1] = a1;
+    if (a0 > a1) {
+        for (int i = 1; i < 7; ++i) {
+            alphas[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+        }
+    } else {
+        for (int i = 1; i < 5; ++i) {
+            alphas[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+        }
+        alphas[6] = 0;
+        alphas[7] = 255;
+    }
+}
+
+void OrthoCPUCompositeProducer::uncompressDXT(const unsigned char *src, int tileSize, int channels, unsigned char *dst)
+{
+    assert(channels == 3 || channels == 4);
+    bool dxt1 = channels == 3;
+    int blocks = (tileSize + 3) / 4;
+    int colors[4][3];
+    int alphas[8];
+    for (int by = 0; by < blocks; ++by) {
+        for (int bx = 0; bx < blocks; ++bx) {
+            unsigned int alphaBits[2] = { 0, 0 };
+            if (!dxt1) {
+                getDXTAlphas(src, alphas);
+                // 16 alpha indices of 3 bits each, in two 24 bits groups
+                alphaBits[0] = src[2] | (src[3] << 8) | (src[4] << 16);
+                alphaBits[1] = src[5] | (src[6] << 8) | (src[7] << 16);
+                src += 8;
+            }
+            getDXTColors(src, dxt1, colors);
+            unsigned int colorBits = src[4] | (src[5] << 8) | (src[6] << 16) | ((unsigned int) src[7] << 24);
+            src += 8;
+
+            int w = min(4, tileSize - 4 * bx);
+            int h = min(4, tileSize - 4 * by);
+            for (int j = 0; j < h; ++j) {
+                unsigned char *p = dst + ((4 * by + j) * tileSize + 4 * bx) * channels;
+                for (int i = 0; i < w; ++i) {
+                    int n = 4 * j + i;
+                    int *c = colors[(colorBits >> (2 * n)) & 3];
+                    p[0] = (unsigned char) c[0];
+                    p[1] = (unsigned char) c[1];
+                    p[2] = (unsigned char) c[2];
+                    if (!dxt1) {
+                        p[3] = (unsigned char) alphas[(alphaBits[n / 8] >> (3 * (n % 8))) & 7];
+                    }
+                    p += channels;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Computes the texels and the bilinear interpolation weights used to
+ * upsample a coarse tile, along one axis. See TileProducer#getGpuTileCoords.
+ *
+ * @param tileSize the size of the coarse and of the produced tiles.
+ * @param border the size of the tile borders.
+ * @param dl the level of the produced tile minus the level of the coarse tile.
+ * @param d the coordinate of the produced tile relatively to the first
+ *      tile at its level that is inside the coarse tile.
+ * @param[out] index the first texel used for each produced pixel.
+ * @param[out] weight the weight of the second texel (index + 1) for each
+ *      produced pixel, in 1/256 units.
+ */
+static void getUpsampleWeights(int tileSize, int border, int dl, int d, int *index, int *weight)
+{
+    float dd = float(1 << dl);
+    float ds0 = (tileSize / 2) * 2.0f - 2.0f * border;
+    float ds = ds0 / dd;
+    float x0 = d * ds0 / dd + border - border / dd + (tileSize % 2 == 0 ? 0.0f : 0.5f);
+    float scale = ds / (tileSize - 2 * border);
+    for (int i = 0; i < tileSize; ++i) {
+        // texel coordinates of the center of the produced pixel i; the
+        // texel centers are at half integer coordinates
+        float u = x0 + (i + 0.5f) * scale - 0.5f;
+        int i0 = (int) floor(u);
+        int w = (int) floor((u - i0) * 256.0f + 0.5f);
+        if (w == 256) {
+            i0 += 1;
+            w = 0;
+        }
+        // clamp to edge
+        if (i0 < 0) {
+            i0 = 0;
+            w = 0;
+        } else if (i0 >= tileSize - 1) {
+            i0 = tileSize - 2;
+            w = 256;
+        }
+        index[i] = i0;
+        weight[i] = w;
+    }
+}
+
+void OrthoCPUCompositeProducer::upsample(const unsigned char *src, int tileSize, int border, int channels,
+    int dl, int dx, int dy, unsigned char *dst)
+{
+    assert(tileSize >= 2);
+    int *xi = new int[4 * tileSize];
+    int *xw = xi + tileSize;
+    int *yi = xw + tileSize;
+    int *yw = yi + tileSize;
+    getUpsampleWeights(tileSize, border, dl, dx, xi, xw);
+    getUpsampleWeights(tileSize, border, dl, dy, yi, yw);
+
+    int rowSize = tileSize * channels;
+    for (int j = 0; j < tileSize; ++j) {
+        const unsigned char *r0 = src + yi[j] * rowSize;
+        const unsigned char *r1 = r0 + rowSize;
+        int wy1 = yw[j];
+        int wy0 = 256 - wy1;
+        unsigned char *p = dst + j * rowSize;
+        for (int i = 0; i < tileSize; ++i) {
+            const unsigned char *t00 = r0 + xi[i] * channels;
+            const unsigned char *t10 = r1 + xi[i] * channels;
+            int wx1 = xw[i];
+            int wx0 = 256 - wx1;
+            for (int c = 0; c < channels; ++c) {
+                int v0 = wx0 * t00[c] + wx1 * t00[c + channels];
+                int v1 = wx0 * t10[c] + wx1 * t10[c + channels];
+                p[c] = (unsigned char) ((wy0 * v0 + wy1 * v1 + 32768) >> 16);
+            }
+            p += channels;
+        }
+    }
+
+    delete[] xi;
+}
+
+OrthoCPUCompositeProducer::OrthoCPUCompositeProducer(ptr<TileCache> cache, ptr<TileCache> backgroundCache,
+        ptr<TileProducer> orthoTiles, int maxLevel) :
+    TileProducer("OrthoCPUCompositeProducer", "CreateOrthoCPUCompositeTile")
+{
+    init(cache, backgroundCache, orthoTiles, maxLevel);
+}
+
+OrthoCPUCompositeProducer::OrthoCPUCompositeProducer() :
+    TileProducer("OrthoCPUCompositeProducer", "CreateOrthoCPUCompositeTile")
+{
+}
+
+void OrthoCPUCompositeProducer::init(ptr<TileCache> cache, ptr<TileCache> backgroundCache,
+    ptr<TileProducer> orthoTiles, int maxLevel)
+{
+    TileProducer::init(cache, false);
+    this->orthoTiles = orthoTiles;
+    this->maxLevel = maxLevel;
+    tileSize = cache->getStorage()->getTileSize();
+    channels = cache->getStorage().cast< CPUTileStorage<unsigned char> >()->getChannels();
+    if (orthoTiles != NULL) {
+        ptr<TileStorage> s = orthoTiles->getCache()->getStorage();
+        assert(tileSize == s->getTileSize());
+        assert(channels == s.cast< CPUTileStorage<unsigned char> >()->getChannels());
+        assert(!orthoTiles.cast<OrthoCPUProducer>()->isCompressed() || channels >= 3);
+    }
+
+    if (backgroundCache != NULL) {
+        assert(backgroundCache->getStorage()->getTileSize() == tileSize);
+        coarseCpuTiles = new OrthoCPUCompositeProducer(backgroundCache, NULL, orthoTiles, -1);
+    }
+}
+
+OrthoCPUCompositeProducer::~OrthoCPUCompositeProducer()
+{
+}
+
+void OrthoCPUCompositeProducer::getReferencedProducers(vector< ptr<TileProducer> > &producers) const
+{
+    if (coarseCpuTiles != NULL) {
+        producers.push_back(coarseCpuTiles);
+    }
+    if (orthoTiles != NULL) {
+        producers.push_back(orthoTiles);
+    }
+}
+
+void OrthoCPUCompositeProducer::setRootQuadSize(float size)
+{
+    TileProducer::setRootQuadSize(size);
+    if (orthoTiles != NULL) {
+        orthoTiles->setRootQuadSize(size);
+    }
+}
+
+int OrthoCPUCompositeProducer::getBorder()
+{
+    return orthoTiles == NULL ? 2 : orthoTiles->getBorder();
+}
+
+bool OrthoCPUCompositeProducer::hasTile(int level, int tx, int ty)
+{
+    if (hasLayers()) {
+        return maxLevel == -1 || level <= maxLevel;
+    } else {
+        return orthoTiles == NULL ? (maxLevel == -1 || level <= maxLevel) : orthoTiles->hasTile(level, tx, ty);
+    }
+}
+
+bool OrthoCPUCompositeProducer::prefetchTile(int level, int tx, int ty)
+{
+    bool b = TileProducer::prefetchTile(level, tx, ty);
+    if (!b) {
+        int l;
+        int x;
+        int y;
+        if (getCoarseTile(level, tx, ty, l, x, y)) {
+            coarseCpuTiles->prefetchTile(l, x, y);
+        } else if (orthoTiles != NULL) {
+            orthoTiles->prefetchTile(level, tx, ty);
+        }
+    }
+    return b;
+}
+
+ptr<Task> OrthoCPUCompositeProducer::startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> owner)
+{
+    ptr<TaskGraph> result = owner == NULL ? createTaskGraph(task) : owner;
+    if (orthoTiles != NULL) {
+        TileCache::Tile *t;
+        int l;
+        int x;
+        int y;
+        if (getCoarseTile(level, tx, ty, l, x, y)) {
+            t = coarseCpuTiles->getTile(l, x, y, deadline);
+        } else {
+            t = orthoTiles->getTile(level, tx, ty, deadline);
+        }
+        assert(t != NULL);
+        result->addTask(t->task);
+        result->addDependency(task, t->task);
+    }
+
+    // calls each layer so that it can complete the task graph
+    // with the necessary sub tasks
+    TileProducer::startCreateTile(level, tx, ty, deadline, task, result);
+
+    return result;
+}
+
+bool OrthoCPUCompositeProducer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *data)
+{
+    if (Logger::DEBUG_LOGGER != NULL) {
+        ostringstream oss;
+        oss << "CPU composite tile " << getId() << " " << level << " " << tx << " " << ty;
+        Logger::DEBUG_LOGGER->log("ORTHO", oss.str());
+    }
+
+    CPUTileStorage<unsigned char>::CPUSlot *cpuData = dynamic_cast<CPUTileStorage<unsigned char>::CPUSlot*>(data);
+    assert(cpuData != NULL);
+
+    if (orthoTiles != NULL) {
+        int l;
+        int x;
+        int y;
+        if (getCoarseTile(level, tx, ty, l, x, y)) {
+            TileCache::Tile *coarseTile = coarseCpuTiles->findTile(l, x, y);
+            assert(coarseTile != NULL);
+            CPUTileStorage<unsigned char>::CPUSlot *coarseData = dynamic_cast<CPUTileStorage<unsigned char>::CPUSlot*>(coarseTile->getData());
+            assert(coarseData != NULL);
+            int dl = level - l;
+            upsample(coarseData->data, tileSize, getBorder(), channels,
+                dl, tx - (x << dl), ty - (y << dl), cpuData->data);
+        } else {
+            TileCache::Tile *t = orthoTiles->findTile(level, tx, ty);
+            assert(t != NULL);
+            CPUTileStorage<unsigned char>::CPUSlot *orthoData = dynamic_cast<CPUTileStorage<unsigned char>::CPUSlot*>(t->getData());
+            assert(orthoData != NULL);
+            if (orthoTiles.cast<OrthoCPUProducer>()->isCompressed()) {
+                uncompressDXT(orthoData->data, tileSize, channels, cpuData->data);
+            } else {
+                memcpy(cpuData->data, orthoData->data, tileSize * tileSize * channels);
+            }
+        }
+    } else {
+        memset(cpuData->data, 0, cpuData->size);
+    }
+
+    if (hasLayers()) {
+        TileProducer::doCreateTile(level, tx, ty, data);
+    }
+
+    return true;
+}
+
+void OrthoCPUCompositeProducer::stopCreateTile(int level, int tx, int ty)
+{
+    if (orthoTiles != NULL) {
+        TileCache::Tile *t;
+        int l;
+        int x;
+        int y;
+        if (getCoarseTile(level, tx, ty, l, x, y)) {
+            t = coarseCpuTiles->findTile(l, x, y);
+            assert(t != NULL);
+            coarseCpuTiles->putTile(t);
+        } else {
+            t = orthoTiles->findTile(level, tx, ty);
+            assert(t != NULL);
+            orthoTiles->putTile(t);
+        }
+    }
+
+    TileProducer::stopCreateTile(level, tx, ty);
+}
+
+void OrthoCPUCompositeProducer::swap(ptr<OrthoCPUCompositeProducer> p)
+{
+    TileProducer::swap(p);
+    std::swap(orthoTiles, p->orthoTiles);
+    std::swap(coarseCpuTiles, p->coarseCpuTiles);
+    std::swap(channels, p->channels);
+    std::swap(tileSize, p->tileSize);
+    std::swap(maxLevel, p->maxLevel);
+}
+
+bool OrthoCPUCompositeProducer::getCoarseTile(int level, int tx, int ty, int &l, int &x, int &y)
+{
+    if (orthoTiles == NULL || !hasLayers() || orthoTiles->hasTile(level, tx, ty)) {
+        return false;
+    }
+    assert(coarseCpuTiles != NULL);
+    l = level;
+    x = tx;
+    y = ty;
+    while (!coarseCpuTiles->hasTile(l, x, y)) {
+        l -= 1;
+        x /= 2;
+        y /= 2;
+    }
+    return true;
+}
+
+class OrthoCPUCompositeProducerResource : public ResourceTemplate<3, OrthoCPUCompositeProducer>
+{
+public:
+    OrthoCPUCompositeProducerResource(ptr<ResourceManager> manager, const string &name, ptr<ResourceDescriptor> desc,
+            const TiXmlElement *e = NULL) :
+        ResourceTemplate<3, OrthoCPUCompositeProducer> (manager, name, desc)
+    {
+        e = e == NULL ? desc->descriptor : e;
+        ptr<TileCache> cache;
+        ptr<TileCache> backgroundCache;
+        ptr<TileProducer> ortho;
+        int maxLevel = -1;
+        checkParameters(desc, e, "name,cache,backgroundCache,ortho,maxLevel,");
+        cache = manager->loadResource(getParameter(desc, e, "cache")).cast<TileCache>();
+        if (e->Attribute("backgroundCache") != NULL) {
+            backgroundCache = manager->loadResource(getParameter(desc, e, "backgroundCache")).cast<TileCache>();
+        }
+        if (e->Attribute("ortho") != NULL) {
+            ortho = manager->loadResource(getParameter(desc, e, "ortho")).cast<TileProducer>();
+        }
+        if (e->Attribute("maxLevel") != NULL) {
+            getIntParameter(desc, e, "maxLevel", &maxLevel);
+        }
+
+        bool hasLayers = false;
+        const TiXmlNode *n = e->FirstChild();
+        while (n != NULL) {
+            const TiXmlElement *f = n->ToElement();
+            if (f == NULL) {
+                n = n->NextSibling();
+                continue;
+            }
+
+            ptr<TileLayer> l = manager->loadResource(desc, f).cast<TileLayer>();
+
+            if (l != NULL) {
+                addLayer(l);
+                hasLayers = true;
+            } else {
+                if (Logger::WARNING_LOGGER != NULL) {
+                    log(Logger::WARNING_LOGGER, desc, f, "Unknown scene node element '" + f->ValueStr() + "'");
+                }
+            }
+            n = n->NextSibling();
+        }
+
+        assert(ortho != NULL || hasLayers);
+
+        init(cache, backgroundCache, ortho, maxLevel);
+    }
+};
+
+extern const char orthoCpuCompositeProducer[] = "orthoCpuCompositeProducer";
+
+static ResourceFactory::Type<orthoCpuCompositeProducer, OrthoCPUCompositeProducerResource> OrthoCPUCompositeProducerType;
+
+}
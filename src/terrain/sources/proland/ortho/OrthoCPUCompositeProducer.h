@@ -0,0 +1,194 @@
+/*
+ * Proland: a procedural landscape rendering library.
+ * Copyright (c) 2008-2011 INRIA
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Proland is distributed under a dual-license scheme.
+ * You can obtain a specific license from Inria: proland-licensing@inria.fr.
+ */
+
+/*
+ * Authors: Eric Bruneton, Antoine Begault, Guillaume Piolat.
+ */
+
+#ifndef _PROLAND_ORTHO_CPU_COMPOSITE_PRODUCER_H_
+#define _PROLAND_ORTHO_CPU_COMPOSITE_PRODUCER_H_
+
+#include "proland/producer/TileProducer.h"
+
+namespace proland
+{
+
+/**
+ * A TileProducer to create final texture tiles on CPU from CPU texture
+ * tiles. This %producer is the CPU equivalent of OrthoGPUProducer, and can
+ * be used without any OpenGL context (e.g., to precompute or to check the
+ * produced tiles offline). It uncompresses the DXT tiles of an
+ * OrthoCPUProducer on CPU, or copies them if they are not compressed. If
+ * layers are used, it can produce tiles whose level is greater than the
+ * maximum level of the CPU tile %producer, by upsampling a coarser tile
+ * (produced by a background OrthoCPUCompositeProducer) exactly like
+ * OrthoGPUProducer does with its upsample shader. The layers must draw on
+ * CPU (like those of an OrthoCPUProducer). Tiles being created in parallel
+ * by the Scheduler threads, several tiles are produced in parallel.
+ * The produced tiles are equal to those of OrthoGPUProducer, up to the
+ * rounding errors of the GPU DXT decoder and of the GPU bilinear texture
+ * filtering, i.e., within +/-2 per 8 bits component.
+ * @ingroup ortho
+ * @authors Eric Bruneton, Antoine Begault, Guillaume Piolat
+ */
+PROLAND_API class OrthoCPUCompositeProducer : public TileProducer
+{
+public:
+    /**
+     * Creates a new OrthoCPUCompositeProducer.
+     *
+     * @param cache the cache to store the produced tiles. The underlying
+     *      storage must be a CPUTileStorage of unsigned char type. The size
+     *      of tiles in this storage size must be equal to the size of the
+     *      tiles produced by orthoTiles, and their number of channels must
+     *      be the same.
+     * @param backgroundCache an intermediate cache to store the CPU tiles
+     *      to be enlarged to produce zoomed in versions. Only necessary if
+     *      layers are used, and if you want to produce tiles of level
+     *      greater than the maximum level of orthoTiles. Its storage must
+     *      be similar to the storage of cache.
+     * @param orthoTiles the %producer producing the CPU tiles. This
+     *      %producer should produce its tiles in a CPUTileStorage of
+     *      unsigned byte type. Maybe NULL if layers are used (in this case
+     *      tiles are produced enterily with the layers).
+     * @param maxLevel maximum quadtree level, or -1 to allow any level.
+     */
+    OrthoCPUCompositeProducer(ptr<TileCache> cache, ptr<TileCache> backgroundCache,
+        ptr<TileProducer> orthoTiles, int maxLevel = -1);
+
+    /**
+     * Deletes this OrthoCPUCompositeProducer.
+     */
+    virtual ~OrthoCPUCompositeProducer();
+
+    virtual void getReferencedProducers(std::vector< ptr<TileProducer> > &producers) const;
+
+    virtual void setRootQuadSize(float size);
+
+    virtual int getBorder();
+
+    virtual bool hasTile(int level, int tx, int ty);
+
+    virtual bool prefetchTile(int level, int tx, int ty);
+
+    /**
+     * Uncompresses a DXT1 (3 channels) or DXT5 (4 channels) texture tile.
+     *
+     * @param src the compressed tile data.
+     * @param tileSize the width and height of the tile, in pixels.
+     * @param channels the number of components per pixel of the
+     *      uncompressed tile (3 for DXT1 data, 4 for DXT5 data).
+     * @param[out] dst the uncompressed tile data, of size
+     *      tileSize*tileSize*channels.
+     */
+    static void uncompressDXT(const unsigned char *src, int tileSize, int channels, unsigned char *dst);
+
+    /**
+     * Computes a tile by upsampling a part of a coarser tile, with
+     * bilinear interpolation. This is the CPU version of the upsample
+     * shader of OrthoGPUProducer.
+     *
+     * @param src the coarse tile data.
+     * @param tileSize the width and height of the coarse and of the
+     *      produced tiles, in pixels, borders included.
+     * @param border the size of the tile borders, in pixels.
+     * @param channels the number of components per pixel.
+     * @param dl the level of the produced tile minus the level of the
+     *      coarse tile.
+     * @param dx the x coordinate of the produced tile relatively to the
+     *      first tile at its level that is inside the coarse tile.
+     * @param dy the y coordinate of the produced tile relatively to the
+     *      first tile at its level that is inside the coarse tile.
+     * @param[out] dst the produced tile data.
+     */
+    static void upsample(const unsigned char *src, int tileSize, int border, int channels,
+        int dl, int dx, int dy, unsigned char *dst);
+
+protected:
+    /**
+     * Creates an uninitialized OrthoCPUCompositeProducer.
+     */
+    OrthoCPUCompositeProducer();
+
+    /**
+     * Initializes this OrthoCPUCompositeProducer. See #OrthoCPUCompositeProducer.
+     */
+    void init(ptr<TileCache> cache, ptr<TileCache> backgroundCache,
+        ptr<TileProducer> orthoTiles, int maxLevel = -1);
+
+    virtual ptr<Task> startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> owner);
+
+    virtual bool doCreateTile(int level, int tx, int ty, TileStorage::Slot *data);
+
+    virtual void stopCreateTile(int level, int tx, int ty);
+
+    virtual void swap(ptr<OrthoCPUCompositeProducer> p);
+
+private:
+    /**
+     * The %producer producing the CPU tiles. Maybe NULL if layers are used
+     * (in this case tiles are produced enterily with the layers).
+     */
+    ptr<TileProducer> orthoTiles;
+
+    /**
+     * An intermediate OrthoCPUCompositeProducer to produce the CPU tiles
+     * to be enlarged to produce zoomed in versions. Only necessary if
+     * layers are used, and if you want to produce tiles of level greater
+     * than the maximum level of #orthoTiles.
+     */
+    ptr<TileProducer> coarseCpuTiles;
+
+    /**
+     * The number of components per pixel of the produced tiles.
+     */
+    int channels;
+
+    /**
+     * The size of the produced tiles, including borders.
+     */
+    int tileSize;
+
+    /**
+     * Maximum quadtree level, or -1 to allow any level.
+     */
+    int maxLevel;
+
+    /**
+     * Returns the coarse tile to be upsampled to produce the given tile,
+     * if this tile must be produced by upsampling.
+     *
+     * @param level the level of the tile to produce.
+     * @param tx the logical x coordinate of the tile to produce.
+     * @param ty the logical y coordinate of the tile to produce.
+     * @param[out] l the level of the coarse tile.
+     * @param[out] x the logical x coordinate of the coarse tile.
+     * @param[out] y the logical y coordinate of the coarse tile.
+     * @return true if the given tile must be produced by upsampling.
+     */
+    bool getCoarseTile(int level, int tx, int ty, int &l, int &x, int &y);
+};
+
+}
+
+#endif
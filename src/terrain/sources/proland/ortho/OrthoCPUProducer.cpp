@@ -36,7 +36,11 @@
 
 #include "ork/core/Logger.h"
 #include "ork/resource/ResourceTemplate.h"
+#include "ork/taskgraph/TaskGraph.h"
+#include "proland/ortho/OrthoCPUCompositeProducer.h"
+#include "proland/preprocess/terrain/Util.h"
 #include "proland/producer/CPUTileStorage.h"
+#include "proland/util/checksum.h"
 #include "proland/util/mfs.h"
 
 #include <pthread.h>
@@ -72,6 +76,7 @@ void OrthoCPUProducer::init(ptr<TileCache> cache, const char *name)
 {
     TileProducer::init(cache, false);
     this->name = name;
+    this->checksums = NULL;
     if (strlen(name) == 0) {
         maxLevel = 1;
         tileSize = 0;
@@ -105,6 +110,7 @@ void OrthoCPUProducer::init(ptr<TileCache> cache, const char *name)
         offsets = new long long[2 * ntiles];
         if (tileFile != NULL) {
             fread(offsets, sizeof(long long) * ntiles * 2, 1, tileFile);
+            checksums = readChecksums(tileFile, ntiles);
     #ifndef SINGLE_FILE
             fclose(tileFile);
             tileFile = NULL;
@@ -133,6 +139,7 @@ OrthoCPUProducer::~OrthoCPUProducer()
     delete (pthread_mutex_t*) mutex;
 #endif
     delete[] offsets;
+    delete[] checksums;
 }
 
 int OrthoCPUProducer::getBorder()
@@ -142,7 +149,7 @@ int OrthoCPUProducer::getBorder()
 
 bool OrthoCPUProducer::hasTile(int level, int tx, int ty)
 {
-    return level <= maxLevel;
+    return level <= maxLevel || ((int) name.size() == 0 && hasLayers());
 }
 
 bool OrthoCPUProducer::isCompressed()
@@ -150,6 +157,17 @@ bool OrthoCPUProducer::isCompressed()
     return dxt;
 }
 
+ptr<Task> OrthoCPUProducer::startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> owner)
+{
+    if (!hasLayers()) {
+        return TileProducer::startCreateTile(level, tx, ty, deadline, task, owner);
+    }
+    // the layers may need to add sub tasks, such as the creation of graph tiles
+    ptr<TaskGraph> result = owner == NULL ? createTaskGraph(task) : owner;
+    TileProducer::startCreateTile(level, tx, ty, deadline, task, result);
+    return result;
+}
+
 bool OrthoCPUProducer::doCreateTile(int level, int tx, int ty, TileStorage::Slot *data)
 {
     if (Logger::DEBUG_LOGGER != NULL) {
@@ -161,8 +179,6 @@ bool OrthoCPUProducer::doCreateTile(int level, int tx, int ty, TileStorage::Slot
     CPUTileStorage<unsigned char>::CPUSlot *cpuData = dynamic_cast<CPUTileStorage<unsigned char>::CPUSlot*>(data);
     assert(cpuData != NULL);
 
-    int tileid = getTileId(level, tx, ty);
-
     if ((int) name.size() == 0) {
         for (int i = 0; i < cpuData->size; i++) {
             cpuData->data[i] = 0;
@@ -178,57 +194,24 @@ bool OrthoCPUProducer::doCreateTile(int level, int tx, int ty, TileStorage::Slot
             pthread_setspecific(*((pthread_key_t*) key), compressedData);
         }
 
-        int fsize = (int) (offsets[2 * tileid + 1] - offsets[2 * tileid]);
-        assert(fsize < (tileSize + 2*border) * (tileSize + 2*border) * channels * 2);
-
+        int size = readTile(level, tx, ty, compressedData, cpuData->data);
+        if (size == 0) {
+            if (Logger::WARNING_LOGGER != NULL) {
+                ostringstream oss;
+                oss << "Corrupted tile " << level << " " << tx << " " << ty << " in '" << name << "', using parent tile";
+                Logger::WARNING_LOGGER->log("ORTHO", oss.str());
+            }
+            size = readParentTile(level, tx, ty, compressedData, cpuData->data);
+        }
         if (dxt) {
-    #ifdef SINGLE_FILE
-            pthread_mutex_lock((pthread_mutex_t*) mutex);
-            fseek64(tileFile, header + offsets[2 * tileid], SEEK_SET);
-            fread(cpuData->data, fsize, 1, tileFile);
-            pthread_mutex_unlock((pthread_mutex_t*) mutex);
-    #else
-            FILE *file;
-            fopen(&file, name.c_str(), "rb");
-            fseek64(file, header + offsets[2 * tileid], SEEK_SET);
-            fread(cpuData->data, fsize, 1, file);
-            fclose(file);
-            /*ifstream fs(name.c_str(), ios::binary);
-            fs.seekg(header + offsets[2 * tileid], ios::beg);
-            fs.read((char*) cpuData->data, fsize);
-            fs.close();*/
-    #endif
-            cpuData->size = fsize;
-        } else {
-            unsigned char* srcData = compressedData;
-    #ifdef SINGLE_FILE
-            pthread_mutex_lock((pthread_mutex_t*) mutex);
-            fseek64(tileFile, header + offsets[2 * tileid], SEEK_SET);
-            fread(compressedData, fsize, 1, tileFile);
-            pthread_mutex_unlock((pthread_mutex_t*) mutex);
-    #else
-            FILE *file;
-            fopen(&file, name.c_str(), "rb");
-            fseek64(file, header + offsets[2 * tileid], SEEK_SET);
-            fread(compressedData, fsize, 1, file);
-            fclose(file);
-            /*ifstream fs(name.c_str(), ios::binary);
-            fs.seekg(header + offsets[2 * tileid], ios::beg);
-            fs.read((char*) src, fsize);
-            fs.close();*/
-    #endif
-
-            mfs_file fd;
-            mfs_open(srcData, fsize, (char *)"r", &fd);
-            TIFF* tf = TIFFClientOpen("name", "r", &fd,
-                (TIFFReadWriteProc) mfs_read, (TIFFReadWriteProc) mfs_write, (TIFFSeekProc) mfs_lseek,
-                (TIFFCloseProc) mfs_close, (TIFFSizeProc) mfs_size, (TIFFMapFileProc) mfs_map,
-                (TIFFUnmapFileProc) mfs_unmap);
-            TIFFReadEncodedStrip(tf, 0, cpuData->data, (tsize_t) -1);
-            TIFFClose(tf);
+            cpuData->size = size;
         }
     }
 
+    if (hasLayers() && !dxt) {
+        TileProducer::doCreateTile(level, tx, ty, data);
+    }
+
     return true;
 }
 
@@ -241,15 +224,127 @@ void OrthoCPUProducer::swap(ptr<OrthoCPUProducer> p)
     std::swap(maxLevel, p->maxLevel);
     std::swap(dxt, p->dxt);
     std::swap(offsets, p->offsets);
+    std::swap(checksums, p->checksums);
     std::swap(mutex, p->mutex);
     std::swap(tileFile, p->tileFile);
 }
 
+int OrthoCPUProducer::readCompressedTile(int level, int tx, int ty, unsigned char *data)
+{
+    assert((int) name.size() > 0 && level <= maxLevel);
+    int n = tileSize + 2 * border;
+    return readTileData(level, tx, ty, data, n * n * channels * 2);
+}
+
 int OrthoCPUProducer::getTileId(int level, int tx, int ty)
 {
     return tx + ty * (1 << level) + ((1 << (2 * level)) - 1) / 3;
 }
 
+int OrthoCPUProducer::readTileData(int level, int tx, int ty, unsigned char *data, int maxSize)
+{
+    int tileid = getTileId(level, tx, ty);
+    long long start = offsets[2 * tileid];
+    long long end = offsets[2 * tileid + 1];
+    if (start < 0 || end <= start || end - start > maxSize) {
+        return 0;
+    }
+    int fsize = (int) (end - start);
+    bool ok;
+#ifdef SINGLE_FILE
+    pthread_mutex_lock((pthread_mutex_t*) mutex);
+    fseek64(tileFile, header + start, SEEK_SET);
+    ok = fread(data, fsize, 1, tileFile) == 1;
+    pthread_mutex_unlock((pthread_mutex_t*) mutex);
+#else
+    FILE *file;
+    fopen(&file, name.c_str(), "rb");
+    ok = file != NULL;
+    if (ok) {
+        fseek64(file, header + start, SEEK_SET);
+        ok = fread(data, fsize, 1, file) == 1;
+        fclose(file);
+    }
+    /*ifstream fs(name.c_str(), ios::binary);
+    fs.seekg(header + start, ios::beg);
+    fs.read((char*) data, fsize);
+    fs.close();*/
+#endif
+    if (ok && checksums != NULL && checksum(data, fsize) != checksums[tileid]) {
+        ok = false;
+    }
+    return ok ? fsize : 0;
+}
+
+int OrthoCPUProducer::readTile(int level, int tx, int ty, unsigned char *compressedData, unsigned char *data)
+{
+    int n = tileSize + 2 * border;
+    if (dxt) {
+        return readTileData(level, tx, ty, data, n * n * channels);
+    }
+    int fsize = readTileData(level, tx, ty, compressedData, MAX_TILE_SIZE * MAX_TILE_SIZE * 4 * 2);
+    if (fsize == 0) {
+        return 0;
+    }
+    mfs_file fd;
+    mfs_open(compressedData, fsize, (char *)"r", &fd);
+    TIFF* tf = TIFFClientOpen("name", "r", &fd,
+        (TIFFReadWriteProc) mfs_read, (TIFFReadWriteProc) mfs_write, (TIFFSeekProc) mfs_lseek,
+        (TIFFCloseProc) mfs_close, (TIFFSizeProc) mfs_size, (TIFFMapFileProc) mfs_map,
+        (TIFFUnmapFileProc) mfs_unmap);
+    if (tf == NULL) {
+        return 0;
+    }
+    // the strip size is bounded by the tile size, so that a corrupted
+    // TIFF header cannot overflow the tile data
+    int size = n * n * channels;
+    bool ok = TIFFReadEncodedStrip(tf, 0, data, size) == size;
+    TIFFClose(tf);
+    return ok ? size : 0;
+}
+
+int OrthoCPUProducer::readParentTile(int level, int tx, int ty, unsigned char *compressedData, unsigned char *data)
+{
+    int n = tileSize + 2 * border;
+    unsigned char *parent = new unsigned char[n * n * 4];
+    unsigned char *tile = dxt ? new unsigned char[n * n * 4] : data;
+    int l = level - 1;
+    while (l >= 0) {
+        int dl = level - l;
+        if (readTile(l, tx >> dl, ty >> dl, compressedData, dxt ? tile : parent) > 0) {
+            if (dxt) {
+                OrthoCPUCompositeProducer::uncompressDXT(tile, n, channels, parent);
+            }
+            OrthoCPUCompositeProducer::upsample(parent, n, border, channels, dl, tx - ((tx >> dl) << dl), ty - ((ty >> dl) << dl), tile);
+            break;
+        }
+        --l;
+    }
+    if (l < 0) {
+        // no valid ancestor tile
+        for (int i = 0; i < n * n * channels; ++i) {
+            tile[i] = 0;
+        }
+    }
+    int size = n * n * channels;
+    if (dxt) {
+        if (channels == 4) {
+            CompressImageDXT5(tile, data, n, n, size);
+        } else {
+            for (int i = 0; i < n * n; ++i) {
+                parent[4 * i] = tile[3 * i];
+                parent[4 * i + 1] = tile[3 * i + 1];
+                parent[4 * i + 2] = tile[3 * i + 2];
+                parent[4 * i + 3] = 255;
+            }
+            CompressImageDXT1(parent, data, n, n, size);
+        }
+        delete[] tile;
+    }
+    delete[] parent;
+    return size;
+}
+
 class OrthoCPUProducerResource : public ResourceTemplate<2, OrthoCPUProducer>
 {
 public:
@@ -266,6 +361,25 @@ public:
             file = manager->getLoader()->findResource(file);
         }
         init(cache, file.c_str());
+
+        const TiXmlNode *n = e->FirstChild();
+        while (n != NULL) {
+            const TiXmlElement *f = n->ToElement();
+            if (f == NULL) {
+                n = n->NextSibling();
+                continue;
+            }
+
+            ptr<TileLayer> l = manager->loadResource(desc, f).cast<TileLayer>();
+            if (l != NULL) {
+                addLayer(l);
+            } else {
+                if (Logger::WARNING_LOGGER != NULL) {
+                    log(Logger::WARNING_LOGGER, desc, f, "Unknown scene node element '" + f->ValueStr() + "'");
+                }
+            }
+            n = n->NextSibling();
+        }
     }
 };
 
@@ -43,7 +43,11 @@ namespace proland
 
 /**
  * A TileProducer to load any kind of texture tile from disk to CPU memory.
- * See \ref sec-orthocpu.
+ * Layers can be added to this %producer to draw on top of the loaded tiles
+ * (or on top of empty tiles if there is no file to load) on CPU, such as
+ * the graph layers, which then use a CPURasterizer. Tiles being created in
+ * parallel by the Scheduler threads, the layers of different tiles are then
+ * drawn in parallel. See \ref sec-orthocpu.
  * @ingroup ortho
  * @authors Eric Bruneton, Antoine Begault
  */
@@ -92,10 +96,27 @@ protected:
      */
     virtual void init(ptr<TileCache> cache, const char *name);
 
+    virtual ptr<Task> startCreateTile(int level, int tx, int ty, unsigned int deadline, ptr<Task> task, ptr<TaskGraph> owner);
+
     virtual bool doCreateTile(int level, int tx, int ty, TileStorage::Slot *data);
 
     virtual void swap(ptr<OrthoCPUProducer> p);
 
+    /**
+     * Reads the data of a tile as it is stored on disk, i.e. without
+     * uncompressing it. This tile must be stored in the file of this
+     * %producer (see #hasTile).
+     *
+     * @param level the level of the tile.
+     * @param tx the logical x coordinate of the tile.
+     * @param ty the logical y coordinate of the tile.
+     * @param data where the tile data must be stored. Its size must be at
+     *      least twice the size of an uncompressed tile.
+     * @return the size of the tile data, in bytes, or 0 if this tile is
+     *      missing or corrupted in the file of this %producer.
+     */
+    int readCompressedTile(int level, int tx, int ty, unsigned char *data);
+
 private:
     /**
      * The name of the file containing the residual tiles to load.
@@ -141,6 +162,12 @@ private:
      */
     long long* offsets;
 
+    /**
+     * The checksum of each tile on disk, for each tile id (see #getTileId),
+     * or NULL if the file storing the tiles does not contain checksums.
+     */
+    unsigned int *checksums;
+
     /**
      * A mutex used to serializes accesses to the file storing the tiles.
      */
@@ -166,6 +193,48 @@ private:
      * @return the id of the given tile.
      */
     int getTileId(int level, int tx, int ty);
+
+    /**
+     * Reads the data of a tile as it is stored on disk, and checks it with
+     * its checksum, if available.
+     *
+     * @param level the level of the tile.
+     * @param tx the logical x coordinate of the tile.
+     * @param ty the logical y coordinate of the tile.
+     * @param data where the tile data must be stored.
+     * @param maxSize the size of data, in bytes.
+     * @return the size of the tile data, in bytes, or 0 if this tile is
+     *      missing or corrupted.
+     */
+    int readTileData(int level, int tx, int ty, unsigned char *data, int maxSize);
+
+    /**
+     * Reads a tile and uncompresses it, unless it is compressed in DXT
+     * format.
+     *
+     * @param level the level of the tile.
+     * @param tx the logical x coordinate of the tile.
+     * @param ty the logical y coordinate of the tile.
+     * @param compressedData where the compressed tile data must be stored.
+     * @param data where the tile data must be stored.
+     * @return the size of the tile data, in bytes, or 0 if this tile is
+     *      missing or corrupted.
+     */
+    int readTile(int level, int tx, int ty, unsigned char *compressedData, unsigned char *data);
+
+    /**
+     * Computes a tile by upsampling its nearest ancestor tile that is
+     * not corrupted. Used to replace missing or corrupted tiles.
+     *
+     * @param level the level of the tile.
+     * @param tx the logical x coordinate of the tile.
+     * @param ty the logical y coordinate of the tile.
+     * @param compressedData where the compressed tile data can be stored.
+     * @param data where the tile data must be stored, compressed in DXT
+     *      format if the tiles of this %producer are DXT compressed.
+     * @return the size of the tile data, in bytes.
+     */
+    int readParentTile(int level, int tx, int ty, unsigned char *compressedData, unsigned char *data);
 };
 
 }
@@ -31,6 +31,7 @@
 
 #include "ork/core/Object.h"
 #include "proland/preprocess/terrain/Util.h"
+#include "proland/util/checksum.h"
 #include "proland/util/mfs.h"
 
 #define RESIDUAL_STEPS 2
@@ -50,6 +51,7 @@ ColorMipmap::ColorMipmap(ColorFunction *colorf, int baseLevelSize, int tileSize,
     tile = new unsigned char[(tileSize + 2*border) * (tileSize + 2*border) * channels];
     rgbaTile = new unsigned char[(tileSize + 2*border) * (tileSize + 2*border) * 4];
     dxtTile = new unsigned char[(tileSize + 2*border) * (tileSize + 2*border) * 4];
+    checksums = NULL;
     left = NULL;
     right = NULL;
     bottom = NULL;
@@ -108,6 +110,7 @@ void ColorMipmap::generate(int rootLevel, int rootTx, int rootTy, bool dxt, bool
         fopen(&f, file.c_str(), "wb");
         int nTiles = ((1 << (maxLevel * 2 + 2)) - 1) / 3;
         long long *offsets = new long long[nTiles * 2];
+        checksums = new unsigned int[nTiles];
         fwrite(&maxLevel, sizeof(int), 1, f);
         fwrite(&tileSize, sizeof(int), 1, f);
         fwrite(&fchannels, sizeof(int), 1, f);
@@ -121,11 +124,14 @@ void ColorMipmap::generate(int rootLevel, int rootTx, int rootTy, bool dxt, bool
         for (int l = 0; l <= maxLevel; ++l) {
             produceTilesLebeguesOrder(l, 0, 0, 0, &offset, offsets, f);
         }
+        writeChecksums(f, checksums, nTiles);
         fseek(f, sizeof(int) * 7, SEEK_SET);
         fwrite(offsets, sizeof(long long) * nTiles * 2, 1, f);
         fclose(f);
 
         delete[] offsets;
+        delete[] checksums;
+        checksums = NULL;
     }
 
     constantTileIds.clear();
@@ -167,6 +173,7 @@ void ColorMipmap::generateResiduals(bool jpg, int jpg_quality, const string &inp
         fopen(&f, output.c_str(), "wb");
         int nTiles = ((1 << (maxLevel * 2 + 2)) - 1) / 3;
         long long *offsets = new long long[nTiles * 2];
+        checksums = new unsigned int[nTiles];
         fwrite(&maxLevel, sizeof(int), 1, f);
         fwrite(&tileSize, sizeof(int), 1, f);
         fwrite(&ochannels, sizeof(int), 1, f);
@@ -178,12 +185,15 @@ void ColorMipmap::generateResiduals(bool jpg, int jpg_quality, const string &inp
         fwrite(offsets, sizeof(long long) * nTiles * 2, 1, f);
         long long offset = 0;
         convertTiles(0, 0, 0, NULL, &offset, offsets, f);
+        writeChecksums(f, checksums, nTiles);
         fseek(f, sizeof(int) * 7, SEEK_SET);
         fwrite(offsets, sizeof(long long) * nTiles * 2, 1, f);
         fclose(f);
         fclose(in);
         delete[] ioffsets;
         delete[] offsets;
+        delete[] checksums;
+        checksums = NULL;
         delete[] compressedInputTile;
         delete[] inputTile;
     }
@@ -222,6 +232,7 @@ void ColorMipmap::reorderResiduals(const string &input, const string &output)
         for (int i = 0; i < 2 * nTiles; ++i) {
             offsets[i] = -1;
         }
+        checksums = new unsigned int[nTiles];
         fwrite(&maxLevel, sizeof(int), 1, f);
         fwrite(&tileSize, sizeof(int), 1, f);
         fwrite(&channels, sizeof(int), 1, f);
@@ -235,6 +246,7 @@ void ColorMipmap::reorderResiduals(const string &input, const string &output)
         for (int l = 0; l <= maxLevel; ++l) {
             reorderTilesLebeguesOrder(l, 0, 0, 0, &offset, offsets, f);
         }
+        writeChecksums(f, checksums, nTiles);
         fseek(f, sizeof(int) * 7, SEEK_SET);
         fwrite(offsets, sizeof(long long) * nTiles * 2, 1, f);
         fclose(f);
@@ -243,6 +255,8 @@ void ColorMipmap::reorderResiduals(const string &input, const string &output)
         delete[] inputTile;
         delete[] ioffsets;
         delete[] offsets;
+        delete[] checksums;
+        checksums = NULL;
     }
 }
 
@@ -636,12 +650,14 @@ void ColorMipmap::produceTile(int level, int tx, int ty, long long *offset, long
         int constantId = it->second;
         offsets[2 * tileid] = offsets[2 * constantId];
         offsets[2 * tileid + 1] = offsets[2 * constantId + 1];
+        checksums[tileid] = checksums[constantId];
     } else {
         int size;
         if (dxt) {
             if (channels == 4) {
                 CompressImageDXT5(tile, dxtTile, tileSize + 2*border, tileSize + 2*border, size);
                 fwrite(dxtTile, size, 1, f);
+                checksums[tileid] = checksum(dxtTile, size);
             } else {
                 for (int i = 0; i < (tileSize + 2*border) * (tileSize + 2*border); ++i) {
                     rgbaTile[4*i] = tile[i*channels];
@@ -651,6 +667,7 @@ void ColorMipmap::produceTile(int level, int tx, int ty, long long *offset, long
                 }
                 CompressImageDXT1(rgbaTile, dxtTile, tileSize + 2*border, tileSize + 2*border, size);
                 fwrite(dxtTile, size, 1, f);
+                checksums[tileid] = checksum(dxtTile, size);
             }
         } else {
             mfs_file fd;
@@ -680,6 +697,7 @@ void ColorMipmap::produceTile(int level, int tx, int ty, long long *offset, long
             TIFFClose(tf);
 
             fwrite(fd.buf, fd.buf_size, 1, f);
+            checksums[tileid] = checksum(fd.buf, fd.buf_size);
             free(fd.buf);
             size = fd.buf_size;
         }
@@ -821,6 +839,7 @@ void ColorMipmap::convertTile(int level, int tx, int ty, unsigned char *parent,
         int constantId = it->second;
         offsets[2 * tileid] = offsets[2 * constantId];
         offsets[2 * tileid + 1] = offsets[2 * constantId + 1];
+        checksums[tileid] = checksums[constantId];
     } else {
         int size;
 
@@ -862,6 +881,7 @@ void ColorMipmap::convertTile(int level, int tx, int ty, unsigned char *parent,
         }
 
         fwrite(fd.buf, fd.buf_size, 1, f);
+        checksums[tileid] = checksum(fd.buf, fd.buf_size);
         free(fd.buf);
         size = fd.buf_size;
 
@@ -941,18 +961,21 @@ void ColorMipmap::reorderTilesLebeguesOrder(int l, int level, int tx, int ty, lo
                     fseek64(in, iheader + ioffsets[2 * tileid], SEEK_SET);
                     fread(compressedInputTile, fsize, 1, in);
                     fwrite(compressedInputTile, fsize, 1, f);
+                    checksums[i / 2] = checksum(compressedInputTile, fsize);
                     outOffsets[i] = *outOffset;
                     *outOffset += fsize;
                     outOffsets[i + 1] = *outOffset;
                 }
                 outOffsets[2 * tileid] = outOffsets[i];
                 outOffsets[2 * tileid + 1] = outOffsets[i + 1];
+                checksums[tileid] = checksums[i / 2];
                 return;
             }
         }
         fseek64(in, iheader + ioffsets[2 * tileid], SEEK_SET);
         fread(compressedInputTile, fsize, 1, in);
         fwrite(compressedInputTile, fsize, 1, f);
+        checksums[tileid] = checksum(compressedInputTile, fsize);
         outOffsets[2 * tileid] = *outOffset;
         *outOffset += fsize;
         outOffsets[2 * tileid + 1] = *outOffset;
@@ -127,6 +127,8 @@ protected:
 
     unsigned char *inputTile;
 
+    unsigned int *checksums;
+
     void buildBaseLevelTiles();
 
     void buildBaseLevelTile(int tx, int ty, TIFF *f);
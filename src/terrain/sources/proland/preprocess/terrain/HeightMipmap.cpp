@@ -31,6 +31,7 @@
 
 #include "ork/core/Object.h"
 #include "proland/preprocess/terrain/Util.h"
+#include "proland/util/checksum.h"
 #include "proland/util/mfs.h"
 
 namespace proland
@@ -53,6 +54,7 @@ HeightMipmap::HeightMipmap(HeightFunction *height, int topLevelSize, int baseLev
     }
     tile = new unsigned char[(tileSize + 5) * (tileSize + 5) * 2];
     constantTile = -1;
+    checksums = NULL;
     left = NULL;
     right = NULL;
     bottom = NULL;
@@ -107,6 +109,7 @@ void HeightMipmap::generate(int rootLevel, int rootTx, int rootTy, float scale,
         fopen(&f, file.c_str(), "wb");
         int nTiles = minLevel + ((1 << (max(maxLevel - minLevel, 0) * 2 + 2)) - 1) / 3;
         unsigned int *offsets = new unsigned int[nTiles * 2];
+        checksums = new unsigned int[nTiles];
         fwrite(&minLevel, sizeof(int), 1, f);
         fwrite(&maxLevel, sizeof(int), 1, f);
         fwrite(&tileSize, sizeof(int), 1, f);
@@ -122,9 +125,12 @@ void HeightMipmap::generate(int rootLevel, int rootTx, int rootTy, float scale,
         for (int l = minLevel; l <= maxLevel; ++l) {
             produceTilesLebeguesOrder(l - minLevel, 0, 0, 0, &offset, offsets, f);
         }
+        writeChecksums(f, checksums, nTiles);
         fseek(f, sizeof(int) * 6 + sizeof(float), SEEK_SET);
         fwrite(offsets, sizeof(int) * nTiles * 2, 1, f);
         delete[] offsets;
+        delete[] checksums;
+        checksums = NULL;
         fclose(f);
     }
 }
@@ -609,6 +615,7 @@ void HeightMipmap::produceTile(int level, int tx, int ty, unsigned int *offset,
     if (isConstant && constantTile != -1) {
         offsets[2 * tileid] = offsets[2 * constantTile];
         offsets[2 * tileid + 1] = offsets[2 * constantTile + 1];
+        checksums[tileid] = checksums[constantTile];
     } else {
         mfs_file fd;
         mfs_open(NULL, 0, (char*)"w", &fd);
@@ -630,6 +637,7 @@ void HeightMipmap::produceTile(int level, int tx, int ty, unsigned int *offset,
         TIFFClose(tf);
 
         fwrite(fd.buf, fd.buf_size, 1, f);
+        checksums[tileid] = checksum(fd.buf, fd.buf_size);
         free(fd.buf);
 
         offsets[2 * tileid] = *offset;
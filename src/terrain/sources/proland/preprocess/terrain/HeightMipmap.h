@@ -102,6 +102,8 @@ private:
 
     int constantTile;
 
+    unsigned int *checksums;
+
     void buildBaseLevelTiles();
 
     void buildBaseLevelTile(int tx, int ty, TIFF *f);
@@ -30,11 +30,15 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "ork/core/Object.h"
 #include "proland/preprocess/terrain/ApertureMipmap.h"
 #include "proland/preprocess/terrain/ColorMipmap.h"
 #include "proland/preprocess/terrain/HeightMipmap.h"
 #include "proland/preprocess/terrain/Util.h"
+#include "proland/util/checksum.h"
 
 #define RGB_JPEG_QUALITY 90
 
@@ -733,4 +737,194 @@ void preprocessSphericalOrtho(InputMap *src, int dstTileSize, int dstChannels, i
     cm6->reorderResiduals(tmpFolder + "6/RGB.dat", dstFolder + "/residuals/RGB6.dat");
 }
 
+/**
+ * A range of bytes in a tile file, storing the data of one or more tiles.
+ */
+struct TileRange
+{
+    long long start;
+
+    long long end;
+
+    int id;
+
+    bool operator<(const TileRange &r) const
+    {
+        return start < r.start || (start == r.start && (end < r.end || (end == r.end && id < r.id)));
+    }
+};
+
+/**
+ * Prints the quadtree coordinates of a tile, given its id in a tile file.
+ */
+static void printTile(const char *file, int id, int minLevel, const char *error)
+{
+    int level = id;
+    int tx = 0;
+    int ty = 0;
+    if (id >= minLevel) {
+        int i = id - minLevel;
+        int l = 0;
+        while (i >= ((1 << (2 * (l + 1))) - 1) / 3) {
+            ++l;
+        }
+        i -= ((1 << (2 * l)) - 1) / 3;
+        level = minLevel + l;
+        tx = i % (1 << l);
+        ty = i / (1 << l);
+    }
+    fprintf(stderr, "%s: tile %d %d %d: %s\n", file, level, tx, ty, error);
+}
+
+/**
+ * Checks the tiles of a tile file, given their offsets (relative to the
+ * end of the file header). The tiles are read in file order, which is also
+ * the order in which they were written, so that the file is read sequentially.
+ */
+static int checkTiles(const char *file, FILE *f, long long header, int minLevel, int ntiles, const long long *offsets)
+{
+    unsigned int *checksums = readChecksums(f, ntiles);
+
+    vector<TileRange> ranges;
+    int errors = 0;
+    for (int id = 0; id < ntiles; ++id) {
+        TileRange r;
+        r.start = offsets[2 * id];
+        r.end = offsets[2 * id + 1];
+        r.id = id;
+        if (r.start < 0 || r.end < r.start) {
+            printTile(file, id, minLevel, "invalid offsets");
+            ++errors;
+        } else {
+            ranges.push_back(r);
+        }
+    }
+    sort(ranges.begin(), ranges.end());
+
+    const int bufferSize = 4 * 1024 * 1024;
+    unsigned char *buffer = new unsigned char[bufferSize];
+    long long pos = -1;
+    long long bytes = 0;
+    unsigned int crc = 0;
+    bool truncated = false;
+    for (size_t i = 0; i < ranges.size(); ++i) {
+        const TileRange &r = ranges[i];
+        // tiles with the same offsets share their data (see constant tiles
+        // in HeightMipmap and ColorMipmap), which is checked only once
+        if (i == 0 || r.start != ranges[i - 1].start || r.end != ranges[i - 1].end) {
+            if (pos != header + r.start) {
+                fseek64(f, header + r.start, SEEK_SET);
+                pos = header + r.start;
+            }
+            crc = 0;
+            truncated = false;
+            long long size = r.end - r.start;
+            while (size > 0 && !truncated) {
+                int n = (int) min(size, (long long) bufferSize);
+                if (fread(buffer, n, 1, f) != 1) {
+                    truncated = true;
+                    pos = -1;
+                } else {
+                    crc = checksum(buffer, n, crc);
+                    pos += n;
+                    size -= n;
+                    bytes += n;
+                }
+            }
+        }
+        if (truncated) {
+            printTile(file, r.id, minLevel, "truncated data");
+            ++errors;
+        } else if (checksums != NULL && checksums[r.id] != crc) {
+            printTile(file, r.id, minLevel, "checksum mismatch");
+            ++errors;
+        }
+    }
+    delete[] buffer;
+
+    printf("%s: %d tiles, %lld bytes checked, %d corrupted tiles%s\n", file, ntiles, bytes, errors,
+        checksums == NULL ? " (no checksums, offsets and sizes checked only)" : "");
+    if (checksums != NULL) {
+        delete[] checksums;
+    }
+    return errors;
+}
+
+int checkDemFile(const string &file)
+{
+    FILE *f;
+    fopen(&f, file.c_str(), "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot open file %s\n", file.c_str());
+        return -1;
+    }
+    int params[6];
+    float scale;
+    if (fread(params, sizeof(int), 6, f) != 6 || fread(&scale, sizeof(float), 1, f) != 1) {
+        fprintf(stderr, "%s: cannot read header\n", file.c_str());
+        fclose(f);
+        return -1;
+    }
+    int minLevel = params[0];
+    int maxLevel = params[1];
+    if (minLevel < 0 || maxLevel < 0 || max(maxLevel - minLevel, 0) > 14) {
+        fprintf(stderr, "%s: invalid header\n", file.c_str());
+        fclose(f);
+        return -1;
+    }
+    int ntiles = minLevel + ((1 << (max(maxLevel - minLevel, 0) * 2 + 2)) - 1) / 3;
+    long long header = sizeof(float) + sizeof(int) * (6 + (long long) ntiles * 2);
+    unsigned int *offsets = new unsigned int[ntiles * 2];
+    if (fread(offsets, sizeof(unsigned int) * ntiles * 2, 1, f) != 1) {
+        fprintf(stderr, "%s: cannot read tile offsets\n", file.c_str());
+        delete[] offsets;
+        fclose(f);
+        return -1;
+    }
+    long long *offsets64 = new long long[ntiles * 2];
+    for (int i = 0; i < ntiles * 2; ++i) {
+        offsets64[i] = offsets[i];
+    }
+    int errors = checkTiles(file.c_str(), f, header, minLevel, ntiles, offsets64);
+    delete[] offsets64;
+    delete[] offsets;
+    fclose(f);
+    return errors;
+}
+
+int checkOrthoFile(const string &file)
+{
+    FILE *f;
+    fopen(&f, file.c_str(), "rb");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot open file %s\n", file.c_str());
+        return -1;
+    }
+    int params[7];
+    if (fread(params, sizeof(int), 7, f) != 7) {
+        fprintf(stderr, "%s: cannot read header\n", file.c_str());
+        fclose(f);
+        return -1;
+    }
+    int maxLevel = params[0];
+    if (maxLevel < 0 || maxLevel > 14) {
+        fprintf(stderr, "%s: invalid header\n", file.c_str());
+        fclose(f);
+        return -1;
+    }
+    int ntiles = ((1 << (maxLevel * 2 + 2)) - 1) / 3;
+    long long header = 7 * sizeof(int) + 2 * (long long) ntiles * sizeof(long long);
+    long long *offsets = new long long[ntiles * 2];
+    if (fread(offsets, sizeof(long long) * ntiles * 2, 1, f) != 1) {
+        fprintf(stderr, "%s: cannot read tile offsets\n", file.c_str());
+        delete[] offsets;
+        fclose(f);
+        return -1;
+    }
+    int errors = checkTiles(file.c_str(), f, header, 0, ntiles, offsets);
+    delete[] offsets;
+    fclose(f);
+    return errors;
+}
+
 }
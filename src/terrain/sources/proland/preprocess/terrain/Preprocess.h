@@ -296,6 +296,31 @@ PROLAND_API void preprocessOrtho(InputMap *src, int dstTileSize, int dstChannels
 PROLAND_API void preprocessSphericalOrtho(InputMap *src, int dstTileSize, int dstChannels, int dstMaxLevel,
         const string &dstFolder, const string &tmpFolder, float (*rgbToLinear)(float) = NULL, float (*linearToRgb)(float) = NULL);
 
+/**
+ * Checks the integrity of a file produced by #preprocessDem or
+ * #preprocessSphericalDem (or by a proland::HeightMipmap). The file
+ * structure is checked (tile offsets must lie inside the file) and, if the
+ * file contains tile checksums, the data of each tile is checked against
+ * its checksum. The file is read sequentially, in large blocks, so that this
+ * check runs at disk bandwidth. Each corrupted tile is reported on the
+ * standard error output.
+ * @ingroup preprocess
+ *
+ * @param file the file to be checked.
+ * @return the number of corrupted tiles, or -1 if the file cannot be read.
+ */
+PROLAND_API int checkDemFile(const string &file);
+
+/**
+ * Checks the integrity of a file produced by #preprocessOrtho or
+ * #preprocessSphericalOrtho (or by a proland::ColorMipmap). See #checkDemFile.
+ * @ingroup preprocess
+ *
+ * @param file the file to be checked.
+ * @return the number of corrupted tiles, or -1 if the file cannot be read.
+ */
+PROLAND_API int checkOrthoFile(const string &file);
+
 }
 
 #endif